@@ -60,7 +60,7 @@ void updateVecClock(map<ContextId, map<SeqId, map<ContextId, SeqId> > > &vecCloc
     TaskId tid = t->getTaskId();
     ContextId ctid = tid.getContextId();
     SeqId seqid = tid.getSeqId();
-    auto p = t->getPredecessorTasks();
+    auto& p = t->getPredecessorTasks();
     map<ContextId, SeqId> predSet;
     
     for (TaskId pid : p)
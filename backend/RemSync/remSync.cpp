@@ -48,7 +48,7 @@ int main(int argc, char const *argv[])
         
         }
         else {
-            auto pred = currentTask->getPredecessorTasks();
+            auto& pred = currentTask->getPredecessorTasks();
             vector<Task*> p_tasks;
             vector<Task*> t_tasks;
             
@@ -66,7 +66,7 @@ int main(int argc, char const *argv[])
                 }
             }
 
-            auto succ = currentTask->getSuccessorTasks();
+            auto& succ = currentTask->getSuccessorTasks();
 
             for (auto it = succ.begin(), et = succ.end(); it != et; ++it)
             {
@@ -112,7 +112,7 @@ int main(int argc, char const *argv[])
                 
                 {
                     vector<Task*> t_t_tasks;
-                    auto t_succ = t->getSuccessorTasks();
+                    auto& t_succ = t->getSuccessorTasks();
                     for (auto it = t_succ.begin(), et = t_succ.end(); it != et; ++it)
                     {
                         auto p = taskGraph.find(*it);
@@ -1,5 +1,8 @@
 #include "simpleCache.hpp"
 #include <stdio.h>
+#include <vector>
+
+using namespace std;
 
 int main(int argc, char** argv)
 {
@@ -21,16 +24,21 @@ int main(int argc, char** argv)
     }
     else
     {
+        // One pass over the taskgraph feeds every cache size
+        vector<SimpleCacheBackend*> caches;
+        contech::SimpleBackendWrapper* sbw = NULL;
         for (int c = 10; c <= 28; c++)
         {
             SimpleCacheBackend* bsc = new SimpleCacheBackend(c, 2, 0);
-            contech::SimpleBackendWrapper* sbw = new contech::SimpleBackendWrapper(argv[1], bsc);
-        
-            sbw->runBackend();
-            sbw->completeRun(stdout);
-            delete sbw;
-            delete bsc;
+            if (sbw == NULL) sbw = new contech::SimpleBackendWrapper(argv[1], bsc);
+            else sbw->addBackend(bsc);
+            caches.push_back(bsc);
         }
+        
+        sbw->runBackend();
+        sbw->completeRun(stdout);
+        delete sbw;
+        for (SimpleCacheBackend* bsc : caches) delete bsc;
     }
     
     return 0;
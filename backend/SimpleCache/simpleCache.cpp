@@ -8,21 +8,20 @@ using namespace contech;
 enum {BLOCKING, SUBBLOCKING};
 enum {LRU, NMRU_FIFO};
 
-// This would be better stored as static fields in the class
-static uint64_t global_c; 
+// The size and associativity are per cache, so caches of several sizes can
+//   be simulated in one pass
 static const uint64_t global_b = 6; 
-static uint64_t global_s; 
 static const char global_st = BLOCKING; 
 static const char global_r = LRU;
 
-SimpleCache::SimpleCache()
+SimpleCache::SimpleCache(uint64_t c, uint64_t s) : cacheSize(c), cacheAssoc(s)
 {
     //cacheBlocks.resize(0x1 << (SC_CACHE_SIZE - (SC_CACHE_ASSOC + SC_CACHE_LINE)));
-    cacheBlocks.resize(0x1 << (global_c - (global_s + global_b)));
+    cacheBlocks.resize(0x1 << (cacheSize - (cacheAssoc + global_b)));
     read_misses = 0;
     write_misses = 0;
     accesses = 0;
-    //printf("Cache created: %d of %d\n", cacheBlocks.size(), 0x1 << global_s); 
+    //printf("Cache created: %d of %d\n", cacheBlocks.size(), 0x1 << cacheAssoc); 
 }
 
 void SimpleCache::printIndex(uint64_t idx)
@@ -36,7 +35,7 @@ void SimpleCache::printIndex(uint64_t idx)
 
 bool SimpleCache::updateCacheLine(uint64_t idx, uint64_t tag, uint64_t offset, uint64_t num, bool write)
 {
-    deque<cache_line>::iterator oldest;
+    vector<cache_line>::iterator oldest;
     uint64_t tAccess = ~0x0;
     
     if (idx >= cacheBlocks.size()) idx -= cacheBlocks.size();
@@ -62,7 +61,7 @@ bool SimpleCache::updateCacheLine(uint64_t idx, uint64_t tag, uint64_t offset, u
     
     // The block is not in the cache
     //   First check if there is space to place it in the cache
-    if (cacheBlocks[idx].size() < (0x1<<global_s))
+    if (cacheBlocks[idx].size() < (0x1<<cacheAssoc))
     {
         cache_line t;
         
@@ -80,7 +79,7 @@ bool SimpleCache::updateCacheLine(uint64_t idx, uint64_t tag, uint64_t offset, u
     if (global_r == LRU)
     {
         cacheBlocks[idx].erase(oldest);
-        assert(cacheBlocks[idx].size() < (0x1 << global_s));
+        assert(cacheBlocks[idx].size() < (0x1 << cacheAssoc));
     }
     
     {
@@ -102,12 +101,12 @@ bool SimpleCache::updateCache(bool write, char numOfBytes, uint64_t address, cac
     uint64_t cacheIdx = address >> global_b;
     uint64_t offset = address & ((0x1<<global_b) - 1);
     uint64_t size = numOfBytes;
-    uint64_t tag = address >> ((global_c - global_s));
+    uint64_t tag = address >> ((cacheSize - cacheAssoc));
     uint64_t accessCount = p_stats->accesses;
 
     assert(offset < (0x1 << global_b));
     
-    cacheIdx &= ((0x1 << (global_c - (global_b + global_s))) - 1);
+    cacheIdx &= ((0x1 << (cacheSize - (global_b + cacheAssoc))) - 1);
     
     assert (cacheIdx < cacheBlocks.size());
     accesses++;
@@ -146,9 +145,9 @@ double SimpleCache::getMissRate()
 }
 
 SimpleCacheBackend::SimpleCacheBackend(uint64_t c, uint64_t s, int printMissLoc) {
-    global_c = c;
-    global_s = s;
-    assert(global_c >= (global_s + global_b));
+    cacheSize = c;
+    cacheAssoc = s;
+    assert(cacheSize >= (cacheAssoc + global_b));
     // zero out p_stats
     p_stats = new cache_stats_t;
     p_stats->accesses = 0;
@@ -160,6 +159,16 @@ SimpleCacheBackend::SimpleCacheBackend(uint64_t c, uint64_t s, int printMissLoc)
         printMissLines = false;
 }
 
+SimpleCache& SimpleCacheBackend::getCache(ContextId ctid)
+{
+    auto it = contextCacheState.find(ctid);
+    if (it == contextCacheState.end())
+    {
+        it = contextCacheState.insert(make_pair(ctid, SimpleCache(cacheSize, cacheAssoc))).first;
+    }
+    return it->second;
+}
+
 void SimpleCacheBackend::updateBackend(Task* currentTask)
 {
     //auto memOps = currentTask->getMemOps();
@@ -220,12 +229,12 @@ void SimpleCacheBackend::updateBackend(Task* currentTask)
                     bytesToAccess -= accessSize;
                     if (srcAddress != 0)
                     {
-                        contextCacheState[ctid].updateCache(false, accessSize, srcAddress, p_stats);
+                        getCache(ctid).updateCache(false, accessSize, srcAddress, p_stats);
                         srcAddress += accessSize;
                         p_stats->accesses ++;
                     }
                     
-                    contextCacheState[ctid].updateCache(true, accessSize, dstAddress, p_stats);
+                    getCache(ctid).updateCache(true, accessSize, dstAddress, p_stats);
                     dstAddress += accessSize;
                     p_stats->accesses ++;
                 } while (bytesToAccess > 0);
@@ -251,7 +260,7 @@ void SimpleCacheBackend::updateBackend(Task* currentTask)
                     rw = false;
                 }
                 
-                if (!contextCacheState[ctid].updateCache(rw, accessBytes, address, p_stats))
+                if (!getCache(ctid).updateCache(rw, accessBytes, address, p_stats))
                 {
                     basicBlockMisses[(lastBBID << 32) + memOpPos] ++;
                     auto elem = allocBlocks.upper_bound(address);
@@ -21,17 +21,19 @@ struct cache_line
     char valid_bits;
 };
 
+    uint64_t cacheSize, cacheAssoc;
     uint64_t read_misses;
     uint64_t write_misses;
     uint64_t accesses;
 
-    std::vector< std::deque<cache_line> > cacheBlocks;
+    // A set holds a few lines, and an empty vector allocates nothing
+    std::vector< std::vector<cache_line> > cacheBlocks;
 
     bool updateCacheLine(uint64_t idx, uint64_t tag, uint64_t offset, uint64_t num, bool);
     void printIndex(uint64_t idx);
 
 public:    
-    SimpleCache();
+    SimpleCache(uint64_t c, uint64_t s);
     double getMissRate();
     bool updateCache(bool rw, char numOfBytes, uint64_t address, cache_stats_t* p_stats);
 };
@@ -50,6 +52,9 @@ class SimpleCacheBackend  : public contech::Backend
     std::map <uint64_t, mallocStats> allocBlocks;
     cache_stats_t* p_stats;
     bool printMissLines;
+    uint64_t cacheSize, cacheAssoc;
+    
+    SimpleCache& getCache(contech::ContextId);
 
 public:
     virtual void resetBackend();
@@ -1,4 +1,5 @@
 #include "../../common/taskLib/TaskGraph.hpp"
+#include "../../common/taskLib/ActionScan.hpp"
 #include <algorithm>
 #include <iostream>
 #include <set>
@@ -56,37 +57,49 @@ int main(int argc, char const *argv[])
     }
     
     TaskGraphInfo* tgi = tg->getTaskGraphInfo();
-    if (modelROI) tg->setTaskOrderCurrent(tg->getROIStart());
+    if (modelROI)
+    {
+        TaskFilter roi;
+        roi.roiOnly = true;
+        tg->setTaskFilter(roi);
+    }
 
-    while(Task* currentTask = tg->getNextTask())
+    // The tasks are only read, so each is decoded into the same view
+    TaskView currentTask;
+    vector<uint32_t> blocks;
+    while(tg->getNextTaskView(currentTask))
     {
 
         totalTasks++;
         uint basicBlocksInTask = 0;
         uint memOpsInTask = 0;
         
-        if (currentTask->getTaskId() == tg->getROIStart())
+        if (currentTask.getTaskId() == tg->getROIStart())
         {
             inROI = true;
         }
-        else if (currentTask->getTaskId() == tg->getROIEnd())
+        else if (currentTask.getTaskId() == tg->getROIEnd())
         {
             inROI = false;
             if (modelROI)
             {
-                delete currentTask;
                 break;
             }
         }
 
-        switch(currentTask->getType())
+        switch(currentTask.getType())
         {
             case task_type_basic_blocks:
             {
-                auto bba = currentTask->getBasicBlockActions();
-                for (auto f = bba.begin(), e = bba.end(); f != e; ++f)
+                // The block boundaries in bulk, so the memory actions of a
+                //   block are the gap to the next boundary
+                const Action* act = currentTask.getActions();
+                size_t actionCount = currentTask.getActionCount();
+                if (blocks.size() < actionCount) blocks.resize(actionCount);
+                size_t blockCount = ActionScan::findBasicBlocks(act, actionCount, blocks.data());
+                for (size_t k = 0; k < blockCount; k++)
                 {
-                    BasicBlockAction bb = *f;
+                    BasicBlockAction bb = act[blocks[k]];
                     uniqueBlocks.insert((uint)bb.basic_block_id);
                     
                     auto bbi = tgi->getBasicBlockInfo((uint)bb.basic_block_id);
@@ -105,19 +118,19 @@ int main(int argc, char const *argv[])
                     totalBasicBlocks++;
                     basicBlocksInTask++;
 
-                    uint memOpsInBlock = 0;
                     // Note that memory actions include malloc, etc
-                    for (MemoryAction mem : f.getMemoryActions())
-                    {
-                        totalMemOps++;
-                        memOpsInTask++;
-                        memOpsInBlock++;
-                        if (mem.type == action_type_mem_read || mem.type == action_type_mem_write)
-                            totalMemBytes += (0x1 << mem.pow_size);
-                    }
+                    size_t next = (k + 1 < blockCount) ? blocks[k + 1] : actionCount;
+                    uint memOpsInBlock = next - blocks[k] - 1;
+                    totalMemOps += memOpsInBlock;
+                    memOpsInTask += memOpsInBlock;
 
                     maxMemOpsPerBasicBlock = max(maxMemOpsPerBasicBlock, memOpsInBlock);
                 }
+                // Only reads and writes count toward the bytes
+                if (blockCount > 0)
+                {
+                    totalMemBytes += ActionScan::sumMemOpBytes(act + blocks[0], actionCount - blocks[0]);
+                }
 
                 maxBasicBlocksPerTask = max(maxBasicBlocksPerTask, basicBlocksInTask);
                 maxMemOpsPerTask = max(maxMemOpsPerTask, memOpsInTask);
@@ -141,8 +154,6 @@ int main(int argc, char const *argv[])
                 break;
 
         }
-
-        delete currentTask;
     }
     
     delete tg;
@@ -0,0 +1,117 @@
+#include "../../common/taskLib/TaskGraph.hpp"
+#include "../../common/taskLib/TaskGraphShard.hpp"
+#include <iostream>
+#include <string.h>
+
+using namespace std;
+using namespace contech;
+
+static void usage(const char* name)
+{
+    cout << "Usage: " << name << " split taskGraphInputFile shards context|time outputPrefix" << endl;
+    cout << "       " << name << " merge taskGraphOutputFile shard..." << endl;
+    cout << "       " << name << " info shard" << endl;
+    exit(1);
+}
+
+static int splitGraph(int argc, char const *argv[])
+{
+    if (argc != 6) usage(argv[0]);
+    
+    int shardCount = atoi(argv[3]);
+    shard_partition partition;
+    if (strcmp(argv[4], "context") == 0) partition = shard_by_context;
+    else if (strcmp(argv[4], "time") == 0) partition = shard_by_time;
+    else usage(argv[0]);
+    if (shardCount <= 0) usage(argv[0]);
+    
+    TaskGraph* tg = TaskGraph::initFromFile(argv[2]);
+    if (tg == NULL)
+    {
+        cerr << "ERROR: Couldn't open input file" << endl;
+        return 1;
+    }
+    
+    bool r = TaskGraphShard::split(tg, partition, shardCount, argv[5]);
+    delete tg;
+    
+    return r ? 0 : 1;
+}
+
+static int mergeGraph(int argc, char const *argv[])
+{
+    if (argc < 4) usage(argv[0]);
+    
+    vector<TaskGraph*> shards;
+    for (int i = 3; i < argc; i++)
+    {
+        TaskGraph* tg = TaskGraph::initFromFile(argv[i]);
+        if (tg == NULL)
+        {
+            cerr << "ERROR: Couldn't open shard " << argv[i] << endl;
+            return 1;
+        }
+        shards.push_back(tg);
+    }
+    
+    FILE* out = fopen(argv[2], "wb");
+    if (out == NULL)
+    {
+        cerr << "ERROR: Couldn't open output file" << endl;
+        return 1;
+    }
+    
+    bool r = TaskGraphShard::merge(shards, out);
+    fclose(out);
+    for (TaskGraph* tg : shards) delete tg;
+    
+    return r ? 0 : 1;
+}
+
+static int printShard(int argc, char const *argv[])
+{
+    if (argc != 3) usage(argv[0]);
+    
+    TaskGraph* tg = TaskGraph::initFromFile(argv[2]);
+    if (tg == NULL)
+    {
+        cerr << "ERROR: Couldn't open input file" << endl;
+        return 1;
+    }
+    
+    const TaskGraphShard* info = tg->getShardInfo();
+    if (info == NULL)
+    {
+        cout << "Not a shard: " << tg->getNumberOfTasks() << " tasks" << endl;
+        delete tg;
+        return 0;
+    }
+    
+    uint64 succ = 0;
+    for (const shard_stub& s : info->stubs) succ += s.isSuccessor;
+    
+    cout << "Shard " << info->shard << " of " << info->shardCount << " by "
+         << ((info->partition == shard_by_context) ? "context" : "time") << endl;
+    if (info->partition == shard_by_time)
+    {
+        cout << "Start times: " << info->startTime << " to " << info->endTime << endl;
+    }
+    cout << "Tasks: " << tg->getNumberOfTasks() << " of " << info->graphTaskCount << endl;
+    cout << "Contexts: " << tg->getNumberOfContexts() << endl;
+    cout << "Boundary edges: " << succ << " out, " << info->stubs.size() - succ << " in" << endl;
+    
+    delete tg;
+    return 0;
+}
+
+int main(int argc, char const *argv[])
+{
+    if (argc < 2) usage(argv[0]);
+    
+    if (strcmp(argv[1], "split") == 0) return splitGraph(argc, argv);
+    if (strcmp(argv[1], "merge") == 0) return mergeGraph(argc, argv);
+    if (strcmp(argv[1], "info") == 0) return printShard(argc, argv);
+    
+    usage(argv[0]);
+    return 1;
+}
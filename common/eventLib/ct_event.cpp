@@ -1,8 +1,10 @@
 #include "ct_event.h"
 #include <stdlib.h>
+#include <string.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
+#include <string>
 
 using namespace contech;
 
@@ -30,6 +32,11 @@ EventLib::EventLib()
     
     skipSet.clear();
     skipList.clear();
+    bufIndex.clear();
+    ctidFilter.clear();
+    hasTimeWindow = false;
+    windowStart = 0;
+    windowEnd = 0;
     
     cedPos = 0;
     debug_file = NULL;
@@ -37,6 +44,9 @@ EventLib::EventLib()
     version = 0;
     currentID = ~0;
     bb_count = 0;
+    encodingFlags = 0;
+    memset(deltaAddr, 0, sizeof(deltaAddr));
+    initEventSchema();
     
     bb_info_table = NULL;
     currentPath = NULL;
@@ -166,6 +176,8 @@ void EventLib::resetEventLib()
     version = 0;
     sum = 0;
     bb_count = 0;
+    encodingFlags = 0;
+    initEventSchema();
     currentID = 0;
     bufSum = 0;
     constGVAddr = NULL;
@@ -176,6 +188,9 @@ void EventLib::resetEventLib()
     
     skipSet.clear();
     skipList.clear();
+    maxBufPos = 0;
+    bufIndex.clear();
+    clearSeek();
 }
 
 void EventLib::readMemOp(pct_memory_op pmo, FILE* fptr)
@@ -185,6 +200,213 @@ void EventLib::readMemOp(pct_memory_op pmo, FILE* fptr)
     fread_check(&pmo->data32[1], sizeof(unsigned short), 1, fptr);
 }
 
+//
+// Read a delta encoded address, see CT_VERSION_FLAG_DELTA_ADDR
+//
+void EventLib::readMemOpDelta(pct_memory_op pmo, FILE* fptr, uint32_t slot)
+{
+    uint8_t buf[CT_DELTA_ABS_LEN];
+    uint64_t v = 0;
+    unsigned int len;
+    
+    fread_check(buf, sizeof(uint8_t), 1, fptr);
+    len = (buf[0] & 0x1) ? CT_DELTA_ABS_LEN : (((buf[0] >> 1) & 0x3) + 1);
+    if (len > 1) fread_check(buf + 1, sizeof(uint8_t), len - 1, fptr);
+    for (int i = len - 1; i >= 0; i--)
+    {
+        v = (v << 8) | buf[i];
+    }
+    
+    pmo->data = 0;
+    if (buf[0] & 0x1)
+    {
+        pmo->addr = v >> 1;
+    }
+    else
+    {
+        uint64_t z = v >> CT_DELTA_TAG_BITS;
+        int64_t d = (int64_t)(z >> 1) ^ -(int64_t)(z & 1);
+        pmo->addr = deltaAddr[slot] + d;
+    }
+    deltaAddr[slot] = pmo->addr;
+}
+
+//
+// Decoders generated from CT_EVENT_SCHEMA_TABLE
+//   Each layout becomes a type whose field(i) is the i-th character of its
+//   format, and schema_decode unrolls the loads over those characters, so the
+//   widths and offsets are constants instead of a switch per field.
+//
+namespace {
+    // ct_schema_width, usable in template arguments
+    constexpr unsigned int schema_width(char ty)
+    {
+        return (ty == 'b' || ty == 'c') ? 1 :
+               (ty == 'l') ? 4 :
+               (ty == 's') ? sizeof(size_t) :
+               (ty == 't' || ty == 'p') ? 8 : 0;
+    }
+    
+    template <unsigned int W> struct schema_field;
+    template <> struct schema_field<1>
+    {
+        static uint64_t load(const uint8_t* p) { return *p; }
+    };
+    template <> struct schema_field<4>
+    {
+        static uint64_t load(const uint8_t* p) { uint32_t t; memcpy(&t, p, sizeof(t)); return t; }
+    };
+    template <> struct schema_field<8>
+    {
+        static uint64_t load(const uint8_t* p) { uint64_t t; memcpy(&t, p, sizeof(t)); return t; }
+    };
+    
+    template <class L, unsigned int I = 0, bool End = (L::field(I) == '\0')>
+    struct schema_decode
+    {
+        static void decode(const uint8_t* p, uint64_t* fields)
+        {
+            fields[I] = schema_field<schema_width(L::field(I))>::load(p);
+            schema_decode<L, I + 1>::decode(p + schema_width(L::field(I)), fields);
+        }
+    };
+    
+    template <class L, unsigned int I>
+    struct schema_decode<L, I, true>
+    {
+        static void decode(const uint8_t*, uint64_t*) {}
+    };
+    
+    #define CT_SCHEMA_LAYOUT(ev, fmt) \
+    struct schema_layout_##ev \
+    { \
+        static constexpr char field(unsigned int i) { return fmt[i]; } \
+    };
+    CT_EVENT_SCHEMA_TABLE(CT_SCHEMA_LAYOUT)
+    #undef CT_SCHEMA_LAYOUT
+    
+    bool schemaMatches(const char* fmt, const uint8_t* width, unsigned int numFields)
+    {
+        unsigned int i = 0;
+        for (; fmt[i] != '\0'; i++)
+        {
+            if (i >= numFields || width[i] != ct_schema_width(fmt[i])) return false;
+        }
+        return i == numFields;
+    }
+}
+
+ct_schema_decoder EventLib::getSchemaDecoder(uint8_t id, const uint8_t* width, unsigned int numFields)
+{
+    #define CT_SCHEMA_MATCH(ev, fmt) \
+    if (id == ev && schemaMatches(fmt, width, numFields)) \
+    { \
+        return &schema_decode<schema_layout_##ev>::decode; \
+    }
+    CT_EVENT_SCHEMA_TABLE(CT_SCHEMA_MATCH)
+    #undef CT_SCHEMA_MATCH
+    
+    return NULL;
+}
+
+void EventLib::decodeSchemaFields(const uint8_t* width, unsigned int numFields, const uint8_t* p, uint64_t* fields)
+{
+    for (unsigned int i = 0; i < CT_SCHEMA_MAX_FIELDS; i++)
+    {
+        uint64_t v = 0;
+        if (i < numFields)
+        {
+            switch (width[i])
+            {
+                case 1: v = *p; break;
+                case 2: { uint16_t t; memcpy(&t, p, sizeof(t)); v = t; } break;
+                case 4: { uint32_t t; memcpy(&t, p, sizeof(t)); v = t; } break;
+                case 8: memcpy(&v, p, sizeof(v)); break;
+            }
+            p += width[i];
+        }
+        fields[i] = v;
+    }
+}
+
+//
+// Set the event layouts to those this EventLib was built with
+//
+void EventLib::initEventSchema()
+{
+    memset(eventSchema, 0, sizeof(eventSchema));
+    #define CT_SCHEMA_ENTRY(ev, fmt) \
+    { \
+        internal_event_schema& ies = eventSchema[ev]; \
+        for (const char* f = fmt; *f != '\0'; f++) \
+        { \
+            ies.width[ies.numFields++] = ct_schema_width(*f); \
+            ies.size += ct_schema_width(*f); \
+        } \
+        ies.decode = getSchemaDecoder(ev, ies.width, ies.numFields); \
+    }
+    CT_EVENT_SCHEMA_TABLE(CT_SCHEMA_ENTRY)
+    #undef CT_SCHEMA_ENTRY
+}
+
+//
+// Replace the event layouts with those written by the runtime
+//   count, then for each: id (1), number of fields (1), widths (1 each)
+//
+void EventLib::readEventSchema(FILE* fptr)
+{
+    unsigned int count = 0;
+    
+    fread_check(&count, sizeof(unsigned int), 1, fptr);
+    for (unsigned int i = 0; i < count; i++)
+    {
+        uint8_t entry[2];
+        fread_check(entry, sizeof(uint8_t), 2, fptr);
+        if (entry[1] > CT_SCHEMA_MAX_FIELDS)
+        {
+            fprintf(stderr, "ERROR: Schema for type %d has %d fields\n", entry[0], entry[1]);
+            dumpAndTerminate(fptr);
+        }
+        
+        internal_event_schema& ies = eventSchema[entry[0]];
+        ies.numFields = entry[1];
+        ies.size = 0;
+        fread_check(ies.width, sizeof(uint8_t), ies.numFields, fptr);
+        for (unsigned int j = 0; j < ies.numFields; j++)
+        {
+            uint8_t w = ies.width[j];
+            if (w != 1 && w != 2 && w != 4 && w != 8)
+            {
+                fprintf(stderr, "ERROR: Schema for type %d has field of %d bytes\n", entry[0], w);
+                dumpAndTerminate(fptr);
+            }
+            ies.size += w;
+        }
+        ies.decode = getSchemaDecoder(entry[0], ies.width, ies.numFields);
+    }
+}
+
+//
+// Read a fixed size event into fields, using the schema for its id
+//   fields has CT_SCHEMA_MAX_FIELDS entries.  The event's own fields are
+//   always set, see getSchemaDecoder for the rest.
+//
+void EventLib::readSchemaEvent(uint8_t id, uint64_t* fields, FILE* fptr)
+{
+    internal_event_schema& ies = eventSchema[id];
+    uint8_t buf[CT_SCHEMA_MAX_FIELDS * sizeof(uint64_t)];
+    
+    fread_check(buf, sizeof(uint8_t), ies.size, fptr);
+    if (ies.decode != NULL)
+    {
+        ies.decode(buf, fields);
+    }
+    else
+    {
+        decodeSchemaFields(ies.width, ies.numFields, buf, fields);
+    }
+}
+
 //
 // Deserialize a CT_EVENT from a FILE stream
 //
@@ -222,6 +444,10 @@ pct_event EventLib::createContechEvent(FILE* fptr)
         sum += t;
         
         fread_check(&npe->event_type, sizeof(unsigned int), 1, fptr);
+        
+        // Only the version event is read here, and it may carry encoding flags
+        encodingFlags = ((unsigned int)npe->event_type) >> 8;
+        npe->event_type = (ct_event_id)(npe->event_type & 0xff);
     }
     else if (this->next_basic_block_id != -1)
     {
@@ -483,6 +709,8 @@ pct_event EventLib::createContechEvent(FILE* fptr)
                 }
                 else
                 {
+                    // Index of the memory op among those stored by the runtime
+                    uint32_t storedOp = 0;
                     for (int i = 0; i < npe->bb.len; i++)
                     {
                         npe->bb.mem_op_array[i].data = 0;
@@ -641,7 +869,15 @@ pct_event EventLib::createContechEvent(FILE* fptr)
                         {
                             //fread_check(&npe->bb.mem_op_array[i].data32[0], sizeof(unsigned int), 1, fptr);
                             //fread_check(&npe->bb.mem_op_array[i].data32[1], sizeof(unsigned short), 1, fptr);
-                            readMemOp(&npe->bb.mem_op_array[i], fptr);
+                            if (encodingFlags & CT_VERSION_FLAG_DELTA_ADDR)
+                            {
+                                readMemOpDelta(&npe->bb.mem_op_array[i], fptr, CT_DELTA_SLOT(id, storedOp));
+                            }
+                            else
+                            {
+                                readMemOp(&npe->bb.mem_op_array[i], fptr);
+                            }
+                            storedOp++;
                             
                             npe->bb.mem_op_array[i].is_write = bb_info_table[id].mem_op_info[i].memFlags & 0x1;
                             npe->bb.mem_op_array[i].pow_size = bb_info_table[id].mem_op_info[i].size;
@@ -925,19 +1161,12 @@ pct_event EventLib::createContechEvent(FILE* fptr)
         
         case (ct_event_task_create):
         {
-            const int create_size = sizeof(npe->tc.start_time) +
-                                    sizeof(npe->tc.end_time) + 
-                                    sizeof(npe->tc.other_id) +
-                                    sizeof(npe->tc.approx_skew);
-            uint8_t buf[create_size];
-            int bytesConsume = 0;
-            
-            fread_check(buf, sizeof(uint8_t), create_size, fptr);
-            bytesConsume = unpack(buf, "ttlp", &npe->tc.start_time, 
-                                               &npe->tc.end_time, 
-                                               &npe->tc.other_id, 
-                                               &npe->tc.approx_skew);
-            assert(bytesConsume == create_size);
+            uint64_t f[CT_SCHEMA_MAX_FIELDS];
+            readSchemaEvent(ct_event_task_create, f, fptr);
+            npe->tc.start_time = f[0];
+            npe->tc.end_time = f[1];
+            npe->tc.other_id = f[2];
+            npe->tc.approx_skew = f[3];
             
             if (npe->tc.approx_skew != 0 ||
                 npe->tc.other_id == 0)
@@ -961,94 +1190,76 @@ pct_event EventLib::createContechEvent(FILE* fptr)
         
         case (ct_event_task_join):
         {
-            const int join_size = sizeof(npe->tj.isExit) + 
-                                  sizeof(npe->tj.start_time) + 
-                                  sizeof(npe->tj.end_time) + 
-                                  sizeof(npe->tj.other_id);
-            uint8_t buf[join_size];
-            int bytesConsume = 0;
-            
-            fread_check(buf, sizeof(uint8_t), join_size, fptr);
-            bytesConsume = unpack(buf, "bttl", &npe->tj.isExit, 
-                                               &npe->tj.start_time, 
-                                               &npe->tj.end_time, 
-                                               &npe->tj.other_id);
-            assert(bytesConsume == join_size);
-            
+            uint64_t f[CT_SCHEMA_MAX_FIELDS];
+            readSchemaEvent(ct_event_task_join, f, fptr);
+            npe->tj.isExit = f[0];
+            npe->tj.start_time = f[1];
+            npe->tj.end_time = f[2];
+            npe->tj.other_id = f[3];
         }
         break;
         
         case (ct_event_sync):
         {
-            const int sync_size = sizeof(npe->sy.start_time) + 
-                                  sizeof(npe->sy.end_time) + 
-                                  sizeof(npe->sy.sync_type) + 
-                                  sizeof(npe->sy.sync_addr) +
-                                  sizeof(npe->sy.ticketNum);
-            uint8_t buf[sync_size];
-            int bytesConsume = 0;
-            fread_check(buf, sizeof(uint8_t), sync_size, fptr);
-            bytesConsume = unpack(buf, "ttlpp", &npe->sy.start_time, 
-                                                &npe->sy.end_time, 
-                                                &npe->sy.sync_type, 
-                                                &npe->sy.sync_addr, 
-                                                &npe->sy.ticketNum);
-            assert(bytesConsume == sync_size);
+            uint64_t f[CT_SCHEMA_MAX_FIELDS];
+            readSchemaEvent(ct_event_sync, f, fptr);
+            npe->sy.start_time = f[0];
+            npe->sy.end_time = f[1];
+            npe->sy.sync_type = f[2];
+            npe->sy.sync_addr = f[3];
+            npe->sy.ticketNum = f[4];
         }
         break;
         
         case (ct_event_barrier):
         {
-            const size_t bar_size = sizeof(npe->bar.onEnter) + 
-                                 sizeof(npe->bar.start_time) +
-                                 sizeof(npe->bar.end_time) +
-                                 sizeof(npe->bar.sync_addr) +
-                                 sizeof(npe->bar.barrierNum);
-            uint8_t buf[bar_size];
-            int bytesConsume = 0;
-            fread_check(buf, sizeof(uint8_t), bar_size, fptr);
-            bytesConsume = unpack(buf, "btttt", &npe->bar.onEnter, 
-                                                &npe->bar.start_time,
-                                                &npe->bar.end_time, 
-                                                &npe->bar.sync_addr, 
-                                                &npe->bar.barrierNum);
-            assert(bytesConsume == bar_size);
+            uint64_t f[CT_SCHEMA_MAX_FIELDS];
+            readSchemaEvent(ct_event_barrier, f, fptr);
+            npe->bar.onEnter = f[0];
+            npe->bar.start_time = f[1];
+            npe->bar.end_time = f[2];
+            npe->bar.sync_addr = f[3];
+            npe->bar.barrierNum = f[4];
         }
         break;
         
         case (ct_event_memory):
         {
-            const size_t mem_size = sizeof(npe->mem.isAllocate) +
-                                    sizeof(npe->mem.size) +
-                                    sizeof(npe->mem.alloc_addr);
-            uint8_t buf[mem_size];
-            int bytesConsume = 0;
-            fread_check(buf, sizeof(uint8_t), mem_size, fptr);
-            bytesConsume = unpack(buf, "btt", &npe->mem.isAllocate,
-                                              &npe->mem.size,
-                                              &npe->mem.alloc_addr);
-            assert(bytesConsume == mem_size);
+            uint64_t f[CT_SCHEMA_MAX_FIELDS];
+            readSchemaEvent(ct_event_memory, f, fptr);
+            npe->mem.isAllocate = f[0];
+            npe->mem.size = f[1];
+            npe->mem.alloc_addr = f[2];
         }
         break;
         
         case (ct_event_buffer):
         {
             //fprintf(debug_file, "%u\n", lastBBID);
+            long markerLen = CT_BUFFER_MARKER_LEN;
+            npe->buf.flags = 0;
             if (version > 0)
             {
                 char buf[3];
                 fread_check(buf, sizeof(char), 3, fptr);
+                npe->buf.flags = (uint8_t)buf[0];
                 fread_check(&npe->contech_id, sizeof(unsigned int), 1, fptr);
                 //fprintf(stderr, "Now in ctid - %d\n", npe->contech_id);
             }
             fread_check(&npe->buf.pos, sizeof(unsigned int), 1, fptr);
-            if (maxBufPos == 0) initBufList(fptr);
+            if (npe->buf.flags & CT_BUFFER_FLAG_CRC)
+            {
+                // Checksum is verified by ct_validate, not during decode
+                fread_check(&npe->buf.crc, sizeof(uint32_t), 1, fptr);
+                markerLen += CT_BUFFER_CRC_LEN;
+            }
+            if (maxBufPos == 0) initBufList(fptr, ftell(fptr) - markerLen);
             
             // If the next buffer is valid, keep reading sequentially
             auto ss = skipSet.find(npe->contech_id);
             if ((ss == skipSet.end() || ss->second == false) &&
                 skipList[npe->contech_id].size() > 0 &&
-                ((ftell(fptr) - 12) == skipList[npe->contech_id].front()))
+                ((ftell(fptr) - markerLen) == skipList[npe->contech_id].front()))
             {
                 skipList[npe->contech_id].pop_front();
                 //fprintf(stderr, "CONT: %ld (%u)\n", ftell(fptr) - 12, npe->contech_id);
@@ -1056,7 +1267,7 @@ pct_event EventLib::createContechEvent(FILE* fptr)
             else
             {
                 free(npe);
-                sum -= 12;
+                sum -= markerLen;
                 
                 long earliestPos = LONG_MAX;
                 int zeroCount = 0;
@@ -1107,17 +1318,21 @@ pct_event EventLib::createContechEvent(FILE* fptr)
             }
             if (bufSum == 0)
             {
-                // Everything we've read so far, except this event (12B)
-                bufSum = sum - 12;
+                // Everything we've read so far, except this event (12B, 16B with CRC)
+                bufSum = sum - markerLen;
                 
             }
-            else if ((sum - 12) != bufSum)
+            else if ((sum - markerLen) != bufSum)
             {
-                fprintf(stderr, "Marker at %lu bytes, should be at 12 + %lu\n", sum, bufSum);
+                fprintf(stderr, "Marker at %lu bytes, should be at %ld + %lu\n", sum, markerLen, bufSum);
                 dumpAndTerminate(fptr);
             }
             
-            bufSum += npe->buf.pos + 12;  // 12 for the buffer event
+            bufSum += npe->buf.pos + markerLen;  // for the buffer event
+            if (encodingFlags & CT_VERSION_FLAG_DELTA_ADDR)
+            {
+                memset(deltaAddr, 0, sizeof(deltaAddr));
+            }
             lastBufPos = npe->buf.pos;
             {
                 int idx = lastBufPos % 1024;
@@ -1133,93 +1348,76 @@ pct_event EventLib::createContechEvent(FILE* fptr)
         
         case (ct_event_bulk_memory_op):
         {
-            const size_t bulk_size = sizeof(npe->bm.size) +
-                                     sizeof(npe->bm.dst_addr) +
-                                     sizeof(npe->bm.src_addr);
-            uint8_t buf[bulk_size];
-            int bytesConsume = 0;
-            fread_check(buf, sizeof(uint8_t), bulk_size, fptr);
-            bytesConsume = unpack(buf, "ttt", &npe->bm.size,
-                                              &npe->bm.dst_addr,
-                                              &npe->bm.src_addr);
-                                              
-            assert(bytesConsume == bulk_size);
+            uint64_t f[CT_SCHEMA_MAX_FIELDS];
+            readSchemaEvent(ct_event_bulk_memory_op, f, fptr);
+            npe->bm.size = f[0];
+            npe->bm.dst_addr = f[1];
+            npe->bm.src_addr = f[2];
         }
         break;
         
         case (ct_event_delay):
         {
-            fread_check(&npe->dly.start_time, sizeof(ct_tsc_t), 1, fptr);
-            fread_check(&npe->dly.end_time, sizeof(ct_tsc_t), 1, fptr);
+            uint64_t f[CT_SCHEMA_MAX_FIELDS];
+            readSchemaEvent(ct_event_delay, f, fptr);
+            npe->dly.start_time = f[0];
+            npe->dly.end_time = f[1];
         }
         break;
         
         case (ct_event_rank):
         {
-            fread_check(&npe->rank.rank, sizeof(int), 1, fptr);
+            uint64_t f[CT_SCHEMA_MAX_FIELDS];
+            readSchemaEvent(ct_event_rank, f, fptr);
+            npe->rank.rank = f[0];
         }
         break;
         
         case (ct_event_mpi_transfer):
         {
-            const size_t mpi_size = sizeof(npe->mpixf.isSend) +
-                                    sizeof(npe->mpixf.isBlocking) +
-                                    sizeof(npe->mpixf.comm_rank) +
-                                    sizeof(npe->mpixf.tag) +
-                                    sizeof(npe->mpixf.buf_ptr) +
-                                    sizeof(npe->mpixf.buf_size) +
-                                    sizeof(npe->mpixf.start_time) +
-                                    sizeof(npe->mpixf.end_time) +
-                                    sizeof(npe->mpixf.req_ptr);
-            uint8_t buf[mpi_size];
-            int bytesConsume = 0;
-            fread_check(buf, sizeof(uint8_t), mpi_size, fptr);
-            bytesConsume = unpack(buf, "cclltsttt", &npe->mpixf.isSend, 
-                                                    &npe->mpixf.isBlocking, 
-                                                    &npe->mpixf.comm_rank, 
-                                                    &npe->mpixf.tag,
-                                                    &npe->mpixf.buf_ptr, 
-                                                    &npe->mpixf.buf_size, 
-                                                    &npe->mpixf.start_time, 
-                                                    &npe->mpixf.end_time, 
-                                                    &npe->mpixf.req_ptr);
-            assert(bytesConsume == mpi_size);
+            uint64_t f[CT_SCHEMA_MAX_FIELDS];
+            readSchemaEvent(ct_event_mpi_transfer, f, fptr);
+            npe->mpixf.isSend = f[0];
+            npe->mpixf.isBlocking = f[1];
+            npe->mpixf.comm_rank = f[2];
+            npe->mpixf.tag = f[3];
+            npe->mpixf.buf_ptr = f[4];
+            npe->mpixf.buf_size = f[5];
+            npe->mpixf.start_time = f[6];
+            npe->mpixf.end_time = f[7];
+            npe->mpixf.req_ptr = f[8];
         }
         break;
         
         case (ct_event_mpi_allone):
         {
-            const size_t mpi_size = sizeof(npe->mpiao.isToAll) +
-                                    sizeof(npe->mpiao.one_comm_rank) +
-                                    sizeof(npe->mpiao.buf_ptr) +
-                                    sizeof(npe->mpiao.buf_size) +
-                                    sizeof(npe->mpiao.start_time) +
-                                    sizeof(npe->mpiao.end_time);
-            uint8_t buf[mpi_size];
-            int bytesConsume = 0;
-            fread_check(buf, sizeof(uint8_t), mpi_size, fptr);
-            bytesConsume = unpack(buf, "cltstt", &npe->mpiao.isToAll,
-                                           &npe->mpiao.one_comm_rank,
-                                           &npe->mpiao.buf_ptr,
-                                           &npe->mpiao.buf_size,
-                                           &npe->mpiao.start_time,
-                                           &npe->mpiao.end_time);
-            assert(bytesConsume == mpi_size);
+            uint64_t f[CT_SCHEMA_MAX_FIELDS];
+            readSchemaEvent(ct_event_mpi_allone, f, fptr);
+            npe->mpiao.isToAll = f[0];
+            npe->mpiao.one_comm_rank = f[1];
+            npe->mpiao.buf_ptr = f[2];
+            npe->mpiao.buf_size = f[3];
+            npe->mpiao.start_time = f[4];
+            npe->mpiao.end_time = f[5];
         }
         break;
         
         case (ct_event_mpi_wait):
         {
-            fread_check(&npe->mpiw.req_ptr, sizeof(ct_addr_t), 1, fptr);
-            fread_check(&npe->mpiw.start_time, sizeof(ct_tsc_t), 1, fptr);
-            fread_check(&npe->mpiw.end_time, sizeof(ct_tsc_t), 1, fptr);
+            uint64_t f[CT_SCHEMA_MAX_FIELDS];
+            readSchemaEvent(ct_event_mpi_wait, f, fptr);
+            npe->mpiw.req_ptr = f[0];
+            npe->mpiw.start_time = f[1];
+            npe->mpiw.end_time = f[2];
         }
         break;
         
         case (ct_event_gv_info):
         {
-            fread_check(&npe->gvi.id, sizeof(npe->gvi.id), 1, fptr);
-            fread_check(&npe->gvi.constantGV, sizeof(npe->gvi.constantGV), 1, fptr);
+            uint64_t f[CT_SCHEMA_MAX_FIELDS];
+            readSchemaEvent(ct_event_gv_info, f, fptr);
+            npe->gvi.id = f[0];
+            npe->gvi.constantGV = f[1];
             //fprintf(stderr, "%d %lx %d %d\n", npe->gvi.id, npe->gvi.constantGV, sizeof(npe->gvi.id), sizeof(npe->gvi.constantGV));
             if (constGVAddr == NULL)
             {
@@ -1235,6 +1433,15 @@ pct_event EventLib::createContechEvent(FILE* fptr)
         }
         break;
         
+        case (ct_event_schema):
+        {
+            // Consumed here, the remaining events decode with this schema
+            readEventSchema(fptr);
+            free(npe);
+            return createContechEvent(fptr);
+        }
+        break;
+        
         case (ct_event_version):
         {
             // There should be only one version event in the list
@@ -1261,7 +1468,9 @@ pct_event EventLib::createContechEvent(FILE* fptr)
         case (ct_event_roi):
         {
             // This event has no additional fields
-            fread_check(&npe->roi.start_time, sizeof(ct_tsc_t), 1, fptr);
+            uint64_t f[CT_SCHEMA_MAX_FIELDS];
+            readSchemaEvent(ct_event_roi, f, fptr);
+            npe->roi.start_time = f[0];
         }
         break;
         
@@ -1383,6 +1592,20 @@ pct_event EventLib::createContechEvent(FILE* fptr)
         
         default:
         {
+            // A newer runtime may describe events this EventLib does not know
+            internal_event_schema& ies = eventSchema[npe->event_type & 0xff];
+            if (ies.numFields > 0)
+            {
+                uint64_t f[CT_SCHEMA_MAX_FIELDS];
+                readSchemaEvent(npe->event_type, f, fptr);
+                npe->gen.num_fields = (ies.numFields < CT_GENERIC_MAX_FIELDS) ? ies.numFields : CT_GENERIC_MAX_FIELDS;
+                for (unsigned int i = 0; i < CT_GENERIC_MAX_FIELDS; i++)
+                {
+                    npe->gen.field[i] = f[i];
+                }
+                break;
+            }
+            
             fprintf(stderr, "ERROR: type %d not supported at %lu\n", npe->event_type, sum);
             fprintf(stderr, "\tPrevious event - %d with ID - %d\n", lastType, lastID);
             dumpAndTerminate(fptr);
@@ -1516,34 +1739,206 @@ void EventLib::debugSkipStatus()
     }
 }
 
-void EventLib::initBufList(FILE* fptr)
+void EventLib::initBufList(FILE* fptr, long markerPos)
 {
     uint64_t resetSum = sum;
     long firstBufPos = ftell(fptr);
     long fileLen = 0;
-    uint32_t buf[3];
+    uint32_t buf[4];
     
     fseek(fptr, 0, SEEK_END);
     fileLen = ftell(fptr);
-    fseek(fptr, firstBufPos - 12, SEEK_SET);
+    fseek(fptr, markerPos, SEEK_SET);
+    
+    if (!bufIndex.empty() && bufIndex.begin()->first != markerPos)
+    {
+        fprintf(stderr, "Buffer index does not match trace (%ld vs %ld), scanning instead\n", 
+                        bufIndex.begin()->first, markerPos);
+        bufIndex.clear();
+    }
+    
+    // With the sidecar index, the lists are built from the index and the
+    //   first marker, as the runtime writes a CRC with every buffer or none
+    if (!bufIndex.empty())
+    {
+        long markerLen = CT_BUFFER_MARKER_LEN;
+        fread_check(buf, sizeof(uint32_t), 1, fptr);
+        fseek(fptr, markerPos, SEEK_SET);
+        if ((buf[0] >> 8) & CT_BUFFER_FLAG_CRC) markerLen += CT_BUFFER_CRC_LEN;
+        
+        for (auto it = bufIndex.begin(), et = bufIndex.end(); it != et; ++it)
+        {
+            if ((it->first + markerLen + (long)it->second.len) > fileLen)
+            {
+                fprintf(stderr, "Buffer index extends beyond end of trace at %ld, scanning instead\n", it->first);
+                skipList.clear();
+                bufIndex.clear();
+                break;
+            }
+            skipList[it->second.ctid].push_back(it->first);
+        }
+    }
     
-    while (1)
+    while (bufIndex.empty())
     {
         long curPos = ftell(fptr);
+        long markerLen = CT_BUFFER_MARKER_LEN;
         fread_check(buf, sizeof(uint32_t), 3, fptr);
-        assert(buf[0] == ct_event_buffer);
+        assert((buf[0] & 0xff) == ct_event_buffer);
         uint32_t ctid = buf[1];
         uint32_t bufLen = buf[2];
+        if ((buf[0] >> 8) & CT_BUFFER_FLAG_CRC)
+        {
+            fread_check(&buf[3], sizeof(uint32_t), 1, fptr);
+            markerLen += CT_BUFFER_CRC_LEN;
+        }
         
         skipList[ctid].push_back(curPos);
         
-        if ((curPos + (sizeof(uint32_t) * 3) + (long)bufLen) >= fileLen) break;
+        if ((curPos + markerLen + (long)bufLen) >= fileLen) break;
         fseek(fptr, bufLen, SEEK_CUR);
     }
     
     fseek(fptr, firstBufPos, SEEK_SET);
     sum = resetSum;
     maxBufPos = 1;
+    
+    applyBufFilter();
+}
+
+bool EventLib::keepBuffer(uint32_t ctid, long pos)
+{
+    if (!ctidFilter.empty() && ctidFilter.find(ctid) == ctidFilter.end()) return false;
+    if (!hasTimeWindow) return true;
+    
+    auto bi = bufIndex.find(pos);
+    if (bi == bufIndex.end()) return true;
+    
+    return (bi->second.endTime >= windowStart && bi->second.startTime <= windowEnd);
+}
+
+//
+// Remove buffers that are outside of the requested contexts / time window.
+//   Buffers removed from skipList are then skipped by the buffer event
+//   processing, as they are no longer the next buffer for their context.
+//
+void EventLib::applyBufFilter()
+{
+    if (ctidFilter.empty() && !hasTimeWindow) return;
+    
+    for (auto it = skipList.begin(), et = skipList.end(); it != et; ++it)
+    {
+        std::deque<long> keep;
+        for (auto pit = it->second.begin(), pet = it->second.end(); pit != pet; ++pit)
+        {
+            if (keepBuffer(it->first, *pit)) keep.push_back(*pit);
+        }
+        it->second.swap(keep);
+    }
+}
+
+//
+// Load the sidecar buffer index written by the runtime (<trace>.idx)
+//   Returns false if there is no usable index, in which case the
+//   buffer list is built by scanning the trace.
+//
+bool EventLib::loadBufferIndex(const char* traceName)
+{
+    std::vector<ct_buffer_index_entry> entries;
+    
+    if (!readBufferIndex(traceName, entries)) return false;
+    
+    bufIndex.clear();
+    for (auto it = entries.begin(), et = entries.end(); it != et; ++it)
+    {
+        bufIndex[(long)it->offset] = *it;
+    }
+    
+    return !bufIndex.empty();
+}
+
+long EventLib::findFirstBuffer(FILE* fptr)
+{
+    pct_event npe;
+    
+    // The version event is read whole, the remaining header events start
+    //   with a one byte event id
+    if (version == 0)
+    {
+        if ((npe = createContechEvent(fptr)) == NULL) return -1;
+        deleteContechEvent(npe);
+    }
+    
+    while (true)
+    {
+        long pos = ftell(fptr);
+        unsigned char ty = 0;
+        
+        if (ct_read(&ty, sizeof(ty), fptr) != sizeof(ty)) return -1;
+        fseek(fptr, pos, SEEK_SET);
+        if (ty == ct_event_buffer) return pos;
+        
+        if ((npe = createContechEvent(fptr)) == NULL) return -1;
+        deleteContechEvent(npe);
+    }
+}
+
+bool EventLib::readBufferIndex(const char* traceName, std::vector<ct_buffer_index_entry>& entries)
+{
+    std::string iname = std::string(traceName) + CT_BUFFER_INDEX_SUFFIX;
+    FILE* indexFile = fopen(iname.c_str(), "rb");
+    uint32_t indexVersion = 0;
+    ct_buffer_index_entry cbie;
+    
+    if (indexFile == NULL) return false;
+    
+    if (ct_read(&indexVersion, sizeof(uint32_t), indexFile) != sizeof(uint32_t) ||
+        indexVersion < CT_BUFFER_INDEX_MIN_VERSION ||
+        indexVersion > CONTECH_EVENT_VERSION)
+    {
+        fprintf(stderr, "Buffer index %s has version %u, expected %u to %u\n", 
+                        iname.c_str(), indexVersion, CT_BUFFER_INDEX_MIN_VERSION, CONTECH_EVENT_VERSION);
+        fclose(indexFile);
+        return false;
+    }
+    
+    while (ct_read(&cbie, sizeof(ct_buffer_index_entry), indexFile) == sizeof(ct_buffer_index_entry))
+    {
+        entries.push_back(cbie);
+    }
+    fclose(indexFile);
+    
+    return true;
+}
+
+void EventLib::seekContext(uint32_t ctid)
+{
+    ctidFilter.insert(ctid);
+    if (maxBufPos != 0) applyBufFilter();
+}
+
+bool EventLib::seekTime(ct_tsc_t start, ct_tsc_t end)
+{
+    if (bufIndex.empty())
+    {
+        fprintf(stderr, "Seeking by time requires the buffer index\n");
+        return false;
+    }
+    
+    hasTimeWindow = true;
+    windowStart = start;
+    windowEnd = end;
+    if (maxBufPos != 0) applyBufFilter();
+    
+    return true;
+}
+
+void EventLib::clearSeek()
+{
+    ctidFilter.clear();
+    hasTimeWindow = false;
+    windowStart = 0;
+    windowEnd = 0;
 }
 
 void EventLib::blockCTID(FILE* fptr, uint32_t ctid)
@@ -10,6 +10,7 @@
 #include <vector>
 #include <deque>
 #include <queue>
+#include <set>
 
 #define MAX_PATH_DEPTH 10
 
@@ -84,6 +85,8 @@ namespace contech
     typedef struct _ct_buffer_info
     {
         uint32_t pos;
+        uint32_t flags;  // CT_BUFFER_FLAG_*
+        uint32_t crc;    // only if flags & CT_BUFFER_FLAG_CRC
     } ct_buffer_info, *pct_buffer_info;
 
     typedef struct _ct_bulk_memory
@@ -144,6 +147,14 @@ namespace contech
         ct_addr_t constantGV;
     } ct_gv_info, *pct_gv_info;
     
+    // Event with a schema entry in the trace, but no decoder in this EventLib
+    #define CT_GENERIC_MAX_FIELDS 6
+    typedef struct _ct_generic_event
+    {
+        uint32_t num_fields;
+        uint64_t field[CT_GENERIC_MAX_FIELDS];
+    } ct_generic_event, *pct_generic_event;
+    
     typedef struct _ct_loop_base {
         int32_t step;
         uint32_t stepBlock;
@@ -196,9 +207,13 @@ namespace contech
             ct_gv_info          gvi;
             ct_loop             loop;
             ct_path_info        pi;
+            ct_generic_event    gen;
         };
     } ct_event, *pct_event;
     
+    // Decodes the fields of a fixed size event, see EventLib::getSchemaDecoder
+    typedef void (*ct_schema_decoder)(const uint8_t*, uint64_t*);
+    
     class EventLib
     {
         private:
@@ -238,6 +253,26 @@ namespace contech
             // Interpret basic blocks using the following information
             unsigned int bb_count;
             
+            // CT_VERSION_FLAG_* from the version event
+            unsigned int encodingFlags;
+            
+            // Field widths of the fixed size events, by event id
+            //   Starts as CT_EVENT_SCHEMA_TABLE and is replaced by the trace's
+            //   schema event, if the trace has one (version 10+)
+            typedef struct _internal_event_schema
+            {
+                uint8_t numFields;
+                uint8_t size;
+                uint8_t width[CT_SCHEMA_MAX_FIELDS];
+                ct_schema_decoder decode;  // NULL if no decoder matches the widths
+            } internal_event_schema;
+            
+            internal_event_schema eventSchema[256];
+            
+            // Previous address per slot, if CT_VERSION_FLAG_DELTA_ADDR
+            //   Reset at each buffer, mirroring the runtime's per thread state
+            uint64_t deltaAddr[CT_DELTA_SLOTS];
+            
             typedef struct _internal_memory_op_info
             {
                 char memFlags, size;
@@ -322,6 +357,14 @@ namespace contech
             std::map<uint32_t, std::deque<long> > skipList;
             long maxBufPos;
             
+            // Optional sidecar index (file offset -> entry), see loadBufferIndex
+            //   When present, initBufList does not need to scan the trace and
+            //   the buffer lists can be restricted to contexts or a time window.
+            std::map<long, ct_buffer_index_entry> bufIndex;
+            std::set<uint32_t> ctidFilter;
+            bool hasTimeWindow;
+            ct_tsc_t windowStart, windowEnd;
+            
             pinternal_basic_block_info bb_info_table;
             std::map<uint32_t, internal_path_info> path_info_table;
             ct_addr_t* constGVAddr;
@@ -329,7 +372,12 @@ namespace contech
             
             pinternal_path_track currentPath;
             
-            void initBufList(FILE*);
+            void initBufList(FILE*, long);
+            void applyBufFilter();
+            bool keepBuffer(uint32_t, long);
+            void initEventSchema();
+            void readEventSchema(FILE*);
+            void readSchemaEvent(uint8_t, uint64_t*, FILE*);
             int unpack(uint8_t *buf, char const fmt[], ...);
             void dumpAndTerminate(FILE *fptr);
             void fread_check(void* x, size_t y, size_t z, FILE* a);
@@ -345,11 +393,35 @@ namespace contech
             void debugSkipStatus();
             void resetEventLib();
             void readMemOp(pct_memory_op, FILE*);
+            void readMemOpDelta(pct_memory_op, FILE*, uint32_t);
             uint64_t getSum() {return sum;}
             void unblockCTID(uint32_t);
             void blockCTID(FILE*, uint32_t);
             bool getBlockCTID(uint32_t);
             
+            // Fixed size event decoding.  Each layout in CT_EVENT_SCHEMA_TABLE has a
+            //   decoder generated for its widths, which is used when the trace's
+            //   schema for that event matches.  Other layouts are decoded by
+            //   stepping through their widths, which also zeroes the fields past
+            //   numFields; the generated decoders write only their own fields.
+            static ct_schema_decoder getSchemaDecoder(uint8_t, const uint8_t*, unsigned int);
+            static void decodeSchemaFields(const uint8_t*, unsigned int, const uint8_t*, uint64_t*);
+            
+            // Random access support, requires the sidecar index for time windows.
+            //   Filters apply at buffer granularity and should be set before the
+            //   first buffer event is read.
+            bool loadBufferIndex(const char*);
+            
+            // Decodes the trace header from the start of the trace, returning the
+            //   offset of the first buffer marker, or -1 if the trace has none.
+            //   The file is left at the marker.
+            long findFirstBuffer(FILE*);
+            static bool readBufferIndex(const char*, std::vector<ct_buffer_index_entry>&);
+            bool hasBufferIndex() {return !bufIndex.empty();}
+            void seekContext(uint32_t);
+            bool seekTime(ct_tsc_t, ct_tsc_t);
+            void clearSeek();
+            
     };
     
     
@@ -4,8 +4,9 @@
 #include <stdio.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <stddef.h>
 
-#define CONTECH_EVENT_VERSION 9
+#define CONTECH_EVENT_VERSION 10
 
 typedef uint64_t ct_tsc_t;
 typedef uint64_t ct_addr_t;
@@ -48,9 +49,49 @@ enum _ct_event_id { ct_event_basic_block = 0,
     ct_event_loop_short,
     ct_event_loop_exit,
     ct_event_path_info,
+    ct_event_schema,  // INTERNAL USE
     ct_event_unknown};
 typedef enum _ct_event_id ct_event_id;
 
+//
+// Layout of the fixed size events, the fields that follow the 4 byte event id.
+//   Field widths use the characters of EventLib::unpack:
+//     b / c - 1 byte, l - 4 bytes, t / p - 8 bytes, s - sizeof(size_t)
+//   Starting with version 10, the runtime writes this table into the trace header
+//   (ct_event_schema) and EventLib decodes these events from the table in the trace.
+//   Stores in ct_runtime.c must match this table.
+//
+#define CT_EVENT_SCHEMA_TABLE(X) \
+    X(ct_event_memory,          "btt") \
+    X(ct_event_sync,            "ttlpp") \
+    X(ct_event_barrier,         "btttt") \
+    X(ct_event_task_create,     "ttlp") \
+    X(ct_event_task_join,       "bttl") \
+    X(ct_event_bulk_memory_op,  "ttt") \
+    X(ct_event_delay,           "tt") \
+    X(ct_event_rank,            "l") \
+    X(ct_event_mpi_transfer,    "cclltsttt") \
+    X(ct_event_mpi_allone,      "cltstt") \
+    X(ct_event_mpi_wait,        "ptt") \
+    X(ct_event_roi,             "t") \
+    X(ct_event_gv_info,         "lp")
+
+#define CT_SCHEMA_MAX_FIELDS 12
+
+static inline unsigned int ct_schema_width(char ty)
+{
+    switch (ty)
+    {
+        case 'b':
+        case 'c': return 1;
+        case 'l': return 4;
+        case 's': return sizeof(size_t);
+        case 't':
+        case 'p': return 8;
+        default: return 0;
+    }
+}
+
 enum _ct_sync_type {
     ct_sync_release = 0,
     ct_sync_acquire = 1,
@@ -67,4 +108,42 @@ typedef enum _ct_sync_type ct_sync_type;
 #define BBI_FLAG_MEM_LOOP 0x8
 #define BBI_FLAG_MEM_PRESV 0x10
 
+// The version event carries encoding flags in the second byte of its event id
+//   CT_VERSION_FLAG_DELTA_ADDR - memory op addresses are delta encoded, see below
+#define CT_VERSION_FLAG_DELTA_ADDR 0x1
+
+// Delta encoded memory op addresses
+//   Each address is encoded against the previous address stored in the same
+//   slot, where the slot is a hash of (basic block id, memory op index).
+//   Slots are reset at the start of every buffer, so buffers remain independently
+//   decodable.  The first byte is a tag:
+//     bit 0 = 1 - 6 bytes, absolute address in bits 1 - 47
+//     bit 0 = 0 - (bits 1 - 2) + 1 bytes, zigzag delta in the remaining bits
+//   So an address never takes more than the 6 bytes of the raw encoding.
+#define CT_DELTA_SLOTS 1024
+#define CT_DELTA_SLOT(bbid, idx) ((((bbid) << 3) + (idx)) & (CT_DELTA_SLOTS - 1))
+#define CT_DELTA_ABS_LEN 6
+#define CT_DELTA_TAG_BITS 3
+
+// ct_event_buffer markers carry flags in the second byte of the event id
+//   CT_BUFFER_FLAG_CRC - marker is followed by a uint32_t CRC32C of the buffer data
+#define CT_BUFFER_FLAG_CRC 0x1
+#define CT_BUFFER_MARKER_LEN (3 * sizeof(uint32_t))
+#define CT_BUFFER_CRC_LEN (sizeof(uint32_t))
+
+// Sidecar buffer index, written alongside the event trace as <trace>.idx
+//   The file is a uint32_t version (CONTECH_EVENT_VERSION) followed by one
+//   entry per ct_event_buffer in the order they appear in the trace.
+//   The entry layout is unchanged since version 9.
+#define CT_BUFFER_INDEX_SUFFIX ".idx"
+#define CT_BUFFER_INDEX_MIN_VERSION 9
+
+typedef struct _ct_buffer_index_entry {
+    uint64_t offset;     // file offset of the ct_event_buffer marker
+    uint32_t ctid;
+    uint32_t len;        // bytes of event data following the marker
+    ct_tsc_t startTime;  // rdtsc when the buffer was acquired by the context
+    ct_tsc_t endTime;    // rdtsc when the buffer was queued for writing
+} ct_buffer_index_entry, *pct_buffer_index_entry;
+
 #endif
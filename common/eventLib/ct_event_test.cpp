@@ -0,0 +1,294 @@
+#include "ct_event.h"
+#include "../taskLib/test_check.hpp"
+#include "../runtime/ct_test_prog.h"
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <string>
+
+using namespace contech;
+using namespace std;
+
+//
+// Round trip tests of the runtime's traces through EventLib
+//   ../runtime/ct_test_prog writes the trace, see there for what it stores.
+//   Returns 0 if every test passes.
+//
+
+#define TEST_PROG "../runtime/ct_test_prog"
+#define TEST_PROG_DELTA "../runtime/ct_test_prog_delta"
+#define VALIDATE "./ct_validate"
+
+static char tempDir[] = "/tmp/ct_event_testXXXXXX";
+
+// Runs prog with env set, returning the trace it wrote to the temp directory
+static string writeTrace(const char* prog, const char* name, const char* env)
+{
+    string trace = string(tempDir) + "/" + name;
+    string cmd = string("CONTECH_FE_FILE=") + trace + " " + env + " " + prog + " > /dev/null";
+    if (system(cmd.c_str()) != 0)
+    {
+        fprintf(stderr, "Failed to run %s\n", cmd.c_str());
+        exit(1);
+    }
+    return trace;
+}
+
+// What a pass over a trace saw
+typedef struct _trace_summary
+{
+    uint64_t iterations[2];
+    uint64_t badAddrs;
+    uint64_t mallocs;
+    uint64_t otherCtid;
+    bool indexKept;
+} trace_summary;
+
+static trace_summary readTrace(const string& trace, bool useIndex, int onlyCtid)
+{
+    trace_summary s;
+    memset(&s, 0, sizeof(s));
+
+    EventLib* el = new EventLib();
+    if (useIndex) CHECK(el->loadBufferIndex(trace.c_str()));
+    if (onlyCtid >= 0) el->seekContext(onlyCtid);
+
+    FILE* in = fopen(trace.c_str(), "rb");
+    CHECK(in != NULL);
+    if (in == NULL) return s;
+
+    bool first = true;
+    pct_event ev;
+    while ((ev = el->createContechEvent(in)) != NULL)
+    {
+        unsigned int ctid = ev->contech_id;
+
+        if (ev->event_type == ct_event_basic_block)
+        {
+            if (onlyCtid >= 0 && ctid != (unsigned int)onlyCtid) s.otherCtid++;
+
+            // The index is checked against the trace at the first buffer
+            if (first) s.indexKept = el->hasBufferIndex();
+            first = false;
+
+            if (ev->bb.basic_block_id == 1 && ctid < 2)
+            {
+                uint64_t i = s.iterations[ctid]++;
+                if (ev->bb.len != CT_TEST_STORED_OPS + 1) s.badAddrs++;
+                else
+                {
+                    for (unsigned int op = 0; op < CT_TEST_STORED_OPS; op++)
+                    {
+                        if (ev->bb.mem_op_array[op].addr != ct_test_addr(ctid, i, op)) s.badAddrs++;
+                    }
+                    if (ev->bb.mem_op_array[CT_TEST_STORED_OPS].addr != CT_TEST_GV_ADDR + CT_TEST_GV_OFFSET) s.badAddrs++;
+                }
+            }
+        }
+        else if (ev->event_type == ct_event_memory)
+        {
+            if (ev->mem.isAllocate && ev->mem.alloc_addr == CT_TEST_MALLOC_ADDR &&
+                ev->mem.size == CT_TEST_MALLOC_SIZE) s.mallocs++;
+        }
+        EventLib::deleteContechEvent(ev);
+    }
+
+    fclose(in);
+    delete el;
+    return s;
+}
+
+// A trace with elided globals, read with and without its index
+static void testIndexRoundTrip(const char* prog, const char* name)
+{
+    string trace = writeTrace(prog, name, "");
+
+    trace_summary s = readTrace(trace, true, -1);
+    CHECK(s.indexKept);
+    CHECK(s.iterations[0] == CT_TEST_ITERATIONS);
+    CHECK(s.iterations[1] == CT_TEST_ITERATIONS);
+    CHECK(s.badAddrs == 0);
+    CHECK(s.mallocs == 1);
+
+    s = readTrace(trace, false, -1);
+    CHECK(s.iterations[0] == CT_TEST_ITERATIONS);
+    CHECK(s.iterations[1] == CT_TEST_ITERATIONS);
+    CHECK(s.badAddrs == 0);
+
+    // Seeking uses the index to skip context 0's buffers
+    s = readTrace(trace, true, 1);
+    CHECK(s.indexKept);
+    CHECK(s.iterations[0] == 0);
+    CHECK(s.iterations[1] == CT_TEST_ITERATIONS);
+    CHECK(s.otherCtid == 0);
+    CHECK(s.badAddrs == 0);
+    CHECK(s.mallocs == 1);
+}
+
+// ct_validate's exit code for trace
+static int validate(const string& trace)
+{
+    string cmd = string(VALIDATE) + " " + trace + " > /dev/null 2>&1";
+    int r = system(cmd.c_str());
+    return WIFEXITED(r) ? WEXITSTATUS(r) : -1;
+}
+
+// The encoding flags of trace's version event
+static unsigned int encodingFlags(const string& trace)
+{
+    uint32_t header[2] = {0, 0};
+    FILE* f = fopen(trace.c_str(), "rb");
+    CHECK(f != NULL);
+    if (f == NULL) return 0;
+    CHECK(fread(header, sizeof(header), 1, f) == 1);
+    fclose(f);
+    return header[1] >> 8;
+}
+
+static long fileLength(const string& file)
+{
+    struct stat st;
+    if (stat(file.c_str(), &st) != 0) return -1;
+    return st.st_size;
+}
+
+// The runtime built with CT_DELTA_ADDR decodes to the same addresses, in a
+//   smaller trace
+static void testDeltaRoundTrip()
+{
+    testIndexRoundTrip(TEST_PROG_DELTA, "delta");
+
+    string trace = string(tempDir) + "/delta";
+    string raw = string(tempDir) + "/trace";
+    CHECK(encodingFlags(trace) & CT_VERSION_FLAG_DELTA_ADDR);
+    CHECK((encodingFlags(raw) & CT_VERSION_FLAG_DELTA_ADDR) == 0);
+    CHECK(fileLength(trace) < fileLength(raw));
+    CHECK(validate(trace) == 0);
+}
+
+// With a CRC after each marker, an index entry that runs past the end of the
+//   trace by less than the CRC is found, and the buffers are found by a scan
+static void testIndexPastEnd()
+{
+    string trace = writeTrace(TEST_PROG, "crc", "CONTECH_FE_CRC=1");
+    string index = trace + CT_BUFFER_INDEX_SUFFIX;
+    vector<ct_buffer_index_entry> entries;
+
+    trace_summary s = readTrace(trace, true, -1);
+    CHECK(s.indexKept);
+    CHECK(s.iterations[0] == CT_TEST_ITERATIONS && s.iterations[1] == CT_TEST_ITERATIONS);
+
+    CHECK(EventLib::readBufferIndex(trace.c_str(), entries));
+    CHECK(!entries.empty());
+    if (entries.empty()) return;
+
+    ct_buffer_index_entry& last = entries.back();
+    CHECK(last.offset + CT_BUFFER_MARKER_LEN + CT_BUFFER_CRC_LEN + last.len == (uint64_t)fileLength(trace));
+    uint32_t len = last.len + CT_BUFFER_CRC_LEN / 2;
+    FILE* f = fopen(index.c_str(), "r+b");
+    CHECK(f != NULL);
+    if (f == NULL) return;
+    fseek(f, sizeof(uint32_t) + (entries.size() - 1) * sizeof(ct_buffer_index_entry) +
+             offsetof(ct_buffer_index_entry, len), SEEK_SET);
+    fwrite(&len, sizeof(uint32_t), 1, f);
+    fclose(f);
+
+    s = readTrace(trace, true, -1);
+    CHECK(!s.indexKept);
+    CHECK(s.iterations[0] == CT_TEST_ITERATIONS && s.iterations[1] == CT_TEST_ITERATIONS);
+    CHECK(s.badAddrs == 0);
+    CHECK(s.mallocs == 1);
+}
+
+// Overwrites a byte of file at pos
+static void corrupt(const string& file, long pos)
+{
+    FILE* f = fopen(file.c_str(), "r+b");
+    CHECK(f != NULL);
+    if (f == NULL) return;
+    fseek(f, pos, SEEK_SET);
+    int c = fgetc(f);
+    fseek(f, pos, SEEK_SET);
+    fputc(c ^ 0x5a, f);
+    fclose(f);
+}
+
+// ct_validate finds the buffers from the header, with or without the index
+static void testValidate()
+{
+    string trace = writeTrace(TEST_PROG, "validate", "CONTECH_FE_CRC=1");
+    string index = trace + CT_BUFFER_INDEX_SUFFIX;
+    vector<ct_buffer_index_entry> entries;
+
+    CHECK(validate(trace) == 0);
+    CHECK(EventLib::readBufferIndex(trace.c_str(), entries));
+    CHECK(entries.size() > 1);
+    if (entries.size() < 2) return;
+
+    // A wrong index entry is an index error, the trace is still valid.  The
+    //   second entry's ctid follows the version and the offset.
+    corrupt(index, sizeof(uint32_t) + sizeof(ct_buffer_index_entry) + sizeof(uint64_t));
+    CHECK(validate(trace) == 2);
+
+    unlink(index.c_str());
+    CHECK(validate(trace) == 0);
+
+    // Buffer data no longer matching its checksum
+    corrupt(trace, entries[1].offset + CT_BUFFER_MARKER_LEN + CT_BUFFER_CRC_LEN + entries[1].len / 2);
+    CHECK(validate(trace) == 1);
+}
+
+// Each built in layout has a generated decoder, which agrees with stepping
+//   through the widths.  A trace with another layout gets no decoder.
+static void testSchemaDecoders()
+{
+    uint8_t data[CT_SCHEMA_MAX_FIELDS * sizeof(uint64_t)];
+    for (unsigned int i = 0; i < sizeof(data); i++) data[i] = i * 37 + 11;
+
+    #define CT_SCHEMA_ENTRY(ev, fmt) \
+    { \
+        uint8_t width[CT_SCHEMA_MAX_FIELDS]; \
+        unsigned int n = 0; \
+        uint64_t ref[CT_SCHEMA_MAX_FIELDS], f[CT_SCHEMA_MAX_FIELDS]; \
+        for (const char* c = fmt; *c != '\0'; c++) width[n++] = ct_schema_width(*c); \
+        ct_schema_decoder d = EventLib::getSchemaDecoder(ev, width, n); \
+        CHECK(d != NULL); \
+        if (d != NULL) \
+        { \
+            EventLib::decodeSchemaFields(width, n, data, ref); \
+            d(data, f); \
+            CHECK(memcmp(ref, f, n * sizeof(uint64_t)) == 0); \
+        } \
+        CHECK(EventLib::getSchemaDecoder(ev, width, n - 1) == NULL); \
+        width[0] = 2; \
+        CHECK(EventLib::getSchemaDecoder(ev, width, n) == NULL); \
+    }
+    CT_EVENT_SCHEMA_TABLE(CT_SCHEMA_ENTRY)
+    #undef CT_SCHEMA_ENTRY
+
+    uint8_t width[1] = {8};
+    CHECK(EventLib::getSchemaDecoder(ct_event_unknown, width, 1) == NULL);
+}
+
+int main(int argc, char** argv)
+{
+    if (mkdtemp(tempDir) == NULL)
+    {
+        fprintf(stderr, "Could not create %s\n", tempDir);
+        return 1;
+    }
+
+    testSchemaDecoders();
+    testIndexRoundTrip(TEST_PROG, "trace");
+    testDeltaRoundTrip();
+    testIndexPastEnd();
+    testValidate();
+
+    string cmd = string("rm -rf ") + tempDir;
+    system(cmd.c_str());
+
+    return testResult("ct_event_test");
+}
@@ -0,0 +1,250 @@
+#include "ct_event.h"
+#include "ct_crc32c.h"
+#include <string.h>
+#include <sys/stat.h>
+
+using namespace contech;
+using namespace std;
+
+//
+// ct_validate <event trace> [-v]
+//   Checks the buffer framing of a front-end trace, verifies buffer checksums
+//   when the runtime wrote them (CONTECH_FE_CRC), and checks that each
+//   context's buffers are in order.  The header is decoded to find the first
+//   buffer, then only buffer markers and data are read, so this runs at disk
+//   bandwidth.  When the trace has a sidecar index (<trace>.idx), the index
+//   is checked against the buffers found and used to resynchronize after a
+//   framing error.
+//   Returns 0 if the trace is valid, 1 if it is not and 2 if only its index
+//   is wrong.
+//
+
+#define MAX_REPORTED_ERRORS 32
+#define READ_CHUNK (1024 * 1024)
+
+// Largest buffer the runtime will queue, see SERIAL_BUFFER_SIZE
+#define MAX_BUFFER_LEN (1024 * 1024)
+
+typedef struct _ctid_status
+{
+    uint64_t buffers;
+    uint64_t bytes;
+    ct_tsc_t lastEndTime;
+} ctid_status;
+
+static unsigned int errorCount = 0;
+static unsigned int indexErrorCount = 0;
+
+static void reportError(long pos, const char* msg, uint64_t a, uint64_t b)
+{
+    errorCount++;
+    if (errorCount <= MAX_REPORTED_ERRORS)
+    {
+        fprintf(stderr, "ERROR at %ld: %s (%lu vs %lu)\n", pos, msg, a, b);
+    }
+    else if (errorCount == MAX_REPORTED_ERRORS + 1)
+    {
+        fprintf(stderr, "Too many errors, further errors are counted but not reported\n");
+    }
+}
+
+// An index error is reported as any other, but does not make the trace invalid
+static void reportIndexError(long pos, const char* msg, uint64_t a, uint64_t b)
+{
+    indexErrorCount++;
+    reportError(pos, msg, a, b);
+}
+
+int main(int argc, char** argv)
+{
+    bool verbose = false;
+    struct stat st;
+    uint32_t header[4];
+    vector<ct_buffer_index_entry> entries;
+    map<long, ct_buffer_index_entry> index;
+    set<long> indexed;
+    map<uint32_t, ctid_status> ctidStatus;
+    uint64_t crcChecked = 0;
+
+    if (argc < 2)
+    {
+        fprintf(stderr, "%s <event trace> [-v]\n", argv[0]);
+        return 1;
+    }
+    if (argc > 2 && !strcmp(argv[2], "-v")) verbose = true;
+
+    FILE* in = fopen(argv[1], "rb");
+    if (in == NULL)
+    {
+        fprintf(stderr, "Could not open %s\n", argv[1]);
+        return 1;
+    }
+    fstat(fileno(in), &st);
+    long fileLen = st.st_size;
+
+    // id, ct_event_version, version, bb_count
+    if (ct_read(header, sizeof(header), in) != sizeof(header) ||
+        header[0] != 0 ||
+        (header[1] & 0xff) != ct_event_version)
+    {
+        fprintf(stderr, "%s does not start with a version event\n", argv[1]);
+        return 1;
+    }
+    if (header[2] > CONTECH_EVENT_VERSION)
+    {
+        fprintf(stderr, "Trace version %u exceeds supported version %u\n", header[2], CONTECH_EVENT_VERSION);
+        return 1;
+    }
+
+    // The header events (basic block and GV info) are variable length, so
+    //   they are decoded as EventLib would to find the first buffer
+    fseek(in, 0, SEEK_SET);
+    EventLib* el = new EventLib();
+    long pos = el->findFirstBuffer(in);
+    delete el;
+    if (pos < 0)
+    {
+        fprintf(stderr, "%s has no buffers\n", argv[1]);
+        return 1;
+    }
+
+    if (EventLib::readBufferIndex(argv[1], entries))
+    {
+        long last = -1;
+        for (auto it = entries.begin(), et = entries.end(); it != et; ++it)
+        {
+            if ((long)it->offset <= last) reportIndexError(it->offset, "Index out of order", it->offset, last);
+            last = it->offset;
+            index[(long)it->offset] = *it;
+        }
+        if (!index.empty() && index.begin()->first != pos)
+        {
+            reportIndexError(pos, "Index does not start at first buffer", index.begin()->first, pos);
+        }
+    }
+    else if (verbose)
+    {
+        printf("No buffer index for %s\n", argv[1]);
+    }
+
+    uint8_t* data = (uint8_t*) malloc(READ_CHUNK);
+    assert(data != NULL);
+
+    fseek(in, pos, SEEK_SET);
+
+    while (pos < fileLen)
+    {
+        uint32_t marker[3];
+        uint32_t crc = 0, flags = 0;
+        long markerLen = CT_BUFFER_MARKER_LEN;
+
+        if (ct_read(marker, sizeof(marker), in) != sizeof(marker))
+        {
+            reportError(pos, "Truncated buffer marker", fileLen - pos, sizeof(marker));
+            break;
+        }
+        flags = (marker[0] >> 8) & 0xff;
+        if (flags & CT_BUFFER_FLAG_CRC)
+        {
+            ct_read(&crc, sizeof(crc), in);
+            markerLen += CT_BUFFER_CRC_LEN;
+        }
+
+        bool framingOK = true;
+        if ((marker[0] & 0xff) != ct_event_buffer)
+        {
+            reportError(pos, "Expected buffer marker", marker[0] & 0xff, ct_event_buffer);
+            framingOK = false;
+        }
+        else if (marker[2] > MAX_BUFFER_LEN || (pos + markerLen + (long)marker[2]) > fileLen)
+        {
+            reportError(pos, "Buffer length exceeds trace", marker[2], fileLen - pos - markerLen);
+            framingOK = false;
+        }
+
+        if (!framingOK)
+        {
+            // Resynchronize at the next indexed buffer, if there is one
+            auto next = index.upper_bound(pos);
+            if (next == index.end()) break;
+            pos = next->first;
+            fseek(in, pos, SEEK_SET);
+            continue;
+        }
+
+        uint32_t ctid = marker[1];
+        uint32_t len = marker[2];
+        ctid_status& cs = ctidStatus[ctid];
+
+        auto it = index.find(pos);
+        if (it != index.end())
+        {
+            ct_buffer_index_entry& cbie = it->second;
+            indexed.insert(pos);
+            if (cbie.ctid != ctid) reportIndexError(pos, "Index ctid mismatch", cbie.ctid, ctid);
+            else if (cbie.len != len) reportIndexError(pos, "Index length mismatch", cbie.len, len);
+            else
+            {
+                // Buffers for a context are acquired only after its previous buffer is queued
+                if (cs.buffers > 0 && cbie.startTime < cs.lastEndTime)
+                {
+                    reportError(pos, "Context buffer out of order", cbie.startTime, cs.lastEndTime);
+                }
+                cs.lastEndTime = cbie.endTime;
+            }
+        }
+        else if (!index.empty())
+        {
+            reportIndexError(pos, "Buffer missing from index", ctid, len);
+        }
+        cs.buffers++;
+        cs.bytes += len;
+
+        if (flags & CT_BUFFER_FLAG_CRC)
+        {
+            uint32_t c = 0;
+            uint32_t rem = len;
+            while (rem > 0)
+            {
+                size_t r = (rem > READ_CHUNK) ? READ_CHUNK : rem;
+                if (ct_read(data, r, in) != r) break;
+                c = ct_crc32c(c, data, r);
+                rem -= r;
+            }
+            if (c != crc) reportError(pos, "Checksum mismatch", c, crc);
+            crcChecked++;
+        }
+        else
+        {
+            fseek(in, len, SEEK_CUR);
+        }
+
+        pos += markerLen + len;
+    }
+
+    for (auto it = index.begin(), et = index.end(); it != et; ++it)
+    {
+        if (indexed.find(it->first) == indexed.end())
+        {
+            reportIndexError(it->first, "Index has buffer not in trace", it->second.ctid, it->second.len);
+        }
+    }
+
+    uint64_t totalBuffers = 0;
+    for (auto it = ctidStatus.begin(), et = ctidStatus.end(); it != et; ++it)
+    {
+        totalBuffers += it->second.buffers;
+        if (verbose)
+        {
+            printf("CTID: %u\tBuffers: %lu\tBytes: %lu\n", it->first, it->second.buffers, it->second.bytes);
+        }
+    }
+    printf("Contexts: %lu\tBuffers: %lu\tChecksums: %lu\tErrors: %u\n",
+           ctidStatus.size(), totalBuffers, crcChecked, errorCount);
+
+    free(data);
+    fclose(in);
+
+    if (errorCount == 0) return 0;
+    return (errorCount == indexErrorCount) ? 2 : 1;
+}
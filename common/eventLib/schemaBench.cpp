@@ -0,0 +1,104 @@
+#include "ct_event.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+using namespace std;
+using namespace contech;
+
+//
+// schemaBench [events]
+//   Decodes the fixed size events of CT_EVENT_SCHEMA_TABLE from a buffer of
+//   random bytes, once stepping through the schema widths and once with the
+//   decoders generated for each layout, and checks that they agree.  The
+//   events are mixed, as they are in a trace, so the decoder for each one is
+//   looked up from its id.
+//
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+typedef struct _bench_layout
+{
+    uint8_t id;
+    uint8_t numFields;
+    uint8_t size;
+    uint8_t width[CT_SCHEMA_MAX_FIELDS];
+    ct_schema_decoder decode;
+} bench_layout;
+
+int main(int argc, char** argv)
+{
+    uint64_t count = (argc > 1) ? strtoull(argv[1], NULL, 10) : 16 * 1024 * 1024;
+    vector<bench_layout> layouts;
+    vector<uint8_t> order;
+    vector<uint8_t> data;
+    uint64_t seed = 0x2545F4914F6CDD1DULL;
+
+    if (count == 0)
+    {
+        fprintf(stderr, "%s [events]\n", argv[0]);
+        return 1;
+    }
+
+    #define CT_SCHEMA_ENTRY(ev, fmt) \
+    { \
+        bench_layout bl; \
+        memset(&bl, 0, sizeof(bl)); \
+        bl.id = ev; \
+        for (const char* f = fmt; *f != '\0'; f++) \
+        { \
+            bl.width[bl.numFields++] = ct_schema_width(*f); \
+            bl.size += ct_schema_width(*f); \
+        } \
+        bl.decode = EventLib::getSchemaDecoder(ev, bl.width, bl.numFields); \
+        layouts.push_back(bl); \
+    }
+    CT_EVENT_SCHEMA_TABLE(CT_SCHEMA_ENTRY)
+    #undef CT_SCHEMA_ENTRY
+
+    for (uint64_t i = 0; i < count; i++)
+    {
+        seed ^= seed << 13; seed ^= seed >> 7; seed ^= seed << 17;
+        uint8_t l = seed % layouts.size();
+        order.push_back(l);
+        for (unsigned int b = 0; b < layouts[l].size; b++)
+        {
+            data.push_back((uint8_t)(seed >> (b % 8) * 8) ^ b);
+        }
+    }
+
+    uint64_t fields[CT_SCHEMA_MAX_FIELDS];
+    uint64_t refHash = 0, hash = 0;
+
+    double t0 = now();
+    const uint8_t* p = data.data();
+    for (uint64_t i = 0; i < count; i++)
+    {
+        bench_layout& bl = layouts[order[i]];
+        EventLib::decodeSchemaFields(bl.width, bl.numFields, p, fields);
+        for (unsigned int f = 0; f < bl.numFields; f++) refHash = refHash * 31 + fields[f];
+        p += bl.size;
+    }
+    double t1 = now();
+
+    p = data.data();
+    for (uint64_t i = 0; i < count; i++)
+    {
+        bench_layout& bl = layouts[order[i]];
+        bl.decode(p, fields);
+        for (unsigned int f = 0; f < bl.numFields; f++) hash = hash * 31 + fields[f];
+        p += bl.size;
+    }
+    double t2 = now();
+
+    printf("Events: %lu\tBytes: %lu\n", count, data.size());
+    printf("interpreted %.2f ns/event\n", (t1 - t0) * 1e9 / count);
+    printf("generated   %.2f ns/event%s\n", (t2 - t1) * 1e9 / count, (hash == refHash) ? "" : "\tDIFFERS");
+
+    return (hash == refHash) ? 0 : 1;
+}
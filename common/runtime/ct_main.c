@@ -4,6 +4,7 @@
 #endif
 #include "ct_runtime.h"
 #include "rdtsc.h"
+#include "../eventLib/ct_crc32c.h"
 #include <stdlib.h>
 #include <pthread.h>
 #include <errno.h>
@@ -197,10 +198,77 @@ int main(int argc, char** argv)
 
 static size_t totalWritten = 0;
 static unsigned int maxBuffersAlloc = 0;
+
+//
+// The schema event lists the field widths of each fixed size event, so
+//   that EventLib does not need to know this runtime's layouts.
+//   type, count, then for each: id (1), number of fields (1), widths (1 each)
+//
+static size_t __ctWriteSchemaEvent(FILE* serialFile)
+{
+    typedef struct { uint8_t id; const char* fmt; } schema_entry;
+    #define CT_SCHEMA_ENTRY(ev, fmt) {ev, fmt},
+    static const schema_entry schema[] = { CT_EVENT_SCHEMA_TABLE(CT_SCHEMA_ENTRY) };
+    #undef CT_SCHEMA_ENTRY
+    unsigned int ty = ct_event_schema;
+    unsigned int count = sizeof(schema) / sizeof(schema_entry);
+    size_t written = 0;
+    
+    written += fwrite(&ty, sizeof(unsigned int), 1, serialFile) * sizeof(unsigned int);
+    written += fwrite(&count, sizeof(unsigned int), 1, serialFile) * sizeof(unsigned int);
+    for (unsigned int i = 0; i < count; i++)
+    {
+        uint8_t entry[2 + CT_SCHEMA_MAX_FIELDS];
+        size_t len = strlen(schema[i].fmt);
+        
+        entry[0] = schema[i].id;
+        entry[1] = len;
+        for (size_t j = 0; j < len; j++)
+        {
+            entry[2 + j] = ct_schema_width(schema[i].fmt[j]);
+        }
+        written += fwrite(entry, sizeof(uint8_t), 2 + len, serialFile);
+    }
+    
+    return written;
+}
+
+//
+// The buffer index is a sidecar to the trace, so that consumers can seek to
+//   a context or a time window without scanning every buffer.  Failure to
+//   open it is not fatal, the trace is still complete without it.
+//
+static FILE* __ctOpenBufferIndex(const char* fname)
+{
+    FILE* indexFile;
+    unsigned int version = CONTECH_EVENT_VERSION;
+    size_t len = strlen(fname);
+    char* iname = malloc(len + sizeof(CT_BUFFER_INDEX_SUFFIX));
+    
+    if (iname == NULL) return NULL;
+    memcpy(iname, fname, len);
+    memcpy(iname + len, CT_BUFFER_INDEX_SUFFIX, sizeof(CT_BUFFER_INDEX_SUFFIX));
+    
+    indexFile = fopen(iname, "wb");
+    if (indexFile == NULL)
+    {
+        fprintf(stderr, "Failure to open buffer index %s, continuing without it\n", iname);
+    }
+    else
+    {
+        fwrite(&version, sizeof(unsigned int), 1, indexFile);
+    }
+    free(iname);
+    
+    return indexFile;
+}
+
 void* __ctBackgroundThreadWriter(void* d)
 {
     FILE* serialFile;
+    FILE* indexFile = NULL;
     char* fname = getenv("CONTECH_FE_FILE");
+    bool writeCRC = (getenv("CONTECH_FE_CRC") != NULL);
     unsigned int wpos = 0;
     unsigned int memLimitBufCount = 0;
     pct_serial_buffer memLimitQueue = NULL;
@@ -220,16 +288,19 @@ void* __ctBackgroundThreadWriter(void* d)
             fnameMPI[15] = '.';
             snprintf(fnameMPI + 16, 5, "%d", mpiRank);
             serialFile = fopen(fnameMPI, "wb");
+            indexFile = __ctOpenBufferIndex(fnameMPI);
             free(fnameMPI);
         }
         else
         {
             serialFile = fopen("/tmp/contech_fe", "wb");
+            indexFile = __ctOpenBufferIndex("/tmp/contech_fe");
         }
     }
     else
     {
         serialFile = fopen(fname, "wb");
+        indexFile = __ctOpenBufferIndex(fname);
     }
 
     if (serialFile == NULL)
@@ -242,16 +313,21 @@ void* __ctBackgroundThreadWriter(void* d)
     
     {
         unsigned int id = 0;
-        ct_event_id ty = ct_event_version;
+        unsigned int ty = ct_event_version;
         unsigned int version = CONTECH_EVENT_VERSION;
         uint8_t* bb_info = _binary_contech_bin_start;
         
+        #ifdef CT_DELTA_ADDR
+        ty |= (CT_VERSION_FLAG_DELTA_ADDR << 8);
+        #endif
         fwrite(&id, sizeof(unsigned int), 1, serialFile); 
         fwrite(&ty, sizeof(unsigned int), 1, serialFile);
         fwrite(&version, sizeof(unsigned int), 1, serialFile);
         fwrite(bb_info, sizeof(unsigned int), 1, serialFile);
         totalWritten += 4 * sizeof(unsigned int);
         
+        totalWritten += __ctWriteSchemaEvent(serialFile);
+        
         {
             size_t tl, wl;
             unsigned int buf[2];
@@ -282,6 +358,7 @@ void* __ctBackgroundThreadWriter(void* d)
     }
     
     __ctWriteElideGVEvents(serialFile);
+    totalWritten += __ctGVEventBytes;
     
     // Main loop
     //   Write queued buffer to disk until program terminates
@@ -330,21 +407,39 @@ void* __ctBackgroundThreadWriter(void* d)
             
             // First craft the marker event that indicates a new buffer in the event list
             //   This event tells eventLib which contech created the next set of bytes
+            //   With CONTECH_FE_CRC set, the marker is followed by a CRC32C of the data
             {
-                unsigned int buf[3];
+                unsigned int buf[4];
+                unsigned int markerLen = 3;
                 buf[0] = ct_event_buffer;
                 buf[1] = __ctQueuedBuffers->id;
                 buf[2] = __ctQueuedBuffers->basePos;
+                if (writeCRC)
+                {
+                    buf[0] |= (CT_BUFFER_FLAG_CRC << 8);
+                    buf[3] = ct_crc32c(0, __ctQueuedBuffers->data, __ctQueuedBuffers->pos);
+                    markerLen = 4;
+                }
                 //fprintf(stderr, "%d, %llx, %d\n", __ctQueuedBuffers->id, totalWritten, __ctQueuedBuffers->pos);
                 do
                 {
-                    wl = fwrite(&buf + tl, sizeof(unsigned int), 3 - tl, serialFile);
+                    wl = fwrite(buf + tl, sizeof(unsigned int), markerLen - tl, serialFile);
                     //if (wl > 0)
                     // wl is 0 on error, so it is safe to still add
                     tl += wl;
-                } while  (tl < 3);
-
-                totalWritten += 3 * sizeof(unsigned int);
+                } while  (tl < markerLen);
+                
+                if (indexFile != NULL)
+                {
+                    ct_buffer_index_entry cbie;
+                    cbie.offset = totalWritten;
+                    cbie.ctid = __ctQueuedBuffers->id;
+                    cbie.len = __ctQueuedBuffers->basePos;
+                    cbie.startTime = __ctQueuedBuffers->startTime;
+                    cbie.endTime = __ctQueuedBuffers->endTime;
+                    fwrite(&cbie, sizeof(ct_buffer_index_entry), 1, indexFile);
+                }
+                totalWritten += markerLen * sizeof(unsigned int);
             }
             
             // TODO: fully integrate into debug framework
@@ -513,6 +608,7 @@ void* __ctBackgroundThreadWriter(void* d)
             
             fflush(serialFile);
             fclose(serialFile);
+            if (indexFile != NULL) fclose(indexFile);
             
             pthread_mutex_unlock(&__ctQueueBufferLock);
             pthread_exit(NULL);            
@@ -38,7 +38,7 @@
 // it stores events into this buffer.  The buffer may be assigned to multiple threads,
 // which is fine as the events are outside the bounds of create / join.
 //
-ct_serial_buffer_sized initBuffer = {0, SERIAL_BUFFER_SIZE, 0, NULL, {0}};
+ct_serial_buffer_sized initBuffer = {0, SERIAL_BUFFER_SIZE, 0, NULL, 0, 0, {0}};
 
 __thread pct_serial_buffer __ctThreadLocalBuffer = (pct_serial_buffer)&initBuffer;
 __thread pct_serial_buffer __ctThreadMicroBuffer = NULL;
@@ -49,6 +49,14 @@ __thread pcontech_id_stack __ctThreadIdStack = NULL;
 __thread pcontech_join_stack __ctJoinStack = NULL;
 __thread pcontech_cilk_sync __ctCilkLastFrame = NULL;
 
+#ifdef CT_DELTA_ADDR
+// Previous address per slot, the slot base for the current basic block,
+//   and the position of the next memory op in the current basic block
+__thread uint64_t __ctDeltaAddr[CT_DELTA_SLOTS];
+__thread unsigned int __ctDeltaBlock = 0;
+__thread char* __ctDeltaCursor = NULL;
+#endif
+
 #ifdef CT_OVERHEAD_TRACK
  ct_tsc_t __ctTotalThreadOverhead = 0;
  ct_tsc_t __ctTotalThreadQueue = 0;
@@ -162,6 +170,11 @@ void __ctAllocateLocalBuffer()
 
     __ctThreadLocalBuffer->next = NULL;
     __ctThreadLocalBuffer->id = __ctThreadLocalNumber;
+    __ctThreadLocalBuffer->startTime = rdtsc();
+    #ifdef CT_DELTA_ADDR
+    // Every buffer starts with no prior addresses
+    memset(__ctDeltaAddr, 0, sizeof(__ctDeltaAddr));
+    #endif
     #ifdef DEBUG
     pthread_mutex_lock(&__ctPrintLock);
     fprintf(stderr, "a,%p,%d\n", __ctThreadLocalBuffer, __ctThreadLocalNumber);
@@ -455,6 +468,7 @@ void __ctQueueBuffer(bool alloc)
                 __ctThreadLocalBuffer->length = allocSize;
                 __ctThreadLocalBuffer->next = NULL;
                 __ctThreadLocalBuffer->id = __ctThreadLocalNumber;
+                __ctThreadLocalBuffer->startTime = localBuffer->startTime;
                 
                 memcpy(__ctThreadLocalBuffer->data, localBuffer->data, allocSize);
             }
@@ -491,6 +505,7 @@ void __ctQueueBuffer(bool alloc)
 #endif
 
     __ctThreadLocalBuffer->basePos = __ctThreadLocalBuffer->pos;
+    __ctThreadLocalBuffer->endTime = rdtsc();
     // Locally queue the micro buffer ahead of the local buffer
     if (__ctThreadMicroBuffer != NULL)
     {
@@ -540,7 +555,11 @@ microbuf_exit:
     if (localBuffer != NULL)
     {
         localBuffer->pos = 0;
+        localBuffer->startTime = rdtsc();
         __ctThreadLocalBuffer = localBuffer;
+        #ifdef CT_DELTA_ADDR
+        memset(__ctDeltaAddr, 0, sizeof(__ctDeltaAddr));
+        #endif
     }
     //
     // If we need to allocate a new buffer do so now
@@ -659,6 +678,9 @@ __attribute__((always_inline)) char* __ctStoreBasicBlock(unsigned int bbid, unsi
     char* r = &t->data[p];
     
     __ctCheckBufferSizeDebug(bbid);
+    #ifdef CT_DELTA_ADDR
+    __ctDeltaBlock = bbid;
+    #endif
     
     if (!elide)
     {
@@ -685,6 +707,15 @@ __attribute__((always_inline)) unsigned int __ctStoreBasicBlockComplete(unsigned
 {
     unsigned int nPos = 0;
     #ifdef POS_USED
+    #ifdef CT_DELTA_ADDR
+    // Memory ops are variable length, the cursor is after the last one stored
+    if (numMemOps > 0)
+    {
+        nPos = __ctDeltaCursor - t->data;
+    }
+    else
+    #endif
+    {
     // 6 bytes per memory op, unsigned int (-1 byte) for id + event
     nPos = p + numMemOps * 6 * sizeof(char);
     if (elide == 0)
@@ -695,6 +726,7 @@ __attribute__((always_inline)) unsigned int __ctStoreBasicBlockComplete(unsigned
     {
         nPos += 1 * sizeof(char);
     }
+    }
     if (skipStore == 0)
     {
         t->pos = nPos;
@@ -714,10 +746,47 @@ __attribute__((always_inline)) void __ctStoreMemOp(void* addr, unsigned int c, c
     //   bytes with the next write.  Thus we have the 6 bytes of interest in the buffer
     // void __builtin_ia32_movnti64 (di *, di)
     #if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    #ifdef CT_DELTA_ADDR
+    // Memory ops are stored in order, so the first op of the block sets the cursor
+    if (c == 0)
+    {
+        __ctDeltaCursor = r + ((pathInfo == 1) ? 1 : 0);
+    }
+    {
+        uint64_t a = ((uint64_t)addr) & 0xffffffffffffULL;
+        uint64_t* slot = &__ctDeltaAddr[CT_DELTA_SLOT(__ctDeltaBlock, c)];
+        int64_t d = (int64_t)(a - *slot);
+        uint64_t z = (((uint64_t)d) << 1) ^ (uint64_t)(d >> 63);
+        uint64_t v;
+        unsigned int len;
+        
+        *slot = a;
+        if (z < (1ULL << 5)) {len = 1;}
+        else if (z < (1ULL << 13)) {len = 2;}
+        else if (z < (1ULL << 21)) {len = 3;}
+        else if (z < (1ULL << 29)) {len = 4;}
+        else {len = CT_DELTA_ABS_LEN;}
+        
+        if (len == CT_DELTA_ABS_LEN)
+        {
+            // User space addresses are below 2^47
+            v = (a << 1) | 1;
+        }
+        else
+        {
+            v = (z << CT_DELTA_TAG_BITS) | ((len - 1) << 1);
+        }
+        
+        // As with the raw encoding, write 8 bytes and let the next op overwrite the excess
+        *((uint64_t*)__ctDeltaCursor) = v;
+        __ctDeltaCursor += len;
+    }
+    #else
     r += c * 6 * sizeof(char);
     //if (elide == 0) r += 3 * sizeof(char);
     if (pathInfo == 1) r += 1 * sizeof(char);
     *((uint64_t*)r) = (uint64_t)addr;
+    #endif
     #else
         #error "Compiling for big endian machine"
     // TODO:
@@ -766,12 +835,15 @@ void __ctStoreLoopExit(uint32_t id)
     #endif
 }
 
+size_t __ctGVEventBytes = 0;
+
 void __ctStoreGVEvent(FILE* serialFile, void* addr, int id)
 {
     ct_event_id ty = ct_event_gv_info;
     fwrite(&ty, sizeof(ty), 1, serialFile);
     fwrite(&id, sizeof(id), 1, serialFile);
     fwrite(&addr, sizeof(addr), 1, serialFile);
+    __ctGVEventBytes += sizeof(ty) + sizeof(id) + sizeof(addr);
 }
 
 void __ctStoreSync(void* addr, int syncType, int success, ct_tsc_t start_t, uint64_t ordNum)
@@ -10,6 +10,7 @@ typedef struct _ct_serial_buffer
 {
     unsigned int pos, length, id, basePos;
     struct _ct_serial_buffer* next; // can order buffers 
+    ct_tsc_t startTime, endTime;    // for the sidecar buffer index
     //char pad[24];
     char data[0];
 } ct_serial_buffer, *pct_serial_buffer;
@@ -21,6 +22,10 @@ typedef struct _ct_serial_buffer
 //   Thus the final allocation is 1MB
 #define SERIAL_BUFFER_SIZE (1024 * 1024 * 1)
 
+// Delta encode memory op addresses (CT_VERSION_FLAG_DELTA_ADDR in ct_event_st.h)
+//   Shared by ct_runtime.c and ct_main.c, which records the encoding in the trace.
+//   Defined by building the runtime with make DELTA_ADDR=1.
+
 typedef struct _contech_thread_create {
     void* (*func)(void*);
     void* arg;
@@ -107,6 +112,9 @@ void __ctStoreDelay(ct_tsc_t start_t);
 
 // This function is written only by the Contech pass.
 void __ctWriteElideGVEvents(FILE*);
+// Called from it, once per global, adding what it writes to __ctGVEventBytes
+void __ctStoreGVEvent(FILE*, void*, int);
+extern size_t __ctGVEventBytes;
 
 int __ctIsMPIPresent();
 int __ctGetMPIRank();
@@ -123,6 +131,7 @@ typedef struct _ct_serial_buffer_sized
 {
     unsigned int pos, length, id;
     struct _ct_serial_buffer* next; // can order buffers 
+    ct_tsc_t startTime, endTime;
     char data[SERIAL_BUFFER_SIZE];
 } ct_serial_buffer_sized;
 
@@ -0,0 +1,107 @@
+#include "ct_runtime.h"
+#include "rdtsc.h"
+#include "ct_test_prog.h"
+#include <stdlib.h>
+#include <pthread.h>
+
+//
+// ct_test_prog [iterations]
+//   Stands in for a program built by the Contech pass, so that the runtime
+//   can be built with gcc and its traces checked by eventLib's tests.  The
+//   basic block table, the elided global and the events of each block are
+//   what the pass would generate for:
+//
+//     main:   block 0, block 1 x iterations, create thread, block 2, join
+//     thread: block 0, block 1 x iterations, malloc, free, block 2
+//
+//   Block 1 stores three memory ops and has a fourth, a read of global 0,
+//   elided.  The addresses follow ct_test_addr in ct_test_prog.h, so a
+//   reader can regenerate them.  Every 4096th iteration jumps far enough to
+//   need an absolute address in a delta encoded trace.
+//
+
+//
+// The basic block table, as the pass writes it into contech.bin:
+//   uint32 count, then per block the ct_event_basic_block_info event
+//   (type, id, next id, path count, flags, line, ops, critical path, three
+//   name lengths, loop entry, preserved ops, function exit (-1 for none),
+//   memory op count, then per memory op: flags, size and, for elided ops, base op and offset)
+//
+#define CT_BBI(id, presv, memOps) \
+    ".byte 128\n.long " #id ", -1, 0, 0, 0, 1, 1, 0, 0, 0\n.byte 0\n.long " #presv ", -1, " #memOps "\n"
+
+__asm__(".section .rodata\n"
+        ".globl _binary_contech_bin_start\n"
+        "_binary_contech_bin_start:\n"
+        ".long 3\n"
+        CT_BBI(0, 0, 0)
+        CT_BBI(1, -1, 4)
+        ".byte 0, 3\n"              // read, 8 bytes
+        ".byte 1, 2\n"              // write, 4 bytes
+        ".byte 0, 0\n"              // read, 1 byte
+        ".byte 6, 3\n"              // BBI_FLAG_MEM_GV | BBI_FLAG_MEM_DUP, read, 8 bytes
+        ".short 0\n.quad 8\n"       //   global 0 + CT_TEST_GV_OFFSET
+        CT_BBI(2, -1, 0)
+        ".globl _binary_contech_bin_end\n"
+        "_binary_contech_bin_end:\n"
+        ".globl _binary_contech_bin_size\n"
+        ".set _binary_contech_bin_size, _binary_contech_bin_end - _binary_contech_bin_start\n"
+        ".text\n");
+
+// Written by the pass, the addresses of the globals whose ops are elided
+void __ctWriteElideGVEvents(FILE* serialFile)
+{
+    __ctStoreGVEvent(serialFile, (void*)CT_TEST_GV_ADDR, 0);
+}
+
+static unsigned int iterations = CT_TEST_ITERATIONS;
+
+static void storeBlock(unsigned int bbid, unsigned int iter)
+{
+    pct_serial_buffer b = __ctThreadLocalBuffer;
+    unsigned int p = b->pos;
+    unsigned int n = (bbid == 1) ? CT_TEST_STORED_OPS : 0;
+    char* r = __ctStoreBasicBlock(bbid, p, b, 0);
+
+    for (unsigned int i = 0; i < n; i++)
+    {
+        __ctStoreMemOp((void*)ct_test_addr(__ctThreadLocalNumber, iter, i), i, r, 0, 0);
+    }
+    p = __ctStoreBasicBlockComplete(n, p, b, 0, 0, 0);
+    __ctCheckBufferSize(p);
+}
+
+static void runBlocks()
+{
+    storeBlock(0, 0);
+    for (unsigned int i = 0; i < iterations; i++)
+    {
+        storeBlock(1, i);
+    }
+}
+
+static void* child(void* v)
+{
+    runBlocks();
+    __ctStoreMemoryEvent(true, CT_TEST_MALLOC_SIZE, (void*)CT_TEST_MALLOC_ADDR);
+    __ctStoreMemoryEvent(false, 0, (void*)CT_TEST_MALLOC_ADDR);
+    storeBlock(2, 0);
+    return NULL;
+}
+
+int ct_orig_main(int argc, char** argv)
+{
+    pthread_t pt;
+
+    if (argc > 1) iterations = atoi(argv[1]);
+
+    runBlocks();
+    if (__ctThreadCreateActual(&pt, NULL, child, NULL) != 0) return 1;
+    storeBlock(2, 0);
+
+    ct_tsc_t start = rdtsc();
+    pthread_join(pt, NULL);
+    __ctStoreThreadJoin(pt, start);
+
+    return 0;
+}
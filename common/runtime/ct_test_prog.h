@@ -0,0 +1,30 @@
+#ifndef CT_TEST_PROG_H
+#define CT_TEST_PROG_H
+
+#include <stdint.h>
+
+//
+// What ct_test_prog records, shared with the tests that read its traces
+//
+
+#define CT_TEST_ITERATIONS 100000
+#define CT_TEST_STORED_OPS 3
+#define CT_TEST_GV_ADDR 0x601040ULL
+#define CT_TEST_GV_OFFSET 8
+#define CT_TEST_MALLOC_ADDR 0x7f0000001000ULL
+#define CT_TEST_MALLOC_SIZE 4096
+
+// Address of stored memory op op, in iteration i of context ctid
+static inline uint64_t ct_test_addr(unsigned int ctid, unsigned int i, unsigned int op)
+{
+    uint64_t base = 0x10000000ULL + ((uint64_t)ctid << 32) + ((uint64_t)(i / 4096) << 40);
+
+    switch (op)
+    {
+        case 0: return base + (i % 4096) * 8;
+        case 1: return base + 0x800000 + (i % 4096) * 4;
+        default: return base + 0x1000000 - (i % 4096);
+    }
+}
+
+#endif
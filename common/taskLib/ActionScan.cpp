@@ -0,0 +1,324 @@
+#include "ActionScan.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define CT_ACTION_SCAN_SIMD 1
+#endif
+
+using namespace std;
+using namespace contech;
+
+//
+// The top 6 bits of an action are its type, then the pow_size of a memory
+//   action.  A selection is a 64 bit table with a bit per (type, size), so
+//   each kernel tests an action with one shift of the table by those bits.
+//
+#define ACTION_KEY_SHIFT 58
+
+static uint64_t selectionTable(uint32_t typeMask, uint32_t sizeMask)
+{
+    uint64_t table = 0;
+    for (unsigned int t = 0; t < 8; t++)
+    {
+        if ((typeMask & (1U << t)) == 0) continue;
+        table |= (uint64_t)(sizeMask & 0xff) << (t * 8);
+    }
+    return table;
+}
+
+static inline uint64_t actionKey(uint64_t d) { return d >> ACTION_KEY_SHIFT; }
+
+//
+// Scalar kernels, also used for the tail of the vector kernels
+//   Each candidate is written, then kept by advancing past it, so there is
+//   no branch on the match.
+//
+
+static size_t indicesScalar(const uint64_t* d, size_t n, size_t base, uint64_t table, uint32_t* out)
+{
+    size_t c = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        out[c] = (uint32_t)(base + i);
+        c += (table >> actionKey(d[i])) & 1;
+    }
+    return c;
+}
+
+static size_t selectScalar(const uint64_t* d, size_t n, uint64_t table, uint64_t* out)
+{
+    size_t c = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        out[c] = d[i];
+        c += (table >> actionKey(d[i])) & 1;
+    }
+    return c;
+}
+
+static uint64_t bytesScalar(const uint64_t* d, size_t n, uint64_t table)
+{
+    uint64_t b = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        uint64_t k = actionKey(d[i]);
+        b += ((table >> k) & 1) << (k & 7);
+    }
+    return b;
+}
+
+#ifdef CT_ACTION_SCAN_SIMD
+
+//
+// AVX2, 4 actions at a time
+//   Without a compressing store, the matching lanes are moved to the front
+//   by a table of lane orders for each of the 16 masks, then all 4 lanes are
+//   stored.  Those past the matches are overwritten by the next store.
+//
+static uint32_t compactIndex[16][4];
+static uint32_t compactAction[16][8];
+
+static void initCompactTables()
+{
+    for (unsigned int m = 0; m < 16; m++)
+    {
+        unsigned int c = 0;
+        memset(compactIndex[m], 0, sizeof(compactIndex[m]));
+        memset(compactAction[m], 0, sizeof(compactAction[m]));
+        for (unsigned int j = 0; j < 4; j++)
+        {
+            if ((m & (1U << j)) == 0) continue;
+            compactIndex[m][c] = j;
+            compactAction[m][2 * c] = 2 * j;
+            compactAction[m][2 * c + 1] = 2 * j + 1;
+            c++;
+        }
+    }
+}
+
+__attribute__((target("avx2")))
+static inline unsigned int matchAVX2(__m256i v, __m256i table, __m256i one)
+{
+    __m256i m = _mm256_and_si256(_mm256_srlv_epi64(table, _mm256_srli_epi64(v, ACTION_KEY_SHIFT)), one);
+    m = _mm256_cmpeq_epi64(m, one);
+    return _mm256_movemask_pd(_mm256_castsi256_pd(m));
+}
+
+__attribute__((target("avx2")))
+static size_t indicesAVX2(const uint64_t* d, size_t n, uint64_t t, uint32_t* out)
+{
+    __m256i table = _mm256_set1_epi64x(t);
+    __m256i one = _mm256_set1_epi64x(1);
+    size_t c = 0, i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        unsigned int m = matchAVX2(_mm256_loadu_si256((const __m256i*)(d + i)), table, one);
+        __m128i idx = _mm_add_epi32(_mm_set1_epi32((int)i), _mm_loadu_si128((const __m128i*)compactIndex[m]));
+        _mm_storeu_si128((__m128i*)(out + c), idx);
+        c += __builtin_popcount(m);
+    }
+    return c + indicesScalar(d + i, n - i, i, t, out + c);
+}
+
+__attribute__((target("avx2")))
+static size_t selectAVX2(const uint64_t* d, size_t n, uint64_t t, uint64_t* out)
+{
+    __m256i table = _mm256_set1_epi64x(t);
+    __m256i one = _mm256_set1_epi64x(1);
+    size_t c = 0, i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(d + i));
+        unsigned int m = matchAVX2(v, table, one);
+        __m256i perm = _mm256_loadu_si256((const __m256i*)compactAction[m]);
+        _mm256_storeu_si256((__m256i*)(out + c), _mm256_permutevar8x32_epi32(v, perm));
+        c += __builtin_popcount(m);
+    }
+    return c + selectScalar(d + i, n - i, t, out + c);
+}
+
+__attribute__((target("avx2")))
+static uint64_t bytesAVX2(const uint64_t* d, size_t n, uint64_t t)
+{
+    __m256i table = _mm256_set1_epi64x(t);
+    __m256i one = _mm256_set1_epi64x(1);
+    __m256i seven = _mm256_set1_epi64x(7);
+    __m256i sum = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        __m256i k = _mm256_srli_epi64(_mm256_loadu_si256((const __m256i*)(d + i)), ACTION_KEY_SHIFT);
+        __m256i m = _mm256_and_si256(_mm256_srlv_epi64(table, k), one);
+        sum = _mm256_add_epi64(sum, _mm256_sllv_epi64(m, _mm256_and_si256(k, seven)));
+    }
+    uint64_t lanes[4];
+    _mm256_storeu_si256((__m256i*)lanes, sum);
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3] + bytesScalar(d + i, n - i, t);
+}
+
+//
+// AVX-512, 8 actions at a time, selecting with a compressing store
+//   GCC's intrinsics leave the unused source of the shifts undefined, which
+//   it then warns about.
+//
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+
+// Indices are 32 bits, so two masks of 8 actions compress 16 at a time
+__attribute__((target("avx512f")))
+static size_t indicesAVX512(const uint64_t* d, size_t n, uint64_t t, uint32_t* out)
+{
+    __m512i table = _mm512_set1_epi64(t);
+    __m512i one = _mm512_set1_epi64(1);
+    __m512i lanes = _mm512_set_epi32(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+    size_t c = 0, i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        __m512i k0 = _mm512_srli_epi64(_mm512_loadu_si512(d + i), ACTION_KEY_SHIFT);
+        __m512i k1 = _mm512_srli_epi64(_mm512_loadu_si512(d + i + 8), ACTION_KEY_SHIFT);
+        unsigned int m = _mm512_test_epi64_mask(_mm512_srlv_epi64(table, k0), one) |
+                         (_mm512_test_epi64_mask(_mm512_srlv_epi64(table, k1), one) << 8);
+        __m512i idx = _mm512_add_epi32(_mm512_set1_epi32((int)i), lanes);
+        _mm512_mask_compressstoreu_epi32(out + c, (__mmask16)m, idx);
+        c += __builtin_popcount(m);
+    }
+    return c + indicesScalar(d + i, n - i, i, t, out + c);
+}
+
+__attribute__((target("avx512f")))
+static size_t selectAVX512(const uint64_t* d, size_t n, uint64_t t, uint64_t* out)
+{
+    __m512i table = _mm512_set1_epi64(t);
+    __m512i one = _mm512_set1_epi64(1);
+    size_t c = 0, i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m512i v = _mm512_loadu_si512(d + i);
+        __m512i k = _mm512_srli_epi64(v, ACTION_KEY_SHIFT);
+        __mmask8 m = _mm512_test_epi64_mask(_mm512_srlv_epi64(table, k), one);
+        _mm512_mask_compressstoreu_epi64(out + c, m, v);
+        c += __builtin_popcount(m);
+    }
+    return c + selectScalar(d + i, n - i, t, out + c);
+}
+
+__attribute__((target("avx512f")))
+static uint64_t bytesAVX512(const uint64_t* d, size_t n, uint64_t t)
+{
+    __m512i table = _mm512_set1_epi64(t);
+    __m512i one = _mm512_set1_epi64(1);
+    __m512i seven = _mm512_set1_epi64(7);
+    __m512i sum = _mm512_setzero_si512();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m512i k = _mm512_srli_epi64(_mm512_loadu_si512(d + i), ACTION_KEY_SHIFT);
+        __m512i m = _mm512_and_si512(_mm512_srlv_epi64(table, k), one);
+        sum = _mm512_add_epi64(sum, _mm512_sllv_epi64(m, _mm512_and_si512(k, seven)));
+    }
+    return _mm512_reduce_add_epi64(sum) + bytesScalar(d + i, n - i, t);
+}
+#pragma GCC diagnostic pop
+
+#endif
+
+static bool kernelSupported(action_scan_kernel k)
+{
+#ifdef CT_ACTION_SCAN_SIMD
+    __builtin_cpu_init();
+    if (k == action_scan_avx512) return __builtin_cpu_supports("avx512f");
+    if (k == action_scan_avx2) return __builtin_cpu_supports("avx2");
+#endif
+    return k == action_scan_scalar;
+}
+
+static action_scan_kernel pickKernel()
+{
+#ifdef CT_ACTION_SCAN_SIMD
+    initCompactTables();
+#endif
+    const char* e = getenv("CONTECH_TASKGRAPH_ACTION_SCAN");
+    if (e != NULL)
+    {
+        for (int k = action_scan_avx512; k >= action_scan_scalar; k--)
+        {
+            if (strcmp(e, ActionScan::getKernelName((action_scan_kernel)k)) != 0) continue;
+            if (kernelSupported((action_scan_kernel)k)) return (action_scan_kernel)k;
+            fprintf(stderr, "CONTECH_TASKGRAPH_ACTION_SCAN: %s is not supported, using the default\n", e);
+            break;
+        }
+    }
+
+    if (kernelSupported(action_scan_avx512)) return action_scan_avx512;
+    if (kernelSupported(action_scan_avx2)) return action_scan_avx2;
+    return action_scan_scalar;
+}
+
+static action_scan_kernel scanKernel = pickKernel();
+
+action_scan_kernel ActionScan::getKernel() { return scanKernel; }
+
+void ActionScan::setKernel(action_scan_kernel k)
+{
+    scanKernel = kernelSupported(k) ? k : action_scan_scalar;
+}
+
+const char* ActionScan::getKernelName(action_scan_kernel k)
+{
+    switch (k)
+    {
+        case action_scan_avx2: return "avx2";
+        case action_scan_avx512: return "avx512";
+        default: return "scalar";
+    }
+}
+
+static size_t scanIndices(const Action* a, size_t n, uint64_t table, uint32_t* out)
+{
+    const uint64_t* d = (const uint64_t*)a;
+#ifdef CT_ACTION_SCAN_SIMD
+    if (scanKernel == action_scan_avx512) return indicesAVX512(d, n, table, out);
+    if (scanKernel == action_scan_avx2) return indicesAVX2(d, n, table, out);
+#endif
+    return indicesScalar(d, n, 0, table, out);
+}
+
+static size_t scanSelect(const Action* a, size_t n, uint64_t table, uint64_t* out)
+{
+    const uint64_t* d = (const uint64_t*)a;
+#ifdef CT_ACTION_SCAN_SIMD
+    if (scanKernel == action_scan_avx512) return selectAVX512(d, n, table, out);
+    if (scanKernel == action_scan_avx2) return selectAVX2(d, n, table, out);
+#endif
+    return selectScalar(d, n, table, out);
+}
+
+size_t ActionScan::findBasicBlocks(const Action* a, size_t n, uint32_t* out)
+{
+    return scanIndices(a, n, selectionTable(ACTION_TYPE_BIT(action_type_basicBlock), 0xff), out);
+}
+
+size_t ActionScan::selectActions(const Action* a, size_t n, uint32_t typeMask, uint32_t sizeMask, Action* out)
+{
+    return scanSelect(a, n, selectionTable(typeMask, sizeMask), (uint64_t*)out);
+}
+
+size_t ActionScan::selectMemOps(const Action* a, size_t n, MemoryAction* out, uint32_t sizeMask)
+{
+    return scanSelect(a, n, selectionTable(ACTION_TYPE_MEMOP, sizeMask), (uint64_t*)out);
+}
+
+uint64_t ActionScan::sumMemOpBytes(const Action* a, size_t n)
+{
+    const uint64_t* d = (const uint64_t*)a;
+    uint64_t table = selectionTable(ACTION_TYPE_MEMOP, 0xff);
+#ifdef CT_ACTION_SCAN_SIMD
+    if (scanKernel == action_scan_avx512) return bytesAVX512(d, n, table);
+    if (scanKernel == action_scan_avx2) return bytesAVX2(d, n, table);
+#endif
+    return bytesScalar(d, n, table);
+}
@@ -0,0 +1,51 @@
+#ifndef ACTION_SCAN_HPP
+#define ACTION_SCAN_HPP
+
+#include "Action.hpp"
+#include <stddef.h>
+
+namespace contech {
+
+// A bit per action_type for ActionScan's type masks
+#define ACTION_TYPE_BIT(t) (1U << (t))
+#define ACTION_TYPE_MEMOP (ACTION_TYPE_BIT(action_type_mem_read) | ACTION_TYPE_BIT(action_type_mem_write))
+
+enum action_scan_kernel { action_scan_scalar = 0, action_scan_avx2, action_scan_avx512 };
+
+//
+// Bulk scans of an action array, for backends that want dense arrays in
+//   place of stepping the collection iterators over every action
+//
+//   The block boundaries are the indices of the basic block actions, so the
+//   memory actions of block k are those between boundaries k and k + 1, or
+//   the end.  The kernels test 4 (AVX2) or 8 (AVX-512) actions at a time and
+//   are picked when first used, by what the processor supports.
+//   CONTECH_TASKGRAPH_ACTION_SCAN=scalar|avx2|avx512 picks one instead, when
+//   it is supported.
+//
+class ActionScan
+{
+public:
+    // Each call writes to out and returns how many it wrote.  out must have
+    //   room for n, which the kernels use as scratch past the returned count.
+
+    // The index of every basic block action in a[0, n)
+    static size_t findBasicBlocks(const Action* a, size_t n, uint32_t* out);
+
+    // The actions of a[0, n), in order, with a type in typeMask and, for a
+    //   size in sizeMask, a bit per pow_size.  The size of a basic block
+    //   action is not defined, so leave sizeMask at 0xff to select them.
+    static size_t selectActions(const Action* a, size_t n, uint32_t typeMask, uint32_t sizeMask, Action* out);
+    static size_t selectMemOps(const Action* a, size_t n, MemoryAction* out, uint32_t sizeMask = 0xff);
+
+    // Bytes read and written by the memory operations in a[0, n)
+    static uint64_t sumMemOpBytes(const Action* a, size_t n);
+
+    static action_scan_kernel getKernel();
+    static void setKernel(action_scan_kernel k);
+    static const char* getKernelName(action_scan_kernel k);
+};
+
+}
+
+#endif
@@ -1,39 +1,211 @@
 #include "Backend.hpp"
 #include "TaskGraph.hpp"
+#include "TaskPrefetch.hpp"
+#include <deque>
+#include <memory>
 
+using namespace std;
 using namespace contech;
 
+#define BACKEND_DEFAULT_LOOKAHEAD 256
+
 void Backend::initBackend(TaskGraphInfo*) {}
 
-SimpleBackendWrapper::SimpleBackendWrapper(char* f, Backend* b) : backend(b)
+SimpleBackendWrapper::SimpleBackendWrapper(char* f, Backend* b)
 {
+    backends.push_back(b);
     tg = TaskGraph::initFromFile(f);
     assert(tg != NULL);
+    
+    threads = 0;
+    lookahead = BACKEND_DEFAULT_LOOKAHEAD;
+    if (getenv("CONTECH_BACKEND_THREADS") != NULL)
+    {
+        threads = atoi(getenv("CONTECH_BACKEND_THREADS"));
+    }
+    if (getenv("CONTECH_BACKEND_LOOKAHEAD") != NULL && atoi(getenv("CONTECH_BACKEND_LOOKAHEAD")) > 0)
+    {
+        lookahead = atoi(getenv("CONTECH_BACKEND_LOOKAHEAD"));
+    }
+    if (getenv("CONTECH_BACKEND_ROI") != NULL && atoi(getenv("CONTECH_BACKEND_ROI")) > 0)
+    {
+        TaskFilter roi;
+        roi.roiOnly = true;
+        tg->setTaskFilter(roi);
+    }
+}
+
+void SimpleBackendWrapper::addBackend(Backend* b)
+{
+    backends.push_back(b);
+}
+
+void SimpleBackendWrapper::setThreads(unsigned int t, unsigned int l)
+{
+    threads = t;
+    if (l > 0) lookahead = l;
 }
 
 void SimpleBackendWrapper::runBackend()
 {
     Task* t = NULL;
     
+    if (threads > 0)
+    {
+        runParallel();
+        return;
+    }
+    
     while ((t = tg->getNextTask()) != NULL)
     {
-        backend->updateBackend(t);
+        for (Backend* b : backends) b->updateBackend(t);
         delete t;
     }
 }
 
+//
+// A backend updated on its own thread
+//   Shards take the contexts whose id is their index modulo the shard count,
+//   so a context's tasks stay in order within one shard.  When several
+//   backends share a pass, each gets a lane and every task.
+//
+typedef struct _backend_lane
+{
+    Backend* backend;
+    thread worker;
+    mutex lock;
+    condition_variable cond;
+    deque<shared_ptr<Task> > queue;
+    bool done;
+} backend_lane;
+
+static void runLane(backend_lane* s, unsigned int lookahead)
+{
+    unique_lock<mutex> l(s->lock);
+    
+    while (1)
+    {
+        while (!s->done && s->queue.empty())
+        {
+            s->cond.wait(l);
+        }
+        if (s->queue.empty()) break;
+        
+        shared_ptr<Task> t = s->queue.front();
+        s->queue.pop_front();
+        if (s->queue.size() == lookahead - 1) s->cond.notify_all();
+        l.unlock();
+        
+        s->backend->updateBackend(t.get());
+        t.reset();
+        
+        l.lock();
+    }
+}
+
+static backend_lane* startLane(Backend* b, unsigned int lookahead)
+{
+    backend_lane* s = new backend_lane;
+    s->backend = b;
+    s->done = false;
+    s->worker = thread(runLane, s, lookahead);
+    return s;
+}
+
+static void queueLane(backend_lane* s, const shared_ptr<Task>& t, unsigned int lookahead)
+{
+    unique_lock<mutex> l(s->lock);
+    while (s->queue.size() >= lookahead)
+    {
+        s->cond.wait(l);
+    }
+    s->queue.push_back(t);
+    if (s->queue.size() == 1) s->cond.notify_all();
+}
+
+static void finishLane(backend_lane* s)
+{
+    s->lock.lock();
+    s->done = true;
+    s->lock.unlock();
+    s->cond.notify_all();
+    s->worker.join();
+}
+
+void SimpleBackendWrapper::runParallel()
+{
+    vector<backend_lane*> lanes;
+    Task* t = NULL;
+    
+    // The tasks are read by index, so the graph's own read ahead would only
+    //   decode them a second time
+    tg->setPrefetch(0);
+    TaskPrefetch tp(tg, threads, lookahead);
+    
+    if (backends.size() > 1)
+    {
+        for (Backend* b : backends) lanes.push_back(startLane(b, lookahead));
+        
+        while ((t = tp.next()) != NULL)
+        {
+            shared_ptr<Task> st(t);
+            for (backend_lane* s : lanes) queueLane(s, st, lookahead);
+        }
+        
+        for (backend_lane* s : lanes)
+        {
+            finishLane(s);
+            delete s;
+        }
+        return;
+    }
+    
+    Backend* backend = backends[0];
+    for (unsigned int i = 0; i < threads; i++)
+    {
+        Backend* b = backend->createShard();
+        if (b == NULL)
+        {
+            // Not shardable, only the decoding is in parallel
+            assert(i == 0);
+            while ((t = tp.next()) != NULL)
+            {
+                backend->updateBackend(t);
+                delete t;
+            }
+            return;
+        }
+        b->initBackend(tg->getTaskGraphInfo());
+        lanes.push_back(startLane(b, lookahead));
+    }
+    
+    while ((t = tp.next()) != NULL)
+    {
+        queueLane(lanes[(uint32_t)t->getContextId() % lanes.size()], shared_ptr<Task>(t), lookahead);
+    }
+    
+    // Merge in shard order, so the result does not depend on timing
+    for (backend_lane* s : lanes)
+    {
+        finishLane(s);
+        backend->mergeShard(s->backend);
+        delete s->backend;
+        delete s;
+    }
+}
+
 void SimpleBackendWrapper::initBackend()
 {
-    backend->initBackend(tg->getTaskGraphInfo());
+    for (Backend* b : backends) b->initBackend(tg->getTaskGraphInfo());
 }
 
 void SimpleBackendWrapper::completeRun(FILE* f)
 {
-    backend->completeBackend(f, tg->getTaskGraphInfo());
+    for (Backend* b : backends) b->completeBackend(f, tg->getTaskGraphInfo());
     fflush(f);
 }
 
 SimpleBackendWrapper::~SimpleBackendWrapper()
 {
     delete tg;
-}
\ No newline at end of file
+}
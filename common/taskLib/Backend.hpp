@@ -13,20 +13,51 @@ public:
     virtual void resetBackend() = 0;
     virtual void updateBackend(contech::Task*) = 0;
     virtual void completeBackend(FILE*, contech::TaskGraphInfo*) = 0;
+    
+    // Backends whose state is separate per context may be updated in parallel
+    //   createShard returns a new, empty backend of the same kind, or NULL if
+    //   every task must be seen in order.  A shard receives every task of its
+    //   contexts, in index order, and is merged into this backend at the end.
+    virtual Backend* createShard() { return NULL; }
+    virtual void mergeShard(Backend*) {}
+    virtual ~Backend() {}
 };
 
+//
+// Runs backends over every task of a taskgraph
+//
+//   Every backend added sees each task from one decoded pass, in order, so
+//   e.g. a sweep of cache sizes reads the graph once.
+//   CONTECH_BACKEND_THREADS=<n> decodes tasks on n threads, at most
+//   CONTECH_BACKEND_LOOKAHEAD tasks ahead, which also bounds the tasks held
+//   for the backends.  Several backends are then updated on a thread each.
+//   A single shardable backend is updated on n shards, others still see
+//   every task in order.  CONTECH_BACKEND_ROI=1 runs the backends over the
+//   region of interest only.
+//
 class SimpleBackendWrapper
 {
 private:
     TaskGraph* tg;
-    Backend* backend;
+    vector<Backend*> backends;
+    unsigned int threads;
+    unsigned int lookahead;
+    
+    void runParallel();
 
 public:
     SimpleBackendWrapper(char*, contech::Backend*);
     ~SimpleBackendWrapper();
+    void addBackend(contech::Backend*);
     void runBackend();
     void initBackend();
     void completeRun(FILE*);
+    
+    // 0 threads runs the backend serially
+    void setThreads(unsigned int t, unsigned int lookahead);
+    
+    // Backends only see the tasks that pass the filter
+    void setTaskFilter(const TaskFilter& tf) { tg->setTaskFilter(tf); }
 };
 
 };
@@ -0,0 +1,180 @@
+#include "Backend.hpp"
+#include "test_graph.hpp"
+#include <stdlib.h>
+#include <unistd.h>
+#include <map>
+
+using namespace contech;
+
+//
+// SimpleBackendWrapper running backends serially, on threads and on shards,
+//   over a graph from test_graph.hpp.  Returns 0 if every test passes.
+//
+
+#define TEST_CONTEXTS 7
+#define TEST_TASKS_PER_CONTEXT 40
+
+static char graphPath[] = "/tmp/Backend_testXXXXXX";
+
+// The tasks a backend saw, kept per context as a per context backend would
+class ContextBackend : public Backend
+{
+public:
+    map<ContextId, vector<TaskId> > tasks;
+    map<ContextId, uint64> blocks;
+    bool shardable;
+    bool initialized;
+    unsigned int shards;
+    unsigned int overlaps;
+
+    ContextBackend(bool s) : shardable(s), initialized(false), shards(0), overlaps(0) {}
+
+    virtual void initBackend(TaskGraphInfo* tgi) { initialized = (tgi != NULL); }
+    virtual void resetBackend() { tasks.clear(); blocks.clear(); }
+
+    virtual void updateBackend(Task* t)
+    {
+        tasks[t->getContextId()].push_back(t->getTaskId());
+        blocks[t->getContextId()] += t->getBBCount();
+    }
+
+    virtual void completeBackend(FILE*, TaskGraphInfo*) {}
+
+    virtual Backend* createShard()
+    {
+        if (!shardable) return NULL;
+        shards++;
+        return new ContextBackend(true);
+    }
+
+    // Each context is on one shard, so the shards have none in common
+    virtual void mergeShard(Backend* b)
+    {
+        ContextBackend* s = (ContextBackend*)b;
+        if (!s->initialized) overlaps++;
+        for (auto& e : s->tasks)
+        {
+            if (tasks.count(e.first) != 0) overlaps++;
+            tasks[e.first] = e.second;
+            blocks[e.first] = s->blocks[e.first];
+        }
+    }
+};
+
+// What a serial pass sees, each context's tasks in index order
+static ContextBackend* expected;
+
+static void run(ContextBackend* b, unsigned int threads, unsigned int lookahead)
+{
+    SimpleBackendWrapper sbw(graphPath, b);
+    sbw.setThreads(threads, lookahead);
+    sbw.initBackend();
+    sbw.runBackend();
+}
+
+static bool sameTasks(const ContextBackend* b)
+{
+    return b->tasks == expected->tasks && b->blocks == expected->blocks;
+}
+
+static void testSerial(const vector<Task*>& graph)
+{
+    expected = new ContextBackend(true);
+    run(expected, 0, 0);
+    CHECK(expected->shards == 0);
+    CHECK(expected->tasks.size() == TEST_CONTEXTS);
+
+    // The graph's order is each context's sequence
+    for (auto& e : expected->tasks)
+    {
+        CHECK(e.second.size() == TEST_TASKS_PER_CONTEXT);
+        for (unsigned int s = 0; s < e.second.size(); s++)
+        {
+            CHECK(e.second[s] == TaskId(e.first, SeqId(s)));
+        }
+    }
+
+    uint64 total = 0;
+    for (auto& e : expected->blocks) total += e.second;
+    uint64 graphTotal = 0;
+    for (Task* t : graph) graphTotal += t->getBBCount();
+    CHECK(total == graphTotal);
+}
+
+// A shardable backend on shards, as many as the threads, with more shards
+//   than contexts and a lookahead of one task
+static void testShards()
+{
+    unsigned int threads[] = {1, 2, 3, TEST_CONTEXTS + 2};
+    for (unsigned int t : threads)
+    {
+        for (unsigned int lookahead = 1; lookahead <= 64; lookahead *= 64)
+        {
+            ContextBackend b(true);
+            run(&b, t, lookahead);
+            CHECK(b.shards == t);
+            CHECK(b.overlaps == 0);
+            CHECK(sameTasks(&b));
+        }
+    }
+}
+
+// Without shards, the decoding is in parallel and the backend sees every task
+static void testUnshardable()
+{
+    ContextBackend b(false);
+    run(&b, 3, 4);
+    CHECK(b.shards == 0);
+    CHECK(sameTasks(&b));
+}
+
+// Several backends each see every task, on a thread each
+static void testLanes()
+{
+    ContextBackend a(true), b(false), c(true);
+    SimpleBackendWrapper sbw(graphPath, &a);
+    sbw.addBackend(&b);
+    sbw.addBackend(&c);
+    sbw.setThreads(2, 8);
+    sbw.runBackend();
+    CHECK(a.shards == 0 && c.shards == 0);
+    CHECK(sameTasks(&a));
+    CHECK(sameTasks(&b));
+    CHECK(sameTasks(&c));
+}
+
+// The graph's own read ahead is not used by the parallel run
+static void testGraphPrefetch()
+{
+    setenv("CONTECH_TASKGRAPH_PREFETCH", "8", 1);
+    ContextBackend b(true);
+    run(&b, 2, 4);
+    CHECK(sameTasks(&b));
+    unsetenv("CONTECH_TASKGRAPH_PREFETCH");
+}
+
+int main(int argc, char** argv)
+{
+    int fd = mkstemp(graphPath);
+    if (fd < 0)
+    {
+        fprintf(stderr, "Could not create %s\n", graphPath);
+        return 1;
+    }
+    close(fd);
+
+    vector<Task*> graph = makeTestTasks(TEST_CONTEXTS, TEST_TASKS_PER_CONTEXT);
+    CHECK(writeTestGraph(graphPath, graph));
+
+    testSerial(graph);
+    testShards();
+    testUnshardable();
+    testLanes();
+    testGraphPrefetch();
+
+    delete expected;
+    deleteTestTasks(graph);
+    unlink(graphPath);
+
+    return testResult("Backend_test");
+}
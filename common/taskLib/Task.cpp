@@ -1,9 +1,86 @@
 #include "Task.hpp"
 #include <string.h>
+#include <mutex>
 
 using namespace std;
 using namespace contech;
 
+//
+// Action chunks are carved from slabs that are kept for the life of the
+//   process, and Task objects are kept on a free list, so building and
+//   writing tasks settles into reusing the same memory.
+//
+#define ACTION_CHUNKS_PER_SLAB 16
+#define TASK_FREE_LIST_MAX 65536
+
+static mutex chunkLock;
+static action_chunk* chunkFreeList = NULL;
+
+static mutex taskFreeLock;
+static void* taskFreeList = NULL;
+static size_t taskFreeCount = 0;
+
+static action_chunk* allocActionChunk()
+{
+    lock_guard<mutex> lk(chunkLock);
+    
+    if (chunkFreeList == NULL)
+    {
+        action_chunk* slab = (action_chunk*) malloc(ACTION_CHUNKS_PER_SLAB * sizeof(action_chunk));
+        assert(slab != NULL);
+        for (int i = 0; i < ACTION_CHUNKS_PER_SLAB; i++)
+        {
+            slab[i].next = chunkFreeList;
+            chunkFreeList = &slab[i];
+        }
+    }
+    
+    action_chunk* c = chunkFreeList;
+    chunkFreeList = c->next;
+    c->next = NULL;
+    c->count = 0;
+    return c;
+}
+
+static void freeActionChunks(action_chunk* head, action_chunk* tail)
+{
+    lock_guard<mutex> lk(chunkLock);
+    tail->next = chunkFreeList;
+    chunkFreeList = head;
+}
+
+void* Task::operator new(size_t sz)
+{
+    if (sz == sizeof(Task))
+    {
+        lock_guard<mutex> lk(taskFreeLock);
+        if (taskFreeList != NULL)
+        {
+            void* ptr = taskFreeList;
+            taskFreeList = *(void**)ptr;
+            taskFreeCount--;
+            return ptr;
+        }
+    }
+    return ::operator new(sz);
+}
+
+void Task::operator delete(void* ptr)
+{
+    if (ptr == NULL) return;
+    {
+        lock_guard<mutex> lk(taskFreeLock);
+        if (taskFreeCount < TASK_FREE_LIST_MAX)
+        {
+            *(void**)ptr = taskFreeList;
+            taskFreeList = ptr;
+            taskFreeCount++;
+            return;
+        }
+    }
+    ::operator delete(ptr);
+}
+
 // TODO Remove default constructor
 Task::Task()
 {
@@ -22,12 +99,90 @@ Task::Task(TaskId taskId, task_type type)
     p.clear();
 }
 
+Task::Task(const Task& rhs)
+{
+    *this = rhs;
+}
+
+Task& Task::operator=(const Task& rhs)
+{
+    if (this == &rhs) return *this;
+    
+    releaseActionChunks();
+    taskId = rhs.taskId;
+    startTime = rhs.startTime;
+    endTime = rhs.endTime;
+    a.clear();
+    a.reserve(rhs.getActionCount());
+    rhs.forEachAction([this](const Action& act) { a.push_back(act); });
+    s = rhs.s;
+    p = rhs.p;
+    type = rhs.type;
+    syncType = rhs.syncType;
+    bbCount = rhs.bbCount;
+    return *this;
+}
+
+Task::~Task()
+{
+    releaseActionChunks();
+}
+
+void Task::releaseActionChunks()
+{
+    if (chunkHead != NULL) freeActionChunks(chunkHead, chunkTail);
+    chunkHead = chunkTail = NULL;
+    chunkActions = 0;
+}
+
+// Append an action, into the vector until it has TASK_ACTION_CHUNK and then into chunks
+void Task::recordAction(Action act)
+{
+    if (chunkHead == NULL)
+    {
+        if (a.size() < TASK_ACTION_CHUNK)
+        {
+            if (a.capacity() == 0) a.reserve(TASK_ACTION_CHUNK / 16);
+            a.push_back(act);
+            return;
+        }
+        chunkHead = chunkTail = allocActionChunk();
+    }
+    else if (chunkTail->count == TASK_ACTION_CHUNK)
+    {
+        chunkTail->next = allocActionChunk();
+        chunkTail = chunkTail->next;
+    }
+    
+    chunkTail->act[chunkTail->count++] = act;
+    chunkActions++;
+}
+
+// Move any chunked actions into the vector, for callers that need them contiguous
+void Task::joinActionChunks()
+{
+    if (chunkHead == NULL) return;
+    
+    a.reserve(a.size() + chunkActions);
+    for (action_chunk* c = chunkHead; c != NULL; c = c->next)
+    {
+        a.insert(a.end(), c->act, c->act + c->count);
+    }
+    releaseActionChunks();
+}
+
 bool Task::operator==(const Task& rhs) const
 {
+    if (getActionCount() != rhs.getActionCount()) return false;
+    
+    vector<Action> la, ra;
+    forEachAction([&la](const Action& act) { la.push_back(act); });
+    rhs.forEachAction([&ra](const Action& act) { ra.push_back(act); });
+    
     return  taskId == rhs.taskId &&
             startTime == rhs.startTime &&
             endTime == rhs.endTime &&
-            a == rhs.a &&
+            la == ra &&
             s == rhs.s &&
             p == rhs.p &&
             type == rhs.type;
@@ -54,7 +209,7 @@ void Task::appendTask(Task* app, vector<Task*>* app_t)
     // Tasks are the same type and this is pred to app
     assert(type == app->type &&
            (find(app->p.begin(), app->p.end(), taskId) != app->p.end()));
-    a.insert(a.end(), app->a.begin(), app->a.end());
+    app->forEachAction([this](const Action& act) { recordAction(act); });
     bbCount += app->bbCount;
     s = app->s;
     
@@ -142,31 +297,34 @@ bool Task::removeTask(Task* rem, vector<Task*>* p, vector<Task*>* s)
 void Task::recordMemOpAction(bool is_write, short pow_size, uint64 addr)
 {
     MemoryAction mem;
+    mem.data = 0;
     mem.type = is_write ? action_type_mem_write : action_type_mem_read;
     mem.pow_size = pow_size;
     mem.addr = addr;
-    this->a.push_back(mem);
+    recordAction(mem);
 }
 
 // Record that a malloc occurred in this task
 void Task::recordMallocAction(uint64 addr, uint64 size)
 {
     MemoryAction mem;
+    mem.data = 0;
     mem.type = action_type_malloc;
     mem.addr = addr;
-    this->a.push_back(mem);
+    recordAction(mem);
     mem.type = action_type_size;
     mem.addr = size;
-    this->a.push_back(mem);
+    recordAction(mem);
 }
 
 // Record that a free occurred in this task
 void Task::recordFreeAction(uint64 addr)
 {
     MemoryAction mem;
+    mem.data = 0;
     mem.type = action_type_free;
     mem.addr = addr;
-    this->a.push_back(mem);
+    recordAction(mem);
 }
 
 void Task::recordMemCpyAction(uint64 size, uint64 dst, uint64 src)
@@ -175,33 +333,34 @@ void Task::recordMemCpyAction(uint64 size, uint64 dst, uint64 src)
     MemoryAction mem;
     mem.data = dst;
     mem.type = action_type_memcpy;
-    this->a.push_back(mem);
+    recordAction(mem);
     mem.data = src;
     mem.type = action_type_memcpy;
-    this->a.push_back(mem);
+    recordAction(mem);
     mem.type = action_type_size;
     mem.addr = size;
-    this->a.push_back(mem);
+    recordAction(mem);
 }
 
 // Record that a basic block occurred in this task
 void Task::recordBasicBlockAction(uint id)
 {
     BasicBlockAction bb;
+    bb.data = 0;
     bb.type = action_type_basicBlock;
     bb.basic_block_id = id;
-    this->a.push_back(bb);
+    recordAction(bb);
     bbCount++;
 }
 
 // Get all the actions that occurred in this task
-vector<Action>& Task::getActions() { return a; }
+vector<Action>& Task::getActions() { joinActionChunks(); return a; }
 
 // Get all the memOps (reads/writes) that occurred in this task
-Task::memOpCollection Task::getMemOps() { return memOpCollection(a.begin(), a.end()); }
+Task::memOpCollection Task::getMemOps() { joinActionChunks(); return memOpCollection(a.data(), a.data() + a.size()); }
 
 Task::memOpCollection::memOpCollection(){}
-Task::memOpCollection::memOpCollection(vector<Action>::iterator f, vector<Action>::iterator e) : first(f), last(e)
+Task::memOpCollection::memOpCollection(Action* f, Action* e) : first(f), last(e)
 {
     // Skip until the first memOp
     while (first != last && !first->isMemOp()) first++;
@@ -216,10 +375,10 @@ uint Task::memOpCollection::size()
 }
 
 // Get all the memory actions that occurred in this task
-Task::memoryActionCollection Task::getMemoryActions() { return memoryActionCollection(a.begin(), a.end()); }
+Task::memoryActionCollection Task::getMemoryActions() { joinActionChunks(); return memoryActionCollection(a.data(), a.data() + a.size()); }
 
 Task::memoryActionCollection::memoryActionCollection(){}
-Task::memoryActionCollection::memoryActionCollection(vector<Action>::iterator f, vector<Action>::iterator e) : first(f), last(e)
+Task::memoryActionCollection::memoryActionCollection(Action* f, Action* e) : first(f), last(e)
 {
     // Skip until the first memory action
     while (first != last && !first->isMemoryAction()) first++;
@@ -234,10 +393,10 @@ uint Task::memoryActionCollection::size()
 }
 
 // Get all the basic block actions that occurred in this task
-Task::basicBlockActionCollection Task::getBasicBlockActions() { return basicBlockActionCollection(a.begin(), a.end()); }
+Task::basicBlockActionCollection Task::getBasicBlockActions() { joinActionChunks(); return basicBlockActionCollection(a.data(), a.data() + a.size()); }
 
 Task::basicBlockActionCollection::basicBlockActionCollection(){}
-Task::basicBlockActionCollection::basicBlockActionCollection(vector<Action>::iterator f, vector<Action>::iterator e) : first(f), last(e)
+Task::basicBlockActionCollection::basicBlockActionCollection(Action* f, Action* e) : first(f), last(e)
 {
     // Skip until the first basic block action
     while (first != last && !first->isBasicBlockAction() ) first++;
@@ -277,76 +436,332 @@ void Task::addSuccessor(TaskId succ) { assert(succ != taskId); s.push_back(succ)
 vector<TaskId>& Task::getPredecessorTasks() { return p; }
 void Task::addPredecessor(TaskId pred) { assert(pred != taskId); p.push_back(pred); }
 
+size_t Task::getMemoryFootprint() const
+{
+    size_t chunks = (chunkActions + TASK_ACTION_CHUNK - 1) / TASK_ACTION_CHUNK;
+    return sizeof(Task) + a.capacity() * sizeof(Action) + chunks * sizeof(action_chunk) +
+           (s.capacity() + p.capacity()) * sizeof(TaskId);
+}
+
 task_type Task::getType() const { return type; }
 void Task::setType(task_type e) { type = e; }
 
 sync_type Task::getSyncType() const { return syncType; }
 void Task::setSyncType(sync_type e) { syncType = e; }
 
-// Deserialize a Task from a file
-Task* Task::readContechTaskUnlock(FILE* in)
+//
+// Columnar action encoding
+//
+//   When TASK_ACTIONS_COLUMNAR is set in the action count, the actions are
+//   stored as separate streams, each of which compresses better than the
+//   interleaved 64-bit actions:
+//     uint32 length of each stream: kinds, block ids, addresses, raw
+//     kinds     - one byte per action, type | pow_size << 3, or TASK_ACTION_RAW
+//     block ids - zigzag varint delta from the previous basic block id
+//     addresses - zigzag varint delta from the previous address in the same
+//                 slot, where the slot is the block id and the action's
+//                 position after its basic block
+//     raw       - 8 byte actions that do not fit the above, e.g. MPI ranks
+//
+#define TASK_ACTION_RAW 0x80
+#define TASK_ACTION_SLOTS 1024
+#define TASK_ACTION_SLOT(bbid, idx) ((((bbid) << 3) + (idx)) & (TASK_ACTION_SLOTS - 1))
+
+static inline void putVarint(vector<unsigned char>& out, uint64 v)
 {
-    Task* task = new Task();
+    while (v >= 0x80)
+    {
+        out.push_back((unsigned char)(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back((unsigned char)v);
+}
+
+// False if the varint runs past end or is longer than 64 bits
+static inline bool getVarint(const unsigned char*& p, const unsigned char* end, uint64& v)
+{
+    v = 0;
+    for (int shift = 0; p < end && shift < 64; shift += 7)
+    {
+        unsigned char b = *p++;
+        v |= ((uint64)(b & 0x7f)) << shift;
+        if ((b & 0x80) == 0) return true;
+    }
+    return false;
+}
+
+static inline uint64 zigzag(int64_t d) { return ((uint64)d << 1) ^ (uint64)(d >> 63); }
+static inline int64_t unzigzag(uint64 z) { return (int64_t)(z >> 1) ^ -(int64_t)(z & 1); }
+
+// Actions are fed one at a time, so chunked tasks are encoded in place
+class ActionColumnEncoder
+{
+private:
+    vector<unsigned char> kinds, bbs, addrs, raw;
+    vector<uint64> lastAddr;
+    uint32_t bbid = 0, idx = 0;
+    
+public:
+    ActionColumnEncoder(size_t asize) : lastAddr(TASK_ACTION_SLOTS, 0) { kinds.reserve(asize); }
+    
+    void encode(const Action& act)
+    {
+        if (act.getType() == action_type_basicBlock)
+        {
+            BasicBlockAction bba = act;
+            if (bba.reserv == 0)
+            {
+                kinds.push_back(action_type_basicBlock);
+                putVarint(bbs, zigzag((int64_t)bba.basic_block_id - (int64_t)bbid));
+                bbid = bba.basic_block_id;
+                idx = 0;
+                return;
+            }
+        }
+        else if (act.getType() != action_type_null)
+        {
+            MemoryAction ma = act;
+            if (ma.rank == 0 && ma.resrv == 0)
+            {
+                uint32_t slot = TASK_ACTION_SLOT(bbid, idx);
+                kinds.push_back(ma.type | (ma.pow_size << 3));
+                putVarint(addrs, zigzag((int64_t)ma.addr - (int64_t)lastAddr[slot]));
+                lastAddr[slot] = ma.addr;
+                idx++;
+                return;
+            }
+        }
+        
+        kinds.push_back(TASK_ACTION_RAW);
+        raw.insert(raw.end(), (const unsigned char*)&act.data, (const unsigned char*)&act.data + sizeof(uint64));
+    }
+    
+    void finish(vector<unsigned char>& out)
+    {
+        uint32_t lens[4] = {(uint32_t)kinds.size(), (uint32_t)bbs.size(), (uint32_t)addrs.size(), (uint32_t)raw.size()};
+        out.reserve(sizeof(lens) + lens[0] + lens[1] + lens[2] + lens[3]);
+        out.insert(out.end(), (const unsigned char*)lens, (const unsigned char*)lens + sizeof(lens));
+        out.insert(out.end(), kinds.begin(), kinds.end());
+        out.insert(out.end(), bbs.begin(), bbs.end());
+        out.insert(out.end(), addrs.begin(), addrs.end());
+        out.insert(out.end(), raw.begin(), raw.end());
+    }
+};
+
+// Expands asize actions from the len bytes at buf, setting used to the bytes
+//   consumed.  Returns false if the columns do not fit in len or do not hold
+//   exactly asize actions.
+static bool decodeActionColumns(const unsigned char* buf, size_t len, uint32_t asize, vector<Action>& a,
+                                int* bbCount, size_t* used)
+{
+    uint32_t lens[4];
+    if (len < sizeof(lens)) return false;
+    memcpy(lens, buf, sizeof(lens));
+    if (lens[0] != asize || (lens[3] % sizeof(uint64)) != 0) return false;
+    uint64 total = (uint64)lens[0] + lens[1] + lens[2] + lens[3];
+    if (total > len - sizeof(lens)) return false;
+    
+    const unsigned char* kinds = buf + sizeof(lens);
+    const unsigned char* bbs = kinds + lens[0];
+    const unsigned char* bbEnd = bbs + lens[1];
+    const unsigned char* addrs = bbEnd;
+    const unsigned char* addrEnd = addrs + lens[2];
+    const unsigned char* raw = addrEnd;
+    const unsigned char* rawEnd = raw + lens[3];
+    vector<uint64> lastAddr(TASK_ACTION_SLOTS, 0);
+    uint32_t bbid = 0, idx = 0;
+    uint64 v;
+    
+    a.resize(asize);
+    for (uint32_t i = 0; i < asize; i++)
+    {
+        unsigned char k = kinds[i];
+        Action& act = a[i];
         
+        if (k & TASK_ACTION_RAW)
+        {
+            if (raw == rawEnd) return false;
+            memcpy(&act.data, raw, sizeof(uint64));
+            raw += sizeof(uint64);
+            if (act.isBasicBlockAction()) (*bbCount)++;
+        }
+        else if ((k & 0x7) == action_type_basicBlock)
+        {
+            BasicBlockAction bba;
+            bba.data = 0;
+            if (!getVarint(bbs, bbEnd, v)) return false;
+            bbid += unzigzag(v);
+            bba.basic_block_id = bbid;
+            bba.type = action_type_basicBlock;
+            act = bba;
+            idx = 0;
+            (*bbCount)++;
+        }
+        else
+        {
+            uint32_t slot = TASK_ACTION_SLOT(bbid, idx);
+            if (!getVarint(addrs, addrEnd, v)) return false;
+            uint64 addr = lastAddr[slot] + unzigzag(v);
+            act = MemoryAction(addr, (k >> 3) & 0x7, (action_type)(k & 0x7));
+            lastAddr[slot] = addr;
+            idx++;
+        }
+    }
+    
+    // Every column is used up by the actions that it encodes
+    if (bbs != bbEnd || addrs != addrEnd || raw != rawEnd) return false;
+    
+    *used = sizeof(lens) + total;
+    return true;
+}
+
+// Deserialize a Task from a file
+//   Records are zlib compressed, unless the taskgraph names another codec
+Task* Task::readContechTaskUnlock(FILE* in, const TaskCodec* codec)
+{
     // Read in record length
     uint64 recordLength;
     ct_read(&recordLength, sizeof(uint64), in);
     uint64 compLength;
     ct_read(&compLength, sizeof(uint64), in);
 
-    if (feof(in) != 0) { delete task; return NULL;}
+    if (feof(in) != 0) { return NULL;}
     
     unsigned char* comp = (unsigned char*) malloc(compLength);
-    
-    uint64 uncompPos = 0;
-    
     assert(comp != NULL);
     
     ct_read(comp, compLength, in);
     
+    Task* task = decodeRecord(comp, compLength, recordLength, codec);
+    free(comp);
+    
+    return task;
+}
+
+// Deserialize a Task from a record in memory, such as a mapped taskgraph
+//   len bounds the record, NULL if it is truncated
+Task* Task::decodeContechTask(const unsigned char* rec, size_t len, const TaskCodec* codec)
+{
+    uint64 recordLength;
+    uint64 compLength;
+    
+    if (len < 2 * sizeof(uint64)) return NULL;
+    memcpy(&recordLength, rec, sizeof(uint64));
+    memcpy(&compLength, rec + sizeof(uint64), sizeof(uint64));
+    if (compLength > len - 2 * sizeof(uint64)) return NULL;
+    
+    return decodeRecord(rec + 2 * sizeof(uint64), compLength, recordLength, codec);
+}
+
+bool Task::decompressRecord(unsigned char* uncomp, uint64 recordLength, const unsigned char* comp, uint64 compLength,
+                            const TaskCodec* codec)
+{
+    if (codec == NULL)
+    {
+        uLongf len = recordLength;
+        if (uncompress(uncomp, &len, comp, compLength) != Z_OK || len != recordLength)
+        {
+            fprintf(stderr, "TASK GRAPH - Failed to decompress zlib task record\n");
+            return false;
+        }
+        return true;
+    }
+    
+    if (!codec->decompress(uncomp, recordLength, comp, compLength))
+    {
+        fprintf(stderr, "TASK GRAPH - Failed to decompress %s task record\n", TaskCodec::getCodecName(codec->getCodec()));
+        return false;
+    }
+    return true;
+}
+
+bool Task::decodeActions(const unsigned char* buf, size_t len, uint32_t asize, vector<Action>& a, int* bbCount,
+                         size_t* used)
+{
+    return decodeActionColumns(buf, len, asize, a, bbCount, used);
+}
+
+//
+// Decompress and parse the body of a task record
+//   Only touches the new task, so records may be decoded in parallel.
+//   NULL if the record does not decompress or its fields do not fit in it.
+//
+Task* Task::decodeRecord(const unsigned char* comp, uint64 compLength, uint64 recordLength, const TaskCodec* codec)
+{
+    Task* task = new Task();
+    
     unsigned char* uncomp = (unsigned char*) malloc(recordLength);
     assert(uncomp != NULL);
-    uncompress(uncomp, (uLongf*)&recordLength, comp, compLength);
+    if (!decompressRecord(uncomp, recordLength, comp, compLength, codec) ||
+        !parseRecord(task, uncomp, recordLength))
+    {
+        free(uncomp);
+        delete task;
+        return NULL;
+    }
+    
+    // TODO: Resolve issue with condition variables creating empty basic block tasks
+    //assert(task->bbCount > 0 || task->type != task_type_basic_blocks);
+    
+    free(uncomp);
+    
+    return task;
+}
 
-    //ct_read(&task->taskId, sizeof(TaskId), in);
+bool Task::parseRecord(Task* task, const unsigned char* uncomp, uint64 recordLength)
+{
+    uint64 uncompPos = 0;
+    
+    // The fields up to the actions
+    if (recordLength < sizeof(TaskId) + 2 * sizeof(ct_timestamp) + sizeof(uint32_t)) return false;
     memcpy(&task->taskId, uncomp + uncompPos, sizeof(TaskId));
     uncompPos += sizeof(TaskId);
-    //ct_read(&task->startTime, sizeof(ct_timestamp), in);
     memcpy(&task->startTime, uncomp + uncompPos, sizeof(ct_timestamp));
     uncompPos += sizeof(ct_timestamp);
-    //ct_read(&task->endTime, sizeof(ct_timestamp), in);
     memcpy(&task->endTime, uncomp + uncompPos, sizeof(ct_timestamp));
     uncompPos += sizeof(ct_timestamp);
 
     // Read size and data for a vector
     uint32_t asize;
     task->bbCount = 0;
-    //ct_read(&asize, sizeof(uint), in);
     memcpy(&asize, uncomp + uncompPos, sizeof(uint32_t));
     uncompPos += sizeof(uint32_t);
     task->a.clear();
-    task->a.reserve(asize);
-    assert(task->a.capacity() >= asize);
-    for (uint i = 0; i < asize; i++)
+    if (asize & TASK_ACTIONS_COLUMNAR)
     {
-        Action action;
-        //ct_read(&action.data, sizeof(uint64), in);
-        memcpy(&action.data, uncomp + uncompPos, sizeof(uint64));
-        uncompPos += sizeof(uint64);
-        task->a.push_back(action);
-        if (action.isBasicBlockAction()) task->bbCount++;
+        size_t used = 0;
+        asize &= ~TASK_ACTIONS_COLUMNAR;
+        if (!decodeActionColumns(uncomp + uncompPos, recordLength - uncompPos, asize, task->a, &task->bbCount, &used))
+        {
+            return false;
+        }
+        uncompPos += used;
+    }
+    else
+    {
+        if ((recordLength - uncompPos) / sizeof(uint64) < asize) return false;
+        task->a.reserve(asize);
+        assert(task->a.capacity() >= asize);
+        for (uint i = 0; i < asize; i++)
+        {
+            Action action;
+            memcpy(&action.data, uncomp + uncompPos, sizeof(uint64));
+            uncompPos += sizeof(uint64);
+            task->a.push_back(action);
+            if (action.isBasicBlockAction()) task->bbCount++;
+        }
     }
 
     // Read size and data for s vector
     uint32_t ssize;
-    //ct_read(&ssize, sizeof(uint), in);
+    if (recordLength - uncompPos < sizeof(uint32_t)) return false;
     memcpy(&ssize, uncomp + uncompPos, sizeof(uint32_t));
     uncompPos += sizeof(uint32_t);
+    if ((recordLength - uncompPos) / sizeof(TaskId) < ssize) return false;
     task->s.reserve(ssize);
     for (uint i = 0; i < ssize; i++)
     {
         TaskId succ;
-        //ct_read(&succ, sizeof(TaskId), in);
         memcpy(&succ, uncomp + uncompPos, sizeof(TaskId));
         uncompPos += sizeof(TaskId);
         task->s.push_back(succ);
@@ -354,54 +769,100 @@ Task* Task::readContechTaskUnlock(FILE* in)
 
     // Read size and data for p vector
     uint32_t psize;
-    //ct_read(&psize, sizeof(uint), in);
+    if (recordLength - uncompPos < sizeof(uint32_t)) return false;
     memcpy(&psize, uncomp + uncompPos, sizeof(uint32_t));
     uncompPos += sizeof(uint32_t);
+    if ((recordLength - uncompPos) / sizeof(TaskId) < psize) return false;
     task->p.clear();
     task->p.reserve(psize);
     for (uint i = 0; i < psize; i++)
     {
         TaskId pred;
-        //ct_read(&pred, sizeof(TaskId), in);
         memcpy(&pred, uncomp + uncompPos, sizeof(TaskId));
         uncompPos += sizeof(TaskId);
         task->p.push_back(pred);
     }
 
     task_type typeInt;
-    //ct_read(&typeInt, sizeof(task_type), in);
+    if (recordLength - uncompPos < sizeof(task_type) + sizeof(sync_type)) return false;
     memcpy(&typeInt, uncomp + uncompPos, sizeof(task_type));
     uncompPos += sizeof(task_type);
     task->type = (task_type)typeInt;
     
     sync_type typeIntSync;
-    //ct_read(&typeIntSync, sizeof(sync_type), in);
     memcpy(&typeIntSync, uncomp + uncompPos, sizeof(sync_type));
     uncompPos += sizeof(sync_type);
     task->syncType = (sync_type)typeIntSync;
     
-    // uint64 fileOffset;
-    //ct_read(&fileOffset,sizeof(uint64),in);
-    // memcpy(&typeIntSync, uncomp + uncompPos, sizeof(sync_type));
-    // uncompPos += sizeof(sync_type);
-    // task->setFileOffset(fileOffset);
+    return true;
+}
+
+// Serialize a Task to a file
+size_t Task::writeContechTask(Task& task, FILE* out)
+{
+    size_t len = 0;
+    unsigned char* rec = encodeContechTask(task, &len);
     
-    // TODO: Resolve issue with condition variables creating empty basic block tasks
-    //assert(task->bbCount > 0 || task->type != task_type_basic_blocks);
+    ct_write(rec, len, out);
+    free(rec);
     
-    free(uncomp);
-    free(comp);
+    return len;
+}
+
+// Serialize and compress a Task into a record
+//   uint64 uncompressed length, uint64 compressed length, compressed data
+unsigned char* Task::encodeContechTask(Task& task, size_t* len, const TaskCodec* codec)
+{
+    size_t recordLength = 0;
+    unsigned char* src = serializeContechTask(task, &recordLength);
     
-    return task;
+    // The compressed data follows the two lengths in the record
+    const size_t headerLen = sizeof(uint64) + sizeof(uint64);
+    size_t dstLen = (codec == NULL) ? compressBound(recordLength) : codec->compressBound(recordLength);
+    unsigned char* rec = (unsigned char*) malloc(headerLen + dstLen);
+    unsigned char* dst = rec + headerLen;
+    assert(rec != NULL);
+    
+    if (codec == NULL)
+    {
+        uLongf zLen = dstLen;
+        int r = compress(dst, &zLen, src, recordLength);
+        assert(r == Z_OK);
+        dstLen = zLen;
+    }
+    else
+    {
+        bool r = codec->compress(dst, &dstLen, src, recordLength);
+        assert(r == true);
+    }
+    
+    uint64 recLen = recordLength;
+    uint64 compLen = dstLen;
+    memcpy(rec, &recLen, sizeof(recLen));
+    memcpy(rec + sizeof(recLen), &compLen, sizeof(compLen));
+    //printf("%u, %lu, %f\n", recordLength, dstLen, ((float)dstLen )/ ((float)recordLength));
+    
+    free(src);
+    
+    *len = headerLen + compLen;
+    return rec;
 }
 
-// Serialize a Task to a file
-size_t Task::writeContechTask(Task& task, FILE* out)
+// Serialize a Task into an uncompressed record
+unsigned char* Task::serializeContechTask(Task& task, size_t* len)
 {
     // Calculate record length
-    uint asize = task.a.size();
+    uint asize = task.getActionCount();
     uint ssize = task.s.size();
     uint psize = task.p.size();
+    
+    // Actions are stored as columns, see ActionColumnEncoder
+    vector<unsigned char> actionColumns;
+    assert(asize < TASK_ACTIONS_COLUMNAR);
+    ActionColumnEncoder enc(asize);
+    task.forEachAction([&enc](const Action& act) { enc.encode(act); });
+    enc.finish(actionColumns);
+    uint asizeFlag = asize | TASK_ACTIONS_COLUMNAR;
 
     uint64 recordLength =
         // Unique ID
@@ -413,7 +874,7 @@ size_t Task::writeContechTask(Task& task, FILE* out)
         // Size of action list
         sizeof(uint) +
         // action list
-        asize * sizeof(uint64) +
+        actionColumns.size() +
         // Size of s list
         sizeof(uint) +
         // s list
@@ -431,11 +892,9 @@ size_t Task::writeContechTask(Task& task, FILE* out)
     assert(recordLength < ((unsigned long long)2 * 1024 * 1024 * 1024));
         
     unsigned char* src = (unsigned char*) malloc(recordLength);
-    unsigned char* dst = (unsigned char*) malloc(recordLength+12);
     uint srcPos = 0;
         
     assert(src != NULL);
-    assert(dst != NULL);
     
     if (task.type == task_type_join)
         assert(task.p.size() > task.s.size());
@@ -464,15 +923,11 @@ size_t Task::writeContechTask(Task& task, FILE* out)
 
     // Size of action list
     //ct_write(&asize, sizeof(uint), out);
-    memcpy(src + srcPos, &asize, sizeof(uint));
+    memcpy(src + srcPos, &asizeFlag, sizeof(uint));
     srcPos += sizeof(uint);
     // action list
-    for (Action a : task.a)
-    {
-        //ct_write(&a.data, sizeof(uint64), out);
-        memcpy(src + srcPos, &a.data, sizeof(uint64));
-        srcPos += sizeof(uint64);
-    }
+    memcpy(src + srcPos, actionColumns.data(), actionColumns.size());
+    srcPos += actionColumns.size();
 
     // Size of s list
     //ct_write (&ssize, sizeof(uint), out);
@@ -511,18 +966,9 @@ size_t Task::writeContechTask(Task& task, FILE* out)
     //memcpy(src + srcPos, &task.fileOffset, sizeof(uint64));
     //srcPos += sizeof(uint64);
     
-    uint64 dstLen = recordLength + 12;
-    compress(dst, (uLongf*)&dstLen, src, recordLength);
-    ct_write(&recordLength, sizeof(recordLength), out);
-    ct_write(&dstLen, sizeof(dstLen), out);
-    ct_write(dst, dstLen, out);
-    //printf("%u, %lu, %f\n", recordLength, dstLen, ((float)dstLen )/ ((float)recordLength));
-    
-    free(dst);
-    free(src);
-    
-    //account for the recordLength itself with the addition
-    return recordLength + sizeof(recordLength) + sizeof(dstLen);
+    assert(srcPos == recordLength);
+    *len = recordLength;
+    return src;
 }
 
 /*
@@ -588,10 +1034,7 @@ string Task::toString() const {
     out << "Type:" << type << endl;
 
     out << "a:";
-    for (Action action : a)
-    {
-        out << action.toString();
-    }
+    forEachAction([&out](const Action& action) { out << action.toString(); });
     out << endl;
 
     out << "s:";
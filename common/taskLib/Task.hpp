@@ -3,6 +3,7 @@
 
 #include "TaskId.hpp"
 #include "Action.hpp"
+#include "TaskCodec.hpp"
 #include "ct_file.h"
 #include <stdio.h>
 #include <stdlib.h>
@@ -30,13 +31,31 @@ enum sync_type {
     sync_type_atomic,
     sync_type_task_dependency};
 
+// Set in a record's action count when the actions are stored as columns
+#define TASK_ACTIONS_COLUMNAR 0x80000000
+
+// Actions past the first TASK_ACTION_CHUNK are recorded into fixed size chunks
+//   from a shared arena, so long tasks are built without reallocating.  Reading
+//   the actions through getActions() or a collection joins them into one vector.
+#define TASK_ACTION_CHUNK 4096
+
+struct action_chunk
+{
+    action_chunk* next;
+    uint32_t count;
+    Action act[TASK_ACTION_CHUNK];
+};
+
 class TaskGraph;
+class TaskView;
 
 class Task
 {
 friend class TaskGraph;
+friend class TaskView;
 protected:
-    static Task* readContechTaskUnlock(FILE* in);
+    static Task* readContechTaskUnlock(FILE* in, const TaskCodec* codec = NULL);
+    static Task* decodeContechTask(const unsigned char* rec, size_t len, const TaskCodec* codec = NULL);
 
 private:
 
@@ -45,7 +64,11 @@ private:
     ct_timestamp endTime = 0;
 
     // Internal list of actions (memOp's, mallocs, frees, and basic blocks)
+    //   followed by any chunks of actions, see TASK_ACTION_CHUNK
     vector<Action> a;
+    action_chunk* chunkHead = NULL;
+    action_chunk* chunkTail = NULL;
+    uint32_t chunkActions = 0;
     // Internal list of successor tasks
     vector<TaskId> s;
     // Internal list of predecessor tasks
@@ -60,12 +83,40 @@ private:
 
     int bbCount;
     
+    void recordAction(Action act);
+    void joinActionChunks();
+    void releaseActionChunks();
+    static Task* decodeRecord(const unsigned char* comp, uint64 compLength, uint64 recordLength, const TaskCodec* codec);
+    static bool decompressRecord(unsigned char* uncomp, uint64 recordLength, const unsigned char* comp, uint64 compLength,
+                                 const TaskCodec* codec);
+    static bool parseRecord(Task* task, const unsigned char* uncomp, uint64 recordLength);
+    // Expands asize columnar actions from the len bytes at buf into a, setting
+    //   used to the bytes consumed.  False if they are not well formed.
+    static bool decodeActions(const unsigned char* buf, size_t len, uint32_t asize, vector<Action>& a, int* bbCount,
+                              size_t* used);
+    template <typename F> void forEachAction(F f) const
+    {
+        for (const Action& act : a) f(act);
+        for (action_chunk* c = chunkHead; c != NULL; c = c->next)
+        {
+            for (uint32_t i = 0; i < c->count; i++) f(c->act[i]);
+        }
+    }
+    
 public:
 
     // Default constructor
     Task();
     // Constructs a task with the given taskId and start time
     Task(TaskId taskId, task_type type);
+    // Copies hold their actions in one vector
+    Task(const Task& rhs);
+    Task& operator=(const Task& rhs);
+    ~Task();
+    
+    // Task objects are recycled, as the middle layer creates and deletes millions
+    static void* operator new(size_t sz);
+    static void operator delete(void* ptr);
 
     // Compares the contents of two tasks
     bool operator==(const Task& rhs) const;
@@ -96,6 +147,10 @@ public:
     void addPredecessor(TaskId pred);
 
     int getBBCount() const {return bbCount;}
+    size_t getActionCount() const {return a.size() + chunkActions;}
+    
+    // Bytes held by this task, including its action and dependency lists
+    size_t getMemoryFootprint() const;
     
     task_type getType() const;
     void setType(task_type e);
@@ -114,6 +169,16 @@ public:
     
     //returns the record size written
     static size_t writeContechTask(Task& task, FILE* out);
+    //reads a record written by writeContechTask, NULL at the end of the file
+    static Task* readContechTask(FILE* in) { return readContechTaskUnlock(in); }
+    
+    //returns a malloc'd record, as written by writeContechTask, of len bytes
+    //  this does not touch any shared state, so tasks may be encoded in parallel
+    //  codec is the taskgraph's codec, zlib without a dictionary if NULL
+    static unsigned char* encodeContechTask(Task& task, size_t* len, const TaskCodec* codec = NULL);
+    
+    //returns a malloc'd uncompressed record of len bytes, e.g. to train a dictionary
+    static unsigned char* serializeContechTask(Task& task, size_t* len);
 
     // Wraps the internal list of actions, presenting it as an iterable collection of only memory reads and writes
     // Internally, we skip past actions that we don't care about on increment
@@ -128,7 +193,7 @@ public:
                     typedef iterator self_type;
                     typedef Action value_type;
                     typedef Action& reference;
-                    typedef vector<Action>::iterator pointer;
+                    typedef Action* pointer;
                     typedef std::forward_iterator_tag iterator_category;
                     typedef int difference_type;
 
@@ -158,11 +223,11 @@ public:
             uint size();
 
             memOpCollection();
-            memOpCollection(vector<Action>::iterator f, vector<Action>::iterator e);
+            memOpCollection(Action* f, Action* e);
 
         private:
-            vector<Action>::iterator first;
-            vector<Action>::iterator last;
+            Action* first;
+            Action* last;
 
     };
 
@@ -179,7 +244,7 @@ public:
                     typedef iterator self_type;
                     typedef Action value_type;
                     typedef Action& reference;
-                    typedef vector<Action>::iterator pointer;
+                    typedef Action* pointer;
                     typedef std::forward_iterator_tag iterator_category;
                     typedef int difference_type;
 
@@ -209,11 +274,11 @@ public:
             uint size();
 
             memoryActionCollection();
-            memoryActionCollection(vector<Action>::iterator f, vector<Action>::iterator e);
+            memoryActionCollection(Action* f, Action* e);
 
         private:
-            vector<Action>::iterator first;
-            vector<Action>::iterator last;
+            Action* first;
+            Action* last;
 
     };
 
@@ -231,7 +296,7 @@ public:
                     typedef iterator self_type;
                     typedef Action value_type;
                     typedef Action& reference;
-                    typedef vector<Action>::iterator pointer;
+                    typedef Action* pointer;
                     typedef std::forward_iterator_tag iterator_category;
                     typedef int difference_type;
 
@@ -271,12 +336,12 @@ public:
             uint size();
 
             basicBlockActionCollection();
-            basicBlockActionCollection(vector<Action>::iterator f, vector<Action>::iterator e);
+            basicBlockActionCollection(Action* f, Action* e);
 
 
         private:
-            vector<Action>::iterator first;
-            vector<Action>::iterator last;
+            Action* first;
+            Action* last;
 
     };
 
@@ -0,0 +1,320 @@
+#include "TaskCodec.hpp"
+#include <string.h>
+#include <assert.h>
+#include <zlib.h>
+
+#ifdef CT_HAVE_ZSTD
+#include <zdict.h>
+#endif
+
+using namespace contech;
+
+// zlib only keeps a 32KB window, so a larger dictionary is not used
+#define ZLIB_MAX_DICT (32 * 1024)
+
+//
+// Cannot call constructor directly, but wrap with "factory"
+//
+TaskCodec* TaskCodec::createCodec(task_codec c, const unsigned char* d, size_t dLen)
+{
+    if (!isSupported(c)) return NULL;
+    if (dLen > TASK_CODEC_MAX_DICT) return NULL;
+
+    return new TaskCodec(c, d, dLen);
+}
+
+TaskCodec::TaskCodec(task_codec c, const unsigned char* d, size_t dLen)
+{
+    codec = c;
+    if (d != NULL && dLen > 0)
+    {
+        dict.assign(d, d + dLen);
+    }
+#ifdef CT_HAVE_LZ4
+    ldict = NULL;
+    if (codec == task_codec_lz4 && !dict.empty())
+    {
+        ldict = LZ4_createStream();
+        assert(ldict != NULL);
+        LZ4_loadDict(ldict, (const char*)dict.data(), dict.size());
+    }
+#endif
+#ifdef CT_HAVE_ZSTD
+    cdict = NULL;
+    ddict = NULL;
+    if (codec == task_codec_zstd && !dict.empty())
+    {
+        cdict = ZSTD_createCDict(dict.data(), dict.size(), 3);
+        ddict = ZSTD_createDDict(dict.data(), dict.size());
+        assert(cdict != NULL && ddict != NULL);
+    }
+#endif
+}
+
+TaskCodec::~TaskCodec()
+{
+#ifdef CT_HAVE_LZ4
+    if (ldict != NULL) LZ4_freeStream(ldict);
+#endif
+#ifdef CT_HAVE_ZSTD
+    if (cdict != NULL) ZSTD_freeCDict(cdict);
+    if (ddict != NULL) ZSTD_freeDDict(ddict);
+    for (auto it = cctxFree.begin(), et = cctxFree.end(); it != et; ++it) ZSTD_freeCCtx(*it);
+    for (auto it = dctxFree.begin(), et = dctxFree.end(); it != et; ++it) ZSTD_freeDCtx(*it);
+#endif
+}
+
+#ifdef CT_HAVE_ZSTD
+//
+// Contexts are reused across calls, as the middle layer compresses and the
+//   prefetch workers decompress in pools of threads
+//
+ZSTD_CCtx* TaskCodec::acquireCCtx() const
+{
+    {
+        lock_guard<mutex> lg(ctxLock);
+        if (!cctxFree.empty())
+        {
+            ZSTD_CCtx* cctx = cctxFree.back();
+            cctxFree.pop_back();
+            return cctx;
+        }
+    }
+    return ZSTD_createCCtx();
+}
+
+void TaskCodec::releaseCCtx(ZSTD_CCtx* cctx) const
+{
+    lock_guard<mutex> lg(ctxLock);
+    cctxFree.push_back(cctx);
+}
+
+ZSTD_DCtx* TaskCodec::acquireDCtx() const
+{
+    {
+        lock_guard<mutex> lg(ctxLock);
+        if (!dctxFree.empty())
+        {
+            ZSTD_DCtx* dctx = dctxFree.back();
+            dctxFree.pop_back();
+            return dctx;
+        }
+    }
+    return ZSTD_createDCtx();
+}
+
+void TaskCodec::releaseDCtx(ZSTD_DCtx* dctx) const
+{
+    lock_guard<mutex> lg(ctxLock);
+    dctxFree.push_back(dctx);
+}
+#endif
+
+bool TaskCodec::isSupported(task_codec c)
+{
+    switch (c)
+    {
+        case task_codec_zlib: return true;
+#ifdef CT_HAVE_LZ4
+        case task_codec_lz4: return true;
+#endif
+#ifdef CT_HAVE_ZSTD
+        case task_codec_zstd: return true;
+#endif
+        default: return false;
+    }
+}
+
+task_codec TaskCodec::getCodecByName(const char* name)
+{
+    if (name == NULL) return task_codec_unknown;
+    if (!strcmp(name, "zlib")) return task_codec_zlib;
+    if (!strcmp(name, "lz4")) return task_codec_lz4;
+    if (!strcmp(name, "zstd")) return task_codec_zstd;
+    return task_codec_unknown;
+}
+
+const char* TaskCodec::getCodecName(task_codec c)
+{
+    switch (c)
+    {
+        case task_codec_zlib: return "zlib";
+        case task_codec_lz4: return "lz4";
+        case task_codec_zstd: return "zstd";
+        default: return "unknown";
+    }
+}
+
+//
+// zstd trains a dictionary from the samples.  For the LZ codecs, the dictionary
+//   is simply prior data, so use the most recent sample bytes.
+//
+void TaskCodec::trainDictionary(task_codec c, const vector<vector<unsigned char> >& samples,
+                                size_t maxLen, vector<unsigned char>& d)
+{
+    vector<unsigned char> all;
+    vector<size_t> sizes;
+
+    d.clear();
+    if (maxLen > TASK_CODEC_MAX_DICT) maxLen = TASK_CODEC_MAX_DICT;
+    if (c == task_codec_zlib && maxLen > ZLIB_MAX_DICT) maxLen = ZLIB_MAX_DICT;
+
+    for (auto it = samples.begin(), et = samples.end(); it != et; ++it)
+    {
+        all.insert(all.end(), it->begin(), it->end());
+        sizes.push_back(it->size());
+    }
+    if (all.empty() || maxLen == 0) return;
+
+#ifdef CT_HAVE_ZSTD
+    if (c == task_codec_zstd)
+    {
+        d.resize(maxLen);
+        size_t r = ZDICT_trainFromBuffer(d.data(), maxLen, all.data(), sizes.data(), sizes.size());
+        if (!ZDICT_isError(r))
+        {
+            d.resize(r);
+            return;
+        }
+        // Too few samples to train, so fall through to raw content
+        d.clear();
+    }
+#endif
+
+    size_t len = (all.size() < maxLen) ? all.size() : maxLen;
+    d.assign(all.end() - len, all.end());
+}
+
+size_t TaskCodec::compressBound(size_t srcLen) const
+{
+    switch (codec)
+    {
+#ifdef CT_HAVE_LZ4
+        case task_codec_lz4: return LZ4_compressBound(srcLen);
+#endif
+#ifdef CT_HAVE_ZSTD
+        case task_codec_zstd: return ZSTD_compressBound(srcLen);
+#endif
+        // The zlib header carries a dictionary id, when there is a dictionary
+        default: return ::compressBound(srcLen) + 4;
+    }
+}
+
+bool TaskCodec::compress(unsigned char* dst, size_t* dstLen, const unsigned char* src, size_t srcLen) const
+{
+    switch (codec)
+    {
+        case task_codec_zlib:
+        {
+            if (dict.empty())
+            {
+                uLongf zLen = *dstLen;
+                if (Z_OK != ::compress(dst, &zLen, src, srcLen)) return false;
+                *dstLen = zLen;
+                return true;
+            }
+
+            z_stream zs;
+            memset(&zs, 0, sizeof(zs));
+            if (Z_OK != deflateInit(&zs, Z_DEFAULT_COMPRESSION)) return false;
+            deflateSetDictionary(&zs, dict.data(), dict.size());
+            zs.next_in = (Bytef*)src;
+            zs.avail_in = srcLen;
+            zs.next_out = dst;
+            zs.avail_out = *dstLen;
+            int r = deflate(&zs, Z_FINISH);
+            *dstLen = zs.total_out;
+            deflateEnd(&zs);
+            return (r == Z_STREAM_END);
+        }
+#ifdef CT_HAVE_LZ4
+        case task_codec_lz4:
+        {
+            int r;
+            if (dict.empty())
+            {
+                r = LZ4_compress_default((const char*)src, (char*)dst, srcLen, *dstLen);
+            }
+            else
+            {
+                // A copy of the loaded stream, rather than hashing the dictionary again
+                //   (LZ4_attach_dictionary is not exported by the shared liblz4)
+                LZ4_stream_t ls;
+                memcpy(&ls, ldict, sizeof(LZ4_stream_t));
+                r = LZ4_compress_fast_continue(&ls, (const char*)src, (char*)dst, srcLen, *dstLen, 1);
+            }
+            if (r <= 0) return false;
+            *dstLen = r;
+            return true;
+        }
+#endif
+#ifdef CT_HAVE_ZSTD
+        case task_codec_zstd:
+        {
+            ZSTD_CCtx* cctx = acquireCCtx();
+            if (cctx == NULL) return false;
+            size_t r;
+            if (cdict != NULL)
+                r = ZSTD_compress_usingCDict(cctx, dst, *dstLen, src, srcLen, cdict);
+            else
+                r = ZSTD_compressCCtx(cctx, dst, *dstLen, src, srcLen, 3);
+            releaseCCtx(cctx);
+            if (ZSTD_isError(r)) return false;
+            *dstLen = r;
+            return true;
+        }
+#endif
+        default:
+            return false;
+    }
+}
+
+bool TaskCodec::decompress(unsigned char* dst, size_t dstLen, const unsigned char* src, size_t srcLen) const
+{
+    switch (codec)
+    {
+        case task_codec_zlib:
+        {
+            z_stream zs;
+            memset(&zs, 0, sizeof(zs));
+            if (Z_OK != inflateInit(&zs)) return false;
+            zs.next_in = (Bytef*)src;
+            zs.avail_in = srcLen;
+            zs.next_out = dst;
+            zs.avail_out = dstLen;
+            int r = inflate(&zs, Z_FINISH);
+            if (r == Z_NEED_DICT && !dict.empty())
+            {
+                inflateSetDictionary(&zs, dict.data(), dict.size());
+                r = inflate(&zs, Z_FINISH);
+            }
+            bool ok = (r == Z_STREAM_END && zs.total_out == dstLen);
+            inflateEnd(&zs);
+            return ok;
+        }
+#ifdef CT_HAVE_LZ4
+        case task_codec_lz4:
+        {
+            int r = LZ4_decompress_safe_usingDict((const char*)src, (char*)dst, srcLen, dstLen,
+                                                  (const char*)dict.data(), dict.size());
+            return (r >= 0 && (size_t)r == dstLen);
+        }
+#endif
+#ifdef CT_HAVE_ZSTD
+        case task_codec_zstd:
+        {
+            ZSTD_DCtx* dctx = acquireDCtx();
+            if (dctx == NULL) return false;
+            size_t r;
+            if (ddict != NULL)
+                r = ZSTD_decompress_usingDDict(dctx, dst, dstLen, src, srcLen, ddict);
+            else
+                r = ZSTD_decompressDCtx(dctx, dst, dstLen, src, srcLen);
+            releaseDCtx(dctx);
+            return (!ZSTD_isError(r) && r == dstLen);
+        }
+#endif
+        default:
+            return false;
+    }
+}
@@ -0,0 +1,87 @@
+#ifndef TASK_CODEC_HPP
+#define TASK_CODEC_HPP
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <inttypes.h>
+#include <vector>
+#include <mutex>
+
+#ifdef CT_HAVE_LZ4
+#include <lz4.h>
+#endif
+#ifdef CT_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+using namespace std;
+namespace contech {
+
+//
+// Compression of task records
+//
+//   The taskgraph header names the codec for every record in the file, and
+//   may point to a dictionary that was stored once and is shared by every
+//   record.  zlib is always available, lz4 and zstd when libTask was built
+//   with CT_HAVE_LZ4 / CT_HAVE_ZSTD.
+//
+enum task_codec { task_codec_zlib = 0, task_codec_lz4, task_codec_zstd, task_codec_unknown };
+
+// Largest dictionary that is useful to any codec
+#define TASK_CODEC_MAX_DICT (64 * 1024)
+
+class TaskCodec
+{
+private:
+    task_codec codec;
+    vector<unsigned char> dict;
+#ifdef CT_HAVE_LZ4
+    // The dictionary loaded once, and copied into a stream for each record
+    LZ4_stream_t* ldict;
+#endif
+#ifdef CT_HAVE_ZSTD
+    ZSTD_CDict* cdict;
+    ZSTD_DDict* ddict;
+
+    // Contexts not in use by a compress or decompress call.  There are at most
+    //   as many as calls that have run at once, and the codec frees them.
+    mutable mutex ctxLock;
+    mutable vector<ZSTD_CCtx*> cctxFree;
+    mutable vector<ZSTD_DCtx*> dctxFree;
+
+    ZSTD_CCtx* acquireCCtx() const;
+    void releaseCCtx(ZSTD_CCtx*) const;
+    ZSTD_DCtx* acquireDCtx() const;
+    void releaseDCtx(ZSTD_DCtx*) const;
+#endif
+
+    TaskCodec(task_codec, const unsigned char*, size_t);
+
+public:
+    // Returns NULL if the codec is not supported in this build
+    static TaskCodec* createCodec(task_codec c, const unsigned char* d = NULL, size_t dLen = 0);
+    static bool isSupported(task_codec c);
+    static task_codec getCodecByName(const char* name);
+    static const char* getCodecName(task_codec c);
+
+    // Build a dictionary of at most maxLen bytes from sample records
+    static void trainDictionary(task_codec c, const vector<vector<unsigned char> >& samples,
+                                size_t maxLen, vector<unsigned char>& d);
+
+    task_codec getCodec() const { return codec; }
+    const vector<unsigned char>& getDictionary() const { return dict; }
+
+    size_t compressBound(size_t srcLen) const;
+
+    // Both return false on failure, compress updates dstLen with the compressed size
+    //   These may be called concurrently from multiple threads.
+    bool compress(unsigned char* dst, size_t* dstLen, const unsigned char* src, size_t srcLen) const;
+    bool decompress(unsigned char* dst, size_t dstLen, const unsigned char* src, size_t srcLen) const;
+
+    ~TaskCodec();
+};
+
+}
+
+#endif
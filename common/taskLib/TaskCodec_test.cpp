@@ -0,0 +1,134 @@
+#include "TaskCodec.hpp"
+#include "test_check.hpp"
+#include <string.h>
+#include <thread>
+
+using namespace contech;
+
+//
+// Round trips of task-record-like data through every codec in this build,
+//   with and without a dictionary and from several threads at once.  lz4 and
+//   zstd are tested when libTask was built with CT_HAVE_LZ4 / CT_HAVE_ZSTD.
+//   Returns 0 if every test passes.
+//
+
+#define RECORD_COUNT 64
+#define THREAD_COUNT 4
+
+// Records that share structure, as task records do: counters and addresses
+//   that step by small amounts, with some noise
+static void makeRecords(vector<vector<unsigned char> >& records)
+{
+    uint64_t seed = 0x9E3779B97F4A7C15ULL;
+    for (unsigned int r = 0; r < RECORD_COUNT; r++)
+    {
+        vector<unsigned char> rec;
+        uint64_t addr = 0x7f0000000000ULL + r * 4096;
+        size_t len = 256 + (r * 977) % 8192;
+        while (rec.size() < len)
+        {
+            seed ^= seed << 13; seed ^= seed >> 7; seed ^= seed << 17;
+            addr += (seed % 4) * 8;
+            unsigned char op[10];
+            op[0] = (seed >> 8) % 3;
+            op[1] = 3;
+            memcpy(op + 2, &addr, sizeof(addr));
+            rec.insert(rec.end(), op, op + sizeof(op));
+        }
+        records.push_back(rec);
+    }
+}
+
+static bool roundTrip(const TaskCodec* tc, const vector<unsigned char>& rec, size_t* compLen)
+{
+    vector<unsigned char> comp(tc->compressBound(rec.size()));
+    vector<unsigned char> out(rec.size());
+    size_t len = comp.size();
+
+    if (!tc->compress(comp.data(), &len, rec.data(), rec.size())) return false;
+    if (compLen != NULL) *compLen += len;
+    if (!tc->decompress(out.data(), out.size(), comp.data(), len)) return false;
+    if (out != rec) return false;
+
+    // A record that decompresses to another length is rejected
+    vector<unsigned char> shortOut(rec.size() - 1);
+    return !tc->decompress(shortOut.data(), shortOut.size(), comp.data(), len);
+}
+
+static void testCodec(task_codec c, const vector<vector<unsigned char> >& records)
+{
+    const char* name = TaskCodec::getCodecName(c);
+    vector<unsigned char> dict;
+    size_t plain = 0, withDict = 0;
+
+    TaskCodec* tc = TaskCodec::createCodec(c);
+    CHECK(tc != NULL);
+    if (tc == NULL) return;
+    for (auto it = records.begin(), et = records.end(); it != et; ++it)
+    {
+        CHECK(roundTrip(tc, *it, &plain));
+    }
+    delete tc;
+
+    TaskCodec::trainDictionary(c, records, TASK_CODEC_MAX_DICT, dict);
+    CHECK(!dict.empty());
+    tc = TaskCodec::createCodec(c, dict.data(), dict.size());
+    CHECK(tc != NULL);
+    if (tc == NULL) return;
+    CHECK(tc->getDictionary() == dict);
+    for (auto it = records.begin(), et = records.end(); it != et; ++it)
+    {
+        CHECK(roundTrip(tc, *it, &withDict));
+    }
+
+    // The codec is shared by the prefetch workers and the middle's writers
+    bool ok[THREAD_COUNT];
+    vector<std::thread> threads;
+    for (unsigned int t = 0; t < THREAD_COUNT; t++)
+    {
+        threads.push_back(std::thread([&, t]() {
+            ok[t] = true;
+            for (unsigned int i = 0; i < 4; i++)
+            {
+                for (unsigned int r = t; r < records.size(); r += THREAD_COUNT)
+                {
+                    if (!roundTrip(tc, records[r], NULL)) ok[t] = false;
+                }
+            }
+        }));
+    }
+    for (unsigned int t = 0; t < THREAD_COUNT; t++)
+    {
+        threads[t].join();
+        CHECK(ok[t]);
+    }
+    delete tc;
+
+    size_t total = 0;
+    for (auto it = records.begin(), et = records.end(); it != et; ++it) total += it->size();
+    printf("%s: %lu bytes compress to %lu, or %lu with a %lu byte dictionary\n",
+           name, total, plain, withDict, dict.size());
+}
+
+int main(int argc, char** argv)
+{
+    vector<vector<unsigned char> > records;
+    makeRecords(records);
+
+    for (int c = task_codec_zlib; c < task_codec_unknown; c++)
+    {
+        task_codec tc = (task_codec)c;
+        CHECK(TaskCodec::getCodecByName(TaskCodec::getCodecName(tc)) == tc);
+        if (!TaskCodec::isSupported(tc))
+        {
+            printf("%s: not in this build\n", TaskCodec::getCodecName(tc));
+            CHECK(TaskCodec::createCodec(tc) == NULL);
+            continue;
+        }
+        testCodec(tc, records);
+    }
+    CHECK(TaskCodec::createCodec(task_codec_unknown) == NULL);
+    CHECK(TaskCodec::getCodecByName("none") == task_codec_unknown);
+
+    return testResult("TaskCodec_test");
+}
@@ -1,4 +1,9 @@
 #include "TaskGraph.hpp"
+#include "TaskPrefetch.hpp"
+#include "TaskGraphShard.hpp"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <string.h>
 
 using namespace contech;
 
@@ -35,9 +40,24 @@ TaskGraph::TaskGraph(FILE* f)
     uint version = 0;
     uint64 taskIndexOffset = 0;
     inputFile = f;
+    tgi = NULL;
+    codec = NULL;
+    codecId = task_codec_zlib;
+    mapBase = NULL;
+    mapLength = 0;
+    prefetch = NULL;
+    prefetchDepth = 0;
+    prefetchThreads = 0;
+    skeletonOffset = 0;
+    skeleton = NULL;
+    shardInfo = NULL;
+    numOfContexts = 0;
+    filtered = false;
+    nextTask = 0;
     
     // This is to ensure the file is at the start
     fseek(f, 0, SEEK_SET);
+    mapTaskGraph();
     
     // First is the version number
     if (sizeof(uint32_t) != ct_read(&version, sizeof(uint32_t), f))
@@ -56,17 +76,118 @@ TaskGraph::TaskGraph(FILE* f)
     ct_read(&ROIStart, sizeof(TaskId), f);
     ct_read(&ROIEnd, sizeof(TaskId), f);
     
+    // Which codec compressed the task records
+    if (version >= TASK_GRAPH_CODEC_VERSION && !readTaskCodec())
+    {
+        return;
+    }
+    
     // Then comes the taskGraphInfo structure
     tgi = readTaskGraphInfo();
     
-    // Now skip to the index
-    initTaskIndex(taskIndexOffset);
+    // Now skip to the index, which is followed by the skeleton
+    uint64 indexEnd = initTaskIndex(taskIndexOffset);
+    if (version >= TASK_GRAPH_SKELETON_VERSION)
+    {
+        skeletonOffset = indexEnd;
+        readShardInfo();
+    }
+    
+    if (getenv("CONTECH_TASKGRAPH_PREFETCH") != NULL && atoi(getenv("CONTECH_TASKGRAPH_PREFETCH")) > 0)
+    {
+        setPrefetch(atoi(getenv("CONTECH_TASKGRAPH_PREFETCH")));
+    }
 }
 
 TaskGraph::~TaskGraph()
 {
+    if (prefetch != NULL)
+    {
+        printPrefetchStats(stderr);
+        delete prefetch;
+    }
     taskOrder.clear();
+    delete skeleton;
+    delete shardInfo;
+    if (mapBase != NULL) munmap((void*)mapBase, mapLength);
     delete tgi;
+    delete codec;
+}
+
+//
+// Read the codec and load its dictionary, leaving the file after the header
+//
+bool TaskGraph::readTaskCodec()
+{
+    uint32_t c = task_codec_zlib;
+    uint64 dictOffset = 0;
+    uint32_t dictLen = 0;
+    vector<unsigned char>& dict = codecDict;
+    
+    ct_read(&c, sizeof(uint32_t), inputFile);
+    codecId = (task_codec)c;
+    ct_read(&dictOffset, sizeof(uint64), inputFile);
+    
+    if (dictOffset != 0)
+    {
+        long pos = ftell(inputFile);
+        fseek(inputFile, dictOffset, SEEK_SET);
+        ct_read(&dictLen, sizeof(uint32_t), inputFile);
+        if (dictLen > TASK_CODEC_MAX_DICT)
+        {
+            fprintf(stderr, "TASK GRAPH - Dictionary of %u bytes exceeds maximum\n", dictLen);
+            return false;
+        }
+        dict.resize(dictLen);
+        ct_read(dict.data(), dictLen, inputFile);
+        fseek(inputFile, pos, SEEK_SET);
+    }
+    
+    // Plain zlib is the default decoder
+    if (codecId == task_codec_zlib && dictLen == 0) return true;
+    
+    codec = TaskCodec::createCodec(codecId, dict.data(), dictLen);
+    if (codec == NULL)
+    {
+        fprintf(stderr, "TASK GRAPH - Codec %s (%u) is not supported by this build\n", 
+                        TaskCodec::getCodecName(codecId), c);
+        return false;
+    }
+    
+    return true;
+}
+
+//
+// Map the whole file, pipes and the like stay with stdio reads
+//
+void TaskGraph::mapTaskGraph()
+{
+    struct stat st;
+    
+    if (0 != fstat(fileno(inputFile), &st) || !S_ISREG(st.st_mode) || st.st_size == 0) return;
+    
+    void* m = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fileno(inputFile), 0);
+    if (m == MAP_FAILED) return;
+    
+    mapBase = (const unsigned char*)m;
+    mapLength = st.st_size;
+}
+
+//
+// Decode the task record at pos
+//
+Task* TaskGraph::readTaskAt(uint64 pos)
+{
+    if (mapBase != NULL)
+    {
+        if (pos >= mapLength) return NULL;
+        return Task::decodeContechTask(mapBase + pos, mapLength - pos, codec);
+    }
+    
+    lock_guard<mutex> lock(fileLock);
+    fseek(inputFile, pos, SEEK_SET);
+    
+    return Task::readContechTaskUnlock(inputFile, codec);
 }
 
 //
@@ -74,45 +195,221 @@ TaskGraph::~TaskGraph()
 //
 Task* TaskGraph::getNextTask()
 {
-    if (nextTask == taskOrder.end()) return NULL;
+    if (nextTask >= getFilteredCount()) return NULL;
+    
+    unsigned int i = getFilteredIndex(nextTask);
+    ++nextTask;
     
-    //if ((e = ct_lock(inputFile))) return NULL;
+    if (prefetch != NULL) return prefetch->next();
     
-    fseek(inputFile, *nextTask, SEEK_SET);
+    return readTaskAt(taskOrder[i]);
+}
+
+bool TaskGraph::getNextTaskView(TaskView& view)
+{
+    if (prefetch != NULL)
+    {
+        fprintf(stderr, "TASK GRAPH - Task views are not prefetched, prefetch of depth %u is turned off\n", prefetchDepth);
+        setPrefetch(0);
+    }
+    if (nextTask >= getFilteredCount()) return false;
+    
+    unsigned int i = getFilteredIndex(nextTask);
     ++nextTask;
     
-    return Task::readContechTaskUnlock(inputFile);
+    return getTaskViewByIndex(i, view);
+}
+
+bool TaskGraph::getTaskViewByIndex(unsigned int i, TaskView& view)
+{
+    if (i >= taskOrder.size()) return false;
+    uint64 pos = taskOrder[i];
+    
+    if (mapBase != NULL)
+    {
+        if (pos >= mapLength) return false;
+        return view.decode(mapBase + pos, mapLength - pos, codec);
+    }
+    
+    if (!getRecordByIndex(i, view.comp)) return false;
+    return view.decode(view.comp.data(), view.comp.size(), codec);
+}
+
+void TaskGraph::setPrefetch(unsigned int depth, unsigned int threads)
+{
+    if (prefetch != NULL)
+    {
+        delete prefetch;
+        prefetch = NULL;
+    }
+    
+    prefetchDepth = depth;
+    prefetchThreads = (threads > 0) ? threads : 1;
+    restartPrefetch();
+}
+
+//
+// The order was moved, so tasks read ahead are discarded
+//
+void TaskGraph::restartPrefetch()
+{
+    if (prefetchDepth == 0) return;
+    
+    if (prefetch != NULL) delete prefetch;
+    prefetch = new TaskPrefetch(this, prefetchThreads, prefetchDepth, nextTask);
+}
+
+void TaskGraph::printPrefetchStats(FILE* f)
+{
+    if (prefetch != NULL) prefetch->printStats(f);
+}
+
+//
+// Get the task at position i of the order
+//
+Task* TaskGraph::getTaskByIndex(unsigned int i)
+{
+    if (i >= taskOrder.size()) return NULL;
+    
+    return readTaskAt(taskOrder[i]);
+}
+
+bool TaskGraph::getRecordByIndex(unsigned int i, vector<unsigned char>& rec)
+{
+    uint64 lengths[2];
+    
+    if (i >= taskOrder.size()) return false;
+    uint64 pos = taskOrder[i];
+    
+    if (mapBase != NULL)
+    {
+        if (pos > mapLength || mapLength - pos < sizeof(lengths)) return false;
+        memcpy(lengths, mapBase + pos, sizeof(lengths));
+        if (lengths[1] > mapLength - pos - sizeof(lengths)) return false;
+        rec.assign(mapBase + pos, mapBase + pos + sizeof(lengths) + lengths[1]);
+        return true;
+    }
+    
+    lock_guard<mutex> lock(fileLock);
+    fseek(inputFile, pos, SEEK_SET);
+    if (sizeof(lengths) != ct_read(lengths, sizeof(lengths), inputFile)) return false;
+    rec.resize(sizeof(lengths) + lengths[1]);
+    memcpy(rec.data(), lengths, sizeof(lengths));
+    return lengths[1] == ct_read(rec.data() + sizeof(lengths), lengths[1], inputFile);
 }
 
 void TaskGraph::resetTaskOrder()
 {
-    nextTask = taskOrder.begin();
+    nextTask = 0;
+    restartPrefetch();
 }
 
 //
 // Sets the specified TaskId as the current task
-//   getNextTask will retrieve the next task starting with TaskId
+//   getNextTask will retrieve the next task starting with TaskId, or with the
+//   first task after it that passes the filter
 //
 void TaskGraph::setTaskOrderCurrent(TaskId tid)
 {
-    uint64_t tidPos = taskIdx[tid];
-    while (nextTask != taskOrder.end() &&
-           *nextTask != tidPos) {++nextTask;}
+    uint32_t i;
+    if (!TaskSkeleton::findPosition(taskIdx, tid, &i))
+    {
+        nextTask = getFilteredCount();
+    }
+    else if (!filtered)
+    {
+        nextTask = i;
+    }
+    else
+    {
+        nextTask = lower_bound(filterOrder.begin(), filterOrder.end(), i) - filterOrder.begin();
+    }
+    restartPrefetch();
+}
+
+unsigned int TaskGraph::getFilteredCount()
+{
+    return filtered ? filterOrder.size() : taskOrder.size();
+}
+
+unsigned int TaskGraph::getFilteredIndex(unsigned int k)
+{
+    return filtered ? filterOrder[k] : k;
 }
 
 //
-// Request tasks in order until ID is found
+// Evaluate the filter over the whole order
+//   Contexts and the ROI come from the index, so only times and types need
+//   the skeleton.  No task records are read unless the file predates the
+//   skeleton section.
 //
-Task* TaskGraph::getTaskById(TaskId id)
+void TaskGraph::setTaskFilter(const TaskFilter& tf)
 {
-    auto it = taskIdx.find(id);
+    unsigned int first = 0, last = taskOrder.size();
+    uint32_t i;
+    
+    if (tf.roiOnly)
+    {
+        // Without the start task, nothing is in the ROI; without the end, the ROI runs to the end
+        first = last;
+        if (TaskSkeleton::findPosition(taskIdx, ROIStart, &first) &&
+            ROIEnd != ROIStart && TaskSkeleton::findPosition(taskIdx, ROIEnd, &i) && i > first)
+        {
+            last = i + 1;
+        }
+    }
     
-    if (it == taskIdx.end()) return NULL;
+    vector<ContextId> ctx;
+    if (!tf.contexts.empty())
+    {
+        ctx.resize(taskOrder.size());
+        for (auto& p : taskIdx) ctx[p.second] = p.first.getContextId();
+    }
     
-    //if (ct_lock(inputFile)) return NULL;
-    fseek(inputFile, it->second, SEEK_SET);
+    const TaskSkeleton* sk = NULL;
+    if (tf.needsSkeleton())
+    {
+        sk = getSkeleton();
+        if (sk == NULL || sk->size() != taskOrder.size())
+        {
+            fprintf(stderr, "TASK GRAPH - No skeleton, times and types are not filtered\n");
+            sk = NULL;
+        }
+    }
+    
+    filterOrder.clear();
+    for (i = first; i < last; i++)
+    {
+        if (!ctx.empty() && tf.contexts.count(ctx[i]) == 0) continue;
+        if (sk != NULL)
+        {
+            if (tf.typeMask != 0 && (tf.typeMask & (1U << sk->type[i])) == 0) continue;
+            if (sk->end[i] <= tf.startTime || sk->start[i] >= tf.endTime) continue;
+        }
+        filterOrder.push_back(i);
+    }
+    filtered = true;
     
-    return Task::readContechTaskUnlock(inputFile);
+    resetTaskOrder();
+}
+
+void TaskGraph::clearTaskFilter()
+{
+    filtered = false;
+    filterOrder.clear();
+    resetTaskOrder();
+}
+
+//
+// Find a task by binary search of the index
+//
+Task* TaskGraph::getTaskById(TaskId id)
+{
+    uint32_t i;
+    
+    if (!TaskSkeleton::findPosition(taskIdx, id, &i)) return NULL;
+    
+    return readTaskAt(taskOrder[i]);
 }
 
 Task* TaskGraph::readContechTask()
@@ -132,41 +429,128 @@ TaskGraphInfo* TaskGraph::getTaskGraphInfo()
     return tgi;
 }
 
-void TaskGraph::initTaskIndex(uint64 off)
+//
+// Read the index in one block, from the mapping if there is one
+//   Returns the offset that follows the index, 0 if it cannot be read
+//
+uint64 TaskGraph::initTaskIndex(uint64 off)
 {
-    if (0 != fseek(inputFile, off, SEEK_SET))
+    const size_t entryLen = sizeof(TaskId) + sizeof(uint64);
+    uint64 taskCount = 0;
+    const unsigned char* entries = NULL;
+    vector<unsigned char> buf;
+    
+    if (mapBase != NULL)
     {
-        fprintf(stderr, "Failed to seek to specified offset for Task Graph Index - %lu\n", off);
-        return;
+        if (off + sizeof(uint64) > mapLength)
+        {
+            fprintf(stderr, "Failed to seek to specified offset for Task Graph Index - %lu\n", off);
+            return 0;
+        }
+        memcpy(&taskCount, mapBase + off, sizeof(uint64));
+        if (taskCount > (mapLength - off - sizeof(uint64)) / entryLen)
+        {
+            fprintf(stderr, "Task Graph Index of %lu tasks exceeds the file\n", taskCount);
+            return 0;
+        }
+        entries = mapBase + off + sizeof(uint64);
+    }
+    else
+    {
+        if (0 != fseek(inputFile, off, SEEK_SET))
+        {
+            fprintf(stderr, "Failed to seek to specified offset for Task Graph Index - %lu\n", off);
+            return 0;
+        }
+        ct_read(&taskCount, sizeof(uint64), inputFile);
+        buf.resize(taskCount * entryLen);
+        if (buf.size() != ct_read(buf.data(), buf.size(), inputFile))
+        {
+            fprintf(stderr, "Task Graph Index of %lu tasks exceeds the file\n", taskCount);
+            return 0;
+        }
+        entries = buf.data();
     }
-    //printf("At %lld, ready to read index\n", off);
-    
-    uint64 taskCount;
-    ct_read(&taskCount, sizeof(uint64), inputFile);
-    //printf("Tasks in index - %llu\n", taskCount);
-    
-    set<ContextId> uniqContexts;
     
-    for (uint i = 0; i < taskCount; i++)
+    taskOrder.resize(taskCount);
+    taskIdx.resize(taskCount);
+    for (uint64 i = 0; i < taskCount; i++)
     {
         TaskId tid;
         uint64 pos;
         
-        ct_read(&tid, sizeof(TaskId), inputFile);
-        ct_read(&pos, sizeof(uint64), inputFile);
-        
-        //printf("%s at %llu\n", tid.toString().c_str(), pos);
+        memcpy(&tid, entries + i * entryLen, sizeof(TaskId));
+        memcpy(&pos, entries + i * entryLen + sizeof(TaskId), sizeof(uint64));
         
         // We expect that the index comes after every task in the file
         assert(pos < off);
+        taskOrder[i] = pos;
+        taskIdx[i] = make_pair(tid, (uint32_t)i);
+    }
+    
+    // Sorted by TaskId, each context's tasks are adjacent
+    sort(taskIdx.begin(), taskIdx.end());
+    numOfContexts = 0;
+    for (uint64 i = 0; i < taskCount; i++)
+    {
+        if (i == 0 || taskIdx[i].first.getContextId() != taskIdx[i - 1].first.getContextId()) numOfContexts++;
+        
         // Every tid should only exist once in the index
-        assert(taskIdx.find(tid) == taskIdx.end());
-        taskIdx[tid] = pos;
-        taskOrder.push_back(pos);
-        uniqContexts.insert(tid.getContextId());
+        assert(i == 0 || taskIdx[i].first != taskIdx[i - 1].first);
+    }
+    nextTask = 0;
+    
+    return off + sizeof(uint64) + taskCount * entryLen;
+}
+
+//
+// A shard's section is found from the trailer at the end of the file
+//
+void TaskGraph::readShardInfo()
+{
+    unsigned char trailer[SHARD_TRAILER_LENGTH];
+    vector<unsigned char> buf;
+    uint64 fileLength = 0;
+    
+    if (mapBase != NULL)
+    {
+        fileLength = mapLength;
+        if (fileLength < sizeof(trailer)) return;
+        memcpy(trailer, mapBase + fileLength - sizeof(trailer), sizeof(trailer));
+    }
+    else
+    {
+        lock_guard<mutex> lock(fileLock);
+        fseek(inputFile, 0, SEEK_END);
+        fileLength = ftell(inputFile);
+        if (fileLength < sizeof(trailer)) return;
+        fseek(inputFile, fileLength - sizeof(trailer), SEEK_SET);
+        if (sizeof(trailer) != ct_read(trailer, sizeof(trailer), inputFile)) return;
+    }
+    
+    // Other files end with the skeleton section
+    uint64 off = TaskGraphShard::getSectionOffset(trailer, fileLength);
+    if (off == 0 || off < skeletonOffset) return;
+    
+    size_t len = fileLength - sizeof(trailer) - off;
+    if (mapBase != NULL)
+    {
+        shardInfo = TaskGraphShard::decodeSection(mapBase + off, len);
+    }
+    else
+    {
+        lock_guard<mutex> lock(fileLock);
+        buf.resize(len);
+        fseek(inputFile, off, SEEK_SET);
+        if (len == ct_read(buf.data(), len, inputFile)) shardInfo = TaskGraphShard::decodeSection(buf.data(), len);
+    }
+    
+    if (shardInfo == NULL || shardInfo->graphIndex.size() != taskOrder.size())
+    {
+        fprintf(stderr, "TASK GRAPH - Shard section does not match the index\n");
+        delete shardInfo;
+        shardInfo = NULL;
     }
-    nextTask = taskOrder.begin();
-    numOfContexts = uniqContexts.size();
 }
 
 TaskGraphInfo* TaskGraph::readTaskGraphInfo()
@@ -180,6 +564,63 @@ TaskGraphInfo* TaskGraph::readTaskGraphInfo()
     return tTgi;
 }
 
+const TaskSkeleton* TaskGraph::getSkeleton()
+{
+    if (skeleton == NULL) skeleton = readSkeleton();
+    return skeleton;
+}
+
+//
+// Read the skeleton section, or build the skeleton by decoding every task
+//
+TaskSkeleton* TaskGraph::readSkeleton()
+{
+    const TaskSkeleton::task_positions& pos = taskIdx;
+    TaskSkeleton* sk = NULL;
+    
+    if (skeletonOffset != 0 && mapBase != NULL && skeletonOffset <= mapLength)
+    {
+        sk = TaskSkeleton::decodeSection(mapBase + skeletonOffset, mapLength - skeletonOffset, pos);
+    }
+    else if (skeletonOffset != 0)
+    {
+        lock_guard<mutex> lock(fileLock);
+        vector<unsigned char> buf;
+        fseek(inputFile, 0, SEEK_END);
+        long end = ftell(inputFile);
+        if (end > (long)skeletonOffset)
+        {
+            buf.resize(end - skeletonOffset);
+            fseek(inputFile, skeletonOffset, SEEK_SET);
+            buf.resize(ct_read(buf.data(), buf.size(), inputFile));
+        }
+        sk = TaskSkeleton::decodeSection(buf.data(), buf.size(), pos);
+    }
+    
+    if (sk != NULL) return sk;
+    if (skeletonOffset != 0)
+    {
+        fprintf(stderr, "TASK GRAPH - Skeleton does not match the index, decoding every task\n");
+    }
+    
+    sk = new TaskSkeleton();
+    for (unsigned int i = 0; i < taskOrder.size(); i++)
+    {
+        Task* t = getTaskByIndex(i);
+        if (t == NULL)
+        {
+            fprintf(stderr, "TASK GRAPH - Failed to read task %u for the skeleton\n", i);
+            delete sk;
+            return NULL;
+        }
+        sk->appendTask(t, pos);
+        delete t;
+    }
+    sk->finishTasks();
+    
+    return sk;
+}
+
 unsigned int TaskGraph::getNumberOfTasks()
 {
     return taskOrder.size();
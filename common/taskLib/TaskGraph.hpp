@@ -5,6 +5,8 @@
 #include "TaskGraphInfo.hpp"
 #include "TaskId.hpp"
 #include "Action.hpp"
+#include "TaskSkeleton.hpp"
+#include "TaskView.hpp"
 #include "ct_file.h"
 #include <stdio.h>
 #include <stdlib.h>
@@ -17,34 +19,105 @@
 #include <deque>
 #include <algorithm>
 #include <inttypes.h>
+#include <mutex>
 
-#define TASK_GRAPH_VERSION 4315
+#define TASK_GRAPH_VERSION 4318
+
+// From this version, the header has the task record codec and the offset of
+//   its dictionary (0 for none) after the ROI:
+//   uint32 codec, uint64 dictionary offset -> uint32 length, dictionary
+#define TASK_GRAPH_CODEC_VERSION 4316
+
+// From this version, task records may store their actions as columns
+#define TASK_GRAPH_COLUMNAR_VERSION 4317
+
+// From this version, the index is followed by the skeleton section, see TaskSkeleton
+#define TASK_GRAPH_SKELETON_VERSION 4318
 
 using namespace std;
 namespace contech {
 
+class TaskPrefetch;
+class TaskGraphShard;
+
+//
+// Restricts the tasks returned by getNextTask
+//   Every criterion left at its default passes all tasks.  A task passes the
+//   time range if it overlaps [startTime, endTime).  The ROI is the order
+//   from the ROI start task through the ROI end task, so backends still see
+//   both markers.
+//
+class TaskFilter
+{
+public:
+    ct_timestamp startTime;
+    ct_timestamp endTime;
+    bool roiOnly;
+    set<ContextId> contexts;    // empty for every context
+    uint32_t typeMask;          // bit (1 << task_type) per type, 0 for every type
+    
+    TaskFilter() : startTime(0), endTime(~0ULL), roiOnly(false), typeMask(0) {}
+    
+    // Times and types are only in the skeleton, the rest is in the index
+    bool needsSkeleton() const { return typeMask != 0 || startTime != 0 || endTime != ~0ULL; }
+};
+
 class TaskGraph
 {
 private:
     FILE* inputFile;
     TaskGraphInfo* tgi;
     
+    // The file mapped read only, so tasks are decoded in place by any thread
+    //   NULL if the file cannot be mapped, then reads are serialized on fileLock
+    const unsigned char* mapBase;
+    size_t mapLength;
+    mutex fileLock;
+    void mapTaskGraph();
+    Task* readTaskAt(uint64 pos);
+    
     // Use an index to find each task in the graph
-    //   TaskId -> position in file
-    map<TaskId, uint64> taskIdx;
+    //   (TaskId, position in taskOrder), sorted by TaskId for binary search
+    TaskSkeleton::task_positions taskIdx;
     
     // Store the positions of each task
     vector<uint64> taskOrder;
-    vector<uint64>::iterator nextTask;
+    
+    // Indices of the tasks that pass the filter, in order
+    bool filtered;
+    vector<uint32_t> filterOrder;
+    
+    // Position of the next task in the (filtered) order
+    unsigned int nextTask;
+    
+    // Reads ahead of getNextTask, NULL unless enabled
+    TaskPrefetch* prefetch;
+    unsigned int prefetchDepth, prefetchThreads;
+    void restartPrefetch();
     
     TaskId ROIStart;
     TaskId ROIEnd;
     
+    // Decoder for the task records, NULL if zlib without a dictionary
+    TaskCodec* codec;
+    task_codec codecId;
+    vector<unsigned char> codecDict;
+    bool readTaskCodec();
+    
     unsigned int numOfContexts;
     
+    // Offset of the skeleton section, 0 if the file has none
+    uint64 skeletonOffset;
+    TaskSkeleton* skeleton;
+    TaskSkeleton* readSkeleton();
+    
+    // Set when the file is one shard of a graph, see TaskGraphShard
+    TaskGraphShard* shardInfo;
+    void readShardInfo();
+    
     // Privately, attempt to read a task graph info struct
     TaskGraphInfo* readTaskGraphInfo();
-    void initTaskIndex(uint64);
+    uint64 initTaskIndex(uint64);
     
     TaskGraph(FILE*);
 
@@ -54,10 +127,49 @@ public:
     static TaskGraph* initFromFile(FILE*);
     
     Task* getNextTask();
+    // Safe to call from any number of threads
     Task* getTaskById(TaskId id);
+    Task* getTaskByIndex(unsigned int i);
+    
+    // Decode a task into a view, reusing the view's buffers, see TaskView
+    //   Views are decoded by the caller, not read ahead, so getNextTaskView
+    //   turns off setPrefetch and CONTECH_TASKGRAPH_PREFETCH, with a warning
+    //   on stderr.  getTaskViewByIndex is safe from any number of threads,
+    //   each with its own view.
+    bool getNextTaskView(TaskView& view);
+    bool getTaskViewByIndex(unsigned int i, TaskView& view);
+    bool isMapped() { return mapBase != NULL; }
     void setTaskOrderCurrent(TaskId tid);
     void resetTaskOrder();
     
+    // Tasks that fail the filter are skipped by getNextTask without being
+    //   read, and the order is reset.  Filters do not combine, each replaces
+    //   the last.
+    void setTaskFilter(const TaskFilter&);
+    void clearTaskFilter();
+    // The number of tasks in the filtered order and the index of the k-th
+    unsigned int getFilteredCount();
+    unsigned int getFilteredIndex(unsigned int k);
+    
+    // Decode the next depth tasks of the order in the background
+    //   CONTECH_TASKGRAPH_PREFETCH=<depth> enables this for every taskgraph,
+    //   and the stalls are reported when the graph is deleted.  0 disables it.
+    void setPrefetch(unsigned int depth, unsigned int threads = 1);
+    void printPrefetchStats(FILE*);
+    
+    // Ids, times, types and edges of every task, without decoding any actions
+    //   unless the file predates the skeleton section.  Owned by the graph.
+    const TaskSkeleton* getSkeleton();
+    
+    // The record of task i as it is stored: the two lengths, then the
+    //   compressed task.  Safe to call from any number of threads.
+    bool getRecordByIndex(unsigned int i, vector<unsigned char>& rec);
+    task_codec getCodecId() { return codecId; }
+    const vector<unsigned char>& getCodecDictionary() { return codecDict; }
+    
+    // NULL unless the file was written by TaskGraphShard::split
+    const TaskGraphShard* getShardInfo() { return shardInfo; }
+    
     unsigned int getNumberOfTasks();
     unsigned int getNumberOfContexts();
     
@@ -0,0 +1,335 @@
+#include "TaskGraphShard.hpp"
+#include "TaskGraphWriter.hpp"
+#include <string.h>
+
+using namespace std;
+using namespace contech;
+
+#define SHARD_HEADER_LENGTH (4 * sizeof(uint32_t) + 4 * sizeof(uint64))
+#define SHARD_COPY_CHUNK (1024 * 1024)
+
+// A task to write, as the graph that has it and its index in that graph
+typedef pair<TaskGraph*, uint32_t> source_task;
+
+static inline void putBytes(vector<unsigned char>& buf, const void* v, size_t len)
+{
+    buf.insert(buf.end(), (const unsigned char*)v, (const unsigned char*)v + len);
+}
+
+static inline bool getBytes(const unsigned char*& p, const unsigned char* e, void* v, size_t len)
+{
+    if ((size_t)(e - p) < len) return false;
+    memcpy(v, p, len);
+    p += len;
+    return true;
+}
+
+void TaskGraphShard::encodeSection(vector<unsigned char>& buf) const
+{
+    uint32_t header[4] = {shard, shardCount, (uint32_t)partition, 0};
+    uint64 taskCount = graphIndex.size();
+    uint64 stubCount = stubs.size();
+
+    putBytes(buf, header, sizeof(header));
+    putBytes(buf, &startTime, sizeof(ct_timestamp));
+    putBytes(buf, &endTime, sizeof(ct_timestamp));
+    putBytes(buf, &graphTaskCount, sizeof(uint64));
+    putBytes(buf, &taskCount, sizeof(uint64));
+    putBytes(buf, graphIndex.data(), taskCount * sizeof(uint32_t));
+    putBytes(buf, &stubCount, sizeof(uint64));
+    putBytes(buf, stubs.data(), stubCount * sizeof(shard_stub));
+}
+
+TaskGraphShard* TaskGraphShard::decodeSection(const unsigned char* p, size_t len)
+{
+    const unsigned char* e = p + len;
+    uint32_t header[4];
+    uint64 taskCount = 0, stubCount = 0;
+
+    if (len < SHARD_HEADER_LENGTH) return NULL;
+
+    TaskGraphShard* s = new TaskGraphShard();
+    getBytes(p, e, header, sizeof(header));
+    getBytes(p, e, &s->startTime, sizeof(ct_timestamp));
+    getBytes(p, e, &s->endTime, sizeof(ct_timestamp));
+    getBytes(p, e, &s->graphTaskCount, sizeof(uint64));
+    getBytes(p, e, &taskCount, sizeof(uint64));
+    s->shard = header[0];
+    s->shardCount = header[1];
+    s->partition = (shard_partition)header[2];
+
+    if (taskCount > s->graphTaskCount || (size_t)(e - p) / sizeof(uint32_t) < taskCount)
+    {
+        delete s;
+        return NULL;
+    }
+    s->graphIndex.resize(taskCount);
+    getBytes(p, e, s->graphIndex.data(), taskCount * sizeof(uint32_t));
+
+    if (!getBytes(p, e, &stubCount, sizeof(uint64)) || (size_t)(e - p) / sizeof(shard_stub) < stubCount)
+    {
+        delete s;
+        return NULL;
+    }
+    s->stubs.resize(stubCount);
+    getBytes(p, e, s->stubs.data(), stubCount * sizeof(shard_stub));
+
+    return s;
+}
+
+uint64 TaskGraphShard::getSectionOffset(const unsigned char* trailer, uint64 fileLength)
+{
+    uint64 off;
+    uint32_t magic;
+
+    memcpy(&off, trailer, sizeof(uint64));
+    memcpy(&magic, trailer + sizeof(uint64), sizeof(uint32_t));
+    if (magic != SHARD_MAGIC || fileLength < SHARD_TRAILER_LENGTH + SHARD_HEADER_LENGTH) return 0;
+    if (off > fileLength - SHARD_TRAILER_LENGTH - SHARD_HEADER_LENGTH) return 0;
+
+    return off;
+}
+
+//
+// The skeleton entry of a task, with every edge
+//   A whole graph's skeleton has them all, but a shard's drops the edges to
+//   other shards, so its tasks are decoded instead.
+//
+static bool getSkeletonEntry(TaskGraph* g, uint32_t i, vector<unsigned char>& entry)
+{
+    if (g->getShardInfo() == NULL)
+    {
+        const TaskSkeleton* sk = g->getSkeleton();
+        if (sk == NULL || i >= sk->size()) return false;
+        sk->encodeEntry(i, entry);
+        return true;
+    }
+
+    Task* t = g->getTaskByIndex(i);
+    if (t == NULL) return false;
+    TaskSkeleton::encodeEntry(*t, entry);
+    delete t;
+    return true;
+}
+
+//
+// Write a taskgraph of tasks taken from other graphs, in the order given
+//   The ROI, TaskGraphInfo and codec are those of g, which every source
+//   shares, so the records are copied as they are stored.
+//
+static bool writeGraph(FILE* out, TaskGraph* g, const vector<source_task>& tasks, const TaskGraphShard* info)
+{
+    uint64 indexOffset = 0, dictOffset = 0;
+    TaskId roiStart = g->getROIStart(), roiEnd = g->getROIEnd();
+    uint32_t codecId = g->getCodecId();
+    const vector<unsigned char>& dict = g->getCodecDictionary();
+
+    TaskGraphWriter::writeHeader(out, roiStart, roiEnd, codecId);
+    g->getTaskGraphInfo()->writeTaskGraphInfo(out);
+
+    if (!dict.empty())
+    {
+        dictOffset = TaskGraphWriter::writeDictionary(out, dict.data(), dict.size());
+    }
+
+    // The skeleton entries wait in a temporary file until the index is written
+    FILE* skeletonFile = tmpfile();
+    if (skeletonFile == NULL)
+    {
+        perror("Cannot create temporary file for the skeleton");
+        return false;
+    }
+
+    vector<pair<TaskId, uint64> > index;
+    vector<unsigned char> rec, entry;
+    index.reserve(tasks.size());
+    for (const source_task& st : tasks)
+    {
+        entry.clear();
+        if (!st.first->getRecordByIndex(st.second, rec) || !getSkeletonEntry(st.first, st.second, entry))
+        {
+            fprintf(stderr, "TASK GRAPH - Failed to read task %u\n", st.second);
+            fclose(skeletonFile);
+            return false;
+        }
+
+        // Each entry starts with the task's id
+        TaskId tid;
+        memcpy(&tid, entry.data(), sizeof(TaskId));
+        index.push_back(make_pair(tid, (uint64)ftell(out)));
+
+        ct_write(rec.data(), rec.size(), out);
+        fwrite(entry.data(), 1, entry.size(), skeletonFile);
+    }
+
+    indexOffset = ftell(out);
+    TaskGraphWriter::writeIndex(out, index);
+
+    TaskGraphWriter::writeSkeletonCount(out, index.size());
+    fflush(skeletonFile);
+    rewind(skeletonFile);
+    char* buf = (char*) malloc(SHARD_COPY_CHUNK);
+    assert(buf != NULL);
+    size_t r;
+    while ((r = fread(buf, 1, SHARD_COPY_CHUNK, skeletonFile)) > 0)
+    {
+        ct_write(buf, r, out);
+    }
+    free(buf);
+    fclose(skeletonFile);
+
+    if (info != NULL)
+    {
+        vector<unsigned char> section;
+        uint64 sectionOffset = ftell(out);
+        uint32_t magic = SHARD_MAGIC;
+        info->encodeSection(section);
+        ct_write(section.data(), section.size(), out);
+        ct_write(&sectionOffset, sizeof(uint64), out);
+        ct_write(&magic, sizeof(uint32_t), out);
+    }
+
+    TaskGraphWriter::finishHeader(out, indexOffset, roiStart, roiEnd, codecId, dictOffset);
+    fflush(out);
+
+    return true;
+}
+
+bool TaskGraphShard::split(TaskGraph* tg, shard_partition partition, unsigned int shardCount, const char* prefix)
+{
+    if (tg->getShardInfo() != NULL)
+    {
+        fprintf(stderr, "TASK GRAPH - Cannot split a shard, merge the shards first\n");
+        return false;
+    }
+
+    const TaskSkeleton* sk = tg->getSkeleton();
+    if (sk == NULL || shardCount == 0) return false;
+    uint32_t n = sk->size();
+
+    // By time, shard s starts at bound[s - 1]
+    vector<ct_timestamp> bound;
+    if (partition == shard_by_time)
+    {
+        vector<ct_timestamp> sorted(sk->start);
+        sort(sorted.begin(), sorted.end());
+        for (unsigned int s = 1; s < shardCount; s++)
+        {
+            bound.push_back(sorted.empty() ? 0 : sorted[((uint64)s * n) / shardCount]);
+        }
+    }
+
+    vector<uint32_t> shardOf(n);
+    for (uint32_t i = 0; i < n; i++)
+    {
+        if (partition == shard_by_context)
+        {
+            shardOf[i] = (uint32_t)sk->id[i].getContextId() % shardCount;
+        }
+        else
+        {
+            shardOf[i] = upper_bound(bound.begin(), bound.end(), sk->start[i]) - bound.begin();
+        }
+    }
+
+    for (unsigned int s = 0; s < shardCount; s++)
+    {
+        TaskGraphShard info;
+        vector<source_task> tasks;
+
+        info.shard = s;
+        info.shardCount = shardCount;
+        info.partition = partition;
+        info.startTime = (partition == shard_by_time && s > 0) ? bound[s - 1] : 0;
+        info.endTime = (partition == shard_by_time && s + 1 < shardCount) ? bound[s] : ~0ULL;
+        info.graphTaskCount = n;
+
+        for (uint32_t i = 0; i < n; i++)
+        {
+            if (shardOf[i] != s) continue;
+
+            info.graphIndex.push_back(i);
+            tasks.push_back(make_pair(tg, i));
+
+            for (uint64 k = 0; k < sk->getSuccessorCount(i); k++)
+            {
+                uint32_t j = sk->getSuccessors(i)[k];
+                if (shardOf[j] != s) info.stubs.push_back({sk->id[i], sk->id[j], shardOf[j], 1});
+            }
+            for (uint64 k = 0; k < sk->getPredecessorCount(i); k++)
+            {
+                uint32_t j = sk->getPredecessors(i)[k];
+                if (shardOf[j] != s) info.stubs.push_back({sk->id[i], sk->id[j], shardOf[j], 0});
+            }
+        }
+
+        string fname = string(prefix) + "." + to_string(s) + ".tg";
+        FILE* out = fopen(fname.c_str(), "wb");
+        if (out == NULL)
+        {
+            fprintf(stderr, "TASK GRAPH - Cannot open %s\n", fname.c_str());
+            return false;
+        }
+
+        bool r = writeGraph(out, tg, tasks, &info);
+        fclose(out);
+        if (!r) return false;
+    }
+
+    return true;
+}
+
+bool TaskGraphShard::merge(vector<TaskGraph*>& shards, FILE* out)
+{
+    vector<source_task> tasks;
+    vector<bool> seen(shards.size(), false);
+
+    if (shards.empty()) return false;
+    for (TaskGraph* g : shards)
+    {
+        const TaskGraphShard* info = g->getShardInfo();
+        if (info == NULL)
+        {
+            fprintf(stderr, "TASK GRAPH - Not a shard, cannot merge\n");
+            return false;
+        }
+        if (info->shardCount != shards.size() || info->shard >= shards.size() || seen[info->shard])
+        {
+            fprintf(stderr, "TASK GRAPH - Shard %u of %u does not belong with %zu shards\n",
+                            info->shard, info->shardCount, shards.size());
+            return false;
+        }
+        seen[info->shard] = true;
+
+        if (g == shards[0]) tasks.assign(info->graphTaskCount, source_task(NULL, 0));
+        if (info->graphTaskCount != tasks.size() ||
+            g->getCodecId() != shards[0]->getCodecId() ||
+            g->getCodecDictionary() != shards[0]->getCodecDictionary())
+        {
+            fprintf(stderr, "TASK GRAPH - Shards are from different graphs\n");
+            return false;
+        }
+
+        for (uint32_t i = 0; i < info->graphIndex.size(); i++)
+        {
+            uint32_t gi = info->graphIndex[i];
+            if (gi >= tasks.size() || tasks[gi].first != NULL)
+            {
+                fprintf(stderr, "TASK GRAPH - Shards overlap at task %u\n", gi);
+                return false;
+            }
+            tasks[gi] = source_task(g, i);
+        }
+    }
+
+    for (const source_task& st : tasks)
+    {
+        if (st.first == NULL)
+        {
+            fprintf(stderr, "TASK GRAPH - Shards are missing tasks\n");
+            return false;
+        }
+    }
+
+    return writeGraph(out, shards[0], tasks, NULL);
+}
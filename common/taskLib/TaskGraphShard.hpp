@@ -0,0 +1,68 @@
+#ifndef TASK_GRAPH_SHARD_HPP
+#define TASK_GRAPH_SHARD_HPP
+
+#include "TaskGraph.hpp"
+#include <vector>
+
+namespace contech {
+
+// The last bytes of a shard: uint64 offset of the shard section, uint32 magic
+#define SHARD_TRAILER_LENGTH (sizeof(uint64) + sizeof(uint32_t))
+#define SHARD_MAGIC 0x44524853
+
+enum shard_partition { shard_by_context = 0, shard_by_time };
+
+// An edge between a task of this shard and a task of another
+typedef struct _shard_stub
+{
+    TaskId local;
+    TaskId remote;
+    uint32_t remoteShard;
+    uint32_t isSuccessor;   // 1 if remote is a successor of local, 0 if a predecessor
+} shard_stub;
+
+//
+// One part of a taskgraph that was split for separate processing
+//
+//   Each shard is a complete taskgraph file with the tasks of its part, in
+//   the original index order, and a copy of the TaskGraphInfo, ROI and codec.
+//   The records are copied without being decoded.  Edges to other shards stay
+//   in the records and skeleton entries, and are listed again as stubs, so
+//   a shard's boundary is known without reading the others.  The shard
+//   section follows the skeleton:
+//   uint32 shard, shard count, partition, 0, uint64 start time, end time,
+//   tasks in the graph, tasks in the shard, uint32 graph index per task,
+//   uint64 stub count, then the stubs, and last the trailer.
+//
+class TaskGraphShard
+{
+public:
+    uint32_t shard;
+    uint32_t shardCount;
+    shard_partition partition;
+    // By time, the shard has the tasks that start in [startTime, endTime)
+    ct_timestamp startTime;
+    ct_timestamp endTime;
+    uint64 graphTaskCount;
+    // Position of each task in the index order of the whole graph
+    vector<uint32_t> graphIndex;
+    vector<shard_stub> stubs;
+
+    void encodeSection(vector<unsigned char>& buf) const;
+    static TaskGraphShard* decodeSection(const unsigned char* p, size_t len);
+    // 0 unless the trailer is a shard's
+    static uint64 getSectionOffset(const unsigned char* trailer, uint64 fileLength);
+
+    // Writes shardCount shards of tg, as <prefix>.<shard>.tg
+    //   By context, a shard has the contexts whose id is its index modulo the
+    //   shard count, as SimpleBackendWrapper shards a backend.  By time, each
+    //   has about the same number of tasks.
+    static bool split(TaskGraph* tg, shard_partition partition, unsigned int shardCount, const char* prefix);
+
+    // Writes the graph that the shards were split from
+    static bool merge(vector<TaskGraph*>& shards, FILE* out);
+};
+
+}
+
+#endif
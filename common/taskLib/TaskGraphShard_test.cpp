@@ -0,0 +1,267 @@
+#include "TaskGraphShard.hpp"
+#include "test_graph.hpp"
+#include <string.h>
+#include <unistd.h>
+#include <string>
+
+using namespace contech;
+
+//
+// Shards of a graph from test_graph.hpp: the shard section, split by context
+//   and by time, and merging the shards back into the graph.  Returns 0 if
+//   every test passes.
+//
+
+#define TEST_CONTEXTS 7
+#define TEST_TASKS_PER_CONTEXT 30
+#define TEST_SHARDS 3
+
+static char tempDir[] = "/tmp/TaskGraphShard_testXXXXXX";
+static string graphPath;
+
+static vector<unsigned char> readFile(const string& path)
+{
+    vector<unsigned char> buf;
+    FILE* f = fopen(path.c_str(), "rb");
+    if (f == NULL) return buf;
+    fseek(f, 0, SEEK_END);
+    buf.resize(ftell(f));
+    rewind(f);
+    buf.resize(fread(buf.data(), 1, buf.size(), f));
+    fclose(f);
+    return buf;
+}
+
+static string shardPath(const string& prefix, unsigned int s)
+{
+    return prefix + "." + to_string(s) + ".tg";
+}
+
+static vector<TaskGraph*> openShards(const string& prefix, unsigned int count)
+{
+    vector<TaskGraph*> shards;
+    for (unsigned int s = 0; s < count; s++)
+    {
+        TaskGraph* g = TaskGraph::initFromFile(shardPath(prefix, s).c_str());
+        CHECK(g != NULL);
+        if (g != NULL) shards.push_back(g);
+    }
+    return shards;
+}
+
+static void closeShards(vector<TaskGraph*>& shards)
+{
+    for (TaskGraph* g : shards) delete g;
+    shards.clear();
+}
+
+static void testSection()
+{
+    TaskGraphShard info;
+    info.shard = 2;
+    info.shardCount = 5;
+    info.partition = shard_by_time;
+    info.startTime = 1000;
+    info.endTime = 2000;
+    info.graphTaskCount = 40;
+    for (uint32_t i = 3; i < 40; i += 3) info.graphIndex.push_back(i);
+    info.stubs.push_back({TaskId(ContextId(1), SeqId(2)), TaskId(ContextId(4), SeqId(0)), 4, 1});
+    info.stubs.push_back({TaskId(ContextId(3), SeqId(0)), TaskId(ContextId(2), SeqId(1)), 0, 0});
+
+    vector<unsigned char> buf;
+    info.encodeSection(buf);
+    TaskGraphShard* d = TaskGraphShard::decodeSection(buf.data(), buf.size());
+    CHECK(d != NULL);
+    if (d != NULL)
+    {
+        CHECK(d->shard == info.shard && d->shardCount == info.shardCount);
+        CHECK(d->partition == info.partition);
+        CHECK(d->startTime == info.startTime && d->endTime == info.endTime);
+        CHECK(d->graphTaskCount == info.graphTaskCount);
+        CHECK(d->graphIndex == info.graphIndex);
+        CHECK(d->stubs.size() == info.stubs.size() &&
+              memcmp(d->stubs.data(), info.stubs.data(), info.stubs.size() * sizeof(shard_stub)) == 0);
+        delete d;
+    }
+
+    // Every truncation is missing part of the index or the stubs
+    unsigned int accepted = 0;
+    for (size_t l = 0; l < buf.size(); l++)
+    {
+        d = TaskGraphShard::decodeSection(buf.data(), l);
+        if (d != NULL) accepted++;
+        delete d;
+    }
+    CHECK(accepted == 0);
+
+    // More tasks in the shard than in the graph
+    vector<unsigned char> bad(buf);
+    uint64 n = info.graphTaskCount + 1;
+    memcpy(bad.data() + 4 * sizeof(uint32_t) + 3 * sizeof(uint64), &n, sizeof(uint64));
+    CHECK(TaskGraphShard::decodeSection(bad.data(), bad.size()) == NULL);
+
+    // The trailer is found only with the magic and an offset inside the file
+    unsigned char trailer[SHARD_TRAILER_LENGTH];
+    uint64 off = 100;
+    uint32_t magic = SHARD_MAGIC;
+    memcpy(trailer, &off, sizeof(uint64));
+    memcpy(trailer + sizeof(uint64), &magic, sizeof(uint32_t));
+    CHECK(TaskGraphShard::getSectionOffset(trailer, 1000) == off);
+    CHECK(TaskGraphShard::getSectionOffset(trailer, off + SHARD_TRAILER_LENGTH) == 0);
+    magic++;
+    memcpy(trailer + sizeof(uint64), &magic, sizeof(uint32_t));
+    CHECK(TaskGraphShard::getSectionOffset(trailer, 1000) == 0);
+}
+
+// Each shard has its tasks in the graph's order, copied as they are stored,
+//   and a stub for every edge that leaves it
+static void checkShards(TaskGraph* tg, vector<TaskGraph*>& shards, shard_partition partition)
+{
+    const TaskSkeleton* sk = tg->getSkeleton();
+    CHECK(sk != NULL && shards.size() == TEST_SHARDS);
+    if (sk == NULL || shards.size() != TEST_SHARDS) return;
+
+    vector<int> shardOf(sk->size(), -1);
+    uint64 total = 0;
+    for (TaskGraph* g : shards)
+    {
+        const TaskGraphShard* info = g->getShardInfo();
+        CHECK(info != NULL);
+        if (info == NULL) return;
+        CHECK(info->shardCount == TEST_SHARDS && info->partition == partition);
+        CHECK(info->graphTaskCount == sk->size());
+        CHECK(info->graphIndex.size() == g->getNumberOfTasks());
+        CHECK(g->getROIStart() == tg->getROIStart() && g->getROIEnd() == tg->getROIEnd());
+        total += info->graphIndex.size();
+
+        bool same = true;
+        vector<unsigned char> a, b;
+        for (uint32_t i = 0; i < info->graphIndex.size(); i++)
+        {
+            uint32_t gi = info->graphIndex[i];
+            if (gi >= sk->size() || shardOf[gi] != -1 || (i > 0 && gi <= info->graphIndex[i - 1]))
+            {
+                same = false;
+                continue;
+            }
+            shardOf[gi] = info->shard;
+            if (!g->getRecordByIndex(i, a) || !tg->getRecordByIndex(gi, b) || a != b) same = false;
+
+            if (partition == shard_by_context)
+            {
+                if ((uint32_t)sk->id[gi].getContextId() % TEST_SHARDS != info->shard) same = false;
+            }
+            else if (sk->start[gi] < info->startTime || sk->start[gi] >= info->endTime)
+            {
+                same = false;
+            }
+        }
+        CHECK(same);
+    }
+    CHECK(total == sk->size());
+
+    // The stubs are the edges between shards, from both ends
+    TaskSkeleton::task_positions pos;
+    for (uint32_t i = 0; i < sk->size(); i++) pos.push_back(make_pair(sk->id[i], i));
+    sort(pos.begin(), pos.end());
+    uint64 crossing = 0, stubs = 0;
+    for (uint32_t i = 0; i < sk->size(); i++)
+    {
+        for (uint64 k = 0; k < sk->getSuccessorCount(i); k++)
+        {
+            if (shardOf[sk->getSuccessors(i)[k]] != shardOf[i]) crossing++;
+        }
+        for (uint64 k = 0; k < sk->getPredecessorCount(i); k++)
+        {
+            if (shardOf[sk->getPredecessors(i)[k]] != shardOf[i]) crossing++;
+        }
+    }
+    for (TaskGraph* g : shards)
+    {
+        const TaskGraphShard* info = g->getShardInfo();
+        for (const shard_stub& st : info->stubs)
+        {
+            uint32_t l, r;
+            bool found = TaskSkeleton::findPosition(pos, st.local, &l) &&
+                         TaskSkeleton::findPosition(pos, st.remote, &r);
+            CHECK(found);
+            if (found)
+            {
+                CHECK(shardOf[l] == (int)info->shard && shardOf[r] == (int)st.remoteShard);
+            }
+            stubs++;
+        }
+    }
+    CHECK(crossing > 0);
+    CHECK(stubs == crossing);
+}
+
+// Merging the shards, in any order, writes the graph they were split from
+static void testSplitMerge(shard_partition partition)
+{
+    TaskGraph* tg = TaskGraph::initFromFile(graphPath.c_str());
+    CHECK(tg != NULL);
+    if (tg == NULL) return;
+
+    string prefix = string(tempDir) + ((partition == shard_by_context) ? "/ctx" : "/time");
+    CHECK(TaskGraphShard::split(tg, partition, TEST_SHARDS, prefix.c_str()));
+    vector<TaskGraph*> shards = openShards(prefix, TEST_SHARDS);
+    checkShards(tg, shards, partition);
+
+    // A shard is not split again
+    CHECK(!TaskGraphShard::split(shards[0], partition, 2, (prefix + ".again").c_str()));
+
+    reverse(shards.begin(), shards.end());
+    string merged = prefix + ".merged";
+    FILE* out = fopen(merged.c_str(), "wb");
+    CHECK(out != NULL);
+    if (out != NULL)
+    {
+        CHECK(TaskGraphShard::merge(shards, out));
+        fclose(out);
+        CHECK(readFile(merged) == readFile(graphPath));
+    }
+
+    // Shards that are missing, given twice or from another split
+    out = fopen(merged.c_str(), "wb");
+    vector<TaskGraph*> part(shards.begin(), shards.end() - 1);
+    CHECK(!TaskGraphShard::merge(part, out));
+    part.push_back(shards[0]);
+    CHECK(!TaskGraphShard::merge(part, out));
+    fclose(out);
+
+    CHECK(TaskGraphShard::split(tg, partition, TEST_SHARDS + 1, (prefix + ".other").c_str()));
+    vector<TaskGraph*> other = openShards(prefix + ".other", TEST_SHARDS + 1);
+    part.assign(shards.begin(), shards.end() - 1);
+    part.push_back(other[0]);
+    out = fopen(merged.c_str(), "wb");
+    CHECK(!TaskGraphShard::merge(part, out));
+    fclose(out);
+
+    closeShards(other);
+    closeShards(shards);
+    delete tg;
+}
+
+int main(int argc, char** argv)
+{
+    if (mkdtemp(tempDir) == NULL)
+    {
+        fprintf(stderr, "Could not create %s\n", tempDir);
+        return 1;
+    }
+    graphPath = string(tempDir) + "/graph";
+
+    vector<Task*> tasks = makeTestTasks(TEST_CONTEXTS, TEST_TASKS_PER_CONTEXT);
+    CHECK(writeTestGraph(graphPath.c_str(), tasks));
+    deleteTestTasks(tasks);
+
+    testSection();
+    testSplitMerge(shard_by_context);
+    testSplitMerge(shard_by_time);
+
+    string cmd = string("rm -rf ") + tempDir;
+    system(cmd.c_str());
+
+    return testResult("TaskGraphShard_test");
+}
@@ -0,0 +1,62 @@
+#include "TaskGraphWriter.hpp"
+
+using namespace std;
+using namespace contech;
+
+void TaskGraphWriter::writeHeader(FILE* out, TaskId roiStart, TaskId roiEnd, uint32_t codecId)
+{
+    uint32_t version = TASK_GRAPH_VERSION;
+    uint64 offset = 0;
+
+    ct_write(&version, sizeof(uint32_t), out);
+    ct_write(&offset, sizeof(uint64), out);     // Index
+    ct_write(&roiStart, sizeof(TaskId), out);
+    ct_write(&roiEnd, sizeof(TaskId), out);
+    ct_write(&codecId, sizeof(uint32_t), out);
+    ct_write(&offset, sizeof(uint64), out);     // Codec dictionary
+}
+
+void TaskGraphWriter::finishHeader(FILE* out, uint64 indexOffset, TaskId roiStart, TaskId roiEnd,
+                                   uint32_t codecId, uint64 dictOffset)
+{
+    fseek(out, sizeof(uint32_t), SEEK_SET);
+    ct_write(&indexOffset, sizeof(uint64), out);
+    ct_write(&roiStart, sizeof(TaskId), out);
+    ct_write(&roiEnd, sizeof(TaskId), out);
+    ct_write(&codecId, sizeof(uint32_t), out);
+    ct_write(&dictOffset, sizeof(uint64), out);
+    fseek(out, 0, SEEK_END);
+}
+
+uint64 TaskGraphWriter::writeDictionary(FILE* out, const unsigned char* dict, uint32_t len)
+{
+    uint64 offset = ftell(out);
+    ct_write(&len, sizeof(uint32_t), out);
+    ct_write(dict, len, out);
+    return offset;
+}
+
+void TaskGraphWriter::writeIndexCount(FILE* out, uint64 count)
+{
+    ct_write(&count, sizeof(uint64), out);
+}
+
+void TaskGraphWriter::writeIndexEntry(FILE* out, TaskId tid, uint64 offset)
+{
+    ct_write(&tid, sizeof(TaskId), out);
+    ct_write(&offset, sizeof(uint64), out);
+}
+
+void TaskGraphWriter::writeIndex(FILE* out, const vector<pair<TaskId, uint64> >& index)
+{
+    writeIndexCount(out, index.size());
+    for (auto& e : index)
+    {
+        writeIndexEntry(out, e.first, e.second);
+    }
+}
+
+void TaskGraphWriter::writeSkeletonCount(FILE* out, uint64 count)
+{
+    ct_write(&count, sizeof(uint64), out);
+}
@@ -0,0 +1,46 @@
+#ifndef TASK_GRAPH_WRITER_HPP
+#define TASK_GRAPH_WRITER_HPP
+
+#include "TaskGraph.hpp"
+#include "TaskCodec.hpp"
+#include <stdio.h>
+#include <vector>
+
+namespace contech {
+
+//
+// Writes the parts of a taskgraph file around the task records
+//
+//   A taskgraph is the header, the TaskGraphInfo, the codec dictionary if
+//   any, the task records, the index and then the skeleton section.  The
+//   header's offsets, and the ROI and codec, are usually only known once
+//   the records are written, so the header is written first with what is
+//   known and again by finishHeader.  Everything that writes a taskgraph
+//   goes through here, so the layout is in one place with TASK_GRAPH_VERSION.
+//
+class TaskGraphWriter
+{
+public:
+    // The header at the current position, the start of out
+    static void writeHeader(FILE* out, TaskId roiStart = 0, TaskId roiEnd = 0,
+                            uint32_t codecId = task_codec_zlib);
+    // Writes the header again with the offsets, then returns to the end of out
+    static void finishHeader(FILE* out, uint64 indexOffset, TaskId roiStart, TaskId roiEnd,
+                             uint32_t codecId, uint64 dictOffset);
+
+    // uint32 length, then the dictionary, returns its offset
+    static uint64 writeDictionary(FILE* out, const unsigned char* dict, uint32_t len);
+
+    // The index is uint64 count, then the TaskId and record offset of each task
+    static void writeIndexCount(FILE* out, uint64 count);
+    static void writeIndexEntry(FILE* out, TaskId tid, uint64 offset);
+    static void writeIndex(FILE* out, const vector<pair<TaskId, uint64> >& index);
+
+    // The skeleton section is uint64 count, then the entries of
+    //   TaskSkeleton::encodeEntry in the order the records were written
+    static void writeSkeletonCount(FILE* out, uint64 count);
+};
+
+}
+
+#endif
@@ -0,0 +1,105 @@
+#include "TaskPrefetch.hpp"
+#include <chrono>
+
+using namespace std;
+using namespace contech;
+
+TaskPrefetch::TaskPrefetch(TaskGraph* g, unsigned int threads, unsigned int lookahead, unsigned int first)
+{
+    assert(threads > 0 && lookahead > 0);
+    
+    tg = g;
+    firstIndex = first;
+    endIndex = tg->getFilteredCount();
+    nextClaim = first;
+    nextTake = first;
+    slot.resize(lookahead, NULL);
+    filled.resize(lookahead, false);
+    stop = false;
+    stallCount = 0;
+    stallNs = 0;
+    fullCount = 0;
+    
+    for (unsigned int i = 0; i < threads; i++)
+    {
+        decoders.push_back(thread(&TaskPrefetch::decodeTasks, this));
+    }
+}
+
+TaskPrefetch::~TaskPrefetch()
+{
+    {
+        lock_guard<mutex> l(lock);
+        stop = true;
+    }
+    spaceCond.notify_all();
+    
+    for (thread& d : decoders) d.join();
+    
+    for (size_t i = 0; i < slot.size(); i++)
+    {
+        if (filled[i]) delete slot[i];
+    }
+}
+
+void TaskPrefetch::decodeTasks()
+{
+    unique_lock<mutex> l(lock);
+    
+    while (1)
+    {
+        if (nextClaim < endIndex && nextClaim >= nextTake + slot.size()) fullCount++;
+        while (!stop && nextClaim < endIndex && nextClaim >= nextTake + slot.size())
+        {
+            spaceCond.wait(l);
+        }
+        if (stop || nextClaim >= endIndex) break;
+        
+        unsigned int i = nextClaim++;
+        l.unlock();
+        
+        Task* t = tg->getTaskByIndex(tg->getFilteredIndex(i));
+        
+        l.lock();
+        slot[i % slot.size()] = t;
+        filled[i % slot.size()] = true;
+        if (i == nextTake) readyCond.notify_one();
+    }
+}
+
+Task* TaskPrefetch::next()
+{
+    unique_lock<mutex> l(lock);
+    
+    if (nextTake >= endIndex) return NULL;
+    
+    size_t s = nextTake % slot.size();
+    if (!filled[s])
+    {
+        auto start = chrono::steady_clock::now();
+        while (!filled[s])
+        {
+            readyCond.wait(l);
+        }
+        stallCount++;
+        stallNs += chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+    }
+    
+    Task* t = slot[s];
+    slot[s] = NULL;
+    filled[s] = false;
+    nextTake++;
+    l.unlock();
+    spaceCond.notify_all();
+    
+    return t;
+}
+
+void TaskPrefetch::printStats(FILE* f)
+{
+    lock_guard<mutex> l(lock);
+    
+    fprintf(f, "Task Prefetch: %u threads, %zu lookahead\n", (unsigned int)decoders.size(), slot.size());
+    fprintf(f, "Task Prefetch Stalls: %lu of %u tasks, %.3f ms waiting, decoders full %lu times\n",
+               stallCount, nextTake - firstIndex, stallNs / 1e6, fullCount);
+}
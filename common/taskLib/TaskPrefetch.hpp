@@ -0,0 +1,57 @@
+#ifndef TASK_PREFETCH_HPP
+#define TASK_PREFETCH_HPP
+
+#include "TaskGraph.hpp"
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <vector>
+
+namespace contech {
+
+//
+// Decodes the tasks of a taskgraph in index order on a pool of threads
+//
+//   Each thread claims the next position in the order, less any tasks the
+//   graph's filter skips, and decodes it with getTaskByIndex, at most
+//   lookahead tasks ahead of the consumer, so the decoded tasks held are
+//   bounded whatever the number of threads.  next returns the tasks in the
+//   order that getNextTask would.
+//
+class TaskPrefetch
+{
+private:
+    TaskGraph* tg;
+    unsigned int firstIndex, endIndex;
+    unsigned int nextClaim, nextTake;
+    
+    // Slot i % lookahead holds the task at position i once filled
+    std::vector<Task*> slot;
+    std::vector<bool> filled;
+    
+    std::mutex lock;
+    std::condition_variable readyCond, spaceCond;
+    std::vector<std::thread> decoders;
+    bool stop;
+    
+    // Time next waited for a task, and how often the decoders were a full
+    //   lookahead ahead
+    uint64_t stallCount, stallNs, fullCount;
+    
+    void decodeTasks();
+
+public:
+    // Decodes positions first up to the end of the filtered order
+    TaskPrefetch(TaskGraph* tg, unsigned int threads, unsigned int lookahead, unsigned int first = 0);
+    // Deletes any tasks not yet returned
+    ~TaskPrefetch();
+    
+    // The next task in order, owned by the caller, NULL at the end
+    Task* next();
+    
+    void printStats(FILE* f);
+};
+
+}
+
+#endif
@@ -0,0 +1,171 @@
+#include "TaskSkeleton.hpp"
+#include <algorithm>
+#include <string.h>
+
+using namespace std;
+using namespace contech;
+
+#define SKELETON_ENTRY_HEADER (sizeof(TaskId) + 2 * sizeof(ct_timestamp) + 4 * sizeof(uint32_t))
+
+static inline void putBytes(vector<unsigned char>& buf, const void* v, size_t len)
+{
+    buf.insert(buf.end(), (const unsigned char*)v, (const unsigned char*)v + len);
+}
+
+void TaskSkeleton::encodeEntry(Task& t, vector<unsigned char>& buf)
+{
+    TaskId tid = t.getTaskId();
+    ct_timestamp start = t.getStartTime(), end = t.getEndTime();
+    vector<TaskId>& s = t.getSuccessorTasks();
+    vector<TaskId>& p = t.getPredecessorTasks();
+    uint32_t counts[4] = {(uint32_t)t.getType(), (uint32_t)t.getBBCount(), (uint32_t)s.size(), (uint32_t)p.size()};
+    
+    putBytes(buf, &tid, sizeof(TaskId));
+    putBytes(buf, &start, sizeof(ct_timestamp));
+    putBytes(buf, &end, sizeof(ct_timestamp));
+    putBytes(buf, counts, sizeof(counts));
+    putBytes(buf, s.data(), s.size() * sizeof(TaskId));
+    putBytes(buf, p.data(), p.size() * sizeof(TaskId));
+}
+
+void TaskSkeleton::encodeEntry(uint32_t i, vector<unsigned char>& buf) const
+{
+    uint32_t counts[4] = {(uint32_t)type[i], bbCount[i], (uint32_t)getSuccessorCount(i), (uint32_t)getPredecessorCount(i)};
+    
+    putBytes(buf, &id[i], sizeof(TaskId));
+    putBytes(buf, &start[i], sizeof(ct_timestamp));
+    putBytes(buf, &end[i], sizeof(ct_timestamp));
+    putBytes(buf, counts, sizeof(counts));
+    for (uint64 k = succStart[i]; k < succStart[i + 1]; k++) putBytes(buf, &id[succ[k]], sizeof(TaskId));
+    for (uint64 k = predStart[i]; k < predStart[i + 1]; k++) putBytes(buf, &id[pred[k]], sizeof(TaskId));
+}
+
+bool TaskSkeleton::findPosition(const task_positions& pos, TaskId tid, uint32_t* i)
+{
+    auto it = lower_bound(pos.begin(), pos.end(), make_pair(tid, (uint32_t)0));
+    if (it == pos.end() || it->first != tid) return false;
+    *i = it->second;
+    return true;
+}
+
+void TaskSkeleton::resize(size_t taskCount)
+{
+    id.resize(taskCount);
+    start.resize(taskCount);
+    end.resize(taskCount);
+    type.resize(taskCount);
+    bbCount.resize(taskCount);
+    succStart.assign(taskCount + 1, 0);
+    predStart.assign(taskCount + 1, 0);
+}
+
+TaskSkeleton* TaskSkeleton::decodeSection(const unsigned char* p, size_t len, const task_positions& pos)
+{
+    const unsigned char* e = p + len;
+    size_t taskCount = pos.size();
+    uint64 count;
+    
+    if (len < sizeof(uint64)) return NULL;
+    memcpy(&count, p, sizeof(uint64));
+    p += sizeof(uint64);
+    if (count != taskCount) return NULL;
+    
+    TaskSkeleton* sk = new TaskSkeleton();
+    sk->resize(taskCount);
+    
+    // The entries are in write order, so first find each one's position
+    vector<const unsigned char*> entry(taskCount, NULL);
+    uint64 succTotal = 0, predTotal = 0;
+    for (uint64 n = 0; n < count; n++)
+    {
+        TaskId tid;
+        uint32_t counts[4];
+        uint32_t i;
+        
+        if ((size_t)(e - p) < SKELETON_ENTRY_HEADER) break;
+        memcpy(&tid, p, sizeof(TaskId));
+        memcpy(counts, p + sizeof(TaskId) + 2 * sizeof(ct_timestamp), sizeof(counts));
+        size_t entryLen = SKELETON_ENTRY_HEADER + ((size_t)counts[2] + counts[3]) * sizeof(TaskId);
+        if ((size_t)(e - p) < entryLen) break;
+        if (!findPosition(pos, tid, &i) || entry[i] != NULL) break;
+        
+        entry[i] = p;
+        sk->id[i] = tid;
+        memcpy(&sk->start[i], p + sizeof(TaskId), sizeof(ct_timestamp));
+        memcpy(&sk->end[i], p + sizeof(TaskId) + sizeof(ct_timestamp), sizeof(ct_timestamp));
+        sk->type[i] = (task_type)counts[0];
+        sk->bbCount[i] = counts[1];
+        succTotal += counts[2];
+        predTotal += counts[3];
+        p += entryLen;
+    }
+    
+    for (size_t i = 0; i < taskCount; i++)
+    {
+        if (entry[i] == NULL)
+        {
+            delete sk;
+            return NULL;
+        }
+    }
+    
+    // Then the rows, in index order
+    sk->succ.reserve(succTotal);
+    sk->pred.reserve(predTotal);
+    for (size_t i = 0; i < taskCount; i++)
+    {
+        const unsigned char* q = entry[i];
+        uint32_t counts[4];
+        uint32_t j;
+        memcpy(counts, q + sizeof(TaskId) + 2 * sizeof(ct_timestamp), sizeof(counts));
+        q += SKELETON_ENTRY_HEADER;
+        
+        sk->succStart[i] = sk->succ.size();
+        for (uint32_t k = 0; k < counts[2]; k++, q += sizeof(TaskId))
+        {
+            TaskId tid;
+            memcpy(&tid, q, sizeof(TaskId));
+            if (findPosition(pos, tid, &j)) sk->succ.push_back(j);
+        }
+        
+        sk->predStart[i] = sk->pred.size();
+        for (uint32_t k = 0; k < counts[3]; k++, q += sizeof(TaskId))
+        {
+            TaskId tid;
+            memcpy(&tid, q, sizeof(TaskId));
+            if (findPosition(pos, tid, &j)) sk->pred.push_back(j);
+        }
+    }
+    sk->succStart[taskCount] = sk->succ.size();
+    sk->predStart[taskCount] = sk->pred.size();
+    
+    return sk;
+}
+
+void TaskSkeleton::appendTask(Task* t, const task_positions& pos)
+{
+    uint32_t j;
+    
+    id.push_back(t->getTaskId());
+    start.push_back(t->getStartTime());
+    end.push_back(t->getEndTime());
+    type.push_back(t->getType());
+    bbCount.push_back(t->getBBCount());
+    
+    succStart.push_back(succ.size());
+    for (TaskId tid : t->getSuccessorTasks())
+    {
+        if (findPosition(pos, tid, &j)) succ.push_back(j);
+    }
+    predStart.push_back(pred.size());
+    for (TaskId tid : t->getPredecessorTasks())
+    {
+        if (findPosition(pos, tid, &j)) pred.push_back(j);
+    }
+}
+
+void TaskSkeleton::finishTasks()
+{
+    succStart.push_back(succ.size());
+    predStart.push_back(pred.size());
+}
@@ -0,0 +1,67 @@
+#ifndef TASK_SKELETON_HPP
+#define TASK_SKELETON_HPP
+
+#include "Task.hpp"
+#include "TaskId.hpp"
+#include <vector>
+
+namespace contech {
+
+//
+// The structure of a taskgraph, without any actions
+//
+//   Tasks are numbered by their position in the index order, as with
+//   TaskGraph::getTaskByIndex.  Edges are stored as compressed sparse rows:
+//   the successors of task i are succ[succStart[i]] up to succ[succStart[i + 1]],
+//   and the same for the predecessors.  Edges to tasks that are not in the
+//   graph are dropped.
+//
+class TaskSkeleton
+{
+public:
+    vector<TaskId> id;
+    vector<ct_timestamp> start;
+    vector<ct_timestamp> end;
+    vector<task_type> type;
+    vector<uint32_t> bbCount;
+    
+    vector<uint64> succStart;
+    vector<uint32_t> succ;
+    vector<uint64> predStart;
+    vector<uint32_t> pred;
+    
+    size_t size() const { return id.size(); }
+    uint64 getSuccessorCount(uint32_t i) const { return succStart[i + 1] - succStart[i]; }
+    const uint32_t* getSuccessors(uint32_t i) const { return succ.data() + succStart[i]; }
+    uint64 getPredecessorCount(uint32_t i) const { return predStart[i + 1] - predStart[i]; }
+    const uint32_t* getPredecessors(uint32_t i) const { return pred.data() + predStart[i]; }
+    
+    //
+    // Skeleton section of the taskgraph file
+    //   It follows the index: uint64 count, then one entry per task in the
+    //   order the records were written:
+    //   TaskId, start, end, uint32 type, bbCount, successor count,
+    //   predecessor count, then the successor and predecessor TaskIds
+    //
+    static void encodeEntry(Task& t, vector<unsigned char>& buf);
+    // The same entry for task i, complete only if no edges were dropped
+    void encodeEntry(uint32_t i, vector<unsigned char>& buf) const;
+    
+    // Position of each task in the index order, sorted by TaskId
+    typedef vector<pair<TaskId, uint32_t> > task_positions;
+    static bool findPosition(const task_positions& pos, TaskId tid, uint32_t* i);
+    
+    // Builds the skeleton from a section, NULL if it does not match the index
+    static TaskSkeleton* decodeSection(const unsigned char* p, size_t len, const task_positions& pos);
+    
+    // Builds the skeleton one decoded task at a time, in index order
+    void appendTask(Task* t, const task_positions& pos);
+    void finishTasks();
+
+private:
+    void resize(size_t taskCount);
+};
+
+}
+
+#endif
@@ -0,0 +1,318 @@
+#include "TaskGraph.hpp"
+#include "test_graph.hpp"
+#include <string.h>
+#include <unistd.h>
+
+using namespace contech;
+
+//
+// The skeleton section of graphs from test_graph.hpp, against the decoded
+//   tasks and against a skeleton built by decoding them.  Returns 0 if every
+//   test passes.
+//
+
+#define TEST_CONTEXTS 5
+#define TEST_TASKS_PER_CONTEXT 24
+
+static char graphPath[] = "/tmp/TaskSkeleton_testXXXXXX";
+
+static vector<unsigned char> readFile(const char* path)
+{
+    vector<unsigned char> buf;
+    FILE* f = fopen(path, "rb");
+    if (f == NULL) return buf;
+    fseek(f, 0, SEEK_END);
+    buf.resize(ftell(f));
+    rewind(f);
+    buf.resize(fread(buf.data(), 1, buf.size(), f));
+    fclose(f);
+    return buf;
+}
+
+static void writeFile(const char* path, const vector<unsigned char>& buf)
+{
+    FILE* f = fopen(path, "wb");
+    CHECK(f != NULL);
+    if (f == NULL) return;
+    fwrite(buf.data(), 1, buf.size(), f);
+    fclose(f);
+}
+
+static bool sameSkeleton(const TaskSkeleton* a, const TaskSkeleton* b)
+{
+    return a != NULL && b != NULL &&
+           a->id == b->id && a->start == b->start && a->end == b->end &&
+           a->type == b->type && a->bbCount == b->bbCount &&
+           a->succStart == b->succStart && a->succ == b->succ &&
+           a->predStart == b->predStart && a->pred == b->pred;
+}
+
+// The skeleton built by decoding every task of tg, as for a file without
+//   the section
+static TaskSkeleton* decodeSkeleton(TaskGraph* tg)
+{
+    TaskSkeleton::task_positions pos;
+    for (unsigned int i = 0; i < tg->getNumberOfTasks(); i++)
+    {
+        Task* t = tg->getTaskByIndex(i);
+        pos.push_back(make_pair(t->getTaskId(), i));
+        delete t;
+    }
+    sort(pos.begin(), pos.end());
+
+    TaskSkeleton* sk = new TaskSkeleton();
+    for (unsigned int i = 0; i < tg->getNumberOfTasks(); i++)
+    {
+        Task* t = tg->getTaskByIndex(i);
+        sk->appendTask(t, pos);
+        delete t;
+    }
+    sk->finishTasks();
+    return sk;
+}
+
+// Each entry has the task's fields, and its edges to the tasks in the graph
+static void checkAgainstTasks(TaskGraph* tg, const TaskSkeleton* sk, bool complete)
+{
+    CHECK(sk != NULL && sk->size() == tg->getNumberOfTasks());
+    if (sk == NULL) return;
+
+    bool same = true;
+    unsigned int dropped = 0;
+    for (uint32_t i = 0; i < sk->size(); i++)
+    {
+        Task* t = tg->getTaskByIndex(i);
+        if (t == NULL) { same = false; continue; }
+        if (sk->id[i] != t->getTaskId() || sk->start[i] != t->getStartTime() ||
+            sk->end[i] != t->getEndTime() || sk->type[i] != t->getType() ||
+            sk->bbCount[i] != (uint32_t)t->getBBCount())
+        {
+            same = false;
+        }
+
+        vector<TaskId> succ, pred;
+        for (uint64 k = 0; k < sk->getSuccessorCount(i); k++) succ.push_back(sk->id[sk->getSuccessors(i)[k]]);
+        for (uint64 k = 0; k < sk->getPredecessorCount(i); k++) pred.push_back(sk->id[sk->getPredecessors(i)[k]]);
+        dropped += t->getSuccessorTasks().size() - succ.size() + t->getPredecessorTasks().size() - pred.size();
+
+        // The edges that are kept stay in order
+        vector<TaskId> kept;
+        for (TaskId s : t->getSuccessorTasks()) if (find(succ.begin(), succ.end(), s) != succ.end()) kept.push_back(s);
+        if (kept != succ) same = false;
+        kept.clear();
+        for (TaskId p : t->getPredecessorTasks()) if (find(pred.begin(), pred.end(), p) != pred.end()) kept.push_back(p);
+        if (kept != pred) same = false;
+
+        // A complete graph's entries encode as the tasks do
+        if (complete)
+        {
+            vector<unsigned char> a, b;
+            sk->encodeEntry(i, a);
+            TaskSkeleton::encodeEntry(*t, b);
+            if (a != b) same = false;
+        }
+        delete t;
+    }
+    CHECK(same);
+    CHECK(complete == (dropped == 0));
+}
+
+static void testSection()
+{
+    vector<Task*> tasks = makeTestTasks(TEST_CONTEXTS, TEST_TASKS_PER_CONTEXT);
+    CHECK(writeTestGraph(graphPath, tasks));
+    deleteTestTasks(tasks);
+
+    TaskGraph* tg = TaskGraph::initFromFile(graphPath);
+    CHECK(tg != NULL && tg->isMapped());
+    if (tg == NULL) return;
+    const TaskSkeleton* sk = tg->getSkeleton();
+    checkAgainstTasks(tg, sk, true);
+
+    TaskSkeleton* dec = decodeSkeleton(tg);
+    CHECK(sameSkeleton(sk, dec));
+    delete dec;
+
+    // Read through stdio rather than the mapping
+    vector<unsigned char> file = readFile(graphPath);
+    FILE* f = fmemopen(file.data(), file.size(), "rb");
+    TaskGraph* sg = TaskGraph::initFromFile(f);
+    CHECK(sg != NULL && !sg->isMapped());
+    if (sg != NULL)
+    {
+        CHECK(sameSkeleton(sk, sg->getSkeleton()));
+        delete sg;
+    }
+    fclose(f);
+
+    delete tg;
+}
+
+// Edges to tasks that are not in the graph are dropped
+static void testDroppedEdges()
+{
+    vector<Task*> tasks = makeTestTasks(TEST_CONTEXTS, TEST_TASKS_PER_CONTEXT);
+    vector<Task*> part;
+    for (Task* t : tasks)
+    {
+        if ((uint32_t)t->getContextId() != 2 && (uint32_t)t->getSeqId() % 5 != 4) part.push_back(t);
+    }
+    CHECK(writeTestGraph(graphPath, part));
+    deleteTestTasks(tasks);
+
+    TaskGraph* tg = TaskGraph::initFromFile(graphPath);
+    CHECK(tg != NULL);
+    if (tg == NULL) return;
+    const TaskSkeleton* sk = tg->getSkeleton();
+    checkAgainstTasks(tg, sk, false);
+
+    TaskSkeleton* dec = decodeSkeleton(tg);
+    CHECK(sameSkeleton(sk, dec));
+    delete dec;
+    delete tg;
+}
+
+// A section that does not match the index is not used, and the skeleton is
+//   built by decoding the tasks instead
+static void testDamagedSection()
+{
+    vector<Task*> tasks = makeTestTasks(TEST_CONTEXTS, TEST_TASKS_PER_CONTEXT);
+    CHECK(writeTestGraph(graphPath, tasks));
+    deleteTestTasks(tasks);
+
+    TaskGraph* tg = TaskGraph::initFromFile(graphPath);
+    CHECK(tg != NULL);
+    if (tg == NULL) return;
+    TaskSkeleton* ref = decodeSkeleton(tg);
+    TaskSkeleton::task_positions pos;
+    for (uint32_t i = 0; i < ref->size(); i++) pos.push_back(make_pair(ref->id[i], i));
+    sort(pos.begin(), pos.end());
+    delete tg;
+
+    // The section is the end of the file
+    vector<unsigned char> file = readFile(graphPath);
+    uint64 indexOffset;
+    memcpy(&indexOffset, file.data() + sizeof(uint32_t), sizeof(uint64));
+    size_t off = indexOffset + sizeof(uint64) + ref->size() * (sizeof(TaskId) + sizeof(uint64));
+    const unsigned char* section = file.data() + off;
+    size_t len = file.size() - off;
+
+    TaskSkeleton* sk = TaskSkeleton::decodeSection(section, len, pos);
+    CHECK(sameSkeleton(sk, ref));
+    delete sk;
+
+    // Every truncation is missing an entry
+    unsigned int accepted = 0;
+    for (size_t l = 0; l < len; l++)
+    {
+        sk = TaskSkeleton::decodeSection(section, l, pos);
+        if (sk != NULL) accepted++;
+        delete sk;
+    }
+    CHECK(accepted == 0);
+
+    // A count that is not the index's
+    vector<unsigned char> bad(section, section + len);
+    uint64 count = ref->size() + 1;
+    memcpy(bad.data(), &count, sizeof(uint64));
+    CHECK(TaskSkeleton::decodeSection(bad.data(), bad.size(), pos) == NULL);
+
+    // An entry for a task that is not in the index, and one given twice
+    bad.assign(section, section + len);
+    TaskId unknown(ContextId(TEST_CONTEXTS + 1), SeqId(0));
+    memcpy(bad.data() + sizeof(uint64), &unknown, sizeof(TaskId));
+    CHECK(TaskSkeleton::decodeSection(bad.data(), bad.size(), pos) == NULL);
+
+    bad.assign(section, section + len);
+    TaskId first;
+    uint32_t i = 0;
+    vector<unsigned char> entry;
+    memcpy(&first, bad.data() + sizeof(uint64), sizeof(TaskId));
+    CHECK(TaskSkeleton::findPosition(pos, first, &i));
+    ref->encodeEntry(i, entry);
+    memcpy(bad.data() + sizeof(uint64) + entry.size(), &first, sizeof(TaskId));
+    CHECK(TaskSkeleton::decodeSection(bad.data(), bad.size(), pos) == NULL);
+
+    // The graph decodes its tasks rather than use the damaged section
+    memcpy(file.data() + off, &count, sizeof(uint64));
+    writeFile(graphPath, file);
+    tg = TaskGraph::initFromFile(graphPath);
+    CHECK(tg != NULL);
+    if (tg != NULL)
+    {
+        CHECK(sameSkeleton(tg->getSkeleton(), ref));
+        delete tg;
+    }
+
+    // As does a graph from before the section
+    uint32_t version = TASK_GRAPH_COLUMNAR_VERSION;
+    memcpy(file.data(), &version, sizeof(uint32_t));
+    file.resize(off);
+    writeFile(graphPath, file);
+    tg = TaskGraph::initFromFile(graphPath);
+    CHECK(tg != NULL);
+    if (tg != NULL)
+    {
+        CHECK(sameSkeleton(tg->getSkeleton(), ref));
+        delete tg;
+    }
+
+    delete ref;
+}
+
+// Filters on times and types read the skeleton, not the records
+static void testFilter()
+{
+    vector<Task*> tasks = makeTestTasks(TEST_CONTEXTS, TEST_TASKS_PER_CONTEXT);
+    CHECK(writeTestGraph(graphPath, tasks));
+
+    TaskGraph* tg = TaskGraph::initFromFile(graphPath);
+    CHECK(tg != NULL);
+    if (tg == NULL) return;
+
+    TaskFilter tf;
+    tf.typeMask = 1U << task_type_sync;
+    tf.startTime = 500;
+    tf.endTime = 1500;
+    tg->setTaskFilter(tf);
+
+    vector<TaskId> want, got;
+    for (Task* t : tasks)
+    {
+        if (t->getType() == task_type_sync && t->getEndTime() > tf.startTime && t->getStartTime() < tf.endTime)
+        {
+            want.push_back(t->getTaskId());
+        }
+    }
+    Task* t;
+    while ((t = tg->getNextTask()) != NULL)
+    {
+        got.push_back(t->getTaskId());
+        delete t;
+    }
+    CHECK(!want.empty());
+    CHECK(got == want);
+
+    delete tg;
+    deleteTestTasks(tasks);
+}
+
+int main(int argc, char** argv)
+{
+    int fd = mkstemp(graphPath);
+    if (fd < 0)
+    {
+        fprintf(stderr, "Could not create %s\n", graphPath);
+        return 1;
+    }
+    close(fd);
+
+    testSection();
+    testDroppedEdges();
+    testDamagedSection();
+    testFilter();
+
+    unlink(graphPath);
+
+    return testResult("TaskSkeleton_test");
+}
@@ -0,0 +1,89 @@
+#include "TaskView.hpp"
+
+using namespace std;
+using namespace contech;
+
+// The fields before a row record's actions are 28 bytes
+#define TASK_VIEW_OFFSET 4
+
+TaskView::TaskView()
+{
+    taskId = 0;
+    startTime = 0;
+    endTime = 0;
+    type = task_type_basic_blocks;
+    syncType = sync_type_unknown;
+    bbCount = 0;
+    actions = NULL;
+    actionCount = 0;
+}
+
+bool TaskView::decode(const unsigned char* rec, size_t len, const TaskCodec* codec)
+{
+    uint64 recordLength;
+    uint64 compLength;
+
+    if (len < 2 * sizeof(uint64)) return false;
+    memcpy(&recordLength, rec, sizeof(uint64));
+    memcpy(&compLength, rec + sizeof(uint64), sizeof(uint64));
+    if (compLength > len - 2 * sizeof(uint64)) return false;
+
+    record.resize(TASK_VIEW_OFFSET + recordLength);
+    unsigned char* u = record.data() + TASK_VIEW_OFFSET;
+    const unsigned char* e = u + recordLength;
+    if (!Task::decompressRecord(u, recordLength, rec + 2 * sizeof(uint64), compLength, codec)) return false;
+
+    // The fixed fields, up to the actions
+    if (recordLength < sizeof(TaskId) + 2 * sizeof(ct_timestamp) + sizeof(uint32_t)) return false;
+    memcpy(&taskId, u, sizeof(TaskId));
+    u += sizeof(TaskId);
+    memcpy(&startTime, u, sizeof(ct_timestamp));
+    u += sizeof(ct_timestamp);
+    memcpy(&endTime, u, sizeof(ct_timestamp));
+    u += sizeof(ct_timestamp);
+    memcpy(&actionCount, u, sizeof(uint32_t));
+    u += sizeof(uint32_t);
+
+    bbCount = 0;
+    if (actionCount & TASK_ACTIONS_COLUMNAR)
+    {
+        size_t used = 0;
+        actionCount &= ~TASK_ACTIONS_COLUMNAR;
+        if (!Task::decodeActions(u, e - u, actionCount, actionBuffer, &bbCount, &used)) return false;
+        u += used;
+        actions = actionBuffer.data();
+    }
+    else
+    {
+        if ((size_t)(e - u) / sizeof(Action) < actionCount) return false;
+        actions = (Action*)u;
+        for (uint32_t i = 0; i < actionCount; i++)
+        {
+            if (actions[i].isBasicBlockAction()) bbCount++;
+        }
+        u += actionCount * sizeof(Action);
+    }
+
+    // Successors and predecessors are each a count, then the TaskIds
+    uint32_t n;
+    if ((size_t)(e - u) < sizeof(uint32_t)) return false;
+    memcpy(&n, u, sizeof(uint32_t));
+    u += sizeof(uint32_t);
+    if ((size_t)(e - u) / sizeof(TaskId) < n) return false;
+    succ = TaskIdSpan(u, n);
+    u += n * sizeof(TaskId);
+
+    if ((size_t)(e - u) < sizeof(uint32_t)) return false;
+    memcpy(&n, u, sizeof(uint32_t));
+    u += sizeof(uint32_t);
+    if ((size_t)(e - u) / sizeof(TaskId) < n) return false;
+    pred = TaskIdSpan(u, n);
+    u += n * sizeof(TaskId);
+
+    if ((size_t)(e - u) < sizeof(task_type) + sizeof(sync_type)) return false;
+    memcpy(&type, u, sizeof(task_type));
+    u += sizeof(task_type);
+    memcpy(&syncType, u, sizeof(sync_type));
+
+    return true;
+}
@@ -0,0 +1,109 @@
+#ifndef TASK_VIEW_HPP
+#define TASK_VIEW_HPP
+
+#include "Task.hpp"
+#include <string.h>
+
+namespace contech {
+
+//
+// A read-only view of a task record, for backends that only read tasks
+//
+//   The view keeps the decompressed record and reads its fields in place:
+//   the successors and predecessors are not copied out, nor are the actions
+//   of row records.  Columnar records, which are what the middle layer now
+//   writes, are expanded once into the view's action buffer.  Decoding the
+//   next task into the same view reuses both buffers, so iterating a graph
+//   with one view does not allocate per task.  Everything returned refers to
+//   the view and is invalid once another task is decoded into it.
+//
+class TaskView
+{
+friend class TaskGraph;
+public:
+    // TaskIds stored in the record, which are not aligned, so read by value
+    class TaskIdSpan
+    {
+        public:
+            class iterator
+            {
+                public:
+                    typedef iterator self_type;
+                    typedef TaskId value_type;
+                    typedef std::forward_iterator_tag iterator_category;
+                    typedef int difference_type;
+
+                    iterator(const unsigned char* i) : it(i) {}
+                    self_type operator++(int post)
+                    {
+                        self_type temp = *this; operator++(); return temp;
+                    }
+                    self_type& operator++() { it += sizeof(TaskId); return *this; }
+                    TaskId operator*() const { TaskId t; memcpy(&t, it, sizeof(TaskId)); return t; }
+                    bool operator==(const self_type& rhs) const { return it == rhs.it; }
+                    bool operator!=(const self_type& rhs) const { return it != rhs.it; }
+                private:
+                    const unsigned char* it;
+            };
+
+            TaskIdSpan() : first(NULL), count(0) {}
+            TaskIdSpan(const unsigned char* f, uint32_t n) : first(f), count(n) {}
+
+            iterator begin() const { return iterator(first); }
+            iterator end() const { return iterator(first + count * sizeof(TaskId)); }
+            size_t size() const { return count; }
+            bool empty() const { return count == 0; }
+            TaskId operator[](size_t i) const { return *iterator(first + i * sizeof(TaskId)); }
+
+        private:
+            const unsigned char* first;
+            uint32_t count;
+    };
+
+private:
+    // The record starts TASK_VIEW_OFFSET bytes into the buffer, which puts the
+    //   actions of a row record on an 8 byte boundary
+    vector<unsigned char> record;
+    vector<unsigned char> comp;
+    vector<Action> actionBuffer;
+
+    TaskId taskId;
+    ct_timestamp startTime;
+    ct_timestamp endTime;
+    task_type type;
+    sync_type syncType;
+    int bbCount;
+    Action* actions;
+    uint32_t actionCount;
+    TaskIdSpan succ;
+    TaskIdSpan pred;
+
+public:
+    TaskView();
+
+    // Decompress and parse a record, as stored in a taskgraph
+    //   False if the record is truncated or does not parse
+    bool decode(const unsigned char* rec, size_t len, const TaskCodec* codec = NULL);
+
+    TaskId getTaskId() const { return taskId; }
+    SeqId getSeqId() const { return taskId.getSeqId(); }
+    ContextId getContextId() const { return taskId.getContextId(); }
+    ct_timestamp getStartTime() const { return startTime; }
+    ct_timestamp getEndTime() const { return endTime; }
+    task_type getType() const { return type; }
+    sync_type getSyncType() const { return syncType; }
+    int getBBCount() const { return bbCount; }
+
+    size_t getActionCount() const { return actionCount; }
+    const Action* getActions() const { return actions; }
+    Task::memOpCollection getMemOps() { return Task::memOpCollection(actions, actions + actionCount); }
+    Task::memoryActionCollection getMemoryActions() { return Task::memoryActionCollection(actions, actions + actionCount); }
+    Task::basicBlockActionCollection getBasicBlockActions() { return Task::basicBlockActionCollection(actions, actions + actionCount); }
+
+    const TaskIdSpan& getSuccessorTasks() const { return succ; }
+    const TaskIdSpan& getPredecessorTasks() const { return pred; }
+};
+
+}
+
+#endif
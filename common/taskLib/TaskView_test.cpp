@@ -0,0 +1,142 @@
+#include "TaskView.hpp"
+#include "test_graph.hpp"
+
+using namespace contech;
+
+//
+// Task records decoded into a TaskView, in the columnar and the row layout,
+//   and records that are truncated, which must be rejected without reading
+//   past the record.  Returns 0 if every test passes.
+//
+
+// The record before the actions were stored as columns
+static vector<unsigned char> serializeRows(Task& t)
+{
+    vector<unsigned char> r;
+    TaskId tid = t.getTaskId();
+    ct_timestamp start = t.getStartTime(), end = t.getEndTime();
+    vector<Action>& a = t.getActions();
+    uint32_t n = a.size();
+    task_type ty = t.getType();
+    sync_type sy = t.getSyncType();
+
+    #define PUT(v, len) r.insert(r.end(), (const unsigned char*)(v), (const unsigned char*)(v) + (len))
+    PUT(&tid, sizeof(TaskId));
+    PUT(&start, sizeof(ct_timestamp));
+    PUT(&end, sizeof(ct_timestamp));
+    PUT(&n, sizeof(uint32_t));
+    PUT(a.data(), n * sizeof(Action));
+    n = t.getSuccessorTasks().size();
+    PUT(&n, sizeof(uint32_t));
+    PUT(t.getSuccessorTasks().data(), n * sizeof(TaskId));
+    n = t.getPredecessorTasks().size();
+    PUT(&n, sizeof(uint32_t));
+    PUT(t.getPredecessorTasks().data(), n * sizeof(TaskId));
+    PUT(&ty, sizeof(task_type));
+    PUT(&sy, sizeof(sync_type));
+    #undef PUT
+
+    return r;
+}
+
+static bool sameTask(TaskView& v, Task& t)
+{
+    vector<Action>& a = t.getActions();
+    vector<TaskId>& s = t.getSuccessorTasks();
+    vector<TaskId>& p = t.getPredecessorTasks();
+
+    if (v.getTaskId() != t.getTaskId() || v.getStartTime() != t.getStartTime() ||
+        v.getEndTime() != t.getEndTime() || v.getType() != t.getType() ||
+        v.getSyncType() != t.getSyncType() || v.getBBCount() != t.getBBCount())
+    {
+        return false;
+    }
+    if (v.getActionCount() != a.size()) return false;
+    for (size_t i = 0; i < a.size(); i++)
+    {
+        if (v.getActions()[i].data != a[i].data) return false;
+    }
+    if (v.getSuccessorTasks().size() != s.size() || v.getPredecessorTasks().size() != p.size()) return false;
+    for (size_t i = 0; i < s.size(); i++) if (v.getSuccessorTasks()[i] != s[i]) return false;
+    for (size_t i = 0; i < p.size(); i++) if (v.getPredecessorTasks()[i] != p[i]) return false;
+    return true;
+}
+
+// One view decodes tasks of either layout, larger and smaller than the last
+static void testRoundTrip()
+{
+    TaskView v;
+    unsigned int sizes[] = {300, 0, 1, 1000, 7};
+    for (unsigned int b : sizes)
+    {
+        Task* t = makeActionTask(b, b % 5);
+
+        size_t len = 0;
+        unsigned char* rec = Task::encodeContechTask(*t, &len);
+        CHECK(v.decode(rec, len));
+        CHECK(sameTask(v, *t));
+        free(rec);
+
+        vector<unsigned char> rows = serializeRows(*t);
+        vector<unsigned char> rowRec = makeTestRecord(rows.data(), rows.size());
+        CHECK(v.decode(rowRec.data(), rowRec.size()));
+        CHECK(sameTask(v, *t));
+
+        delete t;
+    }
+}
+
+// Every shorter record, in either layout, fails to decode
+static void testTruncated()
+{
+    Task* t = makeActionTask(120, 3);
+    size_t len = 0;
+    unsigned char* src = Task::serializeContechTask(*t, &len);
+    vector<unsigned char> rows = serializeRows(*t);
+    TaskView v;
+    unsigned int accepted = 0;
+
+    for (size_t l = 0; l < len; l++)
+    {
+        vector<unsigned char> rec = makeTestRecord(src, l);
+        if (v.decode(rec.data(), rec.size())) accepted++;
+    }
+    for (size_t l = 0; l < rows.size(); l++)
+    {
+        vector<unsigned char> rec = makeTestRecord(rows.data(), l);
+        if (v.decode(rec.data(), rec.size())) accepted++;
+    }
+    CHECK(accepted == 0);
+
+    // The stored record cut short, and lengths that do not match the data
+    vector<unsigned char> rec = makeTestRecord(src, len);
+    for (size_t l = 0; l < rec.size(); l++)
+    {
+        if (v.decode(rec.data(), l)) accepted++;
+    }
+    CHECK(accepted == 0);
+
+    vector<unsigned char> bad(rec);
+    uint64 longer = len + 1;
+    memcpy(bad.data(), &longer, sizeof(uint64));
+    CHECK(!v.decode(bad.data(), bad.size()));
+    bad = rec;
+    longer = rec.size();
+    memcpy(bad.data() + sizeof(uint64), &longer, sizeof(uint64));
+    CHECK(!v.decode(bad.data(), bad.size()));
+
+    // Still decodes the whole record after all that
+    CHECK(v.decode(rec.data(), rec.size()));
+    CHECK(sameTask(v, *t));
+
+    free(src);
+    delete t;
+}
+
+int main(int argc, char** argv)
+{
+    testRoundTrip();
+    testTruncated();
+
+    return testResult("TaskView_test");
+}
@@ -0,0 +1,132 @@
+#include "Task.hpp"
+#include "test_graph.hpp"
+
+using namespace contech;
+
+//
+// Round trips of task records, and records that are truncated or whose
+//   action columns are damaged, which must be rejected without reading past
+//   the record.  Returns 0 if every test passes.
+//
+
+// The fields before the action columns: TaskId, two timestamps, action count
+#define COLUMNS_OFFSET (sizeof(TaskId) + 2 * sizeof(ct_timestamp) + sizeof(uint32_t))
+
+// Reads a record as from a taskgraph file
+static Task* decode(const unsigned char* rec, size_t len)
+{
+    FILE* f = fmemopen((void*)rec, len, "rb");
+    if (f == NULL) return NULL;
+    Task* t = Task::readContechTask(f);
+    fclose(f);
+    return t;
+}
+
+static Task* decode(const vector<unsigned char>& rec)
+{
+    return decode(rec.data(), rec.size());
+}
+
+static void testRoundTrip()
+{
+    Task* t = makeActionTask(200, 2);
+    size_t len = 0;
+    unsigned char* rec = Task::encodeContechTask(*t, &len);
+    Task* d = decode(rec, len);
+    CHECK(d != NULL);
+    if (d != NULL)
+    {
+        CHECK(*d == *t);
+        CHECK(d->getBBCount() == 200);
+        delete d;
+    }
+
+    free(rec);
+    delete t;
+}
+
+// Every shorter record fails to decode
+static void testTruncated()
+{
+    Task* t = makeActionTask(200, 2);
+    size_t len = 0;
+    unsigned char* src = Task::serializeContechTask(*t, &len);
+    unsigned int accepted = 0;
+
+    for (size_t l = 0; l < len; l++)
+    {
+        Task* d = decode(makeTestRecord(src, l));
+        if (d != NULL) accepted++;
+        delete d;
+    }
+    CHECK(accepted == 0);
+
+    Task* d = decode(makeTestRecord(src, len));
+    CHECK(d != NULL && *d == *t);
+    delete d;
+
+    free(src);
+    delete t;
+}
+
+// Column lengths that do not match the actions, and damaged column bytes
+static void testCorruptColumns()
+{
+    Task* t = makeActionTask(200, 2);
+    size_t len = 0;
+    unsigned char* src = Task::serializeContechTask(*t, &len);
+    vector<unsigned char> bad(src, src + len);
+    uint32_t lens[4];
+    memcpy(lens, src + COLUMNS_OFFSET, sizeof(lens));
+
+    // Each column length, too long and too short, and the kinds not matching
+    //   the action count
+    for (unsigned int c = 0; c < 4; c++)
+    {
+        for (int delta = -8; delta <= 8; delta += 16)
+        {
+            uint32_t l = lens[c] + delta;
+            bad.assign(src, src + len);
+            memcpy(bad.data() + COLUMNS_OFFSET + c * sizeof(uint32_t), &l, sizeof(uint32_t));
+            Task* d = decode(makeTestRecord(bad.data(), len));
+            CHECK(d == NULL);
+            delete d;
+        }
+    }
+    uint32_t huge = 0xfffffff0;
+    bad.assign(src, src + len);
+    memcpy(bad.data() + COLUMNS_OFFSET + sizeof(uint32_t), &huge, sizeof(uint32_t));
+    Task* d = decode(makeTestRecord(bad.data(), len));
+    CHECK(d == NULL);
+    delete d;
+
+    // A varint that never ends, at the end of the block id column
+    bad.assign(src, src + len);
+    size_t bbEnd = COLUMNS_OFFSET + sizeof(lens) + lens[0] + lens[1];
+    bad[bbEnd - 1] = 0xff;
+    d = decode(makeTestRecord(bad.data(), len));
+    CHECK(d == NULL);
+    delete d;
+
+    // Any damaged byte decodes to something or is rejected, within the record
+    size_t colEnd = COLUMNS_OFFSET + sizeof(lens) + lens[0] + lens[1] + lens[2] + lens[3];
+    for (size_t p = COLUMNS_OFFSET + sizeof(lens); p < colEnd; p++)
+    {
+        bad.assign(src, src + len);
+        bad[p] ^= 0x80;
+        d = decode(makeTestRecord(bad.data(), len));
+        delete d;
+    }
+
+    free(src);
+    delete t;
+}
+
+int main(int argc, char** argv)
+{
+    testRoundTrip();
+    testTruncated();
+    testCorruptColumns();
+
+    return testResult("Task_test");
+}
@@ -0,0 +1,177 @@
+#include "TaskGraph.hpp"
+#include "ActionScan.hpp"
+#include <time.h>
+#include <ctype.h>
+
+using namespace std;
+using namespace contech;
+
+//
+// actionScanBench [actions] | actionScanBench <taskgraph>
+//   Splits the actions of every task into block boundaries and memory
+//   operations, once with the Task collection iterators and once with each
+//   ActionScan kernel the processor supports, and checks that they agree.
+//   Without a taskgraph, tasks of random actions are generated: about one in
+//   five is a basic block, most of the rest are reads and writes.
+//
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// What a pass found, summed over every task
+struct scan_result
+{
+    uint64_t blocks;
+    uint64_t blockSum;
+    uint64_t memOps;
+    uint64_t memOpHash;
+    uint64_t bytes;
+    bool operator==(const scan_result& r) const
+    {
+        return blocks == r.blocks && blockSum == r.blockSum && memOps == r.memOps &&
+               memOpHash == r.memOpHash && bytes == r.bytes;
+    }
+};
+
+static void writeSynthetic(vector<Action>& actions, vector<size_t>& taskEnd, uint64 count)
+{
+    uint64_t seed = 0x2545F4914F6CDD1DULL;
+    actions.resize(count);
+    for (uint64 i = 0; i < count; i++)
+    {
+        seed ^= seed << 13; seed ^= seed >> 7; seed ^= seed << 17;
+        unsigned int r = seed % 10;
+        if (r < 2)
+        {
+            BasicBlockAction bb;
+            bb.data = 0;
+            bb.basic_block_id = seed >> 32;
+            bb.type = action_type_basicBlock;
+            actions[i] = Action(bb);
+        }
+        else
+        {
+            action_type t = (r < 6) ? action_type_mem_read :
+                            (r < 9) ? action_type_mem_write : (action_type)(action_type_free + (seed >> 60) % 3);
+            actions[i] = Action(MemoryAction((seed >> 8) & 0xffffffffffffULL, (seed >> 56) % 4, t));
+        }
+        // Tasks of up to 4095 actions, so some are shorter than a vector
+        if (((seed >> 20) & 0xfff) == 0 || i + 1 == count) taskEnd.push_back(i + 1);
+    }
+}
+
+static scan_result scanIterators(vector<Action>& actions, vector<size_t>& taskEnd)
+{
+    scan_result r = {0, 0, 0, 0, 0};
+    size_t b = 0;
+    for (size_t e : taskEnd)
+    {
+        Action* base = actions.data() + b;
+        Task::basicBlockActionCollection bbc(base, actions.data() + e);
+        for (auto f = bbc.begin(), et = bbc.end(); f != et; ++f)
+        {
+            r.blocks++;
+            r.blockSum += &(*f) - base;
+        }
+        Task::memOpCollection mc(base, actions.data() + e);
+        for (auto f = mc.begin(), et = mc.end(); f != et; ++f)
+        {
+            MemoryAction mem = *f;
+            r.memOps++;
+            r.memOpHash = r.memOpHash * 31 + mem.data;
+            r.bytes += (0x1 << mem.pow_size);
+        }
+        b = e;
+    }
+    return r;
+}
+
+static scan_result scanKernel(vector<Action>& actions, vector<size_t>& taskEnd)
+{
+    scan_result r = {0, 0, 0, 0, 0};
+    vector<uint32_t> blocks;
+    vector<MemoryAction> memOps;
+    size_t b = 0;
+    for (size_t e : taskEnd)
+    {
+        const Action* base = actions.data() + b;
+        if (blocks.size() < e - b)
+        {
+            blocks.resize(e - b);
+            memOps.resize(e - b);
+        }
+        size_t blockCount = ActionScan::findBasicBlocks(base, e - b, blocks.data());
+        size_t memOpCount = ActionScan::selectMemOps(base, e - b, memOps.data());
+        r.blocks += blockCount;
+        for (size_t i = 0; i < blockCount; i++) r.blockSum += blocks[i];
+        r.memOps += memOpCount;
+        for (size_t i = 0; i < memOpCount; i++) r.memOpHash = r.memOpHash * 31 + memOps[i].data;
+        r.bytes += ActionScan::sumMemOpBytes(base, e - b);
+        b = e;
+    }
+    return r;
+}
+
+int main(int argc, char** argv)
+{
+    vector<Action> actions;
+    vector<size_t> taskEnd;
+
+    if (argc > 1 && !isdigit(argv[1][0]))
+    {
+        TaskGraph* tg = TaskGraph::initFromFile(argv[1]);
+        if (tg == NULL)
+        {
+            fprintf(stderr, "Cannot open %s\n", argv[1]);
+            return 1;
+        }
+
+        TaskView view;
+        while (tg->getNextTaskView(view))
+        {
+            actions.insert(actions.end(), view.getActions(), view.getActions() + view.getActionCount());
+            taskEnd.push_back(actions.size());
+        }
+        delete tg;
+    }
+    else
+    {
+        uint64 count = (argc > 1) ? strtoull(argv[1], NULL, 10) : 16 * 1024 * 1024;
+        if (count == 0)
+        {
+            fprintf(stderr, "%s [actions] | %s <taskgraph>\n", argv[0], argv[0]);
+            return 1;
+        }
+        writeSynthetic(actions, taskEnd, count);
+    }
+
+    double t0 = now();
+    scan_result ref = scanIterators(actions, taskEnd);
+    double t1 = now();
+
+    printf("Tasks: %lu\tActions: %lu\tBlocks: %lu\tMemOps: %lu\n", taskEnd.size(), actions.size(), ref.blocks, ref.memOps);
+    printf("iterators: %.2f ns/action\n", (t1 - t0) * 1e9 / actions.size());
+
+    int ret = 0;
+    action_scan_kernel def = ActionScan::getKernel();
+    for (int k = action_scan_scalar; k <= action_scan_avx512; k++)
+    {
+        ActionScan::setKernel((action_scan_kernel)k);
+        if (ActionScan::getKernel() != k) continue;
+
+        t0 = now();
+        scan_result r = scanKernel(actions, taskEnd);
+        t1 = now();
+
+        printf("%-10s %.2f ns/action%s\n", ActionScan::getKernelName((action_scan_kernel)k),
+               (t1 - t0) * 1e9 / actions.size(), (r == ref) ? "" : "\tDIFFERS");
+        if (!(r == ref)) ret = 1;
+    }
+    ActionScan::setKernel(def);
+
+    return ret;
+}
@@ -0,0 +1,167 @@
+#include "TaskGraph.hpp"
+#include "TaskGraphWriter.hpp"
+#include <time.h>
+#include <ctype.h>
+#include <unistd.h>
+
+using namespace std;
+using namespace contech;
+
+//
+// indexBench [tasks] [contexts] | indexBench <taskgraph>
+//   Times loading a taskgraph's index, once as it was read before, one
+//   ct_read per field into a std::map and a std::set, and once with
+//   TaskGraph::initFromFile.  Then every task is looked up by id, in random
+//   order, in the map and in the sorted array of TaskSkeleton::findPosition.
+//   Without a taskgraph, a synthetic one is written to a temporary file: the
+//   header, no basic block info and an index of tasks in round robin over the
+//   contexts.  No task records are read.
+//
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void writeSynthetic(FILE* f, uint64 tasks, uint32_t contexts)
+{
+    int numBasicBlock = 0;
+    
+    TaskGraphWriter::writeHeader(f);
+    ct_write(&numBasicBlock, sizeof(int), f);
+    
+    // Every entry points at this byte, in place of a task record
+    uint64 recordPos = ftell(f);
+    char pad = 0;
+    ct_write(&pad, 1, f);
+    
+    uint64 indexOffset = ftell(f);
+    TaskGraphWriter::writeIndexCount(f, tasks);
+    for (uint64 i = 0; i < tasks; i++)
+    {
+        TaskGraphWriter::writeIndexEntry(f, TaskId(ContextId(i % contexts), SeqId(i / contexts)), recordPos);
+    }
+    
+    TaskGraphWriter::finishHeader(f, indexOffset, 0, 0, task_codec_zlib, 0);
+    fflush(f);
+}
+
+// The index loading of the original TaskGraph
+static uint64 loadMap(FILE* f, map<TaskId, uint64>& taskIdx, vector<uint64>& taskOrder)
+{
+    uint64 off = 0, taskCount = 0;
+    set<ContextId> uniqContexts;
+    
+    fseek(f, sizeof(uint32_t), SEEK_SET);
+    ct_read(&off, sizeof(uint64), f);
+    fseek(f, off, SEEK_SET);
+    ct_read(&taskCount, sizeof(uint64), f);
+    for (uint64 i = 0; i < taskCount; i++)
+    {
+        TaskId tid;
+        uint64 pos;
+        
+        ct_read(&tid, sizeof(TaskId), f);
+        ct_read(&pos, sizeof(uint64), f);
+        
+        assert(pos < off);
+        assert(taskIdx.find(tid) == taskIdx.end());
+        taskIdx[tid] = pos;
+        taskOrder.push_back(pos);
+        uniqContexts.insert(tid.getContextId());
+    }
+    
+    return uniqContexts.size();
+}
+
+int main(int argc, char** argv)
+{
+    FILE* f = NULL;
+    
+    if (argc > 1 && !isdigit(argv[1][0]))
+    {
+        f = fopen(argv[1], "rb");
+        if (f == NULL)
+        {
+            fprintf(stderr, "Cannot open %s\n", argv[1]);
+            return 1;
+        }
+    }
+    else
+    {
+        uint64 tasks = (argc > 1) ? strtoull(argv[1], NULL, 10) : 16 * 1024 * 1024;
+        uint32_t contexts = (argc > 2) ? strtoul(argv[2], NULL, 10) : 256;
+        if (tasks == 0 || contexts == 0)
+        {
+            fprintf(stderr, "%s [tasks] [contexts] | %s <taskgraph>\n", argv[0], argv[0]);
+            return 1;
+        }
+        
+        f = tmpfile();
+        assert(f != NULL);
+        writeSynthetic(f, tasks, contexts);
+    }
+    
+    map<TaskId, uint64> taskIdx;
+    vector<uint64> taskOrder;
+    double t0 = now();
+    uint64 mapContexts = loadMap(f, taskIdx, taskOrder);
+    double t1 = now();
+    TaskGraph* tg = TaskGraph::initFromFile(f);
+    double t2 = now();
+    
+    if (tg == NULL || tg->getNumberOfTasks() != taskOrder.size() || tg->getNumberOfContexts() != mapContexts)
+    {
+        fprintf(stderr, "Index contents differ\n");
+        return 1;
+    }
+    
+    // The same (TaskId, position) array as TaskGraph builds
+    TaskSkeleton::task_positions pos;
+    vector<TaskId> keys;
+    vector<uint64> filePos;
+    uint32_t i = 0;
+    for (auto it = taskIdx.begin(), et = taskIdx.end(); it != et; ++it)
+    {
+        pos.push_back(make_pair(it->first, i++));
+        keys.push_back(it->first);
+        filePos.push_back(it->second);
+    }
+    uint64_t seed = 0x2545F4914F6CDD1DULL;
+    for (size_t k = keys.size(); k > 1; k--)
+    {
+        seed ^= seed << 13; seed ^= seed >> 7; seed ^= seed << 17;
+        swap(keys[k - 1], keys[seed % k]);
+    }
+    
+    uint64_t mapCheck = 0, flatCheck = 0;
+    double t3 = now();
+    for (TaskId tid : keys)
+    {
+        auto it = taskIdx.find(tid);
+        if (it != taskIdx.end()) mapCheck += it->second;
+    }
+    double t4 = now();
+    for (TaskId tid : keys)
+    {
+        if (TaskSkeleton::findPosition(pos, tid, &i)) flatCheck += filePos[i];
+    }
+    double t5 = now();
+    
+    if (mapCheck != flatCheck)
+    {
+        fprintf(stderr, "Lookup results differ: %lx vs %lx\n", mapCheck, flatCheck);
+        return 1;
+    }
+    
+    printf("Tasks: %lu\tContexts: %lu\n", taskOrder.size(), mapContexts);
+    printf("std::map:     %.3fs load\t%.1f ns/lookup\n", t1 - t0, (t4 - t3) * 1e9 / keys.size());
+    printf("sorted array: %.3fs load\t%.1f ns/lookup\n", t2 - t1, (t5 - t4) * 1e9 / keys.size());
+    
+    delete tg;
+    fclose(f);
+    
+    return 0;
+}
@@ -0,0 +1,24 @@
+#ifndef TEST_CHECK_HPP
+#define TEST_CHECK_HPP
+
+#include <stdio.h>
+
+//
+// The harness of the unit tests
+//   CHECK reports a failed condition and counts it, so a test runs to the
+//   end, and testResult is the exit status of the test program.
+//
+
+static unsigned int failures = 0;
+
+#define CHECK(c) do { if (!(c)) { \
+    fprintf(stderr, "%s:%d: FAILED %s\n", __FILE__, __LINE__, #c); \
+    failures++; } } while (0)
+
+static inline int testResult(const char* name)
+{
+    if (failures == 0) printf("%s: all tests passed\n", name);
+    return (failures == 0) ? 0 : 1;
+}
+
+#endif
@@ -0,0 +1,150 @@
+#ifndef TEST_GRAPH_HPP
+#define TEST_GRAPH_HPP
+
+#include "TaskGraph.hpp"
+#include "TaskSkeleton.hpp"
+#include "TaskGraphWriter.hpp"
+#include "test_check.hpp"
+#include <string.h>
+#include <zlib.h>
+
+namespace contech {
+
+//
+// Tasks, records and taskgraphs for the unit tests, without a trace or the
+//   middle layer
+//
+//   makeActionTask builds one task of blocks with every kind of action the
+//   record columns store, and edges successors and predecessors.
+//   makeTestRecord compresses an uncompressed record as encodeContechTask
+//   would, so tests can store records that are truncated or damaged.
+//
+//   makeTestTasks builds contexts of tasks with basic block actions.  Each
+//   context's tasks are a chain, and task 1 of each context also has task 0
+//   of the next context as a successor, as a create would.  Tasks are ordered
+//   by start time, so the contexts are interleaved as in a middle's output.
+//   writeTestGraph writes them as the middle layer does: the header, an empty
+//   TaskGraphInfo, the records in the order given, the index and the skeleton.
+//
+
+static inline Task* makeActionTask(unsigned int blocks, unsigned int edges)
+{
+    Task* t = new Task(TaskId(ContextId(3), SeqId(7)), task_type_basic_blocks);
+    uint64 addr = 0x7f0000001000ULL;
+    t->setStartTime(1000);
+    t->setEndTime(5000);
+    t->setSyncType(sync_type_lock);
+    for (unsigned int b = 0; b < blocks; b++)
+    {
+        t->recordBasicBlockAction((b * 37) % 50);
+        for (unsigned int i = 0; i < b % 5; i++)
+        {
+            addr += (i * 8) - 12;
+            t->recordMemOpAction(i & 1, i % 4, addr);
+        }
+        if (b % 50 == 0)
+        {
+            t->recordMallocAction(addr + 0x100000, 4096);
+            t->recordFreeAction(addr + 0x100000);
+            // A rank in the destination keeps it out of the address column
+            t->recordMemCpyAction(64, (2ULL << 50) | addr, addr + 64);
+        }
+    }
+    for (unsigned int e = 0; e < edges; e++)
+    {
+        t->addSuccessor(TaskId(ContextId(3), SeqId(8 + e)));
+        t->addPredecessor(TaskId(ContextId(e), SeqId(6)));
+    }
+    return t;
+}
+
+static inline vector<unsigned char> makeTestRecord(const unsigned char* src, uint64 len)
+{
+    uLongf compLen = compressBound(len);
+    vector<unsigned char> rec(2 * sizeof(uint64) + compLen);
+    compress(rec.data() + 2 * sizeof(uint64), &compLen, src, len);
+    uint64 c = compLen;
+    memcpy(rec.data(), &len, sizeof(uint64));
+    memcpy(rec.data() + sizeof(uint64), &c, sizeof(uint64));
+    rec.resize(2 * sizeof(uint64) + compLen);
+    return rec;
+}
+
+static inline Task* makeTestTask(unsigned int c, unsigned int s, unsigned int contexts, unsigned int perContext)
+{
+    task_type ty = (s % 4 == 3) ? task_type_sync : task_type_basic_blocks;
+    Task* t = new Task(TaskId(ContextId(c), SeqId(s)), ty);
+
+    t->setStartTime(s * 100 + c * 7);
+    t->setEndTime(s * 100 + c * 7 + 90);
+    if (ty == task_type_basic_blocks)
+    {
+        for (unsigned int b = 0; b <= (c + s) % 5; b++)
+        {
+            t->recordBasicBlockAction(b + c);
+            t->recordMemOpAction(b & 1, 3, 0x10000000ULL * (c + 1) + s * 64 + b * 8);
+        }
+    }
+
+    if (s > 0) t->addPredecessor(TaskId(ContextId(c), SeqId(s - 1)));
+    if (s + 1 < perContext) t->addSuccessor(TaskId(ContextId(c), SeqId(s + 1)));
+    if (s == 0 && c > 0) t->addPredecessor(TaskId(ContextId(c - 1), SeqId(1)));
+    if (s == 1 && c + 1 < contexts) t->addSuccessor(TaskId(ContextId(c + 1), SeqId(0)));
+
+    return t;
+}
+
+static inline vector<Task*> makeTestTasks(unsigned int contexts, unsigned int perContext)
+{
+    vector<Task*> tasks;
+    for (unsigned int c = 0; c < contexts; c++)
+    {
+        for (unsigned int s = 0; s < perContext; s++)
+        {
+            tasks.push_back(makeTestTask(c, s, contexts, perContext));
+        }
+    }
+
+    stable_sort(tasks.begin(), tasks.end(), [](const Task* a, const Task* b) {
+        return a->getStartTime() < b->getStartTime();
+    });
+    return tasks;
+}
+
+static inline bool writeTestGraph(const char* path, vector<Task*>& tasks)
+{
+    FILE* out = fopen(path, "wb");
+    if (out == NULL) return false;
+
+    TaskGraphInfo tgi;
+    TaskGraphWriter::writeHeader(out);
+    tgi.writeTaskGraphInfo(out);
+
+    vector<pair<TaskId, uint64> > index;
+    vector<unsigned char> skeleton;
+    for (Task* t : tasks)
+    {
+        index.push_back(make_pair(t->getTaskId(), (uint64)ftell(out)));
+        Task::writeContechTask(*t, out);
+        TaskSkeleton::encodeEntry(*t, skeleton);
+    }
+
+    uint64 indexOffset = ftell(out);
+    TaskGraphWriter::writeIndex(out, index);
+    TaskGraphWriter::writeSkeletonCount(out, index.size());
+    ct_write(skeleton.data(), skeleton.size(), out);
+
+    TaskGraphWriter::finishHeader(out, indexOffset, 0, 0, task_codec_zlib, 0);
+    fclose(out);
+    return true;
+}
+
+static inline void deleteTestTasks(vector<Task*>& tasks)
+{
+    for (Task* t : tasks) delete t;
+    tasks.clear();
+}
+
+}
+
+#endif
@@ -170,3 +170,24 @@ Task* BarrierWrapper::onExit(Task* departingTask, ct_tsc_t exitTime, bool* finis
 
     return exitT;
 }
+
+void BarrierWrapper::addTasks(CheckpointFile& ck)
+{
+    ck.addTask(entryBarrierTask);
+    for (Task* t : exitBarrierTasks) ck.addTask(t);
+}
+
+void BarrierWrapper::save(CheckpointFile& ck)
+{
+    ck.putTaskRef(entryBarrierTask);
+    ck.put<uint32_t>(exitBarrierTasks.size());
+    for (Task* t : exitBarrierTasks) ck.putTaskRef(t);
+}
+
+void BarrierWrapper::restore(CheckpointFile& ck)
+{
+    entryBarrierTask = ck.getTaskRef();
+    exitBarrierTasks.clear();
+    uint32_t n = ck.get<uint32_t>();
+    for (uint32_t i = 0; i < n; i++) exitBarrierTasks.push_back(ck.getTaskRef());
+}
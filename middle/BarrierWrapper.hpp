@@ -3,6 +3,7 @@
 
 #include "../common/taskLib/Task.hpp"
 #include "../common/eventLib/ct_event.h"
+#include "Checkpoint.hpp"
 #include <assert.h>
 #include <list>
 
@@ -14,6 +15,10 @@ public:
     BarrierWrapper();
     Task* onEnter(Task& arrivingTask, ct_tsc_t arrivalTime, ct_addr_t addr);
     Task* onExit(Task*, ct_tsc_t exitTime, bool*);
+    
+    void addTasks(CheckpointFile&);
+    void save(CheckpointFile&);
+    void restore(CheckpointFile&);
 private:
     Task* entryBarrierTask;
     list<Task*> exitBarrierTasks;
@@ -0,0 +1,176 @@
+#include "Checkpoint.hpp"
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+using namespace contech;
+
+#define CHECKPOINT_NULL_TASK 0xffffffff
+
+CheckpointFile::CheckpointFile(FILE* file, const char* p, bool w)
+{
+    f = file;
+    path = p;
+    writing = w;
+}
+
+CheckpointFile::~CheckpointFile()
+{
+    if (f != NULL) fclose(f);
+    if (writing) unlink((path + ".tmp").c_str());
+}
+
+CheckpointFile* CheckpointFile::create(const char* path)
+{
+    FILE* f = fopen((string(path) + ".tmp").c_str(), "wb");
+    if (f == NULL)
+    {
+        perror("Cannot create middle checkpoint");
+        return NULL;
+    }
+
+    CheckpointFile* ck = new CheckpointFile(f, path, true);
+    ck->put<uint32_t>(CHECKPOINT_MAGIC);
+    ck->put<uint32_t>(CHECKPOINT_VERSION);
+    return ck;
+}
+
+CheckpointFile* CheckpointFile::open(const char* path)
+{
+    FILE* f = fopen(path, "rb");
+    if (f == NULL) return NULL;
+
+    uint32_t hdr[2] = {0, 0};
+    if (fread(hdr, sizeof(uint32_t), 2, f) != 2 ||
+        hdr[0] != CHECKPOINT_MAGIC ||
+        hdr[1] != CHECKPOINT_VERSION)
+    {
+        fprintf(stderr, "%s is not a version %d middle checkpoint\n", path, CHECKPOINT_VERSION);
+        fclose(f);
+        return NULL;
+    }
+
+    return new CheckpointFile(f, path, false);
+}
+
+bool CheckpointFile::commit()
+{
+    assert(writing);
+
+    bool ok = (fflush(f) == 0 && fsync(fileno(f)) == 0);
+    ok = (fclose(f) == 0) && ok;
+    f = NULL;
+
+    string tmp = path + ".tmp";
+    if (!ok || rename(tmp.c_str(), path.c_str()) != 0)
+    {
+        perror("Cannot write middle checkpoint");
+        return false;
+    }
+    writing = false;
+    return true;
+}
+
+void CheckpointFile::check(size_t r, size_t n)
+{
+    if (r == n) return;
+    fprintf(stderr, "Middle checkpoint %s is truncated or cannot be written\n", path.c_str());
+    assert(0);
+}
+
+void CheckpointFile::putString(const string& s)
+{
+    put<uint32_t>(s.size());
+    putBytes(s.data(), s.size());
+}
+
+string CheckpointFile::getString()
+{
+    string s(get<uint32_t>(), '\0');
+    if (!s.empty()) getBytes(&s[0], s.size());
+    return s;
+}
+
+static uint64_t getTraceSize(const string& name)
+{
+    struct stat st;
+    if (stat(name.c_str(), &st) != 0) return 0;
+    return st.st_size;
+}
+
+void CheckpointFile::putTraces(const vector<string>& traces)
+{
+    put<uint32_t>(traces.size());
+    for (const string& t : traces)
+    {
+        putString(t);
+        put<uint64_t>(getTraceSize(t));
+    }
+}
+
+bool CheckpointFile::checkTraces(const vector<string>& traces)
+{
+    bool match = (get<uint32_t>() == traces.size());
+    for (size_t i = 0; match && i < traces.size(); i++)
+    {
+        string name = getString();
+        uint64_t size = get<uint64_t>();
+        if (name != traces[i] || size != getTraceSize(traces[i]))
+        {
+            fprintf(stderr, "Middle checkpoint was taken from %s (%lu bytes), not %s\n", name.c_str(), size, traces[i].c_str());
+            match = false;
+        }
+    }
+    return match;
+}
+
+void CheckpointFile::addTask(Task* t)
+{
+    if (t == NULL) return;
+
+    uint64_t key = (uint64_t)(uintptr_t)t;
+    if (taskIndex.count(key)) return;
+    taskIndex[key] = taskTable.size();
+    taskTable.push_back(t);
+}
+
+void CheckpointFile::putTaskTable()
+{
+    put<uint32_t>(taskTable.size());
+    for (Task* t : taskTable)
+    {
+        Task::writeContechTask(*t, f);
+    }
+}
+
+void CheckpointFile::getTaskTable()
+{
+    uint32_t n = get<uint32_t>();
+    taskTable.resize(n);
+    for (uint32_t i = 0; i < n; i++)
+    {
+        taskTable[i] = Task::readContechTask(f);
+        check((taskTable[i] != NULL) ? 1 : 0, 1);
+    }
+}
+
+void CheckpointFile::putTaskRef(Task* t)
+{
+    if (t == NULL)
+    {
+        put<uint32_t>(CHECKPOINT_NULL_TASK);
+        return;
+    }
+
+    auto it = taskIndex.find((uint64_t)(uintptr_t)t);
+    assert(it != taskIndex.end());
+    put<uint32_t>(it->second);
+}
+
+Task* CheckpointFile::getTaskRef()
+{
+    uint32_t i = get<uint32_t>();
+    if (i == CHECKPOINT_NULL_TASK) return NULL;
+    assert(i < taskTable.size());
+    return taskTable[i];
+}
@@ -0,0 +1,82 @@
+#ifndef CT_CHECKPOINT_HPP
+#define CT_CHECKPOINT_HPP
+
+#include "../common/taskLib/Task.hpp"
+#include "FlatMap.hpp"
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+namespace contech {
+
+#define CHECKPOINT_MAGIC 0x4b435443
+#define CHECKPOINT_VERSION 1
+
+//
+// A checkpoint file of the middle layer
+//
+//   Values are read back in the order they were written.  Tasks are written
+//   once, as task records, and every reference to a task is an index into that
+//   table, so a task shared by several structures is still shared when it is
+//   restored.  The file is written to <path>.tmp and renamed over path once it
+//   is complete, so a crash while writing keeps the previous checkpoint.
+//
+class CheckpointFile
+{
+private:
+    FILE* f;
+    string path;
+    bool writing;
+    FlatMap<uint64_t, uint32_t> taskIndex;
+    vector<Task*> taskTable;
+
+    CheckpointFile(FILE*, const char*, bool);
+    void check(size_t r, size_t n);
+
+public:
+    // NULL if the file cannot be created / does not exist
+    static CheckpointFile* create(const char* path);
+    static CheckpointFile* open(const char* path);
+    ~CheckpointFile();
+
+    // Writes the file and replaces the previous checkpoint
+    bool commit();
+
+    void putBytes(const void* p, size_t n) { check(fwrite(p, 1, n, f), n); }
+    void getBytes(void* p, size_t n) { check(fread(p, 1, n, f), n); }
+    template <typename T> void put(const T& v) { putBytes(&v, sizeof(T)); }
+    template <typename T> T get() { T v; getBytes(&v, sizeof(T)); return v; }
+
+    void putString(const string&);
+    string getString();
+
+    template <typename T> void putVector(const vector<T>& v)
+    {
+        put<uint64_t>(v.size());
+        if (!v.empty()) putBytes(v.data(), v.size() * sizeof(T));
+    }
+    template <typename T> void getVector(vector<T>& v)
+    {
+        v.resize(get<uint64_t>());
+        if (!v.empty()) getBytes(v.data(), v.size() * sizeof(T));
+    }
+
+    // Traces are identified by name and size, so a checkpoint is only resumed
+    //   on the traces it was taken from
+    void putTraces(const vector<string>&);
+    bool checkTraces(const vector<string>&);
+
+    // Every task must be added before the table is written, and a reference
+    //   is only valid for a task in the table
+    void addTask(Task*);
+    void putTaskTable();
+    void getTaskTable();
+    void putTaskRef(Task*);
+    Task* getTaskRef();
+
+    FILE* getFile() { return f; }
+};
+
+} // end namespace contech
+
+#endif
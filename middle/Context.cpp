@@ -8,9 +8,14 @@ Context::Context()
     tasks.clear();
 }
 
-// Returns the currently active task
-//Task* Context::activeTask() { return this->tasks.front(); }
-Task* Context::activeTask() { return this->tasks.rbegin()->second; }
+//
+// Add a task to the context, the task with the largest id is active
+//
+void Context::addTask(Task* t)
+{
+    tasks[t->getTaskId()] = t;
+    if (active == NULL || active->getTaskId() <= t->getTaskId()) active = t;
+}
 
 //
 // Which of this context's tasks created cid
@@ -55,6 +60,16 @@ bool Context::removeTask(Task* t)
     if (it == tasks.end()) return false;
     tasks.erase(it);
     
+    // Find the new active task, this is rare as the active task is rarely removed
+    if (t == active)
+    {
+        active = NULL;
+        for (auto& p : tasks)
+        {
+            if (active == NULL || active->getTaskId() < p.first) active = p.second;
+        }
+    }
+    
     return true; // false;
 }
 
@@ -136,11 +151,159 @@ Task* Context::createBasicBlockContinuation()
 
     // Make the continuation active
     //tasks.push_front(continuation);
-    tasks[continuation->getTaskId()] = continuation;
+    addTask(continuation);
 
     return continuation;
 }
 
+//
+// Split the active basic block task, which must be in this context's tasks
+//
+//   The split task ends at its start plus one cycle per block, a lower bound,
+//   until resolveSplitTimes is given the end of the run.
+//
+Task* Context::splitBasicBlockTask()
+{
+    Task* activeT = activeTask();
+    assert(activeT->getType() == task_type_basic_blocks);
+    
+    activeT->setEndTime(activeT->getStartTime() + activeT->getBBCount());
+    Task* continuation = createBasicBlockContinuation();
+    bool rem = removeTask(activeT);
+    assert(rem == true);
+    
+    splitTasks.push_back(activeT);
+    splitBytes += activeT->getMemoryFootprint();
+    
+    return continuation;
+}
+
+//
+// Set the times of the split tasks, now that the run of basic blocks they
+//   belong to ends at endTime.  The time from the first split task's start is
+//   divided by block count, including the active task that continues the run.
+//   If the run cannot be timed, the lower bound times are kept.  The caller
+//   queues the split tasks and clears splitTasks.
+//
+void Context::resolveSplitTimes(ct_tsc_t tEndTime)
+{
+    if (splitTasks.empty()) return;
+    
+    ct_tsc_t runStart = splitTasks.front()->getStartTime();
+    if (tEndTime <= runStart) return;
+    
+    // Another event may have already ended the run
+    Task* tail = activeTask();
+    if (tail == NULL ||
+        tail->getType() != task_type_basic_blocks ||
+        tail->getTaskId() != splitTasks.back()->getTaskId().getNext())
+    {
+        return;
+    }
+    
+    uint64_t totalBlocks = tail->getBBCount();
+    for (Task* t : splitTasks) totalBlocks += t->getBBCount();
+    if (totalBlocks == 0) return;
+    
+    unsigned __int128 span = tEndTime - runStart;
+    uint64_t blocks = 0;
+    for (Task* t : splitTasks)
+    {
+        t->setStartTime(runStart + (ct_tsc_t)(span * blocks / totalBlocks));
+        blocks += t->getBBCount();
+        t->setEndTime(runStart + (ct_tsc_t)(span * blocks / totalBlocks));
+    }
+    
+    tail->setStartTime(splitTasks.back()->getEndTime());
+}
+
+void Context::addTasks(CheckpointFile& ck)
+{
+    for (auto it = tasks.begin(), et = tasks.end(); it != et; ++it) ck.addTask(it->second);
+    for (auto it = joinMap.begin(), et = joinMap.end(); it != et; ++it) ck.addTask(it->second);
+    for (Task* t : splitTasks) ck.addTask(t);
+}
+
+void Context::save(CheckpointFile& ck)
+{
+    ck.put<bool>(hasStarted);
+    ck.put<ct_tsc_t>(startTime);
+    ck.put<ct_tsc_t>(endTime);
+    ck.put<ct_tsc_t>(timeOffset);
+    ck.put<ct_tsc_t>(currentTime);
+    
+    ck.put<uint64_t>(tasks.size());
+    for (auto it = tasks.begin(), et = tasks.end(); it != et; ++it) ck.putTaskRef(it->second);
+    
+    ck.put<uint64_t>(creatorMap.size());
+    for (auto it = creatorMap.begin(), et = creatorMap.end(); it != et; ++it)
+    {
+        ck.put<ContextId>(it->first);
+        ck.put<TaskId>(it->second);
+    }
+    
+    ck.put<uint64_t>(joinMap.size());
+    for (auto it = joinMap.begin(), et = joinMap.end(); it != et; ++it)
+    {
+        ck.put<ContextId>(it->first);
+        ck.putTaskRef(it->second);
+    }
+    
+    ck.put<uint64_t>(joinCountMap.size());
+    for (auto it = joinCountMap.begin(), et = joinCountMap.end(); it != et; ++it)
+    {
+        ck.put<TaskId>(it->first);
+        ck.put<int>(it->second);
+    }
+    
+    ck.put<uint64_t>(splitTasks.size());
+    for (Task* t : splitTasks) ck.putTaskRef(t);
+    ck.put<uint64_t>(splitBytes);
+}
+
+void Context::restore(CheckpointFile& ck)
+{
+    hasStarted = ck.get<bool>();
+    startTime = ck.get<ct_tsc_t>();
+    endTime = ck.get<ct_tsc_t>();
+    timeOffset = ck.get<ct_tsc_t>();
+    currentTime = ck.get<ct_tsc_t>();
+    
+    tasks.clear();
+    active = NULL;
+    uint64_t n = ck.get<uint64_t>();
+    for (uint64_t i = 0; i < n; i++) addTask(ck.getTaskRef());
+    
+    creatorMap.clear();
+    n = ck.get<uint64_t>();
+    for (uint64_t i = 0; i < n; i++)
+    {
+        ContextId cid = ck.get<ContextId>();
+        creatorMap[cid] = ck.get<TaskId>();
+    }
+    
+    joinMap.clear();
+    n = ck.get<uint64_t>();
+    for (uint64_t i = 0; i < n; i++)
+    {
+        ContextId cid = ck.get<ContextId>();
+        joinMap[cid] = ck.getTaskRef();
+    }
+    
+    joinCountMap.clear();
+    n = ck.get<uint64_t>();
+    for (uint64_t i = 0; i < n; i++)
+    {
+        TaskId tid = ck.get<TaskId>();
+        joinCountMap[tid] = ck.get<int>();
+    }
+    
+    splitTasks.clear();
+    n = ck.get<uint64_t>();
+    for (uint64_t i = 0; i < n; i++) splitTasks.push_back(ck.getTaskRef());
+    splitBytes = ck.get<uint64_t>();
+}
+
 Task* Context::createContinuation(task_type type, ct_tsc_t tStartTime, ct_tsc_t tEndTime)
 {
     Task* bbContinue = NULL;
@@ -180,7 +343,7 @@ Task* Context::createContinuation(task_type type, ct_tsc_t tStartTime, ct_tsc_t
 
     // Make the continuation active
     //tasks.push_front(continuation);
-    tasks[continuation->getTaskId()] = continuation;
+    addTask(continuation);
 
     if (bbContinue != NULL)
     {
@@ -190,3 +353,36 @@ Task* Context::createContinuation(task_type type, ct_tsc_t tStartTime, ct_tsc_t
     
     return continuation;
 }
+
+ContextTable::~ContextTable()
+{
+    for (auto& r : ranks)
+    {
+        for (Context* c : r) delete c;
+    }
+}
+
+Context& ContextTable::create(ContextId id)
+{
+    uint32_t rank = ((uint32_t)id) >> 24, ctid = ((uint32_t)id) & 0xffffff;
+    
+    if (rank >= ranks.size()) ranks.resize(rank + 1);
+    vector<Context*>& r = ranks[rank];
+    if (ctid >= r.size()) r.resize(ctid + 1, NULL);
+    if (r[ctid] == NULL) r[ctid] = new Context();
+    
+    return *r[ctid];
+}
+
+void ContextTable::getContexts(vector<pair<ContextId, Context*> >& contexts)
+{
+    contexts.clear();
+    for (uint32_t rank = 0; rank < ranks.size(); rank++)
+    {
+        for (uint32_t ctid = 0; ctid < ranks[rank].size(); ctid++)
+        {
+            if (ranks[rank][ctid] == NULL) continue;
+            contexts.push_back(make_pair(ContextId((rank << 24) | ctid), ranks[rank][ctid]));
+        }
+    }
+}
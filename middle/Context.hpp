@@ -6,6 +6,9 @@
 #include <list>
 #include "../common/eventLib/ct_event.h"
 #include "../common/taskLib/Task.hpp"
+#include "FlatMap.hpp"
+#include "Checkpoint.hpp"
+#include <vector>
 
 namespace contech {
 
@@ -16,8 +19,11 @@ public:
 
     Context();
 
-    Task* activeTask();
+    Task* activeTask() { return active; }
+    void addTask(Task*);
     Task* createBasicBlockContinuation();
+    Task* splitBasicBlockTask();
+    void resolveSplitTimes(ct_tsc_t endTime);
     Task* createContinuation(task_type eventType, ct_tsc_t startTime, ct_tsc_t endTime);
     bool removeTask(Task*);
     Task* getTask(TaskId);
@@ -25,18 +31,22 @@ public:
     void getChildJoin(ContextId, Task*);
     Task* childExits(TaskId);
     bool isCompleteJoin(TaskId);
+    
+    void addTasks(CheckpointFile&);
+    void save(CheckpointFile&);
+    void restore(CheckpointFile&);
 
     // Queue of tasks that are running in this contech but have not been written to file yet. These tasks may have incomplete data.
-    // The front of the queue represents more recent tasks.
+    // The task with the largest id is the active task.  Modify through addTask / removeTask.
     //list<Task*> tasks;
-    map<TaskId, Task*> tasks;
+    FlatMap<TaskId, Task*> tasks;
 
     // Map of ContextId -> TaskId, which task created which context
-    map<ContextId, TaskId> creatorMap;
+    FlatMap<ContextId, TaskId> creatorMap;
     // Map of child Context -> (childId -or- joinId)
-    map<ContextId, Task*> joinMap;
+    FlatMap<ContextId, Task*> joinMap;
     // How many joins are pending for this task, if 0 and not active then clear
-    map<TaskId, int> joinCountMap;
+    FlatMap<TaskId, int> joinCountMap;
     
     // Has this contech started running?
     bool hasStarted = false;
@@ -54,6 +64,51 @@ public:
     ct_tsc_t timeOffset = 0;
     
     ct_tsc_t currentTime = 0;
+    
+    // Basic block tasks split from the active task, in order, that are waiting
+    //   for a time stamp.  See TaskSplitPolicy.
+    vector<Task*> splitTasks;
+    size_t splitBytes = 0;
+
+private:
+    // Cached task with the largest id in tasks
+    Task* active = NULL;
+};
+
+//
+// Contexts, indexed by (rank << 24) | contech id
+//
+//   Context ids are dense within each rank, so each rank is a vector.  Each
+//   context is allocated separately, so references stay valid as contexts are
+//   added.
+//
+class ContextTable
+{
+private:
+    vector<vector<Context*> > ranks;
+
+public:
+    ~ContextTable();
+
+    // Returns NULL if the context has not been created
+    Context* find(ContextId id)
+    {
+        uint32_t rank = ((uint32_t)id) >> 24, ctid = ((uint32_t)id) & 0xffffff;
+        if (rank >= ranks.size() || ctid >= ranks[rank].size()) return NULL;
+        return ranks[rank][ctid];
+    }
+    size_t count(ContextId id) { return (find(id) != NULL) ? 1 : 0; }
+
+    // Creates the context if it does not exist
+    Context& operator[](ContextId id)
+    {
+        Context* c = find(id);
+        return (c != NULL) ? *c : create(id);
+    }
+    Context& create(ContextId);
+
+    // Every context, ordered by id
+    void getContexts(vector<pair<ContextId, Context*> >&);
 };
 
 } // end namespace contech
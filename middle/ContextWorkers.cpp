@@ -0,0 +1,145 @@
+#include "ContextWorkers.hpp"
+#include "middle.hpp"
+#include "taskWrite.hpp"
+#include "MemoryBudget.hpp"
+
+using namespace std;
+using namespace contech;
+
+// Events are handed to a worker in batches, to amortize the locking
+#define CONTEXT_WORK_BATCH 256
+
+// Events queued between drains, when no other event drains the pool
+#define CONTEXT_WORK_DRAIN (64 * 1024)
+
+ContextWorkers::ContextWorkers(unsigned int threads, bool pm, bool d)
+{
+    parallelMiddle = pm;
+    debug = d;
+    queuedSinceDrain = 0;
+    
+    for (unsigned int i = 0; i < threads; i++)
+    {
+        context_worker* w = new context_worker;
+        pthread_mutex_init(&w->lock, NULL);
+        pthread_cond_init(&w->workCond, NULL);
+        pthread_cond_init(&w->idleCond, NULL);
+        w->busy = false;
+        w->exit = false;
+        w->pool = this;
+        w->pending.reserve(CONTEXT_WORK_BATCH);
+        
+        int r = pthread_create(&w->thread, NULL, workerMain, w);
+        assert(r == 0);
+        workers.push_back(w);
+    }
+}
+
+ContextWorkers::~ContextWorkers()
+{
+    drain();
+    
+    for (context_worker* w : workers)
+    {
+        pthread_mutex_lock(&w->lock);
+        w->exit = true;
+        pthread_cond_signal(&w->workCond);
+        pthread_mutex_unlock(&w->lock);
+        pthread_join(w->thread, NULL);
+        
+        pthread_mutex_destroy(&w->lock);
+        pthread_cond_destroy(&w->workCond);
+        pthread_cond_destroy(&w->idleCond);
+        delete w;
+    }
+    workers.clear();
+}
+
+void* ContextWorkers::workerMain(void* v)
+{
+    context_worker* w = (context_worker*) v;
+    deque<context_work> work;
+    
+    setTaskStaging(&w->staged);
+    
+    while (1)
+    {
+        pthread_mutex_lock(&w->lock);
+        while (!w->exit && w->queue.empty())
+        {
+            pthread_cond_wait(&w->workCond, &w->lock);
+        }
+        if (w->queue.empty())
+        {
+            pthread_mutex_unlock(&w->lock);
+            break;
+        }
+        work.swap(w->queue);
+        w->busy = true;
+        pthread_mutex_unlock(&w->lock);
+        
+        for (context_work& cw : work)
+        {
+            processContextEvent(*cw.ctx, cw.event, cw.rank, w->pool->parallelMiddle, w->pool->debug);
+            MemoryBudget::release(mem_event_queue, MemoryBudget::eventBytes(cw.event));
+            EventLib::deleteContechEvent(cw.event);
+        }
+        work.clear();
+        
+        pthread_mutex_lock(&w->lock);
+        w->busy = false;
+        if (w->queue.empty()) pthread_cond_signal(&w->idleCond);
+        pthread_mutex_unlock(&w->lock);
+    }
+    
+    return NULL;
+}
+
+void ContextWorkers::flush(context_worker* w)
+{
+    if (w->pending.empty()) return;
+    
+    pthread_mutex_lock(&w->lock);
+    w->queue.insert(w->queue.end(), w->pending.begin(), w->pending.end());
+    pthread_cond_signal(&w->workCond);
+    pthread_mutex_unlock(&w->lock);
+    w->pending.clear();
+}
+
+void ContextWorkers::queueEvent(ContextId id, Context* ctx, ct_event* event, int rank)
+{
+    context_worker* w = workers[(uint32_t)id % workers.size()];
+    context_work cw;
+    
+    cw.ctx = ctx;
+    cw.event = event;
+    cw.rank = rank;
+    MemoryBudget::charge(mem_event_queue, MemoryBudget::eventBytes(event));
+    w->pending.push_back(cw);
+    if (w->pending.size() >= CONTEXT_WORK_BATCH) flush(w);
+    if (++queuedSinceDrain >= CONTEXT_WORK_DRAIN) drain();
+}
+
+void ContextWorkers::drain()
+{
+    for (context_worker* w : workers)
+    {
+        flush(w);
+    }
+    
+    for (context_worker* w : workers)
+    {
+        pthread_mutex_lock(&w->lock);
+        while (w->busy || !w->queue.empty())
+        {
+            pthread_cond_wait(&w->idleCond, &w->lock);
+        }
+        pthread_mutex_unlock(&w->lock);
+        
+        merged.insert(merged.end(), w->staged.begin(), w->staged.end());
+        w->staged.clear();
+    }
+    
+    queueStagedTasks(merged);
+    queuedSinceDrain = 0;
+}
@@ -0,0 +1,74 @@
+#ifndef CT_CONTEXT_WORKERS_HPP
+#define CT_CONTEXT_WORKERS_HPP
+
+#include "../common/eventLib/ct_event.h"
+#include "Context.hpp"
+#include <pthread.h>
+#include <deque>
+#include <vector>
+
+namespace contech {
+
+//
+// Pool of threads that process basic block, memory and bulk memory events
+//
+//   Each context is assigned to one worker, so its events are still applied
+//   in order.  Every other event type is handled by the main loop, which must
+//   drain the pool first, as those events may modify any context.
+//
+//   The tasks that workers complete are queued for writing when the pool is
+//   drained, in TaskId order, so the taskgraph does not depend on the thread
+//   scheduling.  The pool also drains itself every CONTEXT_WORK_DRAIN events,
+//   which bounds the tasks held and keeps the drains at fixed events.
+//
+class ContextWorkers
+{
+private:
+    typedef struct _context_work
+    {
+        Context* ctx;
+        ct_event* event;
+        int rank;
+    } context_work;
+    
+    typedef struct _context_worker
+    {
+        pthread_t thread;
+        pthread_mutex_t lock;
+        pthread_cond_t workCond, idleCond;
+        std::deque<context_work> queue;
+        bool busy;
+        bool exit;
+        ContextWorkers* pool;
+        
+        // Events not yet handed to the worker, only used by the main loop
+        std::vector<context_work> pending;
+        
+        // Tasks completed by the worker since the last drain
+        std::vector<Task*> staged;
+    } context_worker;
+    
+    std::vector<context_worker*> workers;
+    std::vector<Task*> merged;
+    unsigned int queuedSinceDrain;
+    bool parallelMiddle;
+    bool debug;
+    
+    static void* workerMain(void*);
+    void flush(context_worker*);
+
+public:
+    ContextWorkers(unsigned int threads, bool parallelMiddle, bool debug);
+    ~ContextWorkers();
+    
+    // Takes ownership of the event
+    void queueEvent(ContextId id, Context* ctx, ct_event* event, int rank);
+    
+    // Returns once every queued event has been processed and the tasks of
+    //   those events are queued for writing
+    void drain();
+};
+
+} // end namespace contech
+
+#endif
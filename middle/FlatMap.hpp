@@ -0,0 +1,175 @@
+#ifndef CT_FLAT_MAP_HPP
+#define CT_FLAT_MAP_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+#include <assert.h>
+#include <iterator>
+#include <utility>
+#include <vector>
+#include "../common/taskLib/TaskId.hpp"
+
+namespace contech {
+
+// Integer value of a key, ids only convert explicitly
+inline uint64_t flatMapKey(uint64_t k) { return k; }
+inline uint64_t flatMapKey(ContextId k) { return (uint32_t)k; }
+inline uint64_t flatMapKey(TaskId k) { return (uint64_t)k; }
+
+//
+// Open addressing hash table for the middle layer's per event lookups
+//
+//   Keys are anything that converts to an integer (addresses, ContextId,
+//   TaskId), and are spread with a multiplicative hash, as addresses have
+//   zero low bits.  Slots are probed linearly and erase shifts the following
+//   entries back, so there are no tombstones.  Like std::unordered_map, any
+//   insert may move the entries, so do not hold references across inserts.
+//   Iteration order is unspecified.
+//
+template <typename K, typename V>
+class FlatMap
+{
+public:
+    typedef std::pair<K, V> value_type;
+
+    class iterator
+    {
+        friend class FlatMap;
+        FlatMap* m;
+        size_t pos;
+        iterator(FlatMap* m_, size_t p) : m(m_), pos(p) { skip(); }
+        void skip() { while (pos < m->used.size() && !m->used[pos]) pos++; }
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef typename FlatMap::value_type value_type;
+        typedef ptrdiff_t difference_type;
+        typedef value_type* pointer;
+        typedef value_type& reference;
+        
+        value_type& operator*() const { return m->slots[pos]; }
+        value_type* operator->() const { return &m->slots[pos]; }
+        iterator& operator++() { pos++; skip(); return *this; }
+        bool operator==(const iterator& rhs) const { return pos == rhs.pos; }
+        bool operator!=(const iterator& rhs) const { return pos != rhs.pos; }
+    };
+
+private:
+    std::vector<value_type> slots;
+    std::vector<uint8_t> used;
+    size_t entries;
+    size_t mask;
+
+    static size_t hashKey(const K& k)
+    {
+        uint64_t h = flatMapKey(k);
+        h *= 0x9e3779b97f4a7c15ULL;
+        return (size_t)(h ^ (h >> 29));
+    }
+
+    // Returns the slot holding k, or the empty slot where k would go
+    size_t probe(const K& k) const
+    {
+        size_t i = hashKey(k) & mask;
+        while (used[i] && !(slots[i].first == k)) i = (i + 1) & mask;
+        return i;
+    }
+
+    void grow()
+    {
+        std::vector<value_type> oldSlots;
+        std::vector<uint8_t> oldUsed;
+        size_t n = (used.empty()) ? 16 : used.size() * 2;
+
+        oldSlots.swap(slots);
+        oldUsed.swap(used);
+        slots.resize(n);
+        used.assign(n, 0);
+        mask = n - 1;
+
+        for (size_t i = 0; i < oldUsed.size(); i++)
+        {
+            if (!oldUsed[i]) continue;
+            size_t j = probe(oldSlots[i].first);
+            slots[j] = std::move(oldSlots[i]);
+            used[j] = 1;
+        }
+    }
+
+public:
+    FlatMap() : entries(0), mask(0) { grow(); }
+
+    size_t size() const { return entries; }
+    bool empty() const { return entries == 0; }
+
+    iterator begin() { return iterator(this, 0); }
+    iterator end() { return iterator(this, used.size()); }
+
+    iterator find(const K& k)
+    {
+        size_t i = probe(k);
+        return (used[i]) ? iterator(this, i) : end();
+    }
+
+    size_t count(const K& k) const { return used[probe(k)]; }
+
+    V& operator[](const K& k)
+    {
+        size_t i = probe(k);
+        if (used[i]) return slots[i].second;
+
+        // Keep the load factor under 3/4
+        if ((entries + 1) * 4 > used.size() * 3)
+        {
+            grow();
+            i = probe(k);
+        }
+        slots[i].first = k;
+        slots[i].second = V();
+        used[i] = 1;
+        entries++;
+        return slots[i].second;
+    }
+
+    void erase(iterator it)
+    {
+        size_t i = it.pos;
+        assert(used[i]);
+
+        // Shift back any entry whose probe sequence passes through the hole
+        size_t j = i;
+        while (1)
+        {
+            j = (j + 1) & mask;
+            if (!used[j]) break;
+            size_t home = hashKey(slots[j].first) & mask;
+            if (((j - home) & mask) >= ((j - i) & mask))
+            {
+                slots[i] = std::move(slots[j]);
+                i = j;
+            }
+        }
+        slots[i] = value_type();
+        used[i] = 0;
+        entries--;
+    }
+
+    size_t erase(const K& k)
+    {
+        iterator it = find(k);
+        if (it == end()) return 0;
+        erase(it);
+        return 1;
+    }
+
+    void clear()
+    {
+        slots.clear();
+        used.clear();
+        entries = 0;
+        grow();
+    }
+};
+
+} // end namespace contech
+
+#endif
@@ -0,0 +1,129 @@
+#include "FlatMap.hpp"
+#include "../common/taskLib/test_check.hpp"
+#include <stdio.h>
+#include <unordered_map>
+
+using namespace contech;
+using namespace std;
+
+//
+// FlatMap against std::unordered_map, through the inserts, erases and grows
+//   that the middle's lookups do.  Returns 0 if every test passes.
+//
+
+// Same entries, found by lookup and by iteration
+template <typename K>
+static bool sameEntries(FlatMap<K, uint64_t>& fm, unordered_map<uint64_t, uint64_t>& ref)
+{
+    if (fm.size() != ref.size()) return false;
+    size_t n = 0;
+    for (auto it = fm.begin(), et = fm.end(); it != et; ++it)
+    {
+        auto r = ref.find(flatMapKey(it->first));
+        if (r == ref.end() || r->second != it->second) return false;
+        n++;
+    }
+    if (n != ref.size()) return false;
+    for (auto it = ref.begin(), et = ref.end(); it != et; ++it)
+    {
+        auto f = fm.find(K(it->first));
+        if (f == fm.end() || f->second != it->second) return false;
+    }
+    return true;
+}
+
+// Random inserts and erases of keys from a small range, so that erases hit
+//   the clusters that the inserts build, and the table grows as it fills
+static void testRandom(uint64_t stride)
+{
+    FlatMap<uint64_t, uint64_t> fm;
+    unordered_map<uint64_t, uint64_t> ref;
+    uint64_t seed = 0x9E3779B97F4A7C15ULL;
+    bool same = true;
+
+    for (unsigned int i = 0; i < 200000; i++)
+    {
+        seed ^= seed << 13; seed ^= seed >> 7; seed ^= seed << 17;
+        uint64_t k = 0x7f0000000000ULL + ((seed >> 8) % (1 + i / 16)) * stride;
+        switch (seed % 4)
+        {
+            case 0:
+            case 1:
+                fm[k] = i;
+                ref[k] = i;
+                break;
+            case 2:
+                if (fm.erase(k) != ref.erase(k)) same = false;
+                break;
+            case 3:
+                if (fm.count(k) != ref.count(k)) same = false;
+                break;
+        }
+        if (i % 10007 == 0 && !sameEntries(fm, ref)) same = false;
+    }
+    CHECK(same);
+    CHECK(sameEntries(fm, ref));
+
+    // Erase through iterators until empty, checking as the table empties
+    while (!fm.empty())
+    {
+        auto it = fm.begin();
+        ref.erase(it->first);
+        fm.erase(it);
+        if (ref.size() % 1009 == 0 && !sameEntries(fm, ref)) same = false;
+    }
+    CHECK(same);
+    CHECK(ref.empty());
+    CHECK(fm.begin() == fm.end());
+}
+
+// Entries found after every grow, and erasing the entries that were moved
+//   back into the slots of erased ones
+static void testGrow()
+{
+    FlatMap<TaskId, uint64_t> fm;
+    unordered_map<uint64_t, uint64_t> ref;
+
+    for (unsigned int i = 0; i < 5000; i++)
+    {
+        TaskId t(ContextId(i % 7), SeqId(i));
+        fm[t] = i;
+        ref[(uint64_t)t] = i;
+        if ((i & (i - 1)) == 0) CHECK(sameEntries(fm, ref));
+    }
+    CHECK(sameEntries(fm, ref));
+
+    for (unsigned int i = 0; i < 5000; i += 2)
+    {
+        TaskId t(ContextId(i % 7), SeqId(i));
+        CHECK(fm.erase(t) == 1);
+        CHECK(fm.erase(t) == 0);
+        ref.erase((uint64_t)t);
+    }
+    CHECK(sameEntries(fm, ref));
+
+    // Reinserting keeps one entry per key
+    for (unsigned int i = 0; i < 5000; i++)
+    {
+        TaskId t(ContextId(i % 7), SeqId(i));
+        fm[t] = i + 1;
+        ref[(uint64_t)t] = i + 1;
+    }
+    CHECK(sameEntries(fm, ref));
+
+    fm.clear();
+    CHECK(fm.empty());
+    CHECK(fm.find(TaskId(ContextId(0), SeqId(0))) == fm.end());
+    fm[TaskId(ContextId(1), SeqId(1))] = 1;
+    CHECK(fm.size() == 1);
+}
+
+int main(int argc, char** argv)
+{
+    testRandom(1);
+    // Addresses with zero low bits, which a plain mask would put in a few slots
+    testRandom(4096);
+    testGrow();
+
+    return testResult("FlatMap_test");
+}
@@ -0,0 +1,107 @@
+#include "MemoryBudget.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/sysinfo.h>
+#include <iostream>
+
+using namespace std;
+using namespace contech;
+
+std::atomic<int64_t> MemoryBudget::current[mem_component_count];
+std::atomic<int64_t> MemoryBudget::highWater[mem_component_count];
+std::atomic<int64_t> MemoryBudget::totalHighWater;
+uint64_t MemoryBudget::budget = ~0ULL;
+
+static const char* componentName[mem_component_count] = {"Events", "Tasks", "Records"};
+
+void MemoryBudget::charge(mem_component c, int64_t bytes)
+{
+    int64_t v = (current[c] += bytes);
+
+    int64_t h = highWater[c].load(memory_order_relaxed);
+    while (v > h && !highWater[c].compare_exchange_weak(h, v, memory_order_relaxed));
+
+    if (bytes > 0)
+    {
+        int64_t t = getTotal();
+        h = totalHighWater.load(memory_order_relaxed);
+        while (t > h && !totalHighWater.compare_exchange_weak(h, t, memory_order_relaxed));
+    }
+}
+
+uint64_t MemoryBudget::getTotal()
+{
+    int64_t t = 0;
+    for (int i = 0; i < mem_component_count; i++)
+    {
+        t += current[i].load(memory_order_relaxed);
+    }
+    return (t > 0) ? t : 0;
+}
+
+//
+// Returns the cgroup memory limit, or 0 if there is none
+//
+static uint64_t getCgroupLimit()
+{
+    const char* paths[] = {"/sys/fs/cgroup/memory.max", "/sys/fs/cgroup/memory/memory.limit_in_bytes"};
+
+    for (const char* p : paths)
+    {
+        FILE* f = fopen(p, "r");
+        if (f == NULL) continue;
+
+        unsigned long long limit = 0;
+        int r = fscanf(f, "%llu", &limit);
+        fclose(f);
+
+        // "max" or the v1 default of (nearly) 2^63 are no limit
+        if (r == 1 && limit < (1ULL << 62)) return limit;
+    }
+
+    return 0;
+}
+
+void MemoryBudget::initBudget()
+{
+    char* env = getenv("CONTECH_MIDDLE_MEM_BUDGET");
+
+    if (env != NULL && strtoull(env, NULL, 10) > 0)
+    {
+        budget = strtoull(env, NULL, 10) * 1024 * 1024;
+        return;
+    }
+
+    uint64_t limit = getCgroupLimit();
+    if (limit == 0)
+    {
+        struct sysinfo t_info;
+        if (0 == sysinfo(&t_info))
+        {
+            limit = (uint64_t)t_info.totalram * t_info.mem_unit;
+        }
+    }
+
+    if (limit > 0) budget = limit / 2;
+}
+
+size_t MemoryBudget::eventBytes(pct_event event)
+{
+    size_t b = sizeof(ct_event);
+    if (event->event_type == ct_event_basic_block)
+    {
+        b += event->bb.len * sizeof(ct_memory_op);
+    }
+    return b;
+}
+
+void MemoryBudget::printHighWater()
+{
+    cerr << "Middle Memory Budget: " << (budget >> 20) << " MB" << endl;
+    cerr << "Middle Memory High Water:";
+    for (int i = 0; i < mem_component_count; i++)
+    {
+        cerr << " " << componentName[i] << " " << (highWater[i].load() >> 10) << " KB";
+    }
+    cerr << " Total " << (totalHighWater.load() >> 10) << " KB" << endl;
+}
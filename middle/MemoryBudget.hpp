@@ -0,0 +1,51 @@
+#ifndef CT_MEMORY_BUDGET_HPP
+#define CT_MEMORY_BUDGET_HPP
+
+#include "../common/eventLib/ct_event.h"
+#include <stdint.h>
+#include <atomic>
+
+namespace contech {
+
+//
+// Accounting of the memory held between the middle layer's stages
+//
+//   Each stage charges the bytes it takes and releases them when it hands the
+//   data on, so the counters are independent of what else runs on the host.
+//   Tasks still being built by a context are not charged, as they are bounded
+//   by TaskSplitPolicy and cannot be released by stalling.
+//
+enum mem_component
+{
+    mem_event_queue = 0,    // decoded events waiting in EventQ or a context worker
+    mem_task_queue,         // tasks queued for the background writer
+    mem_record_queue,       // compressed records waiting to be appended
+    mem_component_count
+};
+
+class MemoryBudget
+{
+private:
+    static std::atomic<int64_t> current[mem_component_count];
+    static std::atomic<int64_t> highWater[mem_component_count];
+    static std::atomic<int64_t> totalHighWater;
+    static uint64_t budget;
+
+public:
+    static void charge(mem_component c, int64_t bytes);
+    static void release(mem_component c, int64_t bytes) { charge(c, -bytes); }
+
+    static uint64_t getTotal();
+    static bool isOverBudget() { return getTotal() > budget; }
+
+    // CONTECH_MIDDLE_MEM_BUDGET=<MB>, or half of the cgroup or physical memory
+    static void initBudget();
+    static uint64_t getBudget() { return budget; }
+
+    static size_t eventBytes(pct_event);
+    static void printHighWater();
+};
+
+} // end namespace contech
+
+#endif
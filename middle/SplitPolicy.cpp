@@ -0,0 +1,38 @@
+#include "SplitPolicy.hpp"
+#include "middle.hpp"
+#include <stdlib.h>
+#include <iostream>
+
+using namespace std;
+using namespace contech;
+
+uint64_t TaskSplitPolicy::maxBlocks = MAX_BLOCK_THRESHOLD;
+uint64_t TaskSplitPolicy::maxActionBytes = 0;
+ct_tsc_t TaskSplitPolicy::maxCycles = 0;
+bool TaskSplitPolicy::interpolate = false;
+
+static uint64_t getSplitEnv(const char* name, uint64_t def)
+{
+    char* env = getenv(name);
+    if (env == NULL) return def;
+    return strtoull(env, NULL, 10);
+}
+
+void TaskSplitPolicy::initPolicy()
+{
+    maxBlocks = getSplitEnv("CONTECH_MIDDLE_SPLIT_BLOCKS", MAX_BLOCK_THRESHOLD);
+    maxActionBytes = getSplitEnv("CONTECH_MIDDLE_SPLIT_BYTES", 0);
+    maxCycles = getSplitEnv("CONTECH_MIDDLE_SPLIT_CYCLES", 0);
+
+    // Tasks are still bounded when the block limit is disabled
+    if (maxBlocks == 0 || maxBlocks > MAX_BLOCK_THRESHOLD) maxBlocks = MAX_BLOCK_THRESHOLD;
+    interpolate = (maxBlocks != MAX_BLOCK_THRESHOLD || maxActionBytes != 0 || maxCycles != 0);
+}
+
+void TaskSplitPolicy::printPolicy()
+{
+    cerr << "Middle Task Split: Blocks " << maxBlocks;
+    if (maxActionBytes != 0) cerr << " Action Bytes " << maxActionBytes;
+    if (maxCycles != 0) cerr << " Cycles " << maxCycles;
+    cerr << endl;
+}
@@ -0,0 +1,61 @@
+#ifndef CT_SPLIT_POLICY_HPP
+#define CT_SPLIT_POLICY_HPP
+
+#include "../common/taskLib/Task.hpp"
+#include "../common/eventLib/ct_event.h"
+#include <stdint.h>
+
+namespace contech {
+
+//
+// When the middle layer splits a long run of basic blocks into several tasks
+//
+//   A task is full once it reaches the block or action byte limit.  Nothing in
+//   a run of basic blocks is timed, so the split tasks are held by the context
+//   and their times are interpolated by block count once the context's next
+//   timed event arrives.  A task is long once the elapsed time from its start
+//   reaches the cycle limit, which is checked at delay events, as they are the
+//   only time stamps within a run of basic blocks.
+//
+//   With the default policy, which only limits blocks to MAX_BLOCK_THRESHOLD,
+//   split tasks are queued at once with one cycle per block, a lower bound,
+//   and delay events are ignored, as before there was a policy.
+//
+class TaskSplitPolicy
+{
+private:
+    static uint64_t maxBlocks;
+    static uint64_t maxActionBytes;
+    static ct_tsc_t maxCycles;
+    static bool interpolate;
+
+public:
+    // CONTECH_MIDDLE_SPLIT_BLOCKS=<blocks>, CONTECH_MIDDLE_SPLIT_BYTES=<bytes>,
+    //   CONTECH_MIDDLE_SPLIT_CYCLES=<cycles>, 0 disables a limit
+    static void initPolicy();
+
+    static uint64_t getMaxBlocks() { return maxBlocks; }
+
+    // Split tasks are held to interpolate their times
+    static bool interpolatesTimes() { return interpolate; }
+
+    // Delay events are kept, to check the cycle limit
+    static bool usesDelays() { return maxCycles != 0; }
+
+    static bool isFull(const Task* t)
+    {
+        return (uint64_t)t->getBBCount() >= maxBlocks ||
+               (maxActionBytes != 0 && t->getActionCount() * sizeof(Action) >= maxActionBytes);
+    }
+
+    static bool isLong(const Task* t, ct_tsc_t now)
+    {
+        return maxCycles != 0 && now > t->getStartTime() && now - t->getStartTime() >= maxCycles;
+    }
+
+    static void printPolicy();
+};
+
+} // end namespace contech
+
+#endif
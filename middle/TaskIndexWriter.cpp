@@ -0,0 +1,294 @@
+#include "TaskIndexWriter.hpp"
+#include "../common/taskLib/ct_file.h"
+#include "../common/taskLib/TaskGraphWriter.hpp"
+#include <unistd.h>
+
+using namespace std;
+using namespace contech;
+
+#define INDEX_COPY_CHUNK (1024 * 1024)
+
+TaskIndexWriter::TaskIndexWriter(size_t w, size_t s)
+{
+    readyWindow = w;
+    spillLimit = s;
+    memSuccCount = 0;
+    spillEnd = 0;
+    entryCount = 0;
+    lastTid = 0;
+
+    entryFile = tmpfile();
+    spillFile = tmpfile();
+    skeletonFile = tmpfile();
+    if (entryFile == NULL || spillFile == NULL || skeletonFile == NULL)
+    {
+        perror("Cannot create temporary files for the task index");
+        assert(0);
+    }
+}
+
+TaskIndexWriter::~TaskIndexWriter()
+{
+    fclose(entryFile);
+    fclose(spillFile);
+    fclose(skeletonFile);
+}
+
+TaskIndexWriter::index_node& TaskIndexWriter::getNode(TaskId id)
+{
+    auto it = pending.find(id);
+    if (it != pending.end()) return it->second;
+
+    index_node& n = pending[id];
+    n.p = 0;
+    n.written = false;
+    n.start = 0;
+    n.writePos = 0;
+    n.spillPos = -1;
+    n.spillCount = 0;
+    return n;
+}
+
+void TaskIndexWriter::addTask(TaskId id, ct_tsc_t start, unsigned int predCount, const vector<TaskId>& succ, uint64 writePos,
+                              const vector<unsigned char>& skeleton)
+{
+    fwrite(skeleton.data(), 1, skeleton.size(), skeletonFile);
+    
+    // Successors of indexed tasks may already have a node, with a negative count
+    index_node& n = getNode(id);
+    assert(n.written == false);
+
+    n.written = true;
+    n.p += predCount;
+    n.start = start;
+    n.writePos = writePos;
+
+    setSuccessors(n, succ);
+    if (n.p == 0)
+    {
+        ready.push(make_pair(start, make_pair(id, writePos)));
+        indexReady(readyWindow);
+    }
+}
+
+void TaskIndexWriter::setSuccessors(index_node& n, const vector<TaskId>& succ)
+{
+    if (n.p != 0 && memSuccCount + succ.size() > spillLimit && !succ.empty())
+    {
+        // Waiting tasks are the bulk of the frontier, so their successors go to disk
+        ssize_t len = succ.size() * sizeof(TaskId);
+        ssize_t r = pwrite(fileno(spillFile), succ.data(), len, spillEnd);
+        assert(r == len);
+        n.spillPos = spillEnd;
+        n.spillCount = succ.size();
+        spillEnd += len;
+    }
+    else
+    {
+        n.s = succ;
+        memSuccCount += succ.size();
+    }
+}
+
+//
+// Index the oldest ready tasks until at most keep remain.  Indexing a task may
+//   make its successors ready.
+//
+void TaskIndexWriter::indexReady(size_t keep)
+{
+    vector<TaskId> succ;
+
+    while (ready.size() > keep)
+    {
+        TaskId tid = ready.top().second.first;
+        uint64 offset = ready.top().second.second;
+        ready.pop();
+
+        TaskGraphWriter::writeIndexEntry(entryFile, tid, offset);
+        entryCount++;
+        lastTid = tid;
+
+        auto it = pending.find(tid);
+        assert(it != pending.end());
+        index_node& n = it->second;
+
+        if (n.spillPos >= 0)
+        {
+            ssize_t len = n.spillCount * sizeof(TaskId);
+            succ.resize(n.spillCount);
+            ssize_t r = pread(fileno(spillFile), succ.data(), len, n.spillPos);
+            assert(r == len);
+        }
+        else
+        {
+            succ.swap(n.s);
+            memSuccCount -= succ.size();
+        }
+        pending.erase(it);
+
+        for (TaskId s : succ)
+        {
+            index_node& sn = getNode(s);
+            sn.p--;
+            if (sn.p == 0 && sn.written)
+            {
+                ready.push(make_pair(sn.start, make_pair(s, sn.writePos)));
+            }
+        }
+        succ.clear();
+    }
+}
+
+uint64 TaskIndexWriter::finish(FILE* out)
+{
+    indexReady(0);
+
+    fflush(entryFile);
+    rewind(entryFile);
+
+    char* buf = (char*) malloc(INDEX_COPY_CHUNK);
+    assert(buf != NULL);
+    size_t r;
+    while ((r = fread(buf, 1, INDEX_COPY_CHUNK, entryFile)) > 0)
+    {
+        ct_write(buf, r, out);
+    }
+
+    // Every task written has a skeleton entry
+    fflush(skeletonFile);
+    rewind(skeletonFile);
+    TaskGraphWriter::writeSkeletonCount(out, entryCount);
+    while ((r = fread(buf, 1, INDEX_COPY_CHUNK, skeletonFile)) > 0)
+    {
+        ct_write(buf, r, out);
+    }
+    free(buf);
+
+    return entryCount;
+}
+
+void TaskIndexWriter::printPending()
+{
+    for (auto it = pending.begin(), et = pending.end(); it != et; ++it)
+    {
+        index_node& n = it->second;
+        printf("%s (written:%d) (pred:%d)\t", it->first.toString().c_str(), n.written, n.p);
+        for (TaskId succ : n.s)
+        {
+            printf("%s\t", succ.toString().c_str());
+        }
+        if (n.spillPos >= 0) printf("(%u spilled)", n.spillCount);
+        printf("\n");
+    }
+}
+
+void TaskIndexWriter::save(CheckpointFile& ck)
+{
+    ck.put<uint64>(entryCount);
+    ck.put<TaskId>(lastTid);
+    
+    fflush(entryFile);
+    char* buf = (char*) malloc(INDEX_COPY_CHUNK);
+    assert(buf != NULL);
+    off_t entryBytes = entryCount * (sizeof(TaskId) + sizeof(uint64));
+    for (off_t pos = 0; pos < entryBytes; )
+    {
+        ssize_t r = pread(fileno(entryFile), buf, min((off_t)INDEX_COPY_CHUNK, entryBytes - pos), pos);
+        assert(r > 0);
+        ck.putBytes(buf, r);
+        pos += r;
+    }
+    
+    fflush(skeletonFile);
+    off_t skeletonBytes = ftell(skeletonFile);
+    ck.put<uint64>(skeletonBytes);
+    for (off_t pos = 0; pos < skeletonBytes; )
+    {
+        ssize_t r = pread(fileno(skeletonFile), buf, min((off_t)INDEX_COPY_CHUNK, skeletonBytes - pos), pos);
+        assert(r > 0);
+        ck.putBytes(buf, r);
+        pos += r;
+    }
+    free(buf);
+    
+    vector<TaskId> succ;
+    ck.put<uint64>(pending.size());
+    for (auto it = pending.begin(), et = pending.end(); it != et; ++it)
+    {
+        index_node& n = it->second;
+        ck.put<TaskId>(it->first);
+        ck.put<int>(n.p);
+        ck.put<bool>(n.written);
+        ck.put<ct_tsc_t>(n.start);
+        ck.put<uint64>(n.writePos);
+        if (n.spillPos >= 0)
+        {
+            ssize_t len = n.spillCount * sizeof(TaskId);
+            succ.resize(n.spillCount);
+            ssize_t r = pread(fileno(spillFile), succ.data(), len, n.spillPos);
+            assert(r == len);
+            ck.putVector(succ);
+        }
+        else
+        {
+            ck.putVector(n.s);
+        }
+    }
+    
+    // The ready tasks, oldest first
+    auto readyCopy = ready;
+    ck.put<uint64>(readyCopy.size());
+    while (!readyCopy.empty())
+    {
+        ck.put<ready_task>(readyCopy.top());
+        readyCopy.pop();
+    }
+}
+
+void TaskIndexWriter::restore(CheckpointFile& ck)
+{
+    assert(entryCount == 0 && pending.size() == 0);
+    
+    entryCount = ck.get<uint64>();
+    lastTid = ck.get<TaskId>();
+    
+    char* buf = (char*) malloc(INDEX_COPY_CHUNK);
+    assert(buf != NULL);
+    uint64 entryBytes = entryCount * (sizeof(TaskId) + sizeof(uint64));
+    for (uint64 pos = 0; pos < entryBytes; )
+    {
+        size_t len = min((uint64)INDEX_COPY_CHUNK, entryBytes - pos);
+        ck.getBytes(buf, len);
+        fwrite(buf, 1, len, entryFile);
+        pos += len;
+    }
+    
+    uint64 skeletonBytes = ck.get<uint64>();
+    for (uint64 pos = 0; pos < skeletonBytes; )
+    {
+        size_t len = min((uint64)INDEX_COPY_CHUNK, skeletonBytes - pos);
+        ck.getBytes(buf, len);
+        fwrite(buf, 1, len, skeletonFile);
+        pos += len;
+    }
+    free(buf);
+    
+    vector<TaskId> succ;
+    uint64 pendingCount = ck.get<uint64>();
+    for (uint64 i = 0; i < pendingCount; i++)
+    {
+        index_node& n = getNode(ck.get<TaskId>());
+        n.p = ck.get<int>();
+        n.written = ck.get<bool>();
+        n.start = ck.get<ct_tsc_t>();
+        n.writePos = ck.get<uint64>();
+        ck.getVector(succ);
+        setSuccessors(n, succ);
+    }
+    
+    uint64 readyCount = ck.get<uint64>();
+    for (uint64 i = 0; i < readyCount; i++)
+    {
+        ready.push(ck.get<ready_task>());
+    }
+}
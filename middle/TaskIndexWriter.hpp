@@ -0,0 +1,89 @@
+#ifndef CT_TASK_INDEX_WRITER_HPP
+#define CT_TASK_INDEX_WRITER_HPP
+
+#include "../common/taskLib/Task.hpp"
+#include "../common/eventLib/ct_event.h"
+#include "FlatMap.hpp"
+#include "Checkpoint.hpp"
+#include <stdio.h>
+#include <queue>
+#include <vector>
+
+namespace contech {
+
+//
+// Builds the taskgraph index as tasks are written
+//
+//   A task is ready once every predecessor is in the index.  Ready tasks wait
+//   in a heap ordered by start time, and the oldest is indexed whenever the
+//   heap exceeds the window, so the index is in topological order and is the
+//   previous BFS order when the ready set fits in the window.  Only tasks that
+//   are not yet indexed are kept, and their successor lists are spilled to a
+//   temporary file past the spill limit.  The index entries themselves are
+//   kept in a temporary file until the task records are complete, as are the
+//   tasks' skeleton entries, which follow the index.
+//
+class TaskIndexWriter
+{
+private:
+    typedef struct _index_node
+    {
+        int p;              // predecessors not yet indexed, less any not yet written
+        bool written;
+        ct_tsc_t start;
+        uint64 writePos;
+        vector<TaskId> s;
+        long spillPos;      // -1 when s is in memory
+        uint32_t spillCount;
+    } index_node;
+
+    typedef pair<ct_tsc_t, pair<TaskId, uint64> > ready_task;
+    // Oldest first, ties are broken by id so the order does not depend on arrival
+    struct ready_compare
+    {
+        bool operator()(const ready_task& n1, const ready_task& n2) const { return n1 > n2; }
+    };
+
+    FlatMap<TaskId, index_node> pending;
+    priority_queue<ready_task, vector<ready_task>, ready_compare> ready;
+
+    size_t readyWindow;
+    size_t spillLimit, memSuccCount;
+    FILE* entryFile;
+    FILE* spillFile;
+    FILE* skeletonFile;
+    long spillEnd;
+    uint64 entryCount;
+    TaskId lastTid;
+
+    void indexReady(size_t keep);
+    index_node& getNode(TaskId);
+    void setSuccessors(index_node& n, const vector<TaskId>& succ);
+
+public:
+    // readyWindow of 0 holds every ready task until finish
+    TaskIndexWriter(size_t readyWindow, size_t spillLimit);
+    ~TaskIndexWriter();
+
+    // skeleton is the task's entry from TaskSkeleton::encodeEntry
+    void addTask(TaskId id, ct_tsc_t start, unsigned int predCount, const vector<TaskId>& succ, uint64 writePos,
+                 const vector<unsigned char>& skeleton);
+
+    // Index the remaining tasks and append the index entries, then the
+    //   skeleton section, to out
+    //   Returns the number of entries
+    uint64 finish(FILE* out);
+
+    // Last task in the index
+    TaskId getLastTask() const { return lastTid; }
+    size_t getPendingCount() const { return pending.size(); }
+    void printPending();
+
+    // The entries written so far and the tasks not yet indexed
+    void save(CheckpointFile&);
+    void restore(CheckpointFile&);
+};
+
+} // end namespace contech
+
+#endif
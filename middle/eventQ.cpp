@@ -1,8 +1,10 @@
 #include "eventQ.hpp"
+#include "MemoryBudget.hpp"
 #include "../common/taskLib/Task.hpp"
 #include "../common/eventLib/ct_event.h"
 #include <map>
 #include <deque>
+#include <algorithm>
 
 using namespace std;
 using namespace contech;
@@ -17,6 +19,10 @@ EventQ::EventQ()
 {
     currentTrace = traces.begin();
     totalSpace = 0;
+    mergeBatch = 0;
+    mergeRemaining = 0;
+    mergeCurrent.trace = NULL;
+    traceSwitches = 0;
 }
 
 EventQ::~EventQ()
@@ -31,11 +37,12 @@ EventQ::~EventQ()
 void EventQ::printSpaceTime(ct_tsc_t tcyc)
 {
     cerr << "Middle Space Time: " << ((double)totalSpace) / tcyc << endl;
+    cerr << "Middle Trace Switches: " << traceSwitches << endl;
 }
 
-void EventQ::registerEventList(FILE* f)
+void EventQ::registerEventList(FILE* f, const char* name)
 {
-    traces.push_back(new EventList(f));
+    traces.push_back(new EventList(f, name));
 }
 
 void EventQ::readyEvents(int rank, unsigned int context)
@@ -49,11 +56,115 @@ void EventQ::readyEvents(int rank, unsigned int context)
     }
 }
 
+//
+// Switch from round-robin to merging the traces by timestamp, pulling up to
+//   batch events from a trace each time it is selected.  As events from one
+//   rank only become ready through events from that rank, no events are read
+//   ahead and this only changes the order that the ranks are visited.
+//
+void EventQ::setMergeBatch(unsigned int batch)
+{
+    if (batch == 0 || mergeBatch != 0) return;
+    
+    mergeBatch = batch;
+    mergeRemaining = 0;
+    mergeHeap.clear();
+    
+    // Start from the current round-robin position, so that the traces are
+    //   visited in the same order until their timestamps differ.
+    unsigned int order = 0;
+    for (size_t i = 0, n = traces.size(); i < n; i++, order++)
+    {
+        trace_merge_entry tme;
+        tme.lastTime = 0;
+        tme.order = order;
+        tme.trace = *currentTrace;
+        mergeHeap.push_back(tme);
+        ++currentTrace;
+        if (currentTrace == traces.end()) currentTrace = traces.begin();
+    }
+    make_heap(mergeHeap.begin(), mergeHeap.end(), traceMergeLater());
+}
+
+ct_tsc_t EventQ::getEventTime(pct_event event)
+{
+    switch (event->event_type)
+    {
+        case ct_event_task_create: return event->tc.start_time;
+        case ct_event_task_join: return event->tj.start_time;
+        case ct_event_sync: return event->sy.start_time;
+        case ct_event_barrier: return event->bar.start_time;
+        case ct_event_delay: return event->dly.start_time;
+        case ct_event_mpi_transfer: return event->mpixf.start_time;
+        case ct_event_mpi_allone: return event->mpiao.start_time;
+        case ct_event_mpi_wait: return event->mpiw.start_time;
+        case ct_event_roi: return event->roi.start_time;
+        default: return 0;
+    }
+}
+
+void EventQ::closeTrace(EventList* trace)
+{
+    fclose(trace->file);
+    totalSpace += trace->getSpace();
+    
+    auto it = find(traces.begin(), traces.end(), trace);
+    assert(it != traces.end());
+    traces.erase(it);
+    currentTrace = traces.begin();
+    delete trace;
+}
+
+pct_event EventQ::getNextMergedEvent(int* rank)
+{
+    pct_event event = NULL;
+    *rank = -1;
+    
+    while (event == NULL)
+    {
+        if (mergeRemaining == 0)
+        {
+            // Return the current trace to the heap and select the earliest
+            if (mergeCurrent.trace != NULL)
+            {
+                mergeHeap.push_back(mergeCurrent);
+                push_heap(mergeHeap.begin(), mergeHeap.end(), traceMergeLater());
+            }
+            if (mergeHeap.empty()) return NULL;
+            
+            pop_heap(mergeHeap.begin(), mergeHeap.end(), traceMergeLater());
+            if (mergeCurrent.trace != mergeHeap.back().trace) traceSwitches++;
+            mergeCurrent = mergeHeap.back();
+            mergeHeap.pop_back();
+            mergeRemaining = mergeBatch;
+        }
+        
+        event = mergeCurrent.trace->getNextContechEvent();
+        if (event == NULL)
+        {
+            closeTrace(mergeCurrent.trace);
+            mergeCurrent.trace = NULL;
+            mergeRemaining = 0;
+            continue;
+        }
+        
+        // Events without timestamps keep the trace at its last time
+        ct_tsc_t t = getEventTime(event);
+        if (t > mergeCurrent.lastTime) mergeCurrent.lastTime = t;
+        mergeRemaining--;
+        *rank = mergeCurrent.trace->mpiRank;
+    }
+    
+    return event;
+}
+
 pct_event EventQ::getNextContechEvent(int* rank)
 {
     pct_event event = NULL;
     *rank = -1;
     
+    if (mergeBatch != 0) return getNextMergedEvent(rank);
+    
     while (!traces.empty() && event == NULL)
     {
         event = (*currentTrace)->getNextContechEvent();
@@ -69,6 +180,7 @@ pct_event EventQ::getNextContechEvent(int* rank)
         {
             *rank = (*currentTrace)->mpiRank;
             ++currentTrace;
+            if (traces.size() > 1) traceSwitches++;
         }
         if (currentTrace == traces.end()) currentTrace = traces.begin();
     }
@@ -76,10 +188,11 @@ pct_event EventQ::getNextContechEvent(int* rank)
     return event;
 }
 
-EventList::EventList(FILE* f)
+EventList::EventList(FILE* f, const char* name)
 {
     file = f;
     el = new EventLib;
+    if (name != NULL) el->loadBufferIndex(name);
     currentQueuedCount = 0;
     maxQueuedCount = 0;
     barrierNum = 0;
@@ -104,6 +217,16 @@ uint64_t EventList::getSpace()
     return el->getSum();
 }
 
+void EventList::seekContext(unsigned int ctid)
+{
+    el->seekContext(ctid);
+}
+
+bool EventList::seekTime(ct_tsc_t start, ct_tsc_t end)
+{
+    return el->seekTime(start, end);
+}
+
 void EventList::rescanMinTicket()
 {
     for (auto it = queuedEvents.begin(), et = queuedEvents.end(); it != et; ++it)
@@ -211,6 +334,7 @@ pct_event EventList::getNextContechEvent()
                 el->unblockCTID(event->contech_id);
                 barrierNum++;
                 eventQueueCurrent->second.pop_front();
+                MemoryBudget::release(mem_event_queue, MemoryBudget::eventBytes(event));
                 eventQueueCurrent = queuedEvents.begin();
                 assert(currentQueuedCount > 0);
                 currentQueuedCount--;
@@ -239,6 +363,7 @@ pct_event EventList::getNextContechEvent()
         {
             assert((el->getBlockCTID(event->contech_id)) == false);
             eventQueueCurrent->second.pop_front();
+            MemoryBudget::release(mem_event_queue, MemoryBudget::eventBytes(event));
             assert(currentQueuedCount > 0);
             currentQueuedCount--;
             return event;
@@ -251,6 +376,7 @@ pct_event EventList::getNextContechEvent()
             // This is the next ticket
             ticketNum++;
             eventQueueCurrent->second.pop_front();
+            MemoryBudget::release(mem_event_queue, MemoryBudget::eventBytes(event));
             eventQueueCurrent = queuedEvents.begin();
             assert(currentQueuedCount > 0);
             currentQueuedCount--;
@@ -306,6 +432,7 @@ pct_event EventList::getNextContechEvent()
         if (queuedEvents.find(event->contech_id) != queuedEvents.end())
         {
             queuedEvents[event->contech_id].push_back(event);
+            MemoryBudget::charge(mem_event_queue, MemoryBudget::eventBytes(event));
             currentQueuedCount++;
             if (currentQueuedCount > maxQueuedCount) maxQueuedCount = currentQueuedCount;
             continue;
@@ -319,6 +446,7 @@ pct_event EventList::getNextContechEvent()
             else
             {
                 waitingEvents[event->contech_id].push_back(event);
+                MemoryBudget::charge(mem_event_queue, MemoryBudget::eventBytes(event));
                 continue;
             }
         }
@@ -337,6 +465,7 @@ pct_event EventList::getNextContechEvent()
                 el->blockCTID(file, event->contech_id);
                 
                 queuedEvents[event->contech_id].push_back(event);
+                MemoryBudget::charge(mem_event_queue, MemoryBudget::eventBytes(event));
                 eventQueueCurrent = queuedEvents.begin();
                 resetMinTicket = true;
                 minQueuedTicket = 0;
@@ -362,6 +491,7 @@ pct_event EventList::getNextContechEvent()
                 el->blockCTID(file, event->contech_id);
                 
                 queuedEvents[event->contech_id].push_back(event);
+                MemoryBudget::charge(mem_event_queue, MemoryBudget::eventBytes(event));
                 eventQueueCurrent = queuedEvents.begin();
                 resetMinTicket = true;
                 currentQueuedCount++;
@@ -389,6 +519,7 @@ pct_event EventList::getNextContechEvent()
                 {
                     el->blockCTID(file, event->contech_id);
                     waitingEvents[event->contech_id].push_back(event);
+                    MemoryBudget::charge(mem_event_queue, MemoryBudget::eventBytes(event));
                     event = getNextContechEvent();
                 }
             }
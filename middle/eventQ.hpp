@@ -5,6 +5,7 @@
 #include "../common/eventLib/ct_event.h"
 #include <map>
 #include <deque>
+#include <vector>
 
 namespace contech {
 
@@ -29,12 +30,14 @@ namespace contech {
         void barrierTicket();
         
         public:
-        EventList(FILE*);
+        EventList(FILE*, const char* = NULL);
         ~EventList();
         pct_event getNextContechEvent();
         void readyEvents(unsigned int);
         int mpiRank;
         uint64_t getSpace();
+        void seekContext(unsigned int);
+        bool seekTime(ct_tsc_t, ct_tsc_t);
         FILE* file;
     };
 
@@ -45,13 +48,43 @@ namespace contech {
             deque <EventList*> traces;
             deque <EventList*>::iterator currentTrace;
             uint64_t totalSpace;
+            
+            // Merge mode: the trace with the earliest timestamp is selected by a
+            //   min-heap and then up to mergeBatch events are pulled from it.
+            //   Round-robin, one event at a time, when mergeBatch is 0.
+            typedef struct _trace_merge_entry
+            {
+                ct_tsc_t lastTime;
+                unsigned int order;
+                EventList* trace;
+            } trace_merge_entry;
+            
+            struct traceMergeLater
+            {
+                bool operator()(const trace_merge_entry& a, const trace_merge_entry& b) const
+                {
+                    if (a.lastTime != b.lastTime) return a.lastTime > b.lastTime;
+                    return a.order > b.order;
+                }
+            };
+            
+            unsigned int mergeBatch;
+            unsigned int mergeRemaining;
+            trace_merge_entry mergeCurrent;
+            vector <trace_merge_entry> mergeHeap;
+            uint64_t traceSwitches;
+            
+            pct_event getNextMergedEvent(int*);
+            void closeTrace(EventList*);
+            static ct_tsc_t getEventTime(pct_event);
     
         public:
             EventQ();
             ~EventQ();
             pct_event getNextContechEvent(int*);
             void readyEvents(int, unsigned int);
-            void registerEventList(FILE*);
+            void registerEventList(FILE*, const char* = NULL);
+            void setMergeBatch(unsigned int);
             void printSpaceTime(ct_tsc_t);
     };
 
@@ -0,0 +1,148 @@
+#include "middle.hpp"
+#include <time.h>
+#include <map>
+
+using namespace std;
+using namespace contech;
+
+// taskWrite.o is linked for Context, it updates the middle layer's cycle count
+ct_tsc_t totalCycles = 0;
+
+//
+// mapBench [events] [contexts]
+//   Replays the middle layer's per event lookups over a synthetic trace, once
+//   with the std::map containers and once with ContextTable / FlatMap.  Events
+//   arrive in runs from one context, as they do from runtime buffers; 1 in 64
+//   events is a sync on one of 4096 addresses.
+//
+
+#define EVENT_RUN 256
+#define SYNC_ADDRS 4096
+#define TASKS_PER_CONTEXT 8
+
+typedef struct _synthetic_event
+{
+    uint32_t ctid;
+    bool isSync;
+    ct_addr_t addr;
+} synthetic_event;
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void buildTrace(vector<synthetic_event>& trace, size_t events, uint32_t contexts)
+{
+    uint64_t seed = 0x2545F4914F6CDD1DULL;
+    uint32_t ctid = 0;
+
+    trace.resize(events);
+    for (size_t i = 0; i < events; i++)
+    {
+        seed ^= seed << 13; seed ^= seed >> 7; seed ^= seed << 17;
+        if ((i % EVENT_RUN) == 0) ctid = seed % contexts;
+        trace[i].ctid = ctid;
+        trace[i].isSync = ((seed >> 20) % 64) == 0;
+        trace[i].addr = 0x601000 + ((seed >> 32) % SYNC_ADDRS) * 64;
+    }
+}
+
+// The lookups of the original middle layer
+static uint64_t runMap(const vector<synthetic_event>& trace, const vector<Task*>& tasks)
+{
+    map<ContextId, map<TaskId, Task*> > context;
+    map<ct_addr_t, Task*> ownerList;
+    uint64_t check = 0;
+
+    for (Task* t : tasks) context[t->getContextId()][t->getTaskId()] = t;
+
+    for (const synthetic_event& e : trace)
+    {
+        if (!context.count(e.ctid)) continue;
+        Task* active = context[e.ctid].rbegin()->second;
+        check += (uintptr_t)active;
+        if (e.isSync)
+        {
+            auto it = ownerList.find(e.addr);
+            if (it != ownerList.end()) check += (uintptr_t)it->second;
+            ownerList[e.addr] = active;
+        }
+    }
+
+    return check;
+}
+
+// The lookups after moving to ContextTable and FlatMap
+static uint64_t runFlat(const vector<synthetic_event>& trace, const vector<Task*>& tasks)
+{
+    ContextTable context;
+    FlatMap<ct_addr_t, Task*> ownerList;
+    Context* lastContech = NULL;
+    ContextId lastContextId;
+    uint64_t check = 0;
+
+    for (Task* t : tasks) context[t->getContextId()].addTask(t);
+
+    for (const synthetic_event& e : trace)
+    {
+        if (lastContech == NULL || lastContextId != e.ctid)
+        {
+            lastContech = context.find(e.ctid);
+            lastContextId = e.ctid;
+            if (lastContech == NULL) continue;
+        }
+        Task* active = lastContech->activeTask();
+        check += (uintptr_t)active;
+        if (e.isSync)
+        {
+            auto it = ownerList.find(e.addr);
+            if (it != ownerList.end()) check += (uintptr_t)it->second;
+            ownerList[e.addr] = active;
+        }
+    }
+
+    return check;
+}
+
+int main(int argc, char** argv)
+{
+    size_t events = (argc > 1) ? strtoul(argv[1], NULL, 10) : 64 * 1024 * 1024;
+    uint32_t contexts = (argc > 2) ? strtoul(argv[2], NULL, 10) : 256;
+    vector<synthetic_event> trace;
+
+    if (events == 0 || contexts == 0)
+    {
+        fprintf(stderr, "%s [events] [contexts]\n", argv[0]);
+        return 1;
+    }
+
+    buildTrace(trace, events, contexts);
+    vector<Task*> tasks;
+    for (uint32_t c = 0; c < contexts; c++)
+    {
+        for (uint32_t s = 0; s < TASKS_PER_CONTEXT; s++) tasks.push_back(new Task(TaskId(c, s), task_type_basic_blocks));
+    }
+
+    double t0 = now();
+    uint64_t mapCheck = runMap(trace, tasks);
+    double t1 = now();
+    uint64_t flatCheck = runFlat(trace, tasks);
+    double t2 = now();
+
+    if (mapCheck != flatCheck)
+    {
+        fprintf(stderr, "Lookup results differ: %lx vs %lx\n", mapCheck, flatCheck);
+        return 1;
+    }
+
+    printf("Events: %lu\tContexts: %u\n", events, contexts);
+    printf("std::map: %.3fs\t%.1f ns/event\n", t1 - t0, (t1 - t0) * 1e9 / events);
+    printf("FlatMap:  %.3fs\t%.1f ns/event\n", t2 - t1, (t2 - t1) * 1e9 / events);
+
+    for (Task* t : tasks) delete t;
+
+    return 0;
+}
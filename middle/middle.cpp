@@ -1,7 +1,8 @@
 #include "middle.hpp"
 #include "taskWrite.hpp"
-#include <sys/timeb.h>
+#include <time.h>
 #include <pthread.h>
+#include <unistd.h>
 
 using namespace std;
 using namespace contech;
@@ -9,12 +10,308 @@ using namespace contech;
 void* backgroundTaskWriter(void*);
 ct_tsc_t totalCycles = 0;
 
+//
+// Basic block, memory and bulk memory events only modify the given context
+//   and queue its completed tasks.  These may be processed by a ContextWorkers
+//   pool, concurrently with the events of other contexts.
+//
+void processContextEvent(Context& activeContech, ct_event* event, int currentRank, bool parallelMiddle, bool DEBUG)
+{
+    // Basic blocks: Record basic block ID and memOp's
+    if (event->event_type == ct_event_basic_block)
+    {
+        Task* activeT = activeContech.activeTask();
+        //
+        // If transitioning into a basic block task, perhaps the older tasks
+        //   are complete and can be queued to the background thread.
+        //
+        if (activeT->getType() != task_type_basic_blocks &&
+            parallelMiddle)
+        {
+            activeContech.createBasicBlockContinuation();
+            
+            if (DEBUG) {fprintf(stderr, "%s (%d) -> %s via Basic Block (%d)\n", 
+                                        activeT->getTaskId().toString().c_str(), activeT->getType(),
+                                        activeContech.activeTask()->getTaskId().toString().c_str(),
+                                        event->bb.basic_block_id);}
+            
+            // Is the current active task a create or a complete join?
+            attemptBackgroundQueueTask(activeT, activeContech);
+            
+            updateContextTaskList(activeContech);
+            
+            activeT = activeContech.activeTask();
+        }
+        else if (TaskSplitPolicy::isFull(activeT))
+        {
+            // There is no available time stamp for ending this task, so a
+            //   non-default policy holds it until the context's next timed event
+            activeT = activeContech.splitBasicBlockTask();
+            if (!TaskSplitPolicy::interpolatesTimes() ||
+                activeContech.splitTasks.size() >= SPLIT_PENDING_TASKS ||
+                activeContech.splitBytes >= SPLIT_PENDING_BYTES)
+            {
+                queueSplitTasks(activeContech, 0);
+            }
+            updateContextTaskList(activeContech);
+        }
+        
+        // Record that this task executed this basic block
+        activeT->recordBasicBlockAction(event->bb.basic_block_id);
+
+        // Examine memory operations
+        for (uint i = 0; i < event->bb.len; i++)
+        {
+            ct_memory_op memOp = event->bb.mem_op_array[i];
+            memOp.rank = currentRank;
+            activeT->recordMemOpAction(memOp.is_write, memOp.pow_size, memOp.data);
+        }
+    }
+    
+    // Memory allocations
+    else if (event->event_type == ct_event_memory)
+    {
+        ct_memory_op memA;
+        memA.data = 0;
+        memA.addr = event->mem.alloc_addr;
+        memA.rank = currentRank;
+        if (event->mem.isAllocate)
+        {
+            activeContech.activeTask()->recordMallocAction(memA.data, event->mem.size);
+        } else {
+            activeContech.activeTask()->recordFreeAction(memA.data);
+        }
+
+    } 
+    
+    // Memcpy etc
+    //  In the case of etc, src may be NULL
+    else if (event->event_type == ct_event_bulk_memory_op)
+    {
+        ct_memory_op srcA, dstA;
+        srcA.data = 0;
+        srcA.addr = event->bm.src_addr;
+        srcA.rank = currentRank;
+        dstA.data = 0;
+        dstA.addr = event->bm.dst_addr;
+        dstA.rank = currentRank;
+        activeContech.activeTask()->recordMemCpyAction(event->bm.size, dstA.data, srcA.data);
+    }
+}
+
+//
+// Time and queue the context's split tasks, see Context::resolveSplitTimes
+//   An endTime of 0 queues them with their lower bound times.
+//
+void queueSplitTasks(Context& c, ct_tsc_t endTime)
+{
+    if (endTime != 0) c.resolveSplitTimes(endTime);
+    
+    for (Task* t : c.splitTasks)
+    {
+        backgroundQueueTask(t);
+    }
+    c.splitTasks.clear();
+    c.splitBytes = 0;
+}
+
+//
+// Checkpoints, CONTECH_MIDDLE_CHECKPOINT=<file>
+//
+//   Every CONTECH_MIDDLE_CHECKPOINT_EVENTS events, the middle layer waits for
+//   the background writer to write every queued task, and then saves the
+//   output position, the partial index and the state in middle_state.  A run
+//   on the same traces with the same checkpoint file resumes from it.  The
+//   events before the checkpoint are decoded again, but not processed, as
+//   EventLib's decode state includes decoded events that it holds for
+//   reordering.  So a restart skips the task building and writing, but its
+//   cost still grows with the trace before the checkpoint: every one of
+//   those events is read and decoded from the front-end trace.
+//
+void saveMiddleState(CheckpointFile& ck, middle_state& ms)
+{
+    vector<pair<ContextId, Context*> > allContexts;
+    ms.context.getContexts(allContexts);
+    
+    // Every task that is referenced is written once
+    for (auto& p : allContexts) p.second->addTasks(ck);
+    for (auto it = ms.ownerList.begin(), et = ms.ownerList.end(); it != et; ++it) ck.addTask(it->second);
+    for (auto it = ms.barrierList.begin(), et = ms.barrierList.end(); it != et; ++it) it->second.addTasks(ck);
+    for (mpi_task_map* q : {&ms.mpiSendQ, &ms.mpiRecvQ})
+    {
+        for (auto& src : *q) for (auto& dst : src.second) for (auto& tag : dst.second) ck.addTask(tag.second);
+    }
+    for (auto& rank : ms.mpiBCast)
+    {
+        for (auto& b : rank.second)
+        {
+            ck.addTask(b.second->root_sync);
+            ck.addTask(b.second->root_bb);
+            for (Task* t : b.second->dst_sync) ck.addTask(t);
+        }
+    }
+    ck.putTaskTable();
+    
+    ck.put<uint64>(ms.eventCount);
+    ck.put<bool>(ms.roiEvent);
+    ck.put<ct_tsc_t>(totalCycles);
+    
+    ck.put<uint64_t>(allContexts.size());
+    for (auto& p : allContexts)
+    {
+        ck.put<ContextId>(p.first);
+        p.second->save(ck);
+    }
+    
+    ck.put<uint64_t>(ms.ownerList.size());
+    for (auto it = ms.ownerList.begin(), et = ms.ownerList.end(); it != et; ++it)
+    {
+        ck.put<ct_addr_t>(it->first);
+        ck.putTaskRef(it->second);
+    }
+    
+    ck.put<uint64_t>(ms.barrierList.size());
+    for (auto it = ms.barrierList.begin(), et = ms.barrierList.end(); it != et; ++it)
+    {
+        ck.put<ct_addr_t>(it->first);
+        it->second.save(ck);
+    }
+    
+    for (mpi_task_map* q : {&ms.mpiSendQ, &ms.mpiRecvQ})
+    {
+        uint64_t n = 0;
+        for (auto& src : *q) for (auto& dst : src.second) n += dst.second.size();
+        ck.put<uint64_t>(n);
+        for (auto& src : *q) for (auto& dst : src.second) for (auto& tag : dst.second)
+        {
+            ck.put<int>(src.first);
+            ck.put<int>(dst.first);
+            ck.put<int>(tag.first);
+            ck.putTaskRef(tag.second);
+        }
+    }
+    
+    uint64_t n = 0;
+    for (auto& rank : ms.mpiReq) n += rank.second.size();
+    ck.put<uint64_t>(n);
+    for (auto& rank : ms.mpiReq) for (auto& req : rank.second)
+    {
+        ck.put<int>(rank.first);
+        ck.put<ct_addr_t>(req.first);
+        ck.put<mpi_recv_req>(req.second);
+    }
+    
+    n = 0;
+    for (auto& rank : ms.mpiBCast) n += rank.second.size();
+    ck.put<uint64_t>(n);
+    for (auto& rank : ms.mpiBCast) for (auto& b : rank.second)
+    {
+        ck.put<int>(rank.first);
+        ck.put<size_t>(b.first);
+        ck.put<int>(b.second->arrival_count);
+        ck.put<ct_addr_t>(b.second->buf_ptr);
+        ck.putTaskRef(b.second->root_sync);
+        ck.putTaskRef(b.second->root_bb);
+        ck.put<uint64_t>(b.second->dst_sync.size());
+        for (Task* t : b.second->dst_sync) ck.putTaskRef(t);
+        ck.putVector(b.second->dst_buf);
+    }
+}
+
+void restoreMiddleState(CheckpointFile& ck, middle_state& ms)
+{
+    ck.getTaskTable();
+    
+    ms.eventCount = ck.get<uint64>();
+    ms.roiEvent = ck.get<bool>();
+    totalCycles = ck.get<ct_tsc_t>();
+    
+    uint64_t n = ck.get<uint64_t>();
+    for (uint64_t i = 0; i < n; i++)
+    {
+        ContextId cid = ck.get<ContextId>();
+        ms.context[cid].restore(ck);
+    }
+    
+    n = ck.get<uint64_t>();
+    for (uint64_t i = 0; i < n; i++)
+    {
+        ct_addr_t addr = ck.get<ct_addr_t>();
+        ms.ownerList[addr] = ck.getTaskRef();
+    }
+    
+    n = ck.get<uint64_t>();
+    for (uint64_t i = 0; i < n; i++)
+    {
+        ct_addr_t addr = ck.get<ct_addr_t>();
+        ms.barrierList[addr].restore(ck);
+    }
+    
+    for (mpi_task_map* q : {&ms.mpiSendQ, &ms.mpiRecvQ})
+    {
+        n = ck.get<uint64_t>();
+        for (uint64_t i = 0; i < n; i++)
+        {
+            int src = ck.get<int>();
+            int dst = ck.get<int>();
+            int tag = ck.get<int>();
+            (*q)[src][dst][tag] = ck.getTaskRef();
+        }
+    }
+    
+    n = ck.get<uint64_t>();
+    for (uint64_t i = 0; i < n; i++)
+    {
+        int rank = ck.get<int>();
+        ct_addr_t req = ck.get<ct_addr_t>();
+        ms.mpiReq[rank][req] = ck.get<mpi_recv_req>();
+    }
+    
+    n = ck.get<uint64_t>();
+    for (uint64_t i = 0; i < n; i++)
+    {
+        int rank = ck.get<int>();
+        size_t size = ck.get<size_t>();
+        mpi_bcast* mbc = new mpi_bcast;
+        mbc->arrival_count = ck.get<int>();
+        mbc->buf_ptr = ck.get<ct_addr_t>();
+        mbc->root_sync = ck.getTaskRef();
+        mbc->root_bb = ck.getTaskRef();
+        uint64_t dstCount = ck.get<uint64_t>();
+        for (uint64_t j = 0; j < dstCount; j++) mbc->dst_sync.push_back(ck.getTaskRef());
+        ck.getVector(mbc->dst_buf);
+        ms.mpiBCast[rank][size] = mbc;
+    }
+}
+
+static void writeCheckpoint(const char* path, const vector<string>& traces, middle_state& ms, FILE* out)
+{
+    CheckpointFile* ck = CheckpointFile::create(path);
+    if (ck == NULL) return;
+    
+    ck->putTraces(traces);
+    if (!checkpointTaskWrites(*ck, out))
+    {
+        delete ck;
+        return;
+    }
+    saveMiddleState(*ck, ms);
+    if (ck->commit())
+    {
+        struct timespec tp;
+        clock_gettime(CLOCK_REALTIME, &tp);
+        printf("MIDDLE_CHECKPOINT: %d.%03d\t%lu\n", (unsigned int)tp.tv_sec, (int)(tp.tv_nsec / 1000000), ms.eventCount);
+    }
+    delete ck;
+}
+
 int main(int argc, char* argv[])
 {
     bool parallelMiddle = true;
     pthread_t backgroundT;
     EventQ eventQ;
-    bool roiEvent = false;
+    middle_state ms;
+    bool& roiEvent = ms.roiEvent;
     
     // First attempt middle layer in parallel, if there is an error,
     //   then restart in serial mode.
@@ -39,12 +336,34 @@ reset_middle:
     int totalRanks = 0;
     if (DEBUG == true) lastInPos--;
     
+    vector<string> traceNames;
     for (int argPos = 1; argPos <= lastInPos; argPos++, totalRanks++)
     {
         FILE* in;
         in = fopen(argv[argPos], "rb");
         assert(in != NULL && "Could not open input file");
-        eventQ.registerEventList(in);
+        eventQ.registerEventList(in, argv[argPos]);
+        traceNames.push_back(argv[argPos]);
+    }
+    
+    // Resume from a checkpoint of these traces, CONTECH_MIDDLE_CHECKPOINT=<file>
+    char* checkpointPath = getenv("CONTECH_MIDDLE_CHECKPOINT");
+    uint64 checkpointEvents = CHECKPOINT_EVENT_INTERVAL;
+    CheckpointFile* restart = NULL;
+    if (getenv("CONTECH_MIDDLE_CHECKPOINT_EVENTS") != NULL &&
+        strtoull(getenv("CONTECH_MIDDLE_CHECKPOINT_EVENTS"), NULL, 10) > 0)
+    {
+        checkpointEvents = strtoull(getenv("CONTECH_MIDDLE_CHECKPOINT_EVENTS"), NULL, 10);
+    }
+    if (checkpointPath != NULL)
+    {
+        restart = CheckpointFile::open(checkpointPath);
+        if (restart != NULL && !restart->checkTraces(traceNames))
+        {
+            fprintf(stderr, "Ignoring middle checkpoint %s\n", checkpointPath);
+            delete restart;
+            restart = NULL;
+        }
     }
     
     // Open output file
@@ -53,18 +372,20 @@ reset_middle:
     FILE* out;
     int outArgPos = argc - 1;
     if (DEBUG == true) outArgPos--;
-    out = fopen(argv[outArgPos], "wb");
+    out = fopen(argv[outArgPos], (restart != NULL) ? "r+b" : "wb");
     assert(out != NULL && "Could not open output file");
     
-    int taskGraphVersion = TASK_GRAPH_VERSION;
-    unsigned long long space = 0;
-    
-    // Init TaskGraphFile
-    ct_write(&taskGraphVersion, sizeof(int), out);
-    ct_write(&space, sizeof(unsigned long long), out); // Index
-    ct_write(&space, sizeof(unsigned long long), out); // ROI start
-    ct_write(&space, sizeof(unsigned long long), out); // ROI end
+    // Init TaskGraphFile, the offsets, ROI and codec are set once the tasks are written
+    if (restart == NULL)
+    {
+        TaskGraphWriter::writeHeader(out);
+    }
     
+    MemoryBudget::initBudget();
+    TaskSplitPolicy::initPolicy();
+    TaskSplitPolicy::printPolicy();
+    initTaskWrites();
+    if (restart != NULL) restoreTaskWrites(*restart, out);
     pthread_mutex_init(&taskQueueLock, NULL);
     pthread_cond_init(&taskQueueCond, NULL);
     pthread_mutex_init(&taskMemLock, NULL);
@@ -73,51 +394,40 @@ reset_middle:
     int r = pthread_create(&backgroundT, NULL, backgroundTaskWriter, &out);
     assert(r == 0);
     
-    // Track the owners of sync primitives
-    map<ct_addr_t, Task*> ownerList;
-    
-    // Track the barrier task for each address
-    map<ct_addr_t, BarrierWrapper> barrierList;
-
-    // Declare each context
-    map<ContextId, Context> context;
-
-    // MPI Transfers src-rank -> dst rank -> tag -> task
-    map <int, map <int, map <int, Task*> > > mpiSendQ;
-    map <int, map <int, map <int, Task*> > > mpiRecvQ;
-    map <int, map <ct_addr_t, mpi_recv_req> > mpiReq;
-    
-    struct mpi_bcast {
-        int arrival_count;
-        ct_addr_t buf_ptr;
-        Task* root_sync, *root_bb;
-        vector<Task*> dst_sync;
-        vector<ct_memory_op> dst_buf;
-    } ;
-    
-    map <int, map <size_t, mpi_bcast*> > mpiBCast;
+    // The state that is saved in a checkpoint, see middle_state
+    FlatMap<ct_addr_t, Task*>& ownerList = ms.ownerList;
+    FlatMap<ct_addr_t, BarrierWrapper>& barrierList = ms.barrierList;
+    ContextTable& context = ms.context;
+    mpi_task_map& mpiSendQ = ms.mpiSendQ;
+    mpi_task_map& mpiRecvQ = ms.mpiRecvQ;
+    mpi_req_map& mpiReq = ms.mpiReq;
+    mpi_bcast_map& mpiBCast = ms.mpiBCast;
     
     // Context 0 is special, since it is uncreated
-    if (totalRanks > 1)
+    if (restart != NULL)
+    {
+        // Restored below
+    }
+    else if (totalRanks > 1)
     {
         //context[0].tasks.push_front(new Task(0, task_type_create));
-        context[0].tasks[0] = new Task(0, task_type_create);
+        context[0].addTask(new Task(0, task_type_create));
     }
     else
     {
         //context[0].tasks.push_front(new Task(0, task_type_basic_blocks));
-        context[0].tasks[0] = new Task(0, task_type_basic_blocks);
+        context[0].addTask(new Task(0, task_type_basic_blocks));
     }
     context[0].hasStarted = true;
     
 
     // Count the number of events processed
-    uint64 eventCount = 0;
+    uint64& eventCount = ms.eventCount;
 
     {
-        struct timeb tp;
-        ftime(&tp);
-        printf("MIDDLE_START: %d.%03d\n", (unsigned int)tp.time, tp.millitm);
+        struct timespec tp;
+        clock_gettime(CLOCK_REALTIME, &tp);
+        printf("MIDDLE_START: %d.%03d\n", (unsigned int)tp.tv_sec, (int)(tp.tv_nsec / 1000000));
     }
     
     // Scan through the file for the first real event
@@ -164,13 +474,69 @@ reset_middle:
     }
     assert(seenFirstEvent);
     
-    tgi->writeTaskGraphInfo(out);
+    // Multi-rank traces may be merged by timestamp, CONTECH_MIDDLE_MERGE=<events per pull>
+    //   Rank 0 must supply the first create, so this starts after the scan above.
+    if (totalRanks > 1 && getenv("CONTECH_MIDDLE_MERGE") != NULL)
+    {
+        int batch = atoi(getenv("CONTECH_MIDDLE_MERGE"));
+        eventQ.setMergeBatch((batch > 0) ? batch : 64);
+    }
+    
+    if (restart == NULL) tgi->writeTaskGraphInfo(out);
     delete tgi;
+    
+    // Basic block events may be processed by per context workers, CONTECH_MIDDLE_WORKERS=<threads>
+    ContextWorkers* contextWorkers = NULL;
+    if (getenv("CONTECH_MIDDLE_WORKERS") != NULL && atoi(getenv("CONTECH_MIDDLE_WORKERS")) > 0)
+    {
+        contextWorkers = new ContextWorkers(atoi(getenv("CONTECH_MIDDLE_WORKERS")), parallelMiddle, DEBUG);
+    }
 
+    // Contexts are never removed from the table, so this pointer stays valid
+    Context* lastContech = NULL;
+    ContextId lastContextId;
+    
+    uint64 lastCheckpoint = 0;
+    if (restart != NULL)
+    {
+        restoreMiddleState(*restart, ms);
+        delete restart;
+        lastCheckpoint = eventCount;
+        
+        // Decode the events before the checkpoint, creates are the only
+        //   processing that changes which events are decoded next
+        for (uint64 i = 0; i < eventCount; i++)
+        {
+            ct_event* event = eventQ.getNextContechEvent(&currentRank);
+            assert(event != NULL);
+            if (event->event_type == ct_event_task_create &&
+                event->tc.approx_skew == 0 &&
+                event->tc.other_id != 0)
+            {
+                eventQ.readyEvents(currentRank, event->tc.other_id);
+            }
+            EventLib::deleteContechEvent(event);
+        }
+        printf("MIDDLE_RESTART: %lu events\n", eventCount);
+    }
+    
     // Main loop: Process the events from the file in order
     while (ct_event* event = eventQ.getNextContechEvent(&currentRank))
     {
+        // Checkpoint the state after eventCount events, before this event
+        if (checkpointPath != NULL &&
+            eventCount != lastCheckpoint &&
+            (eventCount % checkpointEvents) == 0)
+        {
+            if (contextWorkers != NULL) contextWorkers->drain();
+            writeCheckpoint(checkpointPath, traceNames, ms, out);
+            lastCheckpoint = eventCount;
+        }
+        
         ++eventCount;
+        
+        // Stop decoding while the writer catches up, CONTECH_MIDDLE_MEM_BUDGET=<MB>
+        if (MemoryBudget::isOverBudget()) waitForTaskWrites();
 
         // Whitelist of event types that we handle. Others are informational/debug info and can be skipped
         // Be sure to add event types to this list if you handle new ones
@@ -188,24 +554,53 @@ reset_middle:
             case ct_event_mpi_allone:
             case ct_event_roi:
                 break;
+            case ct_event_delay:
+                if (TaskSplitPolicy::usesDelays()) break;
+                // fall through
             default:
                 EventLib::deleteContechEvent(event);
                 continue;
         }
 
-        // New context ids should only appear on task create events
-        // Seeing an invalid context id is a good sign that the trace is corrupt
-        if (event->event_type != ct_event_task_create && 
-            !context.count((currentRank << 24) | event->contech_id))
+        // Every other event may touch any context, so wait for the workers
+        if (contextWorkers != NULL &&
+            event->event_type != ct_event_basic_block &&
+            event->event_type != ct_event_memory &&
+            event->event_type != ct_event_bulk_memory_op)
         {
-            cerr << "ERROR: Saw an event " << event->event_type <<" from a new context " << event->contech_id << " before seeing a create event for that context." << endl;
-            cerr << "Either the trace is corrupt or the trace file is missing a create event for the new context. " << endl;
-            //displayContechEventDebugInfo();
-            assert(0);
+            contextWorkers->drain();
+        }
+        
+        // Consecutive events are usually from the same buffer, so reuse the last context
+        ContextId activeId = (currentRank << 24) | event->contech_id;
+        if (lastContech == NULL || activeId != lastContextId)
+        {
+            lastContech = context.find(activeId);
+            lastContextId = activeId;
+            
+            // New context ids should only appear on task create events
+            // Seeing an invalid context id is a good sign that the trace is corrupt
+            if (lastContech == NULL)
+            {
+                // Delays are only used to time tasks, so none are needed before a context starts
+                if (event->event_type == ct_event_delay)
+                {
+                    EventLib::deleteContechEvent(event);
+                    continue;
+                }
+                if (event->event_type != ct_event_task_create)
+                {
+                    cerr << "ERROR: Saw an event " << event->event_type <<" from a new context " << event->contech_id << " before seeing a create event for that context." << endl;
+                    cerr << "Either the trace is corrupt or the trace file is missing a create event for the new context. " << endl;
+                    //displayContechEventDebugInfo();
+                    assert(0);
+                }
+                lastContech = &context.create(activeId);
+            }
         }
         
         // The context in which this event occurred
-        Context& activeContech = context[(currentRank << 24) | event->contech_id];
+        Context& activeContech = *lastContech;
 
         // Coalesce start/end times into a single field
         ct_tsc_t startTime, endTime;
@@ -236,6 +631,16 @@ reset_middle:
                 startTime = event->mpiao.start_time;
                 endTime = event->mpiao.end_time;
                 break;
+            case ct_event_delay:
+                startTime = event->dly.start_time;
+                endTime = event->dly.end_time;
+                // Time stamps are only relative once the context has started
+                if (!activeContech.hasStarted || startTime <= activeContech.timeOffset)
+                {
+                    EventLib::deleteContechEvent(event);
+                    continue;
+                }
+                break;
             default:
                 hasTime = false;
                 break;
@@ -267,71 +672,31 @@ reset_middle:
             
         }
         
-        // Basic blocks: Record basic block ID and memOp's
-        if (event->event_type == ct_event_basic_block)
+        bool isContextEvent = (event->event_type == ct_event_basic_block ||
+                               event->event_type == ct_event_memory ||
+                               event->event_type == ct_event_bulk_memory_op);
+        
+        // Any other event ends this context's run of basic blocks, which times the split tasks
+        if (!isContextEvent && !activeContech.splitTasks.empty())
         {
-            Task* activeT = activeContech.activeTask();
-            //
-            // If transitioning into a basic block task, perhaps the older tasks
-            //   are complete and can be queued to the background thread.
-            //
-            if (activeT->getType() != task_type_basic_blocks &&
-                parallelMiddle)
-            {
-                activeContech.createBasicBlockContinuation();
-                
-                if (DEBUG) {fprintf(stderr, "%s (%d) -> %s via Basic Block (%d)\n", 
-                                            activeT->getTaskId().toString().c_str(), activeT->getType(),
-                                            activeContech.activeTask()->getTaskId().toString().c_str(),
-                                            event->bb.basic_block_id);}
-                
-                // Is the current active task a create or a complete join?
-                attemptBackgroundQueueTask(activeT, activeContech);
-                
-                updateContextTaskList(activeContech);
-                
-                activeT = activeContech.activeTask();
-            }
-            else if (activeT->getBBCount() >= MAX_BLOCK_THRESHOLD)
-            {
-                // There is no available time stamp for ending this task
-                //   Assume that every basic block costs 1 cycle, which is a
-                //   lower bound
-                activeT->setEndTime(activeT->getStartTime() + MAX_BLOCK_THRESHOLD);
-                activeContech.createBasicBlockContinuation();
-                activeContech.removeTask(activeT);
-                backgroundQueueTask(activeT);
-                updateContextTaskList(activeContech);
-                
-                activeT = activeContech.activeTask();
-            }
-            
-            // If the basic block action will overflow, then split the task at this time
-            try {
-                // Record that this task executed this basic block
-                activeT->recordBasicBlockAction(event->bb.basic_block_id);
-            }
-            catch (std::bad_alloc)
-            {
-                activeT->setEndTime(activeT->getStartTime() + MAX_BLOCK_THRESHOLD);
-                activeContech.createBasicBlockContinuation();
-                activeContech.removeTask(activeT);
-                backgroundQueueTask(activeT);
-                updateContextTaskList(activeContech);
-                
-                activeT = activeContech.activeTask();
-                activeT->recordBasicBlockAction(event->bb.basic_block_id);
-            }
-
-            // Examine memory operations
-            for (uint i = 0; i < event->bb.len; i++)
+            ct_tsc_t splitEnd = 0;
+            if (hasTime) splitEnd = startTime;
+            else if (event->event_type == ct_event_roi) splitEnd = event->roi.start_time - activeContech.timeOffset;
+            queueSplitTasks(activeContech, splitEnd);
+        }
+        
+        // Basic blocks, allocations and memcpys only update this context's tasks
+        if (isContextEvent)
+        {
+            if (contextWorkers != NULL)
             {
-                ct_memory_op memOp = event->bb.mem_op_array[i];
-                memOp.rank = currentRank;
-                activeT->recordMemOpAction(memOp.is_write, memOp.pow_size, memOp.data);
+                // The worker frees the event
+                contextWorkers->queueEvent((currentRank << 24) | event->contech_id, &activeContech, event, currentRank);
+                continue;
             }
+            processContextEvent(activeContech, event, currentRank, parallelMiddle, DEBUG);
         }
-
+        
         // Task create: Create and initialize child task/context
         else if (event->event_type == ct_event_task_create)
         {
@@ -350,7 +715,7 @@ reset_middle:
                     
                     context[(currentRank << 24) | 0].hasStarted = true;
                     //context[(currentRank << 24) | 0].tasks.push_front(new Task(childTaskId, task_type_basic_blocks));
-                    context[(currentRank << 24) | 0].tasks[childTaskId] = new Task(childTaskId, task_type_basic_blocks);
+                    context[(currentRank << 24) | 0].addTask(new Task(childTaskId, task_type_basic_blocks));
                     context[(currentRank << 24) | 0].timeOffset = event->tc.start_time;
                     taskCreate = context[0].activeTask();
                     assert(taskCreate->getType() == task_type_create);
@@ -406,7 +771,7 @@ reset_middle:
                 // Start the first task for the new context
                 activeContech.hasStarted = true;
                 //activeContech.tasks.push_front(new Task(newContechTaskId, task_type_basic_blocks));
-                activeContech.tasks[newContechTaskId] = new Task(newContechTaskId, task_type_basic_blocks);
+                activeContech.addTask(new Task(newContechTaskId, task_type_basic_blocks));
                 activeContech.activeTask()->setStartTime(endTime);
 
                 // Record parent of this task
@@ -633,10 +998,10 @@ reset_middle:
                     continuation->addPredecessor(activeContech.activeTask()->getTaskId());
                     // Barrier owner is responsible for making sure the barrier task gets added to the output file
                     //activeContech.tasks.push_front(barrierTask);
-                    activeContech.tasks[barrierTask->getTaskId()] = barrierTask;
+                    activeContech.addTask(barrierTask);
                     // Make it the active task for this context
                     //activeContech.tasks.push_front(continuation);
-                    activeContech.tasks[continuation->getTaskId()] = continuation;
+                    activeContech.addTask(continuation);
                     attemptBackgroundQueueTask(activeT, activeContech);
                 }
                 else
@@ -665,36 +1030,6 @@ reset_middle:
             }
         }
 
-        // Memory allocations
-        else if (event->event_type == ct_event_memory)
-        {
-            ct_memory_op memA;
-            memA.data = 0;
-            memA.addr = event->mem.alloc_addr;
-            memA.rank = currentRank;
-            if (event->mem.isAllocate)
-            {
-                activeContech.activeTask()->recordMallocAction(memA.data, event->mem.size);
-            } else {
-                activeContech.activeTask()->recordFreeAction(memA.data);
-            }
-
-        } 
-        
-        // Memcpy etc
-        //  In the case of etc, src may be NULL
-        else if (event->event_type == ct_event_bulk_memory_op)
-        {
-            ct_memory_op srcA, dstA;
-            srcA.data = 0;
-            srcA.addr = event->bm.src_addr;
-            srcA.rank = currentRank;
-            dstA.data = 0;
-            dstA.addr = event->bm.dst_addr;
-            dstA.rank = currentRank;
-            activeContech.activeTask()->recordMemCpyAction(event->bm.size, dstA.data, srcA.data);
-        }
-        
         else if (event->event_type == ct_event_mpi_transfer)
         {
             // MPI maps using a 3-tuple {src_rank, tag, datatype} -> {dst_rank, tag, datatype}
@@ -956,6 +1291,21 @@ reset_middle:
                 activeContech.createBasicBlockContinuation();
             }
         }
+        // Delays are the only time stamps within a run of basic blocks
+        else if (event->event_type == ct_event_delay)
+        {
+            Task* activeT = activeContech.activeTask();
+            if (activeT->getType() == task_type_basic_blocks &&
+                activeT->getBBCount() > 0 &&
+                TaskSplitPolicy::isLong(activeT, startTime))
+            {
+                activeT->setEndTime(startTime);
+                activeContech.createBasicBlockContinuation();
+                activeContech.removeTask(activeT);
+                backgroundQueueTask(activeT);
+                updateContextTaskList(activeContech);
+            }
+        }
         else if (event->event_type == ct_event_roi)
         {
             Task* activeT = activeContech.activeTask();
@@ -984,6 +1334,12 @@ reset_middle:
         EventLib::deleteContechEvent(event);
     }
     //displayContechEventDiagInfo();
+    
+    if (contextWorkers != NULL)
+    {
+        delete contextWorkers;
+        contextWorkers = NULL;
+    }
 
     // TODO: for every context if endtime == 0, then join?
     
@@ -991,13 +1347,23 @@ reset_middle:
     
     char* d = NULL;
     
-    for (auto& p : context)
+    vector<pair<ContextId, Context*> > allContexts;
+    context.getContexts(allContexts);
+    for (auto& p : allContexts)
     {
-        Context& c = p.second;
+        Context& c = *p.second;
         
         //printf("%d\t%llx\t%llx\t%llx\n", p.first, c.timeOffset, c.startTime, c.endTime);
         
-        for (auto t : c.tasks)
+        // Queue in task order, so the output does not depend on the hash order
+        vector<pair<TaskId, Task*> > remaining(c.tasks.begin(), c.tasks.end());
+        for (Task* t : c.splitTasks)
+        {
+            remaining.push_back(make_pair(t->getTaskId(), t));
+        }
+        c.splitTasks.clear();
+        sort(remaining.begin(), remaining.end());
+        for (auto t : remaining)
         {
             backgroundQueueTask(t.second);
         }
@@ -1009,16 +1375,20 @@ reset_middle:
     pthread_cond_signal(&taskQueueCond);
     pthread_mutex_unlock(&taskQueueLock);
     {
-        struct timeb tp;
-        ftime(&tp);
-        printf("MIDDLE_QUEUE: %d.%03d\n", (unsigned int)tp.time, tp.millitm);
+        struct timespec tp;
+        clock_gettime(CLOCK_REALTIME, &tp);
+        printf("MIDDLE_QUEUE: %d.%03d\n", (unsigned int)tp.tv_sec, (int)(tp.tv_nsec / 1000000));
     }
     pthread_join(backgroundT, (void**) &d);
+    MemoryBudget::printHighWater();
+    
+    // The taskgraph is complete, so a later run should not resume from the checkpoint
+    if (checkpointPath != NULL) unlink(checkpointPath);
     
     {
-        struct timeb tp;
-        ftime(&tp);
-        printf("MIDDLE_END: %d.%03d\n", (unsigned int)tp.time, tp.millitm);
+        struct timespec tp;
+        clock_gettime(CLOCK_REALTIME, &tp);
+        printf("MIDDLE_END: %d.%03d\n", (unsigned int)tp.tv_sec, (int)(tp.tv_nsec / 1000000));
     }
     
     fclose(out);
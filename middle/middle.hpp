@@ -1,9 +1,14 @@
 #include "../common/eventLib/ct_event.h"
 #include "../common/taskLib/TaskGraph.hpp"
+#include "../common/taskLib/TaskGraphWriter.hpp"
 
 #include "Context.hpp"
 #include "BarrierWrapper.hpp"
 #include "eventQ.hpp"
+#include "ContextWorkers.hpp"
+#include "MemoryBudget.hpp"
+#include "SplitPolicy.hpp"
+#include "Checkpoint.hpp"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -22,9 +27,18 @@
 
 #define MAX_BLOCK_THRESHOLD 10000000
 
+// Split tasks held by a context before they are queued with lower bound times
+#define SPLIT_PENDING_TASKS 64
+#define SPLIT_PENDING_BYTES (64 * 1024 * 1024)
+
+// Events between checkpoints, CONTECH_MIDDLE_CHECKPOINT_EVENTS=<events>
+#define CHECKPOINT_EVENT_INTERVAL (64 * 1024 * 1024)
+
 using namespace contech;
 
 void checkContextId(ContextId id);
+void processContextEvent(Context& activeContech, ct_event* event, int currentRank, bool parallelMiddle, bool DEBUG);
+void queueSplitTasks(Context& c, ct_tsc_t endTime);
 void eventDebugPrint(TaskId first, string verb, TaskId second, ct_tsc_t start, ct_tsc_t end);
 
 extern ct_tsc_t totalCycles;
@@ -60,3 +74,41 @@ struct mpi_recv_req
     ct_addr_t buf_ptr;
     size_t buf_size;
 };
+
+struct mpi_bcast
+{
+    int arrival_count;
+    ct_addr_t buf_ptr;
+    Task* root_sync, *root_bb;
+    vector<Task*> dst_sync;
+    vector<ct_memory_op> dst_buf;
+};
+
+// MPI Transfers src-rank -> dst rank -> tag -> task
+typedef map <int, map <int, map <int, Task*> > > mpi_task_map;
+typedef map <int, map <ct_addr_t, mpi_recv_req> > mpi_req_map;
+typedef map <int, map <size_t, mpi_bcast*> > mpi_bcast_map;
+
+//
+// The middle layer's state between events, which is saved in a checkpoint
+//
+struct middle_state
+{
+    uint64 eventCount = 0;
+    bool roiEvent = false;
+    
+    // Track the owners of sync primitives
+    FlatMap<ct_addr_t, Task*> ownerList;
+    // Track the barrier task for each address
+    FlatMap<ct_addr_t, BarrierWrapper> barrierList;
+    // Declare each context
+    ContextTable context;
+    
+    mpi_task_map mpiSendQ;
+    mpi_task_map mpiRecvQ;
+    mpi_req_map mpiReq;
+    mpi_bcast_map mpiBCast;
+};
+
+void saveMiddleState(CheckpointFile&, middle_state&);
+void restoreMiddleState(CheckpointFile&, middle_state&);
@@ -1,7 +1,9 @@
 #include "taskWrite.hpp"
 #include "middle.hpp"
+#include "TaskIndexWriter.hpp"
+#include "MemoryBudget.hpp"
 #include "../common/taskLib/TaskGraph.hpp"
-#include <sys/timeb.h>
+#include <time.h>
 #include <sys/sysinfo.h>
 #include <map>
 
@@ -16,10 +18,11 @@ deque<Task*>* taskQueue;
 TaskId roiStart = 0;
 TaskId roiEnd = 0;
 uint64 taskCount = 0, taskWriteCount = 0;
+// Tasks given to backgroundQueueTask, under taskQueueLock
+uint64 taskQueuedCount = 0;
 
-unsigned long long baseFree = 0;
-
-unsigned long long getCurrentFreeMemory();
+// Set for a context worker's thread, see setTaskStaging
+static thread_local vector<Task*>* stagedTasks = NULL;
 
 void setROIStart(TaskId t)
 {
@@ -56,7 +59,7 @@ void backgroundQueueTask(Task* t)
             fprintf(stderr, "BBTY: %s\n", t->getTaskId().toString().c_str());
             
             fprintf(stderr, "PRED: ");
-            auto p = t->getPredecessorTasks();
+            auto& p = t->getPredecessorTasks();
             for (auto it = p.begin(), et = p.end(); it != et; ++it)
             {
                 fprintf(stderr, "%s\t", (*it).toString().c_str());
@@ -64,7 +67,7 @@ void backgroundQueueTask(Task* t)
             fprintf(stderr, "\n");
             
             fprintf(stderr, "SUCC: ");
-            auto s = t->getSuccessorTasks();
+            auto& s = t->getSuccessorTasks();
             for (auto it = s.begin(), et = s.end(); it != et; ++it)
             {
                 fprintf(stderr, "%s\t", (*it).toString().c_str());
@@ -77,22 +80,70 @@ void backgroundQueueTask(Task* t)
     
     ct_tsc_t tcyc = t->getEndTime() - t->getStartTime();
     
+    // Released by the background writer once the task is encoded
+    MemoryBudget::charge(mem_task_queue, t->getMemoryFootprint());
+    
+    if (stagedTasks != NULL)
+    {
+        stagedTasks->push_back(t);
+        return;
+    }
+    
     pthread_mutex_lock(&taskQueueLock);
     qSize = taskQueue->size();
     taskQueue->push_back(t);
+    taskQueuedCount++;
     // Signal if there are enough tasks, or a "maximal" sized task is queued
-    if (qSize == QUEUE_SIGNAL_THRESHOLD || t->getBBCount() > (MAX_BLOCK_THRESHOLD - 1)) {pthread_cond_signal(&taskQueueCond);}
-    pthread_mutex_unlock(&taskQueueLock);
-
+    if (qSize == QUEUE_SIGNAL_THRESHOLD || (uint64_t)t->getBBCount() >= TaskSplitPolicy::getMaxBlocks()) {pthread_cond_signal(&taskQueueCond);}
+    
     if (ty == task_type_basic_blocks)
     {
         totalCycles += tcyc;
     }
+    pthread_mutex_unlock(&taskQueueLock);
+}
+
+//
+// Context workers complete tasks in an order that depends on how their threads
+//   are scheduled, so their tasks are staged and queued by the main loop in
+//   TaskId order when the workers are drained.  The output then depends only
+//   on where the drains are, which is fixed by the events.
+//
+void setTaskStaging(vector<Task*>* staged)
+{
+    stagedTasks = staged;
+}
+
+void queueStagedTasks(vector<Task*>& staged)
+{
+    sort(staged.begin(), staged.end(), [](const Task* a, const Task* b) { return a->getTaskId() < b->getTaskId(); });
+    for (Task* t : staged)
+    {
+        // Already charged when it was staged
+        MemoryBudget::release(mem_task_queue, t->getMemoryFootprint());
+        backgroundQueueTask(t);
+    }
+    staged.clear();
+}
+
+//
+// Backpressure for the event decoding, called by the main loop when the
+//   accounted memory is over budget.  Waits while the background writer has
+//   tasks in hand, as writing them is what frees memory.  Otherwise, the
+//   memory is held by events and contexts and waiting would not help.
+//
+void waitForTaskWrites()
+{
+    // The writer may be waiting for a full queue.  taskCount only counts the
+    //   tasks the writer has taken, so compare against every queued task.
+    pthread_mutex_lock(&taskQueueLock);
+    uint64 queued = taskQueuedCount;
+    if (taskQueue != NULL && !taskQueue->empty()) pthread_cond_signal(&taskQueueCond);
+    pthread_mutex_unlock(&taskQueueLock);
     
     pthread_mutex_lock(&taskMemLock);
-    while (baseFree > 0 &&
-        (taskCount - taskWriteCount) > 1 &&
-        (baseFree / getCurrentFreeMemory()) > 10)
+    while (MemoryBudget::isOverBudget() &&
+           queued > taskWriteCount)
     {
         pthread_cond_wait(&taskMemCond, &taskMemLock);
     }
@@ -106,7 +157,7 @@ void backgroundQueueTask(Task* t)
 //   the tasks currently queued at a context.  And to display the details of the
 //   oldest task.
 //
-void displayContextTasks(map<ContextId, Context> &context, int id)
+void displayContextTasks(ContextTable &context, int id)
 {
     Context tgt = context[id];
     Task* last = NULL;
@@ -157,11 +208,13 @@ void displayContextTasks(map<ContextId, Context> &context, int id)
 //
 // Debug routine
 //
-void identifyMaxTaskPerContext(map<ContextId, Context> &context)
+void identifyMaxTaskPerContext(ContextTable &context)
 {
-    for (auto it = context.begin(), et = context.end(); it != et; ++it)
+    vector<pair<ContextId, Context*> > allContexts;
+    context.getContexts(allContexts);
+    for (auto it = allContexts.begin(), et = allContexts.end(); it != et; ++it)
     {
-        Context tgt = it->second;
+        Context tgt = *it->second;
         int countSyn = 0, countBB = 0, countC = 0, countJ = 0, countBar = 0;
         uint64_t maxBBCount = 0;
         Task* maxBBTask = NULL;
@@ -347,47 +400,254 @@ void debugBackground(map<TaskId, pair<Task*, int> > &tasks)
     }
 }
 
-unsigned long long getCurrentFreeMemory()
+struct TaskWrapper
 {
-    struct sysinfo t_info;
-    unsigned long long mem_size = 0;
-            
-    if (0 == sysinfo(&t_info))
+    TaskId      self;
+    int         p;      // number of predecessor tasks
+    vector<TaskId> s;   // tasks that follow this task
+    ct_tsc_t    start;  // start time for this task
+    vector<unsigned char> skeleton;  // entry for the skeleton section
+};
+
+// Ready tasks held back to order the index, CONTECH_MIDDLE_INDEX_WINDOW=<tasks>
+#define INDEX_READY_WINDOW 4096
+// Successor ids of waiting tasks kept in memory, CONTECH_MIDDLE_INDEX_SPILL=<ids>
+#define INDEX_SPILL_LIMIT (16 * 1024 * 1024)
+
+static size_t getIndexEnv(const char* name, size_t def)
+{
+    char* env = getenv(name);
+    if (env == NULL) return def;
+    return strtoul(env, NULL, 10);
+}
+
+//
+// Compression pool for the background writer
+//
+//   Workers serialize and compress tasks in parallel, then delete them.  The
+//   background writer is the single appender: it takes the finished records
+//   in the order the tasks were queued and assigns their file offsets.
+//
+#define MAX_COMPRESS_THREADS 8
+#define COMPRESS_BATCH_LIMIT 256
+
+struct TaskRecord
+{
+    unsigned char* data;
+    size_t len;
+};
+
+pthread_mutex_t compressLock;
+pthread_cond_t compressWorkCond, compressDoneCond;
+deque<pair<uint64, Task*> > compressWork;
+map<uint64, TaskRecord> compressDone;
+bool compressExit = false;
+
+// Codec for every task record, NULL for zlib without a dictionary
+const TaskCodec* writeCodec = NULL;
+
+// Background writer state, which is saved in a checkpoint
+static TaskIndexWriter* taskIndex = NULL;
+static task_codec codecId = task_codec_zlib;
+static TaskCodec* codec = NULL;
+static bool codecReady = false;
+static long dictPos = 0;
+
+void* compressTaskWorker(void* v)
+{
+    while (1)
     {
-        mem_size = (unsigned long long)t_info.freeram * (unsigned long long)t_info.mem_unit;
-        return mem_size;
+        pair<uint64, Task*> work;
+        
+        pthread_mutex_lock(&compressLock);
+        while (!compressExit && compressWork.empty())
+        {
+            pthread_cond_wait(&compressWorkCond, &compressLock);
+        }
+        if (compressWork.empty())
+        {
+            pthread_mutex_unlock(&compressLock);
+            break;
+        }
+        work = compressWork.front();
+        compressWork.pop_front();
+        pthread_mutex_unlock(&compressLock);
+        
+        TaskRecord tr;
+        tr.data = Task::encodeContechTask(*work.second, &tr.len, writeCodec);
+        MemoryBudget::release(mem_task_queue, work.second->getMemoryFootprint());
+        MemoryBudget::charge(mem_record_queue, tr.len);
+        delete work.second;
+        
+        pthread_mutex_lock(&compressLock);
+        compressDone[work.first] = tr;
+        pthread_cond_signal(&compressDoneCond);
+        pthread_mutex_unlock(&compressLock);
     }
     
-    return 0;
+    return NULL;
 }
 
-struct TaskWrapper
+//
+// Number of compression workers, CONTECH_MIDDLE_COMPRESS_THREADS or a core
+//   count that leaves the foreground and appender threads their own cores.
+//   With 0 workers, the background writer compresses each task itself.
+//
+int getCompressThreadCount()
 {
-    TaskId      self;   // probably redundant in a map
-    int         p;      // number of predecessor tasks remaining
-    vector<TaskId> s;   // tasks that follow this task
-    ct_tsc_t    start;  // start time for this task
-    long        writePos; // where was the task written
-    task_type   t;
-};
+    int n = get_nprocs() - 2;
+    char* env = getenv("CONTECH_MIDDLE_COMPRESS_THREADS");
+    
+    if (env != NULL) n = atoi(env);
+    if (n < 0) n = 0;
+    if (n > MAX_COMPRESS_THREADS) n = MAX_COMPRESS_THREADS;
+    
+    return n;
+}
+
+//
+// Task record codec, CONTECH_MIDDLE_CODEC=zlib|lz4|zstd, and the dictionary
+//   size, CONTECH_MIDDLE_DICT=<bytes>.  The dictionary is trained from the
+//   first tasks received and written once, before the first task record.
+//
+#define CODEC_DICT_SAMPLES 64
 
-void findPredInTaskMap(map<TaskId, TaskWrapper> &writeTaskMap, int c, int s)
+task_codec getTaskCodec()
 {
-    TaskId tid = TaskId(c, s);
+    char* env = getenv("CONTECH_MIDDLE_CODEC");
+    if (env == NULL) return task_codec_zlib;
     
-    for (auto it = writeTaskMap.begin(), et = writeTaskMap.end(); it != et; ++it)
+    task_codec c = TaskCodec::getCodecByName(env);
+    if (!TaskCodec::isSupported(c))
     {
-        for (TaskId succ : it->second.s)
+        fprintf(stderr, "Task codec %s is not supported by this build, using zlib\n", env);
+        c = task_codec_zlib;
+    }
+    
+    return c;
+}
+
+TaskCodec* initTaskCodec(task_codec c, deque<Task*>& sampleTasks, FILE* out, long* dictPos)
+{
+    char* env = getenv("CONTECH_MIDDLE_DICT");
+    size_t dictSize = (env == NULL) ? 0 : atol(env);
+    vector<unsigned char> dict;
+    
+    *dictPos = 0;
+    if (dictSize > 0 && !sampleTasks.empty())
+    {
+        vector<vector<unsigned char> > samples;
+        for (auto it = sampleTasks.begin(), et = sampleTasks.end(); 
+             it != et && samples.size() < CODEC_DICT_SAMPLES; ++it)
         {
-            if (succ == tid)
-            {
-                printf("Found in %u:%u that is at %u\n", (uint32_t)it->first.getContextId(),
-                                                         (uint32_t)it->first.getSeqId(),
-                                                         it->second.p);
-                return;
-            }
+            size_t len = 0;
+            unsigned char* rec = Task::serializeContechTask(**it, &len);
+            samples.push_back(vector<unsigned char>(rec, rec + len));
+            free(rec);
+        }
+        TaskCodec::trainDictionary(c, samples, dictSize, dict);
+    }
+    
+    if (!dict.empty())
+    {
+        *dictPos = TaskGraphWriter::writeDictionary(out, dict.data(), dict.size());
+        printf("Task codec %s with %lu byte dictionary\n", TaskCodec::getCodecName(c), dict.size());
+    }
+    else if (c == task_codec_zlib)
+    {
+        return NULL;
+    }
+    
+    return TaskCodec::createCodec(c, dict.data(), dict.size());
+}
+
+void initTaskWrites()
+{
+    taskIndex = new TaskIndexWriter(getIndexEnv("CONTECH_MIDDLE_INDEX_WINDOW", INDEX_READY_WINDOW),
+                                    getIndexEnv("CONTECH_MIDDLE_INDEX_SPILL", INDEX_SPILL_LIMIT));
+    codecId = getTaskCodec();
+}
+
+//
+// Wait for the background writer to write every queued task, then save the
+//   output position, the index and the writer's counters.  The foreground
+//   queues no tasks meanwhile, so the writer stays idle until this returns.
+//   The output is synced first, as the checkpoint must not reach the disk
+//   before the records it points to.  False if the output cannot be synced.
+//
+bool checkpointTaskWrites(CheckpointFile& ck, FILE* out)
+{
+    pthread_mutex_lock(&taskQueueLock);
+    uint64 queued = taskQueuedCount;
+    pthread_cond_signal(&taskQueueCond);
+    pthread_mutex_unlock(&taskQueueLock);
+    
+    pthread_mutex_lock(&taskMemLock);
+    while (taskWriteCount < queued)
+    {
+        pthread_cond_wait(&taskMemCond, &taskMemLock);
+    }
+    pthread_mutex_unlock(&taskMemLock);
+    
+    if (fflush(out) != 0 || fsync(fileno(out)) != 0)
+    {
+        perror("Cannot sync the taskgraph for a middle checkpoint");
+        return false;
+    }
+    ck.put<long>(ftell(out));
+    ck.put<uint64>(taskWriteCount);
+    ck.put<TaskId>(roiStart);
+    ck.put<TaskId>(roiEnd);
+    ck.put<bool>(codecReady);
+    ck.put<uint32_t>(codecId);
+    ck.put<long>(dictPos);
+    taskIndex->save(ck);
+    return true;
+}
+
+//
+// Continue the output from a checkpoint, the output is truncated to the
+//   position that was saved.  A codec dictionary is read back from the output.
+//
+void restoreTaskWrites(CheckpointFile& ck, FILE* out)
+{
+    long outPos = ck.get<long>();
+    taskCount = taskWriteCount = taskQueuedCount = ck.get<uint64>();
+    roiStart = ck.get<TaskId>();
+    roiEnd = ck.get<TaskId>();
+    codecReady = ck.get<bool>();
+    task_codec savedCodec = (task_codec)ck.get<uint32_t>();
+    dictPos = ck.get<long>();
+    taskIndex->restore(ck);
+    
+    fflush(out);
+    if (ftruncate(fileno(out), outPos) != 0)
+    {
+        perror("Cannot truncate the taskgraph to the checkpoint");
+        assert(0);
+    }
+    
+    if (codecReady)
+    {
+        vector<unsigned char> dict;
+        if (dictPos != 0)
+        {
+            uint32_t dictLen = 0;
+            fseek(out, dictPos, SEEK_SET);
+            ct_read(&dictLen, sizeof(dictLen), out);
+            dict.resize(dictLen);
+            ct_read(dict.data(), dictLen, out);
         }
+        
+        codecId = savedCodec;
+        if (!dict.empty() || codecId != task_codec_zlib)
+        {
+            codec = TaskCodec::createCodec(codecId, dict.data(), dict.size());
+        }
+        writeCodec = codec;
     }
+    
+    fseek(out, outPos, SEEK_SET);
 }
 
 void* backgroundTaskWriter(void* v)
@@ -395,15 +655,26 @@ void* backgroundTaskWriter(void* v)
     FILE* out = *(FILE**)v;
 
     deque<Task*> writeTaskQueue;
-    map<TaskId, TaskWrapper> writeTaskMap;
+    
+    int compressThreadCount = getCompressThreadCount();
+    pthread_t compressThreads[MAX_COMPRESS_THREADS];
+    uint64 nextSeq = 0, nextWriteSeq = 0;
+    deque<TaskWrapper> pendingWrite;
+    vector<unsigned char> skeleton;
+    
+    pthread_mutex_init(&compressLock, NULL);
+    pthread_cond_init(&compressWorkCond, NULL);
+    pthread_cond_init(&compressDoneCond, NULL);
+    for (int i = 0; i < compressThreadCount; i++)
+    {
+        int r = pthread_create(&compressThreads[i], NULL, compressTaskWorker, NULL);
+        assert(r == 0);
+    }
     
     uint64 bytesWritten = ftell(out);
     long pos;
-    bool firstTime = true;
     unsigned int sec = 0, msec = 0, taskLastWriteCount = 0;
     
-    baseFree = getCurrentFreeMemory();
-    
     //
     // noMoreTasks is a flag from the foreground thread
     //   And if there are no more, then there is the worklist of ready tasks
@@ -433,9 +704,9 @@ void* backgroundTaskWriter(void* v)
             taskChunk = taskQueue;
             taskQueue = NULL;
             {
-                struct timeb tp;
-                ftime(&tp);
-                printf("MIDDLE_DEQUE: %d.%03d\t%lu\n", (unsigned int)tp.time, tp.millitm, taskWriteCount);
+                struct timespec tp;
+                clock_gettime(CLOCK_REALTIME, &tp);
+                printf("MIDDLE_DEQUE: %d.%03d\t%lu\n", (unsigned int)tp.tv_sec, (int)(tp.tv_nsec / 1000000), taskWriteCount);
             }
         }
         pthread_mutex_unlock(&taskQueueLock);
@@ -448,9 +719,55 @@ void* backgroundTaskWriter(void* v)
             delete taskChunk;
         }
         
+        // The codec is ready before the first task is written
+        if (!codecReady)
+        {
+            codec = initTaskCodec(codecId, writeTaskQueue, out, &dictPos);
+            writeCodec = codec;
+            codecReady = true;
+        }
+        
         
-        while (!writeTaskQueue.empty())
+        while (!writeTaskQueue.empty() || !pendingWrite.empty())
         {
+            //
+            // Append the finished records in order, waiting for the oldest
+            //   when there is nothing else to queue or too much is in flight.
+            //
+            if (!pendingWrite.empty() &&
+                (writeTaskQueue.empty() || (nextSeq - nextWriteSeq) >= COMPRESS_BATCH_LIMIT))
+            {
+                TaskRecord tr;
+                pthread_mutex_lock(&compressLock);
+                auto dit = compressDone.find(nextWriteSeq);
+                while (dit == compressDone.end())
+                {
+                    pthread_cond_wait(&compressDoneCond, &compressLock);
+                    dit = compressDone.find(nextWriteSeq);
+                }
+                tr = dit->second;
+                compressDone.erase(dit);
+                pthread_mutex_unlock(&compressLock);
+                
+                {
+                    TaskWrapper& tw = pendingWrite.front();
+                    taskIndex->addTask(tw.self, tw.start, tw.p, tw.s, ftell(out), tw.skeleton);
+                    pendingWrite.pop_front();
+                }
+                nextWriteSeq++;
+                
+                ct_write(tr.data, tr.len, out);
+                bytesWritten += tr.len;
+                free(tr.data);
+                MemoryBudget::release(mem_record_queue, tr.len);
+                
+                pthread_mutex_lock(&taskMemLock);
+                taskWriteCount += 1;
+                pthread_cond_signal(&taskMemCond);
+                pthread_mutex_unlock(&taskMemLock);
+                continue;
+            }
+            
             Task* t = writeTaskQueue.front();
             TaskId id = t->getTaskId();
             
@@ -461,36 +778,38 @@ void* backgroundTaskWriter(void* v)
             // Write out the task
             pos = ftell(out);
             
-            // TaskIndex is a graph, then use the graph to
-            //   determine the bfs order, this way tasks can be written out
-            //   immediately
+            if (compressThreadCount > 0)
             {
+                // The worker deletes the task, it is indexed when it is appended
                 TaskWrapper tw;
-                
                 tw.self = id;
                 tw.start = t->getStartTime();
                 tw.p = t->getPredecessorTasks().size();
                 tw.s = t->getSuccessorTasks();
-                tw.t = t->getType();
-                tw.writePos = pos;
-                assert(writeTaskMap.find(id) == writeTaskMap.end());
-                writeTaskMap[id] = tw;
+                TaskSkeleton::encodeEntry(*t, tw.skeleton);
+                pendingWrite.push_back(tw);
                 
-                /* Debugging code for bug where TaskId(x:0) had multiple predecessors
-                if (id.getSeqId() == 0)
-                {
-                    printf("%u:%u -- ", id.getContextId(), id.getSeqId());
-                    auto pr = t->getPredecessorTasks();
-                    for (auto it = pr.begin(), et = pr.end(); it != et; ++it)
-                    {
-                        printf("%s\t", it->toString().c_str());
-                    }
-                    printf("\n");
-                }*/
-                //printf("%s", t->toSummaryString().c_str());
+                pthread_mutex_lock(&compressLock);
+                compressWork.push_back(make_pair(nextSeq++, t));
+                pthread_cond_signal(&compressWorkCond);
+                pthread_mutex_unlock(&compressLock);
+                continue;
+            }
+            
+            // The index is built as tasks are written, see TaskIndexWriter
+            skeleton.clear();
+            TaskSkeleton::encodeEntry(*t, skeleton);
+            taskIndex->addTask(id, t->getStartTime(), t->getPredecessorTasks().size(), t->getSuccessorTasks(), pos, skeleton);
+            
+            {
+                size_t len = 0;
+                unsigned char* rec = Task::encodeContechTask(*t, &len, writeCodec);
+                ct_write(rec, len, out);
+                bytesWritten += len;
+                free(rec);
             }
+            MemoryBudget::release(mem_task_queue, t->getMemoryFootprint());
             
-            bytesWritten += Task::writeContechTask(*t, out);
             pthread_mutex_lock(&taskMemLock);
             taskWriteCount += 1;
             
@@ -504,6 +823,15 @@ void* backgroundTaskWriter(void* v)
         taskLastWriteCount = taskWriteCount;
     }
     
+    pthread_mutex_lock(&compressLock);
+    compressExit = true;
+    pthread_cond_broadcast(&compressWorkCond);
+    pthread_mutex_unlock(&compressLock);
+    for (int i = 0; i < compressThreadCount; i++)
+    {
+        pthread_join(compressThreads[i], NULL);
+    }
+    
     // Write how many entries are in the index
     //   The write each index entry pair
     pos = ftell(out);
@@ -513,99 +841,36 @@ void* backgroundTaskWriter(void* v)
         perror("Cannot identify index position");
     }
     {
-        struct timeb tp;
-        ftime(&tp);
-        printf("MIDDLE_TASK: %d.%03d\n", (unsigned int)tp.time, tp.millitm);
+        struct timespec tp;
+        clock_gettime(CLOCK_REALTIME, &tp);
+        printf("MIDDLE_TASK: %d.%03d\n", (unsigned int)tp.tv_sec, (int)(tp.tv_nsec / 1000000));
     }
     printf("Writing index for %lu at %ld\n", taskWriteCount, pos);
-    size_t t = ct_write(&taskWriteCount, sizeof(taskWriteCount), out);
-    
-    priority_queue<pair<ct_tsc_t, pair<TaskId, uint64> >, vector<pair<ct_tsc_t, pair<TaskId, uint64> > >, first_compare > taskSort;
+    TaskGraphWriter::writeIndexCount(out, taskWriteCount);
     
-    {
-        TaskWrapper tw = writeTaskMap.find(0)->second;
-        taskSort.push(make_pair(tw.start, make_pair(tw.self, tw.writePos)));
-    }
-    
-    //
-    // This reproduces the BFS algorithm that had been used for writing tasks
-    //   It is much faster to sort the tasks on just the graph information than
-    //   to indefinitely delay writing a task until the entire graph is available.
-    //
-    // taskSort is a priority queue, the top element is the oldest task that has all
-    //   its prior tasks in the index.
-    //
-    unsigned int indexWriteCount = 0;
-    TaskId lastTid = 0;
-    while (!taskSort.empty())
-    {
-        TaskId tid = taskSort.top().second.first;
-        uint64 offset = taskSort.top().second.second;
-        
-        lastTid = tid;
-        
-        ct_write(&tid, sizeof(TaskId), out);
-        ct_write(&offset, sizeof(uint64), out);
-        //printf("%d:%d @ %llx\t", tid.getContextId(), tid.getSeqId(), offset);
-        
-        taskSort.pop();
-        
-        auto twit = writeTaskMap.find(tid);
-        assert(twit != writeTaskMap.end());
-        TaskWrapper tw = twit->second;
-        
-        assert(twit->first == tw.self);
-        
-        for (TaskId succ : tw.s)
-        {
-            TaskWrapper &suTW = writeTaskMap.find(succ)->second;
-            
-            //printf("%d:%d (%d)\t", succ.getContextId(), succ.getSeqId(), suTW.p);
-            
-            suTW.p--;
-            if (suTW.p == 0)
-            {
-                taskSort.push(make_pair(suTW.start, make_pair(suTW.self, suTW.writePos)));
-            }
-        }
-        //printf("\n");
-        
-        //  Can erase tid, but we don't need the memory, will it speed up?
-        writeTaskMap.erase(twit);
-        indexWriteCount ++;
-    }
-    printf("Wrote %u tasks to index\n", indexWriteCount);
+    uint64 indexWriteCount = taskIndex->finish(out);
+    TaskId lastTid = taskIndex->getLastTask();
+    printf("Wrote %lu tasks to index\n", indexWriteCount);
     
     if (indexWriteCount != taskWriteCount)
     {
-        for (auto it = writeTaskMap.begin(), et = writeTaskMap.end(); it != et; ++it)
-        {
-            printf("%s (type:%d) (pred:%d)\t", it->first.toString().c_str(), it->second.t, it->second.p);
-            for (TaskId succ : it->second.s)
-            {
-                printf("%s\t", succ.toString().c_str());
-            }
-            printf("\n");
-        }
+        taskIndex->printPending();
     }
     
     // Failing this assert indicates that the graph either has cycles or is disjoint
     //   Both case are bad
     assert(indexWriteCount == taskWriteCount);
     
-    // Now write the position of the index
-    fseek(out, 4, SEEK_SET);
-    
-    // With ftell, we use long, rather than the uint64 type which we track positions
-    ct_write(&pos, sizeof(pos), out);
-    
-    // Write the ROI start and end after index
-    ct_write(&roiStart, sizeof(TaskId), out);
+    // Now write the position of the index, the ROI and the codec into the header
     if (roiEnd == 0)
     {
         roiEnd = lastTid;
     }
-    ct_write(&roiEnd, sizeof(TaskId), out);
+    TaskGraphWriter::finishHeader(out, pos, roiStart, roiEnd, codecId, dictPos);
+    writeCodec = NULL;
+    delete codec;
+    delete taskIndex;
+    taskIndex = NULL;
     
     //
     // Stats for the background thread.
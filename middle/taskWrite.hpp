@@ -5,6 +5,7 @@
 #include "Context.hpp"
 #include "pthread.h"
 #include <deque>
+#include <vector>
 
 extern bool noMoreTasks;
 extern pthread_mutex_t taskQueueLock, taskMemLock;
@@ -15,6 +16,17 @@ void updateContextTaskList(contech::Context &c);
 void attemptBackgroundQueueTask(contech::Task* t, contech::Context &c);
 void backgroundQueueTask(contech::Task* t);
 
+// Tasks this thread gives to backgroundQueueTask are added to staged instead,
+//   until it is set to NULL.  queueStagedTasks then queues them in TaskId order.
+void setTaskStaging(std::vector<contech::Task*>* staged);
+void queueStagedTasks(std::vector<contech::Task*>& staged);
+void waitForTaskWrites();
+
+// Called before the background writer starts
+void initTaskWrites();
+bool checkpointTaskWrites(contech::CheckpointFile&, FILE* out);
+void restoreTaskWrites(contech::CheckpointFile&, FILE* out);
+
 void setROIStart(contech::TaskId);
 void setROIEnd(contech::TaskId);
 